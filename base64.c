@@ -56,6 +56,400 @@
 
 #define  IS_LITTLE_ENDIAN  (!IS_BIG_ENDIAN)
 
+/* SIMD kernels.
+ * They convert the bulk of the buffer and return how much they consumed; the
+ * scalar code below handles the remainder. The kernel is selected once at load
+ * time from the cpu features (x86) or at build time (aarch64).
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_SIMD_X86
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON) && \
+      defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BASE64_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+/* encode a prefix of in, return the number of bytes consumed (multiple of 3) */
+typedef int (*base64_encode_kernel)(unsigned char *out, const unsigned char *in, int inlen);
+/* decode up to groups 4 chars groups from *in (skipping newlines between groups),
+ * advance *in and return the number of groups decoded (3 bytes each) */
+typedef int (*base64_decode_kernel)(char *out, const char **in, int groups);
+
+#if defined(BASE64_SIMD_X86) || defined(BASE64_SIMD_NEON)
+/* scalar decode of one group, used by kernels on blocks they reject (newlines) */
+static inline void decode_group(char *out, const char *in)
+{
+    const uint16_t *inp = (const uint16_t *)in;
+    uint32_t n32 = rbase64lut[inp[0]];
+
+    n32 <<= 10;
+    n32 |= rbase64lut[inp[1]] >> 2;
+
+    out[0] = (n32 >> 16) & 0xff;
+    out[1] = (n32 >> 8) & 0xff;
+    out[2] = n32 & 0xff;
+}
+#endif
+
+#ifdef BASE64_SIMD_X86
+
+/* Vector algorithms from W. Mula and D. Lemire, "Faster Base64 Encoding and
+ * Decoding Using AVX2 Instructions" (2018). */
+
+__attribute__((target("ssse3")))
+static inline __m128i enc_reshuffle_ssse3(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+
+    return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i enc_translate_ssse3(__m128i indices)
+{
+    const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                        '/' - 63, 'A', 0, 0);
+
+    __m128i result     = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    result = _mm_shuffle_epi8(shift, result);
+    return _mm_add_epi8(result, indices);
+}
+
+/* translate 16 chars to 6 bits values and pack them to 12 bytes at out (16 bytes written).
+ * return 0 if any char is not base64 */
+__attribute__((target("ssse3")))
+static inline int dec_block_ssse3(char *out, const char *in)
+{
+    const __m128i lut_lo   = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lut_hi   = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f  = _mm_set1_epi8(0x2f);
+    const __m128i mask_0f  = _mm_set1_epi8(0x0f);
+
+    __m128i v = _mm_loadu_si128((const __m128i *)in);
+    const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(v, 4), mask_0f);
+    const __m128i lo_nibbles = _mm_and_si128(v, mask_0f);
+
+    const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+        return 0;
+
+    const __m128i eq_2f = _mm_cmpeq_epi8(v, mask_2f);
+    const __m128i roll  = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+    v = _mm_add_epi8(v, roll);
+
+    v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+    v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+    v = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+    _mm_storeu_si128((__m128i *)out, v);
+    return 1;
+}
+
+__attribute__((target("ssse3")))
+static int encode_ssse3(unsigned char *out, const unsigned char *in, int inlen)
+{
+    int done = 0;
+
+    /* 16 bytes are loaded for 12 consumed */
+    for (; inlen - done >= 16; done += 12, out += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + done));
+        _mm_storeu_si128((__m128i *)out, enc_translate_ssse3(enc_reshuffle_ssse3(v)));
+    }
+    return done;
+}
+
+__attribute__((target("ssse3")))
+static int decode_ssse3(char *out, const char **pin, int groups)
+{
+    const char *in = *pin;
+    int j = 0;
+
+    /* 16 bytes are stored for 12 produced: leave at least one group behind to cover the extra */
+    while (groups - j >= 5)
+    {
+        if (in[0] == '\n')
+            in++;
+        if (dec_block_ssse3(out, in))
+        {
+            in  += 16;
+            out += 12;
+            j   += 4;
+        }
+        else
+        {
+            decode_group(out, in);
+            in  += 4;
+            out += 3;
+            j++;
+        }
+    }
+    *pin = in;
+    return j;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i enc_reshuffle_avx2(__m256i in)
+{
+    in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                  1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+    const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+
+    return _mm256_or_si256(t1, t3);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i enc_translate_avx2(__m256i indices)
+{
+    const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                           '/' - 63, 'A', 0, 0,
+                                           'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                           '/' - 63, 'A', 0, 0);
+
+    __m256i result     = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+
+    result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    result = _mm256_shuffle_epi8(shift, result);
+    return _mm256_add_epi8(result, indices);
+}
+
+/* same as dec_block_ssse3 for 32 chars to 24 bytes (32 bytes written) */
+__attribute__((target("avx2")))
+static inline int dec_block_avx2(char *out, const char *in)
+{
+    const __m256i lut_lo   = _mm256_broadcastsi128_si256(
+                                 _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                               0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a));
+    const __m256i lut_hi   = _mm256_broadcastsi128_si256(
+                                 _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                               0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+    const __m256i lut_roll = _mm256_broadcastsi128_si256(
+                                 _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i mask_2f  = _mm256_set1_epi8(0x2f);
+    const __m256i mask_0f  = _mm256_set1_epi8(0x0f);
+
+    __m256i v = _mm256_loadu_si256((const __m256i *)in);
+    const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), mask_0f);
+    const __m256i lo_nibbles = _mm256_and_si256(v, mask_0f);
+
+    const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    if (!_mm256_testz_si256(lo, hi))
+        return 0;
+
+    const __m256i eq_2f = _mm256_cmpeq_epi8(v, mask_2f);
+    const __m256i roll  = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+    v = _mm256_add_epi8(v, roll);
+
+    v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+    v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+    v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+    _mm256_storeu_si256((__m256i *)out, v);
+    return 1;
+}
+
+__attribute__((target("avx2")))
+static int encode_avx2(unsigned char *out, const unsigned char *in, int inlen)
+{
+    int done = 0;
+
+    /* two 12 bytes lanes, the second load reads 4 bytes past the 24 consumed */
+    for (; inlen - done >= 28; done += 24, out += 32)
+    {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + done))),
+                                            _mm_loadu_si128((const __m128i *)(in + done + 12)), 1);
+        _mm256_storeu_si256((__m256i *)out, enc_translate_avx2(enc_reshuffle_avx2(v)));
+    }
+    return done + encode_ssse3(out, in + done, inlen - done);
+}
+
+__attribute__((target("avx2")))
+static int decode_avx2(char *out, const char **pin, int groups)
+{
+    const char *in = *pin;
+    int j = 0;
+
+    /* 32 bytes are stored for 24 produced: leave at least three groups behind */
+    while (groups - j >= 11)
+    {
+        if (in[0] == '\n')
+            in++;
+        if (dec_block_avx2(out, in))
+        {
+            in  += 32;
+            out += 24;
+            j   += 8;
+        }
+        else
+        {
+            decode_group(out, in);
+            in  += 4;
+            out += 3;
+            j++;
+        }
+    }
+    *pin = in;
+    return j + decode_ssse3(out, pin, groups - j);
+}
+
+static base64_encode_kernel base64_encoder = NULL;
+static base64_decode_kernel base64_decoder = NULL;
+
+__attribute__((constructor))
+static void base64_select_kernels(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        base64_encoder = encode_avx2;
+        base64_decoder = decode_avx2;
+    }
+    else if (__builtin_cpu_supports("ssse3"))
+    {
+        base64_encoder = encode_ssse3;
+        base64_decoder = decode_ssse3;
+    }
+}
+
+#elif defined(BASE64_SIMD_NEON)
+
+static int encode_neon(unsigned char *out, const unsigned char *in, int inlen)
+{
+    uint8x16x4_t lut;
+    int done = 0;
+
+    lut.val[0] = vld1q_u8((const uint8_t *)base64digits);
+    lut.val[1] = vld1q_u8((const uint8_t *)base64digits + 16);
+    lut.val[2] = vld1q_u8((const uint8_t *)base64digits + 32);
+    lut.val[3] = vld1q_u8((const uint8_t *)base64digits + 48);
+
+    for (; inlen - done >= 48; done += 48, out += 64)
+    {
+        const uint8x16x3_t src = vld3q_u8(in + done);
+        const uint8x16_t mask  = vdupq_n_u8(0x3f);
+        uint8x16x4_t dst;
+
+        dst.val[0] = vshrq_n_u8(src.val[0], 2);
+        dst.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(src.val[0], 4), vshrq_n_u8(src.val[1], 4)), mask);
+        dst.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(src.val[1], 2), vshrq_n_u8(src.val[2], 6)), mask);
+        dst.val[3] = vandq_u8(src.val[2], mask);
+
+        dst.val[0] = vqtbl4q_u8(lut, dst.val[0]);
+        dst.val[1] = vqtbl4q_u8(lut, dst.val[1]);
+        dst.val[2] = vqtbl4q_u8(lut, dst.val[2]);
+        dst.val[3] = vqtbl4q_u8(lut, dst.val[3]);
+
+        vst4q_u8(out, dst);
+    }
+    return done;
+}
+
+/* 6 bits value of each ASCII char, 255 when not base64 */
+static const uint8_t neon_dec_lut[128] =
+{
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255, 255, 255,  63,
+     52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255,
+    255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255, 255,
+    255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+     41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+};
+
+static inline uint8x16_t dec_translate_neon(uint8x16x4_t lo, uint8x16x4_t hi, uint8x16_t v)
+{
+    uint8x16_t r = vqtbl4q_u8(lo, v);
+
+    r = vqtbx4q_u8(r, hi, veorq_u8(v, vdupq_n_u8(0x40)));
+    /* chars above 127 map to 0 in both lookups */
+    return vorrq_u8(r, vcgeq_u8(v, vdupq_n_u8(0x80)));
+}
+
+static int decode_neon(char *out, const char **pin, int groups)
+{
+    const char *in = *pin;
+    uint8x16x4_t lo, hi;
+    int j = 0;
+
+    lo.val[0] = vld1q_u8(neon_dec_lut);
+    lo.val[1] = vld1q_u8(neon_dec_lut + 16);
+    lo.val[2] = vld1q_u8(neon_dec_lut + 32);
+    lo.val[3] = vld1q_u8(neon_dec_lut + 48);
+    hi.val[0] = vld1q_u8(neon_dec_lut + 64);
+    hi.val[1] = vld1q_u8(neon_dec_lut + 80);
+    hi.val[2] = vld1q_u8(neon_dec_lut + 96);
+    hi.val[3] = vld1q_u8(neon_dec_lut + 112);
+
+    while (groups - j >= 16)
+    {
+        if (in[0] == '\n')
+            in++;
+
+        uint8x16x4_t src = vld4q_u8((const uint8_t *)in);
+        src.val[0] = dec_translate_neon(lo, hi, src.val[0]);
+        src.val[1] = dec_translate_neon(lo, hi, src.val[1]);
+        src.val[2] = dec_translate_neon(lo, hi, src.val[2]);
+        src.val[3] = dec_translate_neon(lo, hi, src.val[3]);
+
+        const uint8x16_t all = vorrq_u8(vorrq_u8(src.val[0], src.val[1]), vorrq_u8(src.val[2], src.val[3]));
+        if (vmaxvq_u8(all) > 63)
+        {
+            decode_group(out, in);
+            in  += 4;
+            out += 3;
+            j++;
+            continue;
+        }
+
+        uint8x16x3_t dst;
+        dst.val[0] = vorrq_u8(vshlq_n_u8(src.val[0], 2), vshrq_n_u8(src.val[1], 4));
+        dst.val[1] = vorrq_u8(vshlq_n_u8(src.val[1], 4), vshrq_n_u8(src.val[2], 2));
+        dst.val[2] = vorrq_u8(vshlq_n_u8(src.val[2], 6), src.val[3]);
+        vst3q_u8((uint8_t *)out, dst);
+
+        in  += 64;
+        out += 48;
+        j   += 16;
+    }
+    *pin = in;
+    return j;
+}
+
+static const base64_encode_kernel base64_encoder = encode_neon;
+static const base64_decode_kernel base64_decoder = decode_neon;
+
+#else
+
+static const base64_encode_kernel base64_encoder = NULL;
+static const base64_decode_kernel base64_decoder = NULL;
+
+#endif
+
 /* convert inlen raw bytes at in to base64 string (NUL-terminated) at out. 
  * out size should be at least 4*inlen/3 + 4.
  * return length of out (sans trailing NUL).
@@ -78,6 +472,15 @@ int to64frombits(unsigned char *out, const unsigned char *in, int inlen)
 {
     uint16_t *b64lut = (uint16_t *)base64lut;
     int dlen         = ((inlen + 2) / 3) * 4; /* 4/3, rounded up */
+
+    if (base64_encoder != NULL)
+    {
+        int done = base64_encoder(out, in, inlen);
+        out   += done / 3 * 4;
+        in    += done;
+        inlen -= done;
+    }
+
     uint16_t *wbuf   = (uint16_t *)out;
 
     for (; inlen > 2; inlen -= 3)
@@ -129,7 +532,14 @@ int from64tobits_fast(char *out, const char *in, int inlen)
     int n         = (inlen / 4) - 1;
     uint16_t *inp = (uint16_t *)in;
 
-    for (j = 0; j < n; j++)
+    j = 0;
+    if (base64_decoder != NULL && n > 0)
+    {
+        j = base64_decoder(out, &in, n);
+        out += 3 * j;
+    }
+
+    for (; j < n; j++)
     {
         if (in[0] == '\n')
             in++;
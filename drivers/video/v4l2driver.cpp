@@ -1345,6 +1345,39 @@ float V4L2_Driver::getRemainingExposure() const
     return (float) remaining.tv_sec + (float) remaining.tv_usec / 1000000.0f;
 }
 
+// Keep the 8 most significant bits of Y10 Y12 Y16 pixels, dest may be src
+static void downscale(const unsigned char *src, unsigned char *dest, int bpp, int count)
+{
+    if (bpp < 16)
+    {
+        const unsigned short *src16 = reinterpret_cast<const unsigned short *>(src);
+        unsigned char shift = 0;
+        switch (bpp)
+        {
+            case 10:
+                shift = 2;
+                break;
+            case 12:
+                shift = 4;
+                break;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            *dest++ = *(src16++) >> shift;
+        }
+    }
+    else
+    {
+        src += 1; // Y16 is little endian
+
+        for (int i = 0; i < count; i++)
+        {
+            *dest++ = *src;
+            src += 2;
+        }
+    }
+}
+
 void V4L2_Driver::newFrame()
 {
     struct timeval current_frame_duration = frame_received;
@@ -1377,43 +1410,12 @@ void V4L2_Driver::newFrame()
             buffer                = V4LFrame->RGB24Buffer;
         }
 
-        // downscale Y10 Y12 Y16
-        if (bpp > dbpp)
-        {
-            unsigned short * src = (unsigned short *)buffer;
-            unsigned char * dest = buffer;
-            unsigned char shift = 0;
-
-            if (bpp < 16)
-            {
-                switch (bpp)
-                {
-                    case 10:
-                        shift = 2;
-                        break;
-                    case 12:
-                        shift = 4;
-                        break;
-                }
-                for (int i = 0; i < totalBytes; i++)
-                {
-                    *dest++ = *(src++) >> shift;
-                }
-            }
-            else
-            {
-                unsigned char * src = (unsigned char *)buffer + 1; // Y16 is little endian
-
-                for (int i = 0; i < totalBytes; i++)
-                {
-                    *dest++ = *src;
-                    src += 2;
-                }
-            }
-        }
-
         if (PrimaryCCD.getBinX() > 1)
         {
+            // downscale Y10 Y12 Y16
+            if (bpp > dbpp)
+                downscale(buffer, buffer, bpp, totalBytes);
+
             memcpy(PrimaryCCD.getFrameBuffer(), buffer, totalBytes);
             PrimaryCCD.binFrame();
             guard.unlock();
@@ -1421,8 +1423,18 @@ void V4L2_Driver::newFrame()
         }
         else
         {
+            // write the frame directly into the stream buffer
+            uint8_t *frame = Streamer->acquireFrame(frameBytes);
+            if (frame != nullptr)
+            {
+                if (bpp > dbpp)
+                    downscale(buffer, frame, bpp, std::min<int>(totalBytes, frameBytes));
+                else
+                    memcpy(frame, buffer, frameBytes);
+            }
             guard.unlock();
-            Streamer->newFrame(buffer, frameBytes);
+            if (frame != nullptr)
+                Streamer->commitFrame();
         }
         return;
     }
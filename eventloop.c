@@ -38,6 +38,7 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/time.h>
 
@@ -100,11 +101,31 @@ static void oneLoop(void);
 static void deferTO(void *p);
 static void runImmediates();
 
+/* thread running the loop, set the first time the loop runs */
+static pthread_t loopThread;
+static int loopThreadSet = 0;
+
+static void enterLoop()
+{
+    if (!loopThreadSet)
+    {
+        loopThread    = pthread_self();
+        loopThreadSet = 1;
+    }
+}
+
+int isEventLoopThread()
+{
+    return loopThreadSet && pthread_equal(pthread_self(), loopThread);
+}
+
 /* inf loop to dispatch callbacks, work procs and timers as necessary.
  * never returns.
  */
 void eventLoop()
 {
+    enterLoop();
+
     /* run loop forever */
     while (1)
         oneLoop();
@@ -121,6 +142,8 @@ int deferLoop(int maxms, int *flagp)
     int toflag = 0;
     int totid  = maxms ? addTimer(maxms, deferTO, &toflag) : 0;
 
+    enterLoop();
+
     while (!*flagp)
     {
         oneLoop();
@@ -144,6 +167,8 @@ int deferLoop0(int maxms, int *flagp)
     int toflag = 0;
     int totid  = maxms ? addTimer(maxms, deferTO, &toflag) : 0;
 
+    enterLoop();
+
     while (*flagp)
     {
         oneLoop();
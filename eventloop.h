@@ -129,6 +129,11 @@ extern void rmTimer(int tid);
  */
 extern void addImmediateWork(TCF * fp, void *ud);
 
+/** Tell whether the caller runs on the thread of the event loop, the first one to run eventLoop() or deferLoop().
+ * \return 1 on the event loop thread, 0 on any other thread or before the loop ever ran.
+ */
+extern int isEventLoopThread();
+
 /* utility functions */
 extern int deferLoop(int maxms, int *flagp);
 extern int deferLoop0(int maxms, int *flagp);
@@ -220,6 +220,17 @@ extern void IDSetLightVA(const ILightVectorProperty *l, const char *msg, va_list
 extern void IDSetBLOB(const IBLOBVectorProperty *b, const char *msg, ...) ATTRIBUTE_FORMAT_PRINTF(2, 3);
 extern void IDSetBLOBVA(const IBLOBVectorProperty *b, const char *msg, va_list arg) ATTRIBUTE_FORMAT_PRINTF(2, 0);
 
+/** \brief Coalesce the updates sent from the event loop thread.
+
+    When enabled, IDSetText, IDSetNumber, IDSetSwitch and IDSetLight called from the event loop thread do not write
+    their message right away: the messages of one loop iteration are sent together when the iteration ends, or
+    before any other message. Drivers pushing many updates from their timers then make one write per iteration.
+    Updates sent from other threads are not delayed. Disabled by default.
+
+    \param enable 1 to coalesce the updates, 0 to send each update right away.
+*/
+extern void IDCoalesceSets(int enable);
+
 /*@}*/
 
 /**
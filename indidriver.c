@@ -1757,7 +1757,7 @@ void IDSetTextVA(const ITextVectorProperty *tvp, const char *fmt, va_list ap)
     userio_xmlv1(&io.userio, io.user);
     IUUserIOSetTextVA(&io.userio, io.user, tvp, fmt, ap);
 
-    driverio_finish(&io);
+    driverio_finish_deferred(&io);
 }
 
 void IDSetText(const ITextVectorProperty *tvp, const char *fmt, ...)
@@ -1777,7 +1777,7 @@ void IDSetNumberVA(const INumberVectorProperty *nvp, const char *fmt, va_list ap
     userio_xmlv1(&io.userio, io.user);
     IUUserIOSetNumberVA(&io.userio, io.user, nvp, fmt, ap);
 
-    driverio_finish(&io);
+    driverio_finish_deferred(&io);
 }
 
 void IDSetNumber(const INumberVectorProperty *nvp, const char *fmt, ...)
@@ -1797,7 +1797,7 @@ void IDSetSwitchVA(const ISwitchVectorProperty *svp, const char *fmt, va_list ap
     userio_xmlv1(&io.userio, io.user);
     IUUserIOSetSwitchVA(&io.userio, io.user, svp, fmt, ap);
 
-    driverio_finish(&io);
+    driverio_finish_deferred(&io);
 }
 
 void IDSetSwitch(const ISwitchVectorProperty *svp, const char *fmt, ...)
@@ -1817,7 +1817,7 @@ void IDSetLightVA(const ILightVectorProperty *lvp, const char *fmt, va_list ap)
     userio_xmlv1(&io.userio, io.user);
     IUUserIOSetLightVA(&io.userio, io.user, lvp, fmt, ap);
 
-    driverio_finish(&io);
+    driverio_finish_deferred(&io);
 }
 
 void IDSetLight(const ILightVectorProperty *lvp, const char *fmt, ...)
@@ -38,6 +38,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 #include "userio.h"
 #include "indiuserio.h"
 #include "indidriverio.h"
+#include "eventloop.h"
 
 
 
@@ -47,31 +48,85 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 /* Dump whole buffer when growing over this */
 #define OUTPUTBUFF_FLUSH_THRESOLD 65536
 
-#define MAXFD_PER_MESSAGE 16
+/* Buffers kept between messages are released when larger than this */
+#define OUTPUTBUFF_KEEP_MAX (4 * OUTPUTBUFF_FLUSH_THRESOLD)
 
 static void driverio_flush(driverio * dio, const void * additional, size_t add_size);
 
 static pthread_mutex_t stdout_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* Each thread keeps its output buffer from one message to the next */
+typedef struct outbuffer
+{
+    char * buff;
+    unsigned int alloc;
+    int inUse;
+} outbuffer;
+
+static pthread_key_t outbuffer_key;
+static pthread_once_t outbuffer_once = PTHREAD_ONCE_INIT;
+
+/* Messages waiting for the end of the event loop iteration. Protected by stdout_mutex */
+static int coalesceSets = 0;
+static int pendingScheduled = 0;
+static char * pendingBuff = NULL;
+static unsigned int pendingPos = 0;
+static unsigned int pendingAlloc = 0;
+
 /* Return the buffer size required for storage (rounded to next OUTPUTBUFF_ALLOC) */
 static unsigned int outBuffRequired(unsigned int storage)
 {
     return (storage + OUTPUTBUFF_ALLOC - 1) & ~(OUTPUTBUFF_ALLOC - 1);
 }
 
-static int outBuffAllocated(struct driverio * dio)
+static char * buffGrow(char * buff, unsigned int required)
 {
-    return outBuffRequired(dio->outPos);
+    buff = realloc(buff, required);
+    if (buff == NULL)
+    {
+        perror("malloc");
+        _exit(1);
+    }
+    return buff;
 }
 
-static void outBuffGrow(struct driverio * dio, int required)
+static void outBuffReserve(struct driverio * dio, unsigned int storage)
 {
-    dio->outBuff = realloc(dio->outBuff, required);
-    if (dio->outBuff == NULL)
+    if (storage > dio->outAlloc)
     {
-        perror("malloc");
-        _exit(1);
+        dio->outAlloc = outBuffRequired(storage);
+        dio->outBuff = buffGrow(dio->outBuff, dio->outAlloc);
+    }
+}
+
+static void outbuffer_free(void * p)
+{
+    outbuffer * ob = (outbuffer *)p;
+    free(ob->buff);
+    free(ob);
+}
+
+static void outbuffer_create_key(void)
+{
+    pthread_key_create(&outbuffer_key, outbuffer_free);
+}
+
+static outbuffer * thread_outbuffer(void)
+{
+    outbuffer * ob;
+
+    pthread_once(&outbuffer_once, outbuffer_create_key);
+    ob = (outbuffer *)pthread_getspecific(outbuffer_key);
+    if (ob == NULL)
+    {
+        ob = (outbuffer *)calloc(1, sizeof(outbuffer));
+        if (ob == NULL || pthread_setspecific(outbuffer_key, ob) != 0)
+        {
+            free(ob);
+            return NULL;
+        }
     }
+    return ob;
 }
 
 static size_t driverio_write(void *user, const void * ptr, size_t count)
@@ -84,12 +139,7 @@ static size_t driverio_write(void *user, const void * ptr, size_t count)
     }
     else
     {
-        unsigned int allocated = outBuffAllocated(dio);
-        unsigned int required = outBuffRequired(dio->outPos + count);
-        if (required != allocated)
-        {
-            outBuffGrow(dio, required);
-        }
+        outBuffReserve(dio, dio->outPos + count);
         memcpy(dio->outBuff + dio->outPos, ptr, count);
 
         dio->outPos += count;
@@ -102,13 +152,15 @@ static int driverio_vprintf(void *user, const char * fmt, va_list arg)
     struct driverio * dio = (struct driverio*) user;
     int available;
     int size = 0;
+    va_list ap;
 
-    unsigned int allocated = outBuffAllocated(dio);
     while(1)
     {
-        available = allocated - dio->outPos;
+        available = dio->outAlloc - dio->outPos;
         /* Determine required size */
-        size = vsnprintf(dio->outBuff + dio->outPos, available, fmt, arg);
+        va_copy(ap, arg);
+        size = vsnprintf(dio->outBuff + dio->outPos, available, fmt, ap);
+        va_end(ap);
 
         if (size < 0)
             return size;
@@ -117,8 +169,7 @@ static int driverio_vprintf(void *user, const char * fmt, va_list arg)
         {
             break;
         }
-        allocated = outBuffRequired(available + size + 1);
-        outBuffGrow(dio, allocated);
+        outBuffReserve(dio, dio->outPos + size + 1);
     }
     dio->outPos += size;
     return size;
@@ -127,61 +178,150 @@ static int driverio_vprintf(void *user, const char * fmt, va_list arg)
 static void driverio_join(void * user, const char * xml, void * blob, size_t bloblen)
 {
     struct driverio * dio = (struct driverio*) user;
-    dio->joinCount++;
-    dio->joins = (void **)realloc((void*)dio->joins, sizeof(void*) * dio->joinCount);
-    dio->joinSizes = (size_t *)realloc((void*)dio->joinSizes, sizeof(size_t) * dio->joinCount);
 
-    dio->joins[dio->joinCount - 1] = blob;
-    dio->joinSizes[dio->joinCount - 1] = bloblen;
+    // indiserver takes no more buffers per read. Send the part of the message referencing the attached ones so far,
+    // the buffers are matched with the BLOBs in order
+    if (dio->joinCount == MAXFD_PER_MESSAGE)
+    {
+        driverio_flush(dio, NULL, 0);
+    }
+
+    dio->joins[dio->joinCount] = blob;
+    dio->joinSizes[dio->joinCount] = bloblen;
+    dio->joinCount++;
 
     driverio_write(user, xml, strlen(xml));
 }
 
+static void driverio_sendmsg(struct msghdr * msgh, size_t size)
+{
+    int ret = sendmsg(1, msgh, 0);
+    if (ret == -1)
+    {
+        perror("sendmsg");
+        // FIXME: exiting the driver seems abrupt. Is this the right thing to do ? what about cleanup ?
+        exit(1);
+    }
+    else if ((unsigned)ret != size)
+    {
+        // This is not expected on blocking socket
+        fprintf(stderr, "short write\n");
+        exit(1);
+    }
+}
+
+static void pending_sent(void)
+{
+    pendingPos = 0;
+
+    if (pendingAlloc > OUTPUTBUFF_KEEP_MAX)
+    {
+        free(pendingBuff);
+        pendingBuff = NULL;
+        pendingAlloc = 0;
+    }
+}
+
+/* Send the messages waiting for the end of the event loop iteration. Must hold stdout_mutex */
+static void driverio_send_pending(void)
+{
+    struct msghdr msgh;
+    struct iovec iov;
+
+    if (pendingPos == 0)
+        return;
+
+    iov.iov_base = pendingBuff;
+    iov.iov_len = pendingPos;
+
+    memset(&msgh, 0, sizeof(msgh));
+    msgh.msg_iov = &iov;
+    msgh.msg_iovlen = 1;
+
+    driverio_sendmsg(&msgh, pendingPos);
+    pending_sent();
+}
 
 static void driverio_flush(driverio * dio, const void * additional, size_t add_size)
 {
     struct msghdr msgh;
-    struct iovec iov[2];
-    int cmsghdrlength;
-    struct cmsghdr * cmsgh;
+    struct iovec iov[3];
+    int iovCount = 0;
+    size_t size = 0;
+    union
+    {
+        struct cmsghdr cmsgh;
+        char control[CMSG_SPACE(MAXFD_PER_MESSAGE * sizeof(int))];
+    } control_un;
+    void * temporaryBuffers[MAXFD_PER_MESSAGE];
+    int fdCount = dio->joinCount;
 
-    if (dio->outPos + add_size)
+    if (!dio->locked)
+    {
+        pthread_mutex_lock(&stdout_mutex);
+        dio->locked = 1;
+    }
+
+    /* Messages waiting from the event loop were written before this one */
+    if (pendingPos > 0)
     {
-        int ret = -1;
-        void ** temporaryBuffers = NULL;
-        int fdCount = dio->joinCount;
         if (fdCount > 0)
         {
+            // Keep the attached buffers with the message that references them
+            driverio_send_pending();
+        }
+        else
+        {
+            iov[iovCount].iov_base = pendingBuff;
+            iov[iovCount].iov_len = pendingPos;
+            size += pendingPos;
+            iovCount++;
+        }
+    }
 
-            if (dio->joinCount > MAXFD_PER_MESSAGE)
-            {
-                errno = EMSGSIZE;
-                perror("sendmsg");
-                exit(1);
-            }
+    if (dio->outPos)
+    {
+        iov[iovCount].iov_base = dio->outBuff;
+        iov[iovCount].iov_len = dio->outPos;
+        size += dio->outPos;
+        iovCount++;
+    }
+    if (add_size)
+    {
+        iov[iovCount].iov_base = (void*)additional;
+        iov[iovCount].iov_len = add_size;
+        size += add_size;
+        iovCount++;
+    }
+
+    if (iovCount > 0)
+    {
+        memset(&msgh, 0, sizeof(msgh));
+        msgh.msg_iov = iov;
+        msgh.msg_iovlen = iovCount;
 
-            cmsghdrlength = CMSG_SPACE((fdCount * sizeof(int)));
-            cmsgh = (struct cmsghdr*)malloc(cmsghdrlength);
-            // FIXME: abort on alloc error here
-            temporaryBuffers = (void**)malloc(sizeof(void*)*fdCount);
+        if (fdCount > 0)
+        {
+            struct cmsghdr * cmsgh = &control_un.cmsgh;
 
             /* Write the fd as ancillary data */
-            cmsgh->cmsg_len = CMSG_LEN(sizeof(int));
+            memset(&control_un, 0, sizeof(control_un));
+            cmsgh->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
             cmsgh->cmsg_level = SOL_SOCKET;
             cmsgh->cmsg_type = SCM_RIGHTS;
-            msgh.msg_control = cmsgh;
-            msgh.msg_controllen = cmsghdrlength;
+            msgh.msg_control = control_un.control;
+            msgh.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
             for(int i = 0; i < fdCount; ++i)
             {
                 void * blob = dio->joins[i];
-                size_t size = dio->joinSizes[i];
+                size_t blobSize = dio->joinSizes[i];
 
                 int fd = IDSharedBlobGetFd(blob);
                 if (fd == -1)
                 {
                     // Can't avoid a copy here. Update the driver to change that
-                    temporaryBuffers[i] = IDSharedBlobAlloc(size);
-                    memcpy(temporaryBuffers[i], blob, size);
+                    temporaryBuffers[i] = IDSharedBlobAlloc(blobSize);
+                    memcpy(temporaryBuffers[i], blob, blobSize);
                     fd = IDSharedBlobGetFd(temporaryBuffers[i]);
                 }
                 else
@@ -192,83 +332,44 @@ static void driverio_flush(driverio * dio, const void * additional, size_t add_s
                 ((int *) CMSG_DATA(CMSG_FIRSTHDR(&msgh)))[i] = fd;
             }
         }
-        else
-        {
-            cmsgh = NULL;
-            cmsghdrlength = 0;
-            msgh.msg_control = cmsgh;
-            msgh.msg_controllen = cmsghdrlength;
-        }
-
-        iov[0].iov_base = dio->outBuff;
-        iov[0].iov_len = dio->outPos;
-        if (add_size)
-        {
-            iov[1].iov_base = (void*)additional;
-            iov[1].iov_len = add_size;
-        }
 
-        msgh.msg_flags = 0;
-        msgh.msg_name = NULL;
-        msgh.msg_namelen = 0;
-        msgh.msg_iov = iov;
-        msgh.msg_iovlen = add_size ? 2 : 1;
+        driverio_sendmsg(&msgh, size);
 
-        if (!dio->locked)
+        for(int i = 0; i < fdCount; ++i)
         {
-            pthread_mutex_lock(&stdout_mutex);
-            dio->locked = 1;
-        }
-
-        ret = sendmsg(1, &msgh, 0);
-        if (ret == -1)
-        {
-            perror("sendmsg");
-            // FIXME: exiting the driver seems abrupt. Is this the right thing to do ? what about cleanup ?
-            exit(1);
-        }
-        else if ((unsigned)ret != dio->outPos + add_size)
-        {
-            // This is not expected on blocking socket
-            fprintf(stderr, "short write\n");
-            exit(1);
+            if (temporaryBuffers[i] != NULL)
+            {
+                IDSharedBlobFree(temporaryBuffers[i]);
+            }
         }
 
-        if (fdCount > 0)
+        if (fdCount == 0)
         {
-            for(int i = 0; i < fdCount; ++i)
-            {
-                if (temporaryBuffers[i] != NULL)
-                {
-                    IDSharedBlobFree(temporaryBuffers[i]);
-                }
-            }
-            free(cmsgh);
-            free(temporaryBuffers);
+            pending_sent();
         }
     }
 
-    if (dio->joins != NULL)
-    {
-        free(dio->joins);
-    }
-    dio->joins = NULL;
+    dio->joinCount = 0;
+    dio->outPos = 0;
+}
 
-    if (dio->joinSizes != NULL)
-    {
-        free(dio->joinSizes);
-    }
-    dio->joinSizes = NULL;
+/* Queue the message to be sent at the end of the event loop iteration. Must hold stdout_mutex */
+static int driverio_defer(driverio * dio)
+{
+    if (dio->joinCount > 0 || pendingPos + dio->outPos > OUTPUTBUFF_FLUSH_THRESOLD)
+        return 0;
 
-    if (dio->outBuff != NULL)
+    if (pendingPos + dio->outPos > pendingAlloc)
     {
-        free(dio->outBuff);
+        pendingAlloc = outBuffRequired(pendingPos + dio->outPos);
+        pendingBuff = buffGrow(pendingBuff, pendingAlloc);
     }
+    memcpy(pendingBuff + pendingPos, dio->outBuff, dio->outPos);
+    pendingPos += dio->outPos;
     dio->outPos = 0;
-
+    return 1;
 }
 
-
 static int driverio_is_unix = -1;
 
 static int is_unix_io()
@@ -320,26 +421,65 @@ static int is_unix_io()
 /* Unix io allow attaching buffer in ancillary data. */
 static void driverio_init_unix(driverio * dio)
 {
+    outbuffer * ob = thread_outbuffer();
+
     dio->userio.vprintf = &driverio_vprintf;
     dio->userio.write = &driverio_write;
     dio->userio.joinbuff = &driverio_join;
     dio->user = (void*)dio;
-    dio->joins = NULL;
-    dio->joinSizes = NULL;
     dio->locked = 0;
     dio->joinCount = 0;
-    dio->outBuff = NULL;
     dio->outPos = 0;
+
+    // A message sent while composing another one on the same thread gets a buffer of its own
+    if (ob != NULL && !ob->inUse)
+    {
+        ob->inUse = 1;
+        dio->outBuff = ob->buff;
+        dio->outAlloc = ob->alloc;
+        dio->ownBuff = 0;
+    }
+    else
+    {
+        dio->outBuff = NULL;
+        dio->outAlloc = 0;
+        dio->ownBuff = 1;
+    }
 }
 
-static void driverio_finish_unix(driverio * dio)
+static void driverio_release_unix(driverio * dio)
 {
-    driverio_flush(dio, NULL, 0);
     if (dio->locked)
     {
         pthread_mutex_unlock(&stdout_mutex);
         dio->locked = 0;
     }
+
+    if (dio->outAlloc > OUTPUTBUFF_KEEP_MAX)
+    {
+        free(dio->outBuff);
+        dio->outBuff = NULL;
+        dio->outAlloc = 0;
+    }
+
+    if (dio->ownBuff)
+    {
+        free(dio->outBuff);
+    }
+    else
+    {
+        outbuffer * ob = (outbuffer *)pthread_getspecific(outbuffer_key);
+        ob->buff = dio->outBuff;
+        ob->alloc = dio->outAlloc;
+        ob->inUse = 0;
+    }
+    dio->outBuff = NULL;
+}
+
+static void driverio_finish_unix(driverio * dio)
+{
+    driverio_flush(dio, NULL, 0);
+    driverio_release_unix(dio);
 }
 
 static void driverio_init_stdout(driverio * dio)
@@ -379,3 +519,87 @@ void driverio_finish(driverio * dio)
         driverio_finish_stdout(dio);
     }
 }
+
+/* Run at the end of the event loop iteration that deferred messages */
+static void driverio_flush_pending(void * arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&stdout_mutex);
+    pendingScheduled = 0;
+    if (is_unix_io())
+    {
+        driverio_send_pending();
+    }
+    else
+    {
+        fflush(stdout);
+    }
+    pthread_mutex_unlock(&stdout_mutex);
+}
+
+void driverio_finish_deferred(driverio * dio)
+{
+    // Only the event loop thread knows when its iteration ends
+    if (!coalesceSets || !isEventLoopThread())
+    {
+        driverio_finish(dio);
+        return;
+    }
+
+    int deferred = 1;
+    if (is_unix_io())
+    {
+        if (!dio->locked)
+        {
+            pthread_mutex_lock(&stdout_mutex);
+            dio->locked = 1;
+        }
+
+        deferred = driverio_defer(dio);
+        if (!deferred)
+        {
+            driverio_flush(dio, NULL, 0);
+        }
+    }
+    // else stdout keeps the message buffered until the next fflush
+
+    if (deferred && !pendingScheduled)
+    {
+        pendingScheduled = 1;
+        addImmediateWork(driverio_flush_pending, NULL);
+    }
+
+    if (is_unix_io())
+    {
+        driverio_release_unix(dio);
+    }
+    else
+    {
+        pthread_mutex_unlock(&stdout_mutex);
+    }
+}
+
+static void driverio_flush_at_exit(void)
+{
+    // exit may be called with the lock held, after a failed write. stdout is flushed by exit itself
+    if (pendingPos > 0 && pthread_mutex_trylock(&stdout_mutex) == 0)
+    {
+        ssize_t ret = write(1, pendingBuff, pendingPos);
+        (void)ret;
+        pendingPos = 0;
+        pthread_mutex_unlock(&stdout_mutex);
+    }
+}
+
+void IDCoalesceSets(int enable)
+{
+    static int atexitRegistered = 0;
+
+    if (enable && !atexitRegistered)
+    {
+        atexit(driverio_flush_at_exit);
+        atexitRegistered = 1;
+    }
+    coalesceSets = enable;
+}
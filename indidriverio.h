@@ -23,18 +23,26 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 
 #endif
 
+/* No more than 16 buffers attached to a write, as read by indiserver. A message with more is sent in several writes */
+#define MAXFD_PER_MESSAGE 16
+
 /* A driverio struct is valid only for sending one xml message */
 typedef struct driverio
 {
     struct userio userio;
     void * user;
-    void ** joins;
-    size_t * joinSizes;
+    void * joins[MAXFD_PER_MESSAGE];
+    size_t joinSizes[MAXFD_PER_MESSAGE];
     int joinCount;
     int locked;
     char * outBuff;
     unsigned int outPos;
+    unsigned int outAlloc;
+    int ownBuff;
 } driverio;
 
 void driverio_init(driverio * dio);
 void driverio_finish(driverio * dio);
+/* Same as driverio_finish, but when coalescing is enabled (see IDCoalesceSets) and called from the
+ * event loop thread, the message may wait for the end of the loop iteration to be sent with the others. */
+void driverio_finish_deferred(driverio * dio);
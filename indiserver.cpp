@@ -49,6 +49,7 @@
 #endif
 
 #include "config.h"
+#include <algorithm>
 #include <set>
 #include <string>
 #include <list>
@@ -57,6 +58,11 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 
 #include <assert.h>
 
@@ -69,6 +75,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <limits.h>
 #include <netdb.h>
 #include <signal.h>
 #include <stdio.h>
@@ -87,6 +94,10 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include <sys/mman.h>
 #include <unistd.h>
 #include <sys/un.h>
@@ -100,12 +111,15 @@
 #define INDIUNIXSOCK "/tmp/indiserver" /* default unix socket path (local connections) */
 #define MAXSBUF       512
 #define MAXRBUF       49152 /* max read buffering here */
-#define MAXWSIZ       49152 /* max bytes/write */
+#define DEFREADBUDGET 1024  /* default max KB read from one connection per wakeup */
+#define MAXWSIZ       49152 /* default max bytes/write */
+#define MAXIOV        64    /* max chunks gathered in one write */
 #define SHORTMSGSIZ   2048  /* buf size for most messages */
 #define DEFMAXQSIZ    128   /* default max q behind, MB */
 #define DEFMAXSSIZ    5     /* default max stream behind, MB */
 #define DEFMAXRESTART 10    /* default max restarts */
 #define MAXFD_PER_MESSAGE 16 /* No more than 16 buffer attached to a message */
+#define MAXTHREADS    256   /* most worker or serialization threads */
 #ifdef OSX_EMBEDED_MODE
 #define LOGNAME  "/Users/%s/Library/Logs/indiserver.log"
 #define FIFONAME "/tmp/indiserverFIFO"
@@ -116,6 +130,112 @@
 
 static ev::default_loop loop;
 
+/* Held by every event loop while it is dispatching events. Only used when client writes are spread over
+ * worker loops: it is released while a loop waits for events and while a worker is inside a write system call.
+ */
+static std::mutex serverLock;
+
+/* An additional event loop, running in its own thread, that handles the writes of the clients assigned to it */
+class ClientWorker
+{
+        ev::dynamic_loop workerLoop;
+        ev::async wakeup;
+        std::vector<int> fdsToClose;    /* client fds to close from the worker thread */
+
+        void onWakeup(ev::async &watcher, int revents);
+        void run();
+
+        static std::vector<ClientWorker *> workers;
+        static unsigned int nextWorker;
+
+    public:
+        ClientWorker();
+
+        struct ev_loop * evLoop()
+        {
+            return workerLoop;
+        }
+
+        /* Make the loop notice watchers that were changed from another thread */
+        void wake()
+        {
+            wakeup.send();
+        }
+
+        /* close fd once the worker is not using it anymore */
+        void closeLater(int fd);
+
+        /* start count worker loops. Must be called before any client connects. */
+        static void startAll(int count);
+
+        /* worker for the next client, or nullptr when clients are handled by the main loop */
+        static ClientWorker * pick();
+};
+
+/* A fixed set of threads that produce the serialized content of messages (see SerializedMsg::async_start).
+ * They also help converting large blobs, piece by piece (see Base64Job)
+ */
+class SerializationPool
+{
+        std::mutex lock;
+        std::condition_variable wakeup;
+        std::deque<std::function<void()>> tasks;
+
+        void run();
+
+        static SerializationPool * instance;
+        static unsigned int threadCount;
+
+    public:
+        /* start count threads. Must be called before any message is serialized. */
+        static void startAll(unsigned int count);
+
+        /* Run task from one of the pool threads, as soon as one is available */
+        static void submit(std::function<void()> task);
+
+        /* Number of threads in the pool */
+        static unsigned int size()
+        {
+            return threadCount;
+        }
+};
+
+/* Base64 conversion of a large buffer, split in pieces that are converted concurrently.
+ * Any thread can claim and convert the next piece; the producer publishes them in order.
+ */
+class Base64Job
+{
+        const unsigned char * src;
+        unsigned long srcSize;
+        unsigned long pieceSize;
+        unsigned long pieceCount;
+
+        std::atomic<unsigned long> nextPiece;
+
+        std::mutex lock;
+        std::condition_variable pieceDone;
+        std::vector<char *> buffers;
+        std::vector<int> lengths;
+        std::vector<bool> done;
+
+    public:
+        /* pieceSize must be a multiple of 3 */
+        Base64Job(const unsigned char * src, unsigned long size, unsigned long pieceSize);
+
+        unsigned long count() const
+        {
+            return pieceCount;
+        }
+
+        /* Convert the next unclaimed piece. Return false once every piece was claimed */
+        bool convertNext();
+
+        bool isDone(unsigned long piece);
+
+        /* Wait for the given piece, and return its malloced base64 buffer */
+        char * wait(unsigned long piece, int &length);
+};
+
 template<class M>
 class ConcurrentSet
 {
@@ -251,26 +371,38 @@ class Collectable
         {
             return HeartBeat(id, current);
         }
+
+        /* Increases with each insertion in the ConcurrentSet, 0 when in none */
+        unsigned long insertionId() const
+        {
+            return id;
+        }
 };
 
 /**
  * A MsgChunk is either:
  *  a raw xml fragment
  *  a ref to a shared buffer in the message
+ *  a range of a shared buffer file, sent as is (content is null then)
  */
 class MsgChunck
 {
         friend class SerializedMsg;
         friend class SerializedMsgWithSharedBuffer;
         friend class SerializedMsgWithoutSharedBuffer;
+        friend class SerializedMsgWithRawBlobs;
         friend class MsgChunckIterator;
 
         MsgChunck();
         MsgChunck(char * content, unsigned long length);
+        MsgChunck(int fileFd, off_t fileOffset, unsigned long length);
 
         char * content;
         unsigned long contentLength;
 
+        int fileFd;
+        off_t fileOffset;
+
         std::vector<int> sharedBufferIdsToAttach;
 };
 
@@ -370,6 +502,9 @@ class SerializedMsg
         // TODO : to implement + make sure the task start when it actually block something
         void blockReceiver(MsgQueue * toblock);
 
+        // Number of queues currently writing from this content without holding the server lock
+        int writers = 0;
+
     public:
         SerializedMsg(Msg * parent);
         virtual ~SerializedMsg();
@@ -382,11 +517,18 @@ class SerializedMsg
         // It is possible to have 0 to send, meaning end was actually reached
         bool getContent(MsgChunckIterator &position, void * &data, ssize_t &nsend, std::vector<int> &sharedBuffers);
 
+        // Return true if the content at position is to be read from a file (see getContent for its length)
+        bool getContentFile(const MsgChunckIterator &position, int &fd, off_t &offset);
+
         void advance(MsgChunckIterator &position, ssize_t s);
 
         // When a queue is done with sending this message
         void release(MsgQueue * from);
 
+        // Keep the content alive while it is being written outside of the server lock
+        void pin();
+        void unpin();
+
         void addAwaiter(MsgQueue * awaiter);
 
         ssize_t queueSize();
@@ -408,6 +550,8 @@ class SerializedMsgWithSharedBuffer: public SerializedMsg
 
 class SerializedMsgWithoutSharedBuffer: public SerializedMsg
 {
+        // Push the base64 of the given data, in small chuncks to start writing asap
+        void pushBase64Chuncks(const unsigned char * src, unsigned long size);
 
     public:
         SerializedMsgWithoutSharedBuffer(Msg * parent);
@@ -417,6 +561,20 @@ class SerializedMsgWithoutSharedBuffer: public SerializedMsg
         virtual void generateContent();
 };
 
+/* Serialization for clients that negotiated raw BLOBs: the content of each oneBLOB is sent as is,
+ * rawlen='n' giving its size. Shared buffers are sent straight from their file.
+ */
+class SerializedMsgWithRawBlobs: public SerializedMsg
+{
+
+    public:
+        SerializedMsgWithRawBlobs(Msg * parent);
+        virtual ~SerializedMsgWithRawBlobs();
+
+        virtual bool generateContentAsync() const;
+        virtual void generateContent();
+};
+
 class MsgChunckIterator
 {
         friend class SerializedMsg;
@@ -450,6 +608,7 @@ class Msg
         friend class SerializedMsg;
         friend class SerializedMsgWithSharedBuffer;
         friend class SerializedMsgWithoutSharedBuffer;
+        friend class SerializedMsgWithRawBlobs;
     private:
         // Present for sure until message queing is doned. Prune asap then
         XMLEle * xmlContent;
@@ -466,9 +625,11 @@ class Msg
         // Convertion task and resultat of the task
         SerializedMsg* convertionToSharedBuffer;
         SerializedMsg* convertionToInline;
+        SerializedMsg* convertionToRaw;
 
         SerializedMsg * buildConvertionToSharedBuffer();
         SerializedMsg * buildConvertionToInline();
+        SerializedMsg * buildConvertionToRaw();
 
         bool fetchBlobs(std::list<int> &incomingSharedBuffers);
 
@@ -530,10 +691,17 @@ class MsgQueue: public Collectable
         // Position in the head message
         MsgChunckIterator nsent;
 
+        // Worker loop doing the writes, and its own copy of wFd (nullptr/-1 when writing from the main loop)
+        ClientWorker * writer = nullptr;
+        int writerFd = -1;
+
         // Handle fifo or socket case
-        size_t doRead(char * buff, size_t len);
+        ssize_t doRead(char * buff, size_t len);
         void readFromFd();
 
+        /* parse a chunk of input and dispatch the complete messages. Return false if the queue was closed */
+        bool processChunk(char * buf, ssize_t nr);
+
         /* write the next chunk of the current message in the queue to the given
          * client. pop message from queue when complete and free the message if we are
          * the last one to use it. shut down this client if trouble.
@@ -542,6 +710,15 @@ class MsgQueue: public Collectable
 
     protected:
         bool useSharedBuffer;
+        bool useRawBlobs = false;   /* client asked for oneBLOB content without base64 */
+        bool rawContent = false;    /* we asked the peer for oneBLOB content without base64 */
+
+        /* Perform writes from the given worker loop. Must be called before setFds */
+        void setWriter(ClientWorker * worker)
+        {
+            writer = worker;
+        }
+
         int getRFd() const
         {
             return rFd;
@@ -592,6 +769,14 @@ class MsgQueue: public Collectable
             return useSharedBuffer;
         }
 
+        bool acceptRawBlobs() const
+        {
+            return useRawBlobs;
+        }
+
+        /* Parse the raw oneBLOB content sent by the peer once it was asked to */
+        void allowRawContent();
+
         virtual void log(const std::string &log) const;
 };
 
@@ -606,6 +791,90 @@ class Property
         Property(const std::string &dev, const std::string &name): dev(dev), name(name) {}
 };
 
+/* (device, property) -> subscribers index, so that routing a message only visits its actual recipients.
+ * An empty property name subscribes to every property of the device.
+ */
+template<class M>
+class PropertyIndex
+{
+        std::map<std::string, std::map<std::string, std::map<M*, Property*>>> entries;
+
+        static Property * get(const std::map<std::string, std::map<M*, Property*>> &names, const std::string &name, M* m)
+        {
+            auto nameIt = names.find(name);
+            if (nameIt == names.end())
+                return nullptr;
+            auto it = nameIt->second.find(m);
+            return it == nameIt->second.end() ? nullptr : it->second;
+        }
+
+    public:
+        void insert(M* m, Property *p)
+        {
+            entries[p->dev][p->name][m] = p;
+        }
+
+        void erase(M* m, Property *p)
+        {
+            auto devIt = entries.find(p->dev);
+            if (devIt == entries.end())
+                return;
+            auto nameIt = devIt->second.find(p->name);
+            if (nameIt == devIt->second.end())
+                return;
+
+            nameIt->second.erase(m);
+            if (nameIt->second.empty())
+                devIt->second.erase(nameIt);
+            if (devIt->second.empty())
+                entries.erase(devIt);
+        }
+
+        /* Property of m registered for exactly dev/name, or nullptr */
+        Property * findExact(M* m, const std::string &dev, const std::string &name) const
+        {
+            auto devIt = entries.find(dev);
+            if (devIt == entries.end())
+                return nullptr;
+            return get(devIt->second, name, m);
+        }
+
+        /* Property of m matching dev/name, or nullptr. An exact match wins over a whole device subscription */
+        Property * find(M* m, const std::string &dev, const std::string &name) const
+        {
+            auto devIt = entries.find(dev);
+            if (devIt == entries.end())
+                return nullptr;
+            Property * p = get(devIt->second, name, m);
+            return p ? p : get(devIt->second, "", m);
+        }
+
+        /* Add every subscriber of dev/name to result, with its matching property */
+        void findAll(const std::string &dev, const std::string &name, std::map<M*, Property*> &result) const
+        {
+            auto devIt = entries.find(dev);
+            if (devIt == entries.end())
+                return;
+
+            auto all = devIt->second.find("");
+            if (all != devIt->second.end())
+            {
+                for (auto &e : all->second)
+                    result[e.first] = e.second;
+            }
+
+            if (name.empty())
+                return;
+
+            auto exact = devIt->second.find(name);
+            if (exact != devIt->second.end())
+            {
+                for (auto &e : exact->second)
+                    result[e.first] = e.second;
+            }
+        }
+};
+
 
 class Fifo
 {
@@ -648,9 +917,17 @@ class ClInfo: public MsgQueue
         /* Update the client property BLOB handling policy */
         void crackBLOBHandling(const std::string &dev, const std::string &name, const char *enableBLOB);
 
+        /* handle the encoding attribute of enableBLOB: encoding='raw' asks for BLOBs without base64 on this
+         * connection. It is forwarded as is to chained servers, see q2RDrivers.
+         */
+        void crackBLOBEncoding(XMLEle *root);
+
         /* close down the given client */
         virtual void close();
 
+        /* Change allprops, keeping allPropsClients up to date */
+        void setAllProps(int allprops);
+
     public:
         std::list<Property*> props;     /* props we want */
         int allprops = 0;               /* saw getProperties w/o device */
@@ -680,6 +957,12 @@ class ClInfo: public MsgQueue
 
         /* Reference to all active clients */
         static ConcurrentSet<ClInfo> clients;
+
+        /* Properties wanted by clients */
+        static PropertyIndex<ClInfo> subscriptions;
+
+        /* Clients with allprops set */
+        static std::set<ClInfo*> allPropsClients;
 };
 
 /* info for each connected driver */
@@ -747,6 +1030,9 @@ class DvrInfo: public MsgQueue
 
         /* Reference to all active drivers */
         static ConcurrentSet<DvrInfo> drivers;
+
+        /* Properties snooped by drivers */
+        static PropertyIndex<DvrInfo> snoopers;
 };
 
 class LocalDvrInfo: public DvrInfo
@@ -874,11 +1160,16 @@ static char *ldir;                                     /* where to log driver me
 static unsigned int maxqsiz  = (DEFMAXQSIZ * 1024 * 1024); /* kill if these bytes behind */
 static unsigned int maxstreamsiz  = (DEFMAXSSIZ * 1024 * 1024); /* drop blobs if these bytes behind while streaming*/
 static int maxrestarts   = DEFMAXRESTART;
+static int nworkers      = 0;                          /* client write loops besides the main one */
+static int nserializers  = -1;                         /* serialization threads, -1 for one per cpu */
+static unsigned int readbudget = (DEFREADBUDGET * 1024); /* max bytes read from one connection per wakeup */
+static unsigned int maxwsize = MAXWSIZ;                /* max bytes written to one connection per system call */
 
 static std::vector<XMLEle *> findBlobElements(XMLEle * root);
 
 static void logStartup(int ac, char *av[]);
 static void usage(void);
+static long numberArg(char option, const char *arg, long min, long max);
 static void noSIGPIPE(void);
 static char *indi_tstamp(char *s);
 static void logDMsg(XMLEle *root, const char *dev);
@@ -889,6 +1180,7 @@ static int readFdError(int
 
 static void * attachSharedBuffer(int fd, size_t &size);
 static void dettachSharedBuffer(int fd, void * ptr, size_t size);
+static ssize_t sendFileChunk(int fd, int fileFd, off_t offset, size_t count);
 
 int main(int ac, char *av[])
 {
@@ -986,6 +1278,44 @@ int main(int ac, char *av[])
                         maxrestarts = 0;
                     ac--;
                     break;
+                case 'b':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-b requires max KB read per wakeup\n");
+                        usage();
+                    }
+                    readbudget = 1024 * numberArg('b', *++av, 1, INT_MAX / 1024);
+                    ac--;
+                    break;
+                case 'w':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-w requires max KB per write\n");
+                        usage();
+                    }
+                    maxwsize = 1024 * numberArg('w', *++av, 0, INT_MAX / 1024);
+                    if (maxwsize == 0)
+                        maxwsize = MAXWSIZ;
+                    ac--;
+                    break;
+                case 'j':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-j requires number of worker threads\n");
+                        usage();
+                    }
+                    nworkers = numberArg('j', *++av, 0, MAXTHREADS);
+                    ac--;
+                    break;
+                case 's':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-s requires number of serialization threads\n");
+                        usage();
+                    }
+                    nserializers = numberArg('s', *++av, 1, MAXTHREADS);
+                    ac--;
+                    break;
                 case 'v':
                     verbose++;
                     break;
@@ -1002,6 +1332,15 @@ int main(int ac, char *av[])
     /* take care of some unixisms */
     noSIGPIPE();
 
+    /* spread client writes over worker loops, if requested */
+    if (nworkers > 0)
+        ClientWorker::startAll(nworkers);
+
+    /* threads producing the messages content (base64 conversion of blobs, ...) */
+    if (nserializers < 0)
+        nserializers = std::max(1u, std::thread::hardware_concurrency());
+    SerializationPool::startAll(nserializers);
+
     /* start each driver */
     while (ac-- > 0)
     {
@@ -1075,8 +1414,14 @@ static void usage(void)
     fprintf(stderr, " -u path  : Path for the local connection socket (abstract), default %s\n", INDIUNIXSOCK);
 #endif
     fprintf(stderr, " -p p     : alternate IP port, default %d\n", INDIPORT);
+    fprintf(stderr, " -b k     : read at most this many KB from one connection before serving others, default %d\n",
+            DEFREADBUDGET);
+    fprintf(stderr, " -w k     : write at most this many KB to one connection per system call, default %d\n",
+            MAXWSIZ / 1024);
     fprintf(stderr, " -r r     : maximum driver restarts on error, default %d\n", DEFMAXRESTART);
     fprintf(stderr, " -f path  : Path to fifo for dynamic startup and shutdown of drivers.\n");
+    fprintf(stderr, " -j n     : spread writes to clients over n worker threads, default 0 (main thread only)\n");
+    fprintf(stderr, " -s n     : convert messages content (blobs) over n threads, default one per cpu\n");
     fprintf(stderr, " -v       : show key events, no traffic\n");
     fprintf(stderr, " -vv      : -v + key message content\n");
     fprintf(stderr, " -vvv     : -vv + complete xml\n");
@@ -1085,6 +1430,20 @@ static void usage(void)
     exit(2);
 }
 
+/* arg of -option as a number from min to max, print usage message and exit (2) if it is not one */
+static long numberArg(char option, const char *arg, long min, long max)
+{
+    char *end;
+    long n = strtol(arg, &end, 10);
+
+    if (end == arg || *end != '\0' || n < min || n > max)
+    {
+        fprintf(stderr, "-%c requires a number from %ld to %ld\n", option, min, max);
+        usage();
+    }
+    return n;
+}
+
 /* turn off SIGPIPE on bad write so we can handle it inline */
 static void noSIGPIPE()
 {
@@ -1870,16 +2229,19 @@ void ClInfo::onMessage(XMLEle * root, std::list<int> &sharedBuffers)
         // Signature for CHAINED SERVER
         // Not a regular client.
         if (dev[0] == '*' && !this->props.size())
-            this->allprops = 2;
+            setAllProps(2);
         else
             addDevice(dev, name, isblob);
     }
     else if (!strcmp(roottag, "getProperties") && !this->props.size() && this->allprops != 2)
-        this->allprops = 1;
+        setAllProps(1);
 
     /* snag enableBLOB -- send to remote drivers too */
     if (!strcmp(roottag, "enableBLOB"))
+    {
         crackBLOBHandling(dev, name, pcdataXMLEle(root));
+        crackBLOBEncoding(root);
+    }
 
     if (!strcmp(roottag, "pingRequest"))
     {
@@ -2115,8 +2477,14 @@ void DvrInfo::q2RDrivers(const std::string &dev, Msg *mp, XMLEle *root)
         }
 
         /* JM 2016-10-30: Only send enableBLOB to remote drivers */
-        if (isRemote == 0 && !strcmp(roottag, "enableBLOB"))
-            continue;
+        if (!strcmp(roottag, "enableBLOB"))
+        {
+            if (isRemote == 0)
+                continue;
+            /* the chained server answers with raw BLOBs on this connection from now on */
+            if (!strcmp(findXMLAttValu(root, "encoding"), "raw"))
+                dp->allowRawContent();
+        }
 
         /* ok: queue message to this driver */
         if (verbose > 1)
@@ -2133,16 +2501,16 @@ void DvrInfo::q2RDrivers(const std::string &dev, Msg *mp, XMLEle *root)
 void DvrInfo::q2SDrivers(DvrInfo *me, int isblob, const std::string &dev, const std::string &name, Msg *mp, XMLEle *root)
 {
     std::string meRemoteServerUid = me ? me->remoteServerUid() : "";
-    for (auto dpId : drivers.ids())
-    {
-        auto dp = drivers[dpId];
-        if (dp == nullptr) continue;
 
-        Property *sp = dp->findSDevice(dev, name);
+    std::map<DvrInfo*, Property*> snooping;
+    snoopers.findAll(dev, name, snooping);
 
-        /* nothing for dp if not snooping for dev/name or wrong BLOB mode */
-        if (!sp)
-            continue;
+    for (auto &entry : snooping)
+    {
+        auto dp = entry.first;
+        Property *sp = entry.second;
+
+        /* nothing for dp if wrong BLOB mode */
         if ((isblob && sp->blob == B_NEVER) || (!isblob && sp->blob == B_ONLY))
             continue;
 
@@ -2176,6 +2544,7 @@ void DvrInfo::addSDevice(const std::string &dev, const std::string &name)
     sp = new Property(dev, name);
     sp->blob = B_NEVER;
     sprops.push_back(sp);
+    snoopers.insert(this, sp);
 
     if (verbose)
         log(fmt("snooping on %s.%s\n", dev.c_str(), name.c_str()));
@@ -2183,28 +2552,38 @@ void DvrInfo::addSDevice(const std::string &dev, const std::string &name)
 
 Property * DvrInfo::findSDevice(const std::string &dev, const std::string &name) const
 {
-    for(auto sp : sprops)
-    {
-        if ((sp->dev == dev) && (sp->name.empty() || sp->name == name))
-            return (sp);
-    }
-
-    return nullptr;
+    return snoopers.find(const_cast<DvrInfo*>(this), dev, name);
 }
 
 void ClInfo::q2Clients(ClInfo *notme, int isblob, const std::string &dev, const std::string &name, Msg *mp, XMLEle *root)
 {
-    /* queue message to each interested client */
-    for (auto cpId : clients.ids())
+    /* collect clients interested in dev/name, with their matching property if any */
+    std::map<ClInfo*, Property*> recipients;
+    subscriptions.findAll(dev, name, recipients);
+    if (dev.empty())
     {
-        auto cp = clients[cpId];
-        if (cp == nullptr) continue;
+        for (auto cp : clients)
+            recipients.insert(std::make_pair(cp, nullptr));
+    }
+    else
+    {
+        for (auto cp : allPropsClients)
+            recipients.insert(std::make_pair(cp, nullptr));
+    }
+
+    /* queue message to each interested client, in the order they connected */
+    std::vector<std::pair<ClInfo*, Property*>> ordered(recipients.begin(), recipients.end());
+    std::sort(ordered.begin(), ordered.end(), [](const std::pair<ClInfo*, Property*> &a, const std::pair<ClInfo*, Property*> &b)
+    {
+        return a.first->insertionId() < b.first->insertionId();
+    });
+    for (auto &entry : ordered)
+    {
+        auto cp = entry.first;
 
-        /* cp in use? notme? want this dev/name? blob? */
+        /* notme? blob? */
         if (cp == notme)
             continue;
-        if (cp->findDevice(dev, name) < 0)
-            continue;
 
         //if ((isblob && cp->blob==B_NEVER) || (!isblob && cp->blob==B_ONLY))
         if (!isblob && cp->blob == B_ONLY)
@@ -2214,15 +2593,9 @@ void ClInfo::q2Clients(ClInfo *notme, int isblob, const std::string &dev, const
         {
             if (cp->props.size() > 0)
             {
-                Property *blobp = nullptr;
-                for (auto pp : cp->props)
-                {
-                    if (pp->dev == dev && pp->name == name)
-                    {
-                        blobp = pp;
-                        break;
-                    }
-                }
+                Property *blobp = entry.second;
+                if (blobp && blobp->name != name)
+                    blobp = nullptr;
 
                 if ((blobp && blobp->blob == B_NEVER) || (!blobp && cp->blob == B_NEVER))
                     continue;
@@ -2372,31 +2745,101 @@ void MsgQueue::writeToFd()
     }
     while(nsend == 0);
 
-    /* send next chunk, never more than MAXWSIZ to reduce blocking */
-    if (nsend > MAXWSIZ)
-        nsend = MAXWSIZ;
+    if (sharedBuffers.size() > MAXFD_PER_MESSAGE)
+    {
+        log(fmt("attempt to send too many FD\n"));
+        close();
+        return;
+    }
 
-    if (!useSharedBuffer)
+    /* gather the following chunks, possibly from the next queued messages, into the same system call.
+     * never more than maxwsize bytes to reduce blocking. Only the first chunk may carry buffers, so
+     * gathering stops before any chunk that has some to attach. Chunks to be read from a file are
+     * sent alone.
+     */
+    struct iovec iov[MAXIOV];
+    int iovcnt = 1;
+    ssize_t total = std::min(nsend, (ssize_t)maxwsize);
+    iov[0].iov_base = data;
+    iov[0].iov_len = total;
+
+    int fileFd = -1;
+    off_t fileOffset = 0;
+    if (mp->getContentFile(nsent, fileFd, fileOffset))
+        iovcnt = 0;
+
+    std::vector<SerializedMsg *> msgs;
+    msgs.push_back(mp);
+
+    if (iovcnt && total == nsend)
+    {
+        auto it = msgq.begin();
+        MsgChunckIterator pos = nsent;
+        SerializedMsg * cur = mp;
+        cur->advance(pos, nsend);
+
+        while (iovcnt < MAXIOV && total < (ssize_t)maxwsize)
+        {
+            void * more;
+            ssize_t nmore;
+            std::vector<int> moreBuffers;
+
+            if (!cur->getContent(pos, more, nmore, moreBuffers))
+                break;
+
+            if (nmore == 0)
+            {
+                /* end of this message, continue with the next one */
+                if (++it == msgq.end())
+                    break;
+                cur = *it;
+                pos.reset();
+                if (!cur->requestContent(pos))
+                    break;
+                msgs.push_back(cur);
+                continue;
+            }
+
+            if (!moreBuffers.empty() || more == nullptr)
+                break;
+
+            nmore = std::min(nmore, (ssize_t)maxwsize - total);
+            iov[iovcnt].iov_base = more;
+            iov[iovcnt].iov_len = nmore;
+            iovcnt++;
+            total += nmore;
+            cur->advance(pos, nmore);
+        }
+    }
+
+    /* a worker does the system call without holding the server lock */
+    int fd = wFd;
+    auto hb = heartBeat();
+    if (writer)
+    {
+        fd = writerFd;
+        for (auto m : msgs)
+            m->pin();
+        serverLock.unlock();
+    }
+
+    if (fileFd != -1)
+    {
+        nw = sendFileChunk(fd, fileFd, fileOffset, total);
+    }
+    else if (!useSharedBuffer)
     {
-        nw = write(wFd, data, nsend);
+        nw = writev(fd, iov, iovcnt);
     }
     else
     {
         struct msghdr msgh;
-        struct iovec iov[1];
         int cmsghdrlength;
         struct cmsghdr * cmsgh;
 
         int fdCount = sharedBuffers.size();
         if (fdCount > 0)
         {
-            if (fdCount > MAXFD_PER_MESSAGE)
-            {
-                log(fmt("attempt to send too many FD\n"));
-                close();
-                return;
-            }
-
             cmsghdrlength = CMSG_SPACE((fdCount * sizeof(int)));
             // FIXME: abort on alloc error here
             cmsgh = (struct cmsghdr*)malloc(cmsghdrlength);
@@ -2421,20 +2864,31 @@ void MsgQueue::writeToFd()
             msgh.msg_controllen = cmsghdrlength;
         }
 
-        iov[0].iov_base = data;
-        iov[0].iov_len = nsend;
-
         msgh.msg_flags = 0;
         msgh.msg_name = NULL;
         msgh.msg_namelen = 0;
         msgh.msg_iov = iov;
-        msgh.msg_iovlen = 1;
+        msgh.msg_iovlen = iovcnt;
 
-        nw = sendmsg(wFd, &msgh,  MSG_NOSIGNAL);
+        nw = sendmsg(fd, &msgh,  MSG_NOSIGNAL);
 
         free(cmsgh);
     }
 
+    if (writer)
+    {
+        int writeErrno = errno;
+        serverLock.lock();
+        errno = writeErrno;
+
+        for (auto m : msgs)
+            m->unpin();
+
+        /* the queue may have been closed or cleared meanwhile */
+        if (!hb.alive() || wFd == -1)
+            return;
+    }
+
     /* shut down if trouble */
     if (nw <= 0)
     {
@@ -2449,22 +2903,43 @@ void MsgQueue::writeToFd()
     }
 
     /* trace */
-    if (verbose > 2)
+    if (verbose > 1 && fileFd != -1)
     {
-        log(fmt("sending msg nq %ld:\n%.*s\n",
-                msgq.size(), (int)nw, data));
+        log(fmt("sending %ld bytes of BLOB content\n", (long)nw));
     }
     else if (verbose > 1)
     {
-        log(fmt("sending %.*s\n", (int)nw, data));
+        ssize_t left = nw;
+        for (int i = 0; i < iovcnt && left > 0; ++i)
+        {
+            int len = std::min(left, (ssize_t)iov[i].iov_len);
+            if (verbose > 2)
+                log(fmt("sending msg nq %ld:\n%.*s\n", msgq.size(), len, (char *)iov[i].iov_base));
+            else
+                log(fmt("sending %.*s\n", len, (char *)iov[i].iov_base));
+            left -= len;
+        }
     }
 
     /* update amount sent. when complete: free message if we are the last
      * to use it and pop from our queue.
      */
-    mp->advance(nsent, nw);
-    if (nsent.done())
-        consumeHeadMsg();
+    while (nw > 0)
+    {
+        mp = headMsg();
+        if (mp == nullptr || !mp->getContent(nsent, data, nsend, sharedBuffers))
+            break;
+        if (nsend == 0)
+        {
+            consumeHeadMsg();
+            continue;
+        }
+        nsend = std::min(nsend, nw);
+        mp->advance(nsent, nsend);
+        nw -= nsend;
+        if (nsent.done())
+            consumeHeadMsg();
+    }
 }
 
 void MsgQueue::log(const std::string &str) const
@@ -2480,11 +2955,8 @@ int ClInfo::findDevice(const std::string &dev, const std::string &name) const
 {
     if (allprops >= 1 || dev.empty())
         return (0);
-    for (auto pp : props)
-    {
-        if ((pp->dev == dev) && (pp->name.empty() || (pp->name == name)))
-            return (0);
-    }
+    if (subscriptions.find(const_cast<ClInfo*>(this), dev, name))
+        return (0);
     return (-1);
 }
 
@@ -2492,11 +2964,8 @@ void ClInfo::addDevice(const std::string &dev, const std::string &name, int isbl
 {
     if (isblob)
     {
-        for (auto pp : props)
-        {
-            if (pp->dev == dev && pp->name == name)
-                return;
-        }
+        if (subscriptions.findExact(this, dev, name))
+            return;
     }
     /* no dups */
     else if (!findDevice(dev, name))
@@ -2505,6 +2974,16 @@ void ClInfo::addDevice(const std::string &dev, const std::string &name, int isbl
     /* add */
     Property *pp = new Property(dev, name);
     props.push_back(pp);
+    subscriptions.insert(this, pp);
+}
+
+void ClInfo::setAllProps(int allprops)
+{
+    this->allprops = allprops;
+    if (allprops >= 1)
+        allPropsClients.insert(this);
+    else
+        allPropsClients.erase(this);
 }
 
 void MsgQueue::crackBLOB(const char *enableBLOB, BLOBHandling *bp)
@@ -2528,15 +3007,28 @@ void ClInfo::crackBLOBHandling(const std::string &dev, const std::string &name,
 
     /* If whole client blob handling policy was updated, we need to pass that also to all children
        and if the request was for a specific property, then we apply the policy to it */
-    for (auto pp : props)
+    if (name.empty())
     {
-        if (name.empty())
+        for (auto pp : props)
             crackBLOB(enableBLOB, &pp->blob);
-        else if (pp->dev == dev && pp->name == name)
-        {
+    }
+    else
+    {
+        Property *pp = subscriptions.findExact(this, dev, name);
+        if (pp)
             crackBLOB(enableBLOB, &pp->blob);
-            return;
-        }
+    }
+}
+
+void ClInfo::crackBLOBEncoding(XMLEle *root)
+{
+    XMLAtt *ap = findXMLAtt(root, "encoding");
+    if (ap)
+    {
+        // Local clients receive attached buffers, which is even better
+        useRawBlobs = !useSharedBuffer && !strcmp(valuXMLAtt(ap), "raw");
+        if (verbose > 0)
+            log(fmt("BLOB encoding %s\n", useRawBlobs ? "raw" : "base64"));
     }
 }
 
@@ -2651,6 +3143,7 @@ DvrInfo::~DvrInfo()
     drivers.erase(this);
     for(auto prop : sprops)
     {
+        snoopers.erase(this, prop);
         delete prop;
     }
 }
@@ -2670,6 +3163,7 @@ void DvrInfo::log(const std::string &str) const
 }
 
 ConcurrentSet<DvrInfo> DvrInfo::drivers;
+PropertyIndex<DvrInfo> DvrInfo::snoopers;
 
 LocalDvrInfo::LocalDvrInfo(): DvrInfo(true)
 {
@@ -2803,14 +3297,17 @@ RemoteDvrInfo * RemoteDvrInfo::clone() const
 ClInfo::ClInfo(bool useSharedBuffer) : MsgQueue(useSharedBuffer)
 {
     clients.insert(this);
+    setWriter(ClientWorker::pick());
 }
 
 ClInfo::~ClInfo()
 {
     for(auto prop : props)
     {
+        subscriptions.erase(this, prop);
         delete prop;
     }
+    allPropsClients.erase(this);
 
     clients.erase(this);
 }
@@ -2823,6 +3320,178 @@ void ClInfo::log(const std::string &str) const
 }
 
 ConcurrentSet<ClInfo> ClInfo::clients;
+PropertyIndex<ClInfo> ClInfo::subscriptions;
+std::set<ClInfo*> ClInfo::allPropsClients;
+
+std::vector<ClientWorker *> ClientWorker::workers;
+unsigned int ClientWorker::nextWorker = 0;
+
+/* Keeps the main loop async pipe active, so that async watchers started from worker threads get noticed */
+static ev::async mainLoopWakeup;
+
+static void onMainLoopWakeup(ev::async &, int)
+{
+}
+
+static void releaseServerLock(struct ev_loop *) noexcept
+{
+    serverLock.unlock();
+}
+
+static void acquireServerLock(struct ev_loop *) noexcept
+{
+    serverLock.lock();
+}
+
+ClientWorker::ClientWorker() : workerLoop(), wakeup(workerLoop)
+{
+    wakeup.set<ClientWorker, &ClientWorker::onWakeup>(this);
+    wakeup.start();
+    ev_set_loop_release_cb(workerLoop, releaseServerLock, acquireServerLock);
+}
+
+void ClientWorker::onWakeup(ev::async &, int)
+{
+    for (auto fd : fdsToClose)
+    {
+        ::close(fd);
+    }
+    fdsToClose.clear();
+}
+
+void ClientWorker::closeLater(int fd)
+{
+    fdsToClose.push_back(fd);
+    wake();
+}
+
+void ClientWorker::run()
+{
+    serverLock.lock();
+    workerLoop.run(0);
+    serverLock.unlock();
+}
+
+void ClientWorker::startAll(int count)
+{
+    // From now on, the main loop only runs while holding the lock
+    serverLock.lock();
+    ev_set_loop_release_cb(loop, releaseServerLock, acquireServerLock);
+    mainLoopWakeup.set<onMainLoopWakeup>();
+    mainLoopWakeup.start();
+
+    for (int i = 0; i < count; ++i)
+    {
+        auto worker = new ClientWorker();
+        workers.push_back(worker);
+        std::thread([worker]()
+        {
+            worker->run();
+        }).detach();
+    }
+
+    if (verbose > 0)
+        log(fmt("writing to clients from %d worker threads\n", count));
+}
+
+ClientWorker * ClientWorker::pick()
+{
+    if (workers.empty())
+        return nullptr;
+
+    return workers[nextWorker++ % workers.size()];
+}
+
+SerializationPool * SerializationPool::instance = nullptr;
+unsigned int SerializationPool::threadCount = 0;
+
+void SerializationPool::startAll(unsigned int count)
+{
+    instance = new SerializationPool();
+    threadCount = count;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        std::thread([]()
+        {
+            instance->run();
+        }).detach();
+    }
+
+    if (verbose > 0)
+        log(fmt("serializing messages from %u threads\n", count));
+}
+
+void SerializationPool::submit(std::function<void()> task)
+{
+    std::lock_guard<std::mutex> guard(instance->lock);
+    instance->tasks.push_back(std::move(task));
+    instance->wakeup.notify_one();
+}
+
+void SerializationPool::run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        wakeup.wait(guard, [this]()
+        {
+            return !tasks.empty();
+        });
+
+        auto task = std::move(tasks.front());
+        tasks.pop_front();
+
+        guard.unlock();
+        task();
+        guard.lock();
+    }
+}
+
+Base64Job::Base64Job(const unsigned char * src, unsigned long size, unsigned long pieceSize)
+    : src(src), srcSize(size), pieceSize(pieceSize), nextPiece(0)
+{
+    pieceCount = (size + pieceSize - 1) / pieceSize;
+    buffers.resize(pieceCount, nullptr);
+    lengths.resize(pieceCount, 0);
+    done.resize(pieceCount, false);
+}
+
+bool Base64Job::convertNext()
+{
+    unsigned long piece = nextPiece++;
+    if (piece >= pieceCount)
+        return false;
+
+    unsigned long offset = piece * pieceSize;
+    unsigned long sze = std::min(pieceSize, srcSize - offset);
+
+    char * buffer = (char*) malloc(4 * sze / 3 + 4);
+    int base64Count = to64frombits_s((unsigned char*)buffer, src + offset, sze, (4 * sze / 3 + 4));
+
+    std::lock_guard<std::mutex> guard(lock);
+    buffers[piece] = buffer;
+    lengths[piece] = base64Count;
+    done[piece] = true;
+    pieceDone.notify_all();
+    return true;
+}
+
+bool Base64Job::isDone(unsigned long piece)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return done[piece];
+}
+
+char * Base64Job::wait(unsigned long piece, int &length)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    pieceDone.wait(guard, [this, piece]()
+    {
+        return (bool)done[piece];
+    });
+    length = lengths[piece];
+    return buffers[piece];
+}
 
 SerializedMsg::SerializedMsg(Msg * parent) : asyncProgress(), owner(parent), awaiters(), chuncks(), ownBuffers()
 {
@@ -2894,11 +3563,10 @@ void SerializedMsg::async_start()
     {
         asyncProgress.start();
 
-        std::thread t([this]()
+        SerializationPool::submit([this]()
         {
             generateContent();
         });
-        t.detach();
     }
     else
     {
@@ -2988,11 +3656,31 @@ bool SerializedMsg::getContent(MsgChunckIterator &from, void* &data, ssize_t &si
         sharedBuffers.clear();
     }
 
-    data = ck.content + from.chunckOffset;
+    data = ck.fileFd == -1 ? ck.content + from.chunckOffset : nullptr;
     size = ck.contentLength - from.chunckOffset;
     return true;
 }
 
+bool SerializedMsg::getContentFile(const MsgChunckIterator &from, int &fd, off_t &offset)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+
+    if (from.chunckId >= chuncks.size())
+    {
+        return false;
+    }
+
+    const MsgChunck &ck = chuncks[from.chunckId];
+    if (ck.fileFd == -1)
+    {
+        return false;
+    }
+
+    fd = ck.fileFd;
+    offset = ck.fileOffset + from.chunckOffset;
+    return true;
+}
+
 void SerializedMsg::advance(MsgChunckIterator &iter, ssize_t s)
 {
     std::lock_guard<std::recursive_mutex> guard(lock);
@@ -3018,7 +3706,21 @@ void SerializedMsg::addAwaiter(MsgQueue * q)
 void SerializedMsg::release(MsgQueue * q)
 {
     awaiters.erase(q);
-    if (awaiters.empty() && !isAsyncRunning())
+    if (awaiters.empty() && writers == 0 && !isAsyncRunning())
+    {
+        owner->releaseSerialization(this);
+    }
+}
+
+void SerializedMsg::pin()
+{
+    writers++;
+}
+
+void SerializedMsg::unpin()
+{
+    writers--;
+    if (awaiters.empty() && writers == 0 && !isAsyncRunning())
     {
         owner->releaseSerialization(this);
     }
@@ -3049,6 +3751,14 @@ SerializedMsgWithoutSharedBuffer::~SerializedMsgWithoutSharedBuffer()
 {
 }
 
+SerializedMsgWithRawBlobs::SerializedMsgWithRawBlobs(Msg * parent): SerializedMsg(parent)
+{
+}
+
+SerializedMsgWithRawBlobs::~SerializedMsgWithRawBlobs()
+{
+}
+
 SerializedMsgWithSharedBuffer::SerializedMsgWithSharedBuffer(Msg * parent): SerializedMsg(parent), ownSharedBuffers()
 {
 }
@@ -3066,12 +3776,24 @@ MsgChunck::MsgChunck() : sharedBufferIdsToAttach()
 {
     content = nullptr;
     contentLength = 0;
+    fileFd = -1;
+    fileOffset = 0;
 }
 
 MsgChunck::MsgChunck(char * content, unsigned long length) : sharedBufferIdsToAttach()
 {
     this->content = content;
     this->contentLength = length;
+    this->fileFd = -1;
+    this->fileOffset = 0;
+}
+
+MsgChunck::MsgChunck(int fileFd, off_t fileOffset, unsigned long length) : sharedBufferIdsToAttach()
+{
+    this->content = nullptr;
+    this->contentLength = length;
+    this->fileFd = fileFd;
+    this->fileOffset = fileOffset;
 }
 
 Msg::Msg(MsgQueue * from, XMLEle * ele): sharedBuffers()
@@ -3083,6 +3805,7 @@ Msg::Msg(MsgQueue * from, XMLEle * ele): sharedBuffers()
 
     convertionToSharedBuffer = nullptr;
     convertionToInline = nullptr;
+    convertionToRaw = nullptr;
 
     queueSize = sprlXMLEle(xmlContent, 0);
     for(auto blobContent : findBlobElements(xmlContent))
@@ -3104,6 +3827,7 @@ Msg::~Msg()
     // Assume convertionToSharedBlob and convertionToInlineBlob were already droped
     assert(convertionToSharedBuffer == nullptr);
     assert(convertionToInline == nullptr);
+    assert(convertionToRaw == nullptr);
 
     releaseXmlContent();
     releaseSharedBuffers(std::set<int>());
@@ -3121,6 +3845,11 @@ void Msg::releaseSerialization(SerializedMsg * msg)
         convertionToInline = nullptr;
     }
 
+    if (msg == convertionToRaw)
+    {
+        convertionToRaw = nullptr;
+    }
+
     delete(msg);
     prune();
 }
@@ -3162,6 +3891,10 @@ void Msg::prune()
     {
         convertionToInline->collectRequirements(req);
     }
+    if (convertionToRaw)
+    {
+        convertionToRaw->collectRequirements(req);
+    }
     // Free the resources.
     if (!req.xml)
     {
@@ -3171,12 +3904,18 @@ void Msg::prune()
     releaseSharedBuffers(req.sharedBuffers);
 
     // Nobody cares anymore ?
-    if (convertionToSharedBuffer == nullptr && convertionToInline == nullptr)
+    if (convertionToSharedBuffer == nullptr && convertionToInline == nullptr && convertionToRaw == nullptr)
     {
         delete(this);
     }
 }
 
+/* True for an inline blob whose content is raw bytes instead of base64 */
+static bool isRawBlob(XMLEle * blobContent)
+{
+    return findXMLAtt(blobContent, "rawlen") != nullptr;
+}
+
 bool parseBlobSize(XMLEle * blobWithAttachedBuffer, ssize_t &size)
 {
     std::string sizeStr = findXMLAttValu(blobWithAttachedBuffer, "size");
@@ -3194,6 +3933,18 @@ bool parseBlobSize(XMLEle * blobWithAttachedBuffer, ssize_t &size)
     return true;
 }
 
+/* Length of the content of an attached blob: size is the uncompressed size, len (when present) the actual length */
+static bool parseBlobLength(XMLEle * blobWithAttachedBuffer, ssize_t &length)
+{
+    std::string lenStr = findXMLAttValu(blobWithAttachedBuffer, "len");
+    if (lenStr != "")
+    {
+        length = atoll(lenStr.c_str());
+        return length >= 0;
+    }
+    return parseBlobSize(blobWithAttachedBuffer, length);
+}
+
 /** Init a message from xml content & additional incoming buffers */
 bool Msg::fetchBlobs(std::list<int> &incomingSharedBuffers)
 {
@@ -3223,6 +3974,11 @@ bool Msg::fetchBlobs(std::list<int> &incomingSharedBuffers)
 
             sharedBuffers.push_back(fd);
         }
+        else if (isRawBlob(blobContent))
+        {
+            // Not accounted by sprlXMLEle, that stops at the first nul
+            queueSize += pcdatalenXMLEle(blobContent);
+        }
         else
         {
             // Check cdata length vs blobSize ?
@@ -3272,6 +4028,16 @@ SerializedMsg * Msg::buildConvertionToInline()
     return convertionToInline = new SerializedMsgWithoutSharedBuffer(this);
 }
 
+SerializedMsg * Msg::buildConvertionToRaw()
+{
+    if (convertionToRaw)
+    {
+        return convertionToRaw;
+    }
+
+    return convertionToRaw = new SerializedMsgWithRawBlobs(this);
+}
+
 SerializedMsg * Msg::serialize(MsgQueue * to)
 {
     if (hasSharedBufferBlobs || hasInlineBlobs)
@@ -3280,6 +4046,10 @@ SerializedMsg * Msg::serialize(MsgQueue * to)
         {
             return buildConvertionToSharedBuffer();
         }
+        else if (to->acceptRawBlobs())
+        {
+            return buildConvertionToRaw();
+        }
         else
         {
             return buildConvertionToInline();
@@ -3356,6 +4126,7 @@ void SerializedMsgWithoutSharedBuffer::generateContent()
 
         XMLEle * clone = shallowCloneXMLEle(blobContent);
         rmXMLAtt(clone, "attached");
+        rmXMLAtt(clone, "rawlen");
         editXMLEle(clone, "_");
 
         replacement[blobContent] = clone;
@@ -3365,9 +4136,9 @@ void SerializedMsgWithoutSharedBuffer::generateContent()
         {
             rmXMLAtt(clone, "enclen");
 
-            // Get the size if present
+            // Get the length if present
             ssize_t size = -1;
-            parseBlobSize(clone, size);
+            parseBlobLength(clone, size);
 
             // FIXME: we could add enclen there
 
@@ -3468,32 +4239,18 @@ void SerializedMsgWithoutSharedBuffer::generateContent()
             {
                 // Add a binary chunck. This needs base64 convertion
                 // FIXME: the size here should be the size of the blob element
-                unsigned long buffSze = sizes[i];
-                const unsigned char* src = (const unsigned char*)blobs[i];
-
-                // split here in smaller chuncks for faster startup
-                // This allow starting write before the whole blob is converted
-                while(buffSze > 0)
-                {
-                    // We need a block size multiple of 24 bits (3 bytes)
-                    unsigned long sze = buffSze > 3 * 16384 ? 3 * 16384 : buffSze;
-
-                    char* buffer = (char*) malloc(4 * sze / 3 + 4);
-                    ownBuffers.push_back(buffer);
-                    int base64Count = to64frombits_s((unsigned char*)buffer, src, sze, (4 * sze / 3 + 4));
-
-                    async_pushChunck(MsgChunck(buffer, base64Count));
-
-                    buffSze -= sze;
-                    src += sze;
-                }
-
+                pushBase64Chuncks((const unsigned char*)blobs[i], sizes[i]);
 
                 // Dettach blobs ASAP
                 dettachSharedBuffer(fds[i], blobs[i], attachedSizes[i]);
 
                 // requirements.sharedBuffers.erase(fds[i]);
             }
+            else if (isRawBlob(sharedCData[i]))
+            {
+                // Raw content from a chained server. This needs base64 convertion too
+                pushBase64Chuncks((const unsigned char*)pcdataXMLEle(sharedCData[i]), pcdatalenXMLEle(sharedCData[i]));
+            }
             else
             {
                 // Add an already ready cdata section
@@ -3513,6 +4270,192 @@ void SerializedMsgWithoutSharedBuffer::generateContent()
     async_done();
 }
 
+void SerializedMsgWithoutSharedBuffer::pushBase64Chuncks(const unsigned char * src, unsigned long buffSze)
+{
+    // split here in smaller chuncks for faster startup
+    // This allow starting write before the whole blob is converted
+    if (buffSze == 0)
+        return;
+
+    // We need a block size multiple of 24 bits (3 bytes)
+    auto job = std::make_shared<Base64Job>(src, buffSze, 3 * 16384);
+
+    // Let idle pool threads convert the next pieces while this one publishes in order
+    unsigned long helpers = std::min((unsigned long)SerializationPool::size(), job->count()) - 1;
+    for(unsigned long i = 0; i < helpers; ++i)
+    {
+        SerializationPool::submit([job]()
+        {
+            while(job->convertNext()) {}
+        });
+    }
+
+    for(unsigned long i = 0; i < job->count(); ++i)
+    {
+        // Rather than waiting for a helper, convert pieces that are still unclaimed
+        while(!job->isDone(i) && job->convertNext()) {}
+
+        int base64Count;
+        char * buffer = job->wait(i, base64Count);
+        ownBuffers.push_back(buffer);
+
+        async_pushChunck(MsgChunck(buffer, base64Count));
+    }
+}
+
+bool SerializedMsgWithRawBlobs::generateContentAsync() const
+{
+    return owner->hasInlineBlobs;
+}
+
+void SerializedMsgWithRawBlobs::generateContent()
+{
+    // Replace the content of every blob by its raw bytes
+    auto xmlContent = owner->xmlContent;
+
+    std::vector<XMLEle*> cdata;
+    // For each cdata, either the shared buffer fd and its length, or the decoded inline content
+    std::vector<int> fds;
+    std::vector<size_t> sizes;
+    std::vector<char *> decoded;
+
+    std::unordered_map<XMLEle*, XMLEle*> replacement;
+
+    int ownerSharedBufferId = 0;
+
+    for(auto blobContent : findBlobElements(xmlContent))
+    {
+        std::string attached = findXMLAttValu(blobContent, "attached");
+
+        if (attached != "true" && pcdatalenXMLEle(blobContent) == 0)
+        {
+            continue;
+        }
+
+        XMLEle * clone = shallowCloneXMLEle(blobContent);
+        rmXMLAtt(clone, "attached");
+        rmXMLAtt(clone, "enclen");
+        rmXMLAtt(clone, "rawlen");
+        editXMLEle(clone, "_");
+
+        replacement[blobContent] = clone;
+        cdata.push_back(clone);
+
+        size_t rawlen;
+        if (attached == "true")
+        {
+            int fd = owner->sharedBuffers[ownerSharedBufferId++];
+
+            struct stat sb;
+            if (fstat(fd, &sb) == -1)
+            {
+                perror("invalid shared buffer fd");
+                Bye();
+            }
+            rawlen = sb.st_size;
+
+            // The buffer may be larger than its content: trust the announced length when it fits
+            ssize_t size;
+            if (parseBlobLength(clone, size) && (size_t)size <= rawlen)
+            {
+                rawlen = size;
+            }
+
+            fds.push_back(fd);
+            decoded.push_back(nullptr);
+        }
+        else if (isRawBlob(blobContent))
+        {
+            // Already raw (from a chained server)
+            rawlen = pcdatalenXMLEle(blobContent);
+            fds.push_back(-1);
+            decoded.push_back(pcdataXMLEle(blobContent));
+        }
+        else
+        {
+            int base64datalen = pcdatalenXMLEle(blobContent);
+            XMLAtt * enclenAtt = findXMLAtt(blobContent, "enclen");
+            if (enclenAtt)
+            {
+                int enclen = atoi(valuXMLAtt(enclenAtt));
+                if (enclen > 0 && enclen < base64datalen)
+                    base64datalen = enclen;
+            }
+
+            char * buffer = (char*)malloc(3 * base64datalen / 4 + 3);
+            ownBuffers.push_back(buffer);
+            rawlen = from64tobits_fast(buffer, pcdataXMLEle(blobContent), base64datalen);
+
+            fds.push_back(-1);
+            decoded.push_back(buffer);
+        }
+        sizes.push_back(rawlen);
+        addXMLAtt(clone, "rawlen", std::to_string(rawlen).c_str());
+    }
+
+    if (replacement.empty())
+    {
+        // Just print the content as is...
+        char * model = (char*)malloc(sprlXMLEle(xmlContent, 0) + 1);
+        int modelSize = sprXMLEle(model, xmlContent, 0);
+
+        ownBuffers.push_back(model);
+
+        async_pushChunck(MsgChunck(model, modelSize));
+        async_done();
+        return;
+    }
+
+    // Create a replacement that shares original CData buffers
+    xmlContent = cloneXMLEleWithReplacementMap(xmlContent, replacement);
+
+    std::vector<size_t> modelCdataOffset(cdata.size());
+
+    char * model = (char*)malloc(sprlXMLEle(xmlContent, 0) + 1);
+    int modelSize = sprXMLEle(model, xmlContent, 0);
+
+    ownBuffers.push_back(model);
+
+    for(std::size_t i = 0; i < cdata.size(); ++i)
+    {
+        modelCdataOffset[i] = sprXMLCDataOffset(xmlContent, cdata[i], 0);
+    }
+    delXMLEle(xmlContent);
+
+    int modelOffset = 0;
+    for(std::size_t i = 0; i < cdata.size(); ++i)
+    {
+        int cdataOffset = modelCdataOffset[i];
+        if (cdataOffset > modelOffset)
+        {
+            async_pushChunck(MsgChunck(model + modelOffset, cdataOffset - modelOffset));
+        }
+        // Skip the dummy cdata completly
+        modelOffset = cdataOffset + 1;
+
+        if (sizes[i] == 0)
+        {
+            continue;
+        }
+
+        if (fds[i] != -1)
+        {
+            // Written with sendfile, without being mapped here
+            async_pushChunck(MsgChunck(fds[i], 0, sizes[i]));
+        }
+        else
+        {
+            async_pushChunck(MsgChunck(decoded[i], sizes[i]));
+        }
+    }
+
+    if (modelOffset < modelSize)
+    {
+        async_pushChunck(MsgChunck(model + modelOffset, modelSize - modelOffset));
+    }
+    async_done();
+}
+
 bool SerializedMsgWithSharedBuffer::generateContentAsync() const
 {
     return owner->hasInlineBlobs;
@@ -3539,13 +4482,47 @@ void SerializedMsgWithSharedBuffer::generateContent()
             // We need to replace.
             XMLEle * clone = shallowCloneXMLEle(blobContent);
             rmXMLAtt(clone, "enclen");
+            rmXMLAtt(clone, "rawlen");
             rmXMLAtt(clone, "attached");
+            rmXMLAtt(clone, "len");
             addXMLAtt(clone, "attached", "true");
 
             replacement[blobContent] = clone;
 
+            if (isRawBlob(blobContent))
+            {
+                // Content sent as is by a chained server: just copy it
+                int rawlen = pcdatalenXMLEle(blobContent);
+                void * blob = IDSharedBlobAlloc(rawlen);
+                if (blob == nullptr)
+                {
+                    log(fmt("Unable to allocate shared buffer of size %d : %s\n", rawlen, strerror(errno)));
+                    ::exit(1);
+                }
+                memcpy(blob, pcdataXMLEle(blobContent), rawlen);
+                addXMLAtt(clone, "len", std::to_string(rawlen).c_str());
+
+                int newFd = IDSharedBlobGetFd(blob);
+                ownSharedBuffers.insert(newFd);
+
+                IDSharedBlobDettach(blob);
+
+                sharedBuffers.insert(sharedBuffers.begin() + blobPos, newFd);
+                blobPos++;
+                continue;
+            }
+
             int base64datalen = pcdatalenXMLEle(blobContent);
             char * base64data = pcdataXMLEle(blobContent);
+
+            // Line breaks are skipped while decoding: only enclen tells the actual count of base64 chars
+            XMLAtt * enclenAtt = findXMLAtt(blobContent, "enclen");
+            if (enclenAtt)
+            {
+                int enclen = atoi(valuXMLAtt(enclenAtt));
+                if (enclen > 0 && enclen < base64datalen)
+                    base64datalen = enclen;
+            }
             // Shall we really trust the size here ?
 
             ssize_t size;
@@ -3555,21 +4532,20 @@ void SerializedMsgWithSharedBuffer::generateContent()
                 size = 1;
             }
 
-            void * blob = IDSharedBlobAlloc(size);
+            // size is the uncompressed size: the decoded content can be larger for incompressible data
+            ssize_t allocSize = std::max(size, (ssize_t)(3 * (base64datalen / 4) + 3));
+            void * blob = IDSharedBlobAlloc(allocSize);
             if (blob == nullptr)
             {
-                log(fmt("Unable to allocate shared buffer of size %d : %s\n", size, strerror(errno)));
+                log(fmt("Unable to allocate shared buffer of size %lld : %s\n", (long long int)allocSize, strerror(errno)));
                 ::exit(1);
             }
             log(fmt("Blob allocated at %p\n", blob));
 
             int actualLen = from64tobits_fast((char*)blob, base64data, base64datalen);
 
-            if (actualLen != size)
-            {
-                // FIXME: WTF ? at least prevent overflow ???
-                log(fmt("Blob size mismatch after base64dec: %lld vs %lld\n", (long long int)actualLen, (long long int)size));
-            }
+            // Compressed blobs are shorter than their size: tell the actual length to the receiver
+            addXMLAtt(clone, "len", std::to_string(actualLen).c_str());
 
             int newFd = IDSharedBlobGetFd(blob);
             ownSharedBuffers.insert(newFd);
@@ -3607,6 +4583,7 @@ void SerializedMsgWithSharedBuffer::generateContent()
 MsgQueue::MsgQueue(bool useSharedBuffer): useSharedBuffer(useSharedBuffer)
 {
     lp = newLilXML();
+    useArenaXML(lp, 1);
     rio.set<MsgQueue, &MsgQueue::ioCb>(this);
     wio.set<MsgQueue, &MsgQueue::ioCb>(this);
     rFd = -1;
@@ -3633,6 +4610,14 @@ MsgQueue::~MsgQueue()
     }
 }
 
+void MsgQueue::allowRawContent()
+{
+    if (rawContent)
+        return;
+    rawContent = true;
+    allowRawContentXML(lp, 1);
+}
+
 void MsgQueue::closeWritePart()
 {
     if (wFd == -1)
@@ -3647,6 +4632,12 @@ void MsgQueue::closeWritePart()
     // Clear the queue and stop the io slot
     clearMsgQueue();
 
+    if (writerFd != -1)
+    {
+        writer->closeLater(writerFd);
+        writerFd = -1;
+    }
+
     if (oldWFd == rFd)
     {
         if (shutdown(oldWFd, SHUT_WR) == -1)
@@ -3686,6 +4677,12 @@ void MsgQueue::setFds(int rFd, int wFd)
         ::close(this->wFd);
     }
 
+    if (writerFd != -1)
+    {
+        writer->closeLater(writerFd);
+        writerFd = -1;
+    }
+
     this->rFd = rFd;
     this->wFd = wFd;
     this->nsent.reset();
@@ -3699,7 +4696,22 @@ void MsgQueue::setFds(int rFd, int wFd)
         }
 
         rio.set(rFd, ev::READ);
-        wio.set(wFd, ev::WRITE);
+        if (writer)
+        {
+            // The worker owns a private fd, so that it never writes to a reused fd number
+            writerFd = dup(wFd);
+            if (writerFd == -1)
+            {
+                log(fmt("dup: %s\n", strerror(errno)));
+                Bye();
+            }
+            wio.set(writer->evLoop());
+            wio.set(writerFd, ev::WRITE);
+        }
+        else
+        {
+            wio.set(wFd, ev::WRITE);
+        }
         updateIos();
     }
 }
@@ -3745,9 +4757,12 @@ void MsgQueue::updateIos()
         {
             wio.stop();
         }
-        else
+        else if (!wio.is_active())
         {
             wio.start();
+            // The worker loop may be waiting for events. Make it notice the new watcher
+            if (writer)
+                writer->wake();
         }
     }
     if (rFd != -1)
@@ -3818,12 +4833,12 @@ void MsgQueue::ioCb(ev::io &, int revents)
         writeToFd();
 }
 
-size_t MsgQueue::doRead(char * buf, size_t nr)
+ssize_t MsgQueue::doRead(char * buf, size_t nr)
 {
     if (!useSharedBuffer)
     {
         /* read client - works for all kinds of fds incl pipe*/
-        return read(rFd, buf, sizeof(buf));
+        return read(rFd, buf, nr);
     }
     else
     {
@@ -3893,21 +4908,36 @@ void MsgQueue::readFromFd()
 {
     char buf[MAXRBUF];
     ssize_t nr;
+    size_t total = 0;
 
-    /* read client */
-    nr = doRead(buf, sizeof(buf));
-    if (nr <= 0)
+    /* keep reading while full buffers come in, up to readbudget, so large uploads do not cost one
+     * wakeup per buffer. Stop early if the queue gets closed by one of the messages.
+     */
+    do
     {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        /* read client */
+        nr = doRead(buf, sizeof(buf));
+        if (nr <= 0)
+        {
+            if (nr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
 
-        if (nr < 0)
-            log(fmt("read: %s\n", strerror(errno)));
-        else if (verbose > 0)
-            log(fmt("read EOF\n"));
-        close();
-        return;
+            if (nr < 0)
+                log(fmt("read: %s\n", strerror(errno)));
+            else if (verbose > 0)
+                log(fmt("read EOF\n"));
+            close();
+            return;
+        }
+        total += nr;
+
+        if (!processChunk(buf, nr))
+            return;
     }
+    while (nr == sizeof(buf) && total < readbudget);
+}
 
+bool MsgQueue::processChunk(char * buf, ssize_t nr)
+{
     /* process XML chunk */
     char err[1024];
     XMLEle **nodes = parseXMLChunk(lp, buf, nr, err);
@@ -3916,7 +4946,7 @@ void MsgQueue::readFromFd()
         log(fmt("XML error: %s\n", err));
         log(fmt("XML read: %.*s\n", (int)nr, buf));
         close();
-        return;
+        return false;
     }
 
     int inode = 0;
@@ -3936,6 +4966,13 @@ void MsgQueue::readFromFd()
                         tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name")));
             }
 
+            // Not raw content: the parser did not read it as such
+            if (!rawContent && strstr(tagXMLEle(root), "BLOBVector"))
+            {
+                for (auto blobContent : findBlobElements(root))
+                    rmXMLAtt(blobContent, "rawlen");
+            }
+
             onMessage(root, incomingSharedBuffers);
         }
         else
@@ -3948,6 +4985,8 @@ void MsgQueue::readFromFd()
     }
 
     free(nodes);
+
+    return hb.alive() && rFd != -1;
 }
 
 static std::vector<XMLEle *> findBlobElements(XMLEle * root)
@@ -4043,6 +5082,23 @@ static void dettachSharedBuffer(int fd, void * ptr, size_t size)
     }
 }
 
+/* write count bytes of fileFd, from offset, to fd. Does not move the file position */
+static ssize_t sendFileChunk(int fd, int fileFd, off_t offset, size_t count)
+{
+#ifdef __linux__
+    // No copy through user space
+    return sendfile(fd, fileFd, &offset, count);
+#else
+    char buffer[MAXWSIZ];
+    ssize_t nr = pread(fileFd, buffer, std::min(count, sizeof(buffer)), offset);
+    if (nr == 0)
+        errno = EIO;
+    if (nr <= 0)
+        return -1;
+    return write(fd, buffer, nr);
+#endif
+}
+
 static std::string fmt(const char *fmt, ...)
 {
     char buffer[128];
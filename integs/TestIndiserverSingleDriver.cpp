@@ -16,6 +16,7 @@
  Boston, MA 02110-1301, USA.
 *******************************************************************************/
 
+#include <chrono>
 #include <stdexcept>
 #include <stdio.h>
 #include <unistd.h>
@@ -30,6 +31,10 @@
 #include "DriverMock.h"
 #include "IndiServerController.h"
 #include "IndiClientMock.h"
+#include "ServerMock.h"
+
+// Port of the server chained as a driver
+#define TEST_UPSTREAM_TCP_PORT 17625
 
 // Repeat blob operation for more stress
 #define BLOB_REPEAT_COUNT 5
@@ -347,14 +352,14 @@ TEST(IndiserverSingleDriver, ForwardBase64BlobToUnixClient)
     fprintf(stderr, "Client receive blob\n");
     indiClient.cnx.allowBufferReceive(true);
     indiClient.cnx.expectXml("<setBLOBVector device='fakedev1' name='testblob' timestamp='2018-01-01T00:01:00'>");
-    indiClient.cnx.expectXml("<oneBLOB name='content' size='20' format='.fits' attached='true'/>");
+    indiClient.cnx.expectXml("<oneBLOB name='content' size='20' format='.fits' attached='true' len='21'/>");
     indiClient.cnx.expectXml("</setBLOBVector>");
 
     SharedBuffer receivedFd;
     indiClient.cnx.expectBuffer(receivedFd);
     indiClient.cnx.allowBufferReceive(false);
 
-    EXPECT_GE( receivedFd.getSize(), 20);
+    EXPECT_GE( receivedFd.getSize(), 21);
 
     fakeDriver.terminateDriver();
     // Exit code 1 is expected when driver stopped
@@ -482,4 +487,223 @@ TEST(IndiserverSingleDriver, ForwardAttachedBlobToIPClient)
     indiServer.waitProcessEnd(1);
 }
 
+TEST(IndiserverSingleDriver, ForwardRawBlobToIPClient)
+{
+    // This tests blobs sent without base64 to clients that ask for it
+    DriverMock fakeDriver;
+    IndiServerController indiServer;
+
+    startFakeDev1(indiServer, fakeDriver);
+
+    IndiClientMock indiClient;
+
+    indiClient.connectTcp(indiServer);
+
+    connectFakeDev1Client(indiServer, fakeDriver, indiClient);
+
+    fprintf(stderr, "Client ask raw blobs\n");
+    indiClient.cnx.send("<enableBLOB device='fakedev1' name='testblob' encoding='raw'>Also</enableBLOB>\n");
+
+    for(int i = 0; i < BLOB_REPEAT_COUNT; ++i) {
+        indiClient.ping();
+
+        ssize_t size = 32;
+        driverSendAttachedBlob(fakeDriver, size);
+
+        fprintf(stderr, "Client receive attached blob\n");
+        indiClient.cnx.expectXml("<setBLOBVector device='fakedev1' name='testblob' timestamp='2018-01-01T00:01:00'>");
+        indiClient.cnx.expectXml("<oneBLOB name='content' size='" + std::to_string(size) + "' format='.fits' rawlen='" +
+                                 std::to_string(size) + "'>");
+        indiClient.cnx.expect("\n01234567890123456789012345678901");
+        indiClient.cnx.expectXml("</oneBLOB>");
+        indiClient.cnx.expectXml("</setBLOBVector>");
+    }
+
+    fprintf(stderr, "Driver send base64 blob\n");
+    fakeDriver.cnx.send("<setBLOBVector device='fakedev1' name='testblob' timestamp='2018-01-01T00:01:00'>\n");
+    fakeDriver.cnx.send("<oneBLOB name='content' size='21' format='.fits' enclen='28'>\n");
+    fakeDriver.cnx.send("MDEyMzQ1Njc4OTAxMjM0NTY3ODkK\n");
+    fakeDriver.cnx.send("</oneBLOB>\n");
+    fakeDriver.cnx.send("</setBLOBVector>\n");
+    fakeDriver.ping();
+
+    fprintf(stderr, "Client receive decoded blob\n");
+    indiClient.cnx.expectXml("<setBLOBVector device='fakedev1' name='testblob' timestamp='2018-01-01T00:01:00'>");
+    indiClient.cnx.expectXml("<oneBLOB name='content' size='21' format='.fits' rawlen='21'>");
+    indiClient.cnx.expect("\n01234567890123456789\n");
+    indiClient.cnx.expectXml("</oneBLOB>");
+    indiClient.cnx.expectXml("</setBLOBVector>");
+
+    fakeDriver.terminateDriver();
+    // Exit code 1 is expected when driver stopped
+    indiServer.waitProcessEnd(1);
+}
+
+TEST(IndiserverSingleDriver, ForwardRawBlobFromChainedServer)
+{
+    // This tests raw blobs from a chained server, asked for by a client, and converted to base64 for a legacy client
+    ServerMock upstreamServer;
+    IndiServerController indiServer;
+
+    setupSigPipe();
+
+    upstreamServer.listen(TEST_UPSTREAM_TCP_PORT);
+
+    indiServer.start({ "-p", std::to_string(indiServer.getTcpPort()), "-r", "0", "-vvv",
+                       "fakedev1@127.0.0.1:" + std::to_string(TEST_UPSTREAM_TCP_PORT) });
+    fprintf(stderr, "indiserver started\n");
+
+    IndiClientMock upstream;
+    upstreamServer.accept(upstream);
+    upstream.cnx.expectXml("<getProperties device='fakedev1' version='1.7'/>");
+
+    IndiClientMock indiClient;
+    indiClient.connectTcp(indiServer);
+    IndiClientMock legacyClient;
+    legacyClient.connectTcp(indiServer);
+
+    fprintf(stderr, "Clients ask properties\n");
+    indiClient.cnx.send("<getProperties version='1.7'/>\n");
+    upstream.cnx.expectXml("<getProperties version='1.7'/>");
+    legacyClient.cnx.send("<getProperties version='1.7'/>\n");
+    upstream.cnx.expectXml("<getProperties version='1.7'/>");
+
+    upstream.cnx.send("<defBLOBVector device='fakedev1' name='testblob' label='test label' group='test_group' state='Idle' perm='ro' timeout='100' timestamp='2018-01-01T00:00:00'>\n");
+    upstream.cnx.send("<defBLOB name='content' label='content'/>\n");
+    upstream.cnx.send("</defBLOBVector>\n");
+
+    for (auto client : {&indiClient, &legacyClient})
+    {
+        client->cnx.expectXml("<defBLOBVector device='fakedev1' name='testblob' label='test label' group='test_group' state='Idle' perm='ro' timeout='100' timestamp='2018-01-01T00:00:00'>");
+        client->cnx.expectXml("<defBLOB name='content' label='content'/>");
+        client->cnx.expectXml("</defBLOBVector>");
+    }
+
+    fprintf(stderr, "Clients ask blobs\n");
+    indiClient.cnx.send("<enableBLOB device='fakedev1' name='testblob' encoding='raw'>Also</enableBLOB>\n");
+    upstream.cnx.expectXml("<enableBLOB device='fakedev1' name='testblob' encoding='raw'>");
+    upstream.cnx.expect("\nAlso");
+    upstream.cnx.expectXml("</enableBLOB>");
+    legacyClient.cnx.send("<enableBLOB device='fakedev1' name='testblob'>Also</enableBLOB>\n");
+    upstream.cnx.expectXml("<enableBLOB device='fakedev1' name='testblob'>");
+    upstream.cnx.expect("\nAlso");
+    upstream.cnx.expectXml("</enableBLOB>");
+
+    fprintf(stderr, "Upstream send raw blob\n");
+    upstream.cnx.send("<setBLOBVector device='fakedev1' name='testblob' timestamp='2018-01-01T00:01:00'>\n");
+    upstream.cnx.send("<oneBLOB name='content' size='11' format='.fits' rawlen='11'>\n");
+    upstream.cnx.send(std::string("0123<\0/>\xff\n", 11));
+    upstream.cnx.send("\n</oneBLOB>\n");
+    upstream.cnx.send("</setBLOBVector>\n");
+
+    fprintf(stderr, "Client receive raw blob\n");
+    indiClient.cnx.expectXml("<setBLOBVector device='fakedev1' name='testblob' timestamp='2018-01-01T00:01:00'>");
+    indiClient.cnx.expectXml("<oneBLOB name='content' size='11' format='.fits' rawlen='11'>");
+    indiClient.cnx.expect(std::string("\n0123<\0/>\xff\n", 12));
+    indiClient.cnx.expectXml("</oneBLOB>");
+    indiClient.cnx.expectXml("</setBLOBVector>");
+
+    fprintf(stderr, "Legacy client receive base64 blob\n");
+    legacyClient.cnx.expectXml("<setBLOBVector device='fakedev1' name='testblob' timestamp='2018-01-01T00:01:00'>");
+    legacyClient.cnx.expectXml("<oneBLOB name='content' size='11' format='.fits'>");
+    legacyClient.cnx.expect("\nMDEyMzwALz7/CgA=");
+    legacyClient.cnx.expectXml("</oneBLOB>");
+    legacyClient.cnx.expectXml("</setBLOBVector>");
+
+    upstream.cnx.shutdown(true, true);
+    // Exit code 1 is expected when driver stopped
+    indiServer.waitProcessEnd(1);
+}
+
+TEST(IndiserverSingleDriver, DontParseRawContentFromClient)
+{
+    // Only connections that were asked for raw BLOBs may send raw content
+    DriverMock fakeDriver;
+    IndiServerController indiServer;
+
+    startFakeDev1(indiServer, fakeDriver);
+
+    IndiClientMock indiClient;
+
+    indiClient.connectTcp(indiServer);
+
+    connectFakeDev1Client(indiServer, fakeDriver, indiClient);
+
+    indiClient.cnx.send("<enableBLOB device='fakedev1' name='testblob' encoding='raw'>Also</enableBLOB>\n");
+
+    fprintf(stderr, "Client sends markup as raw text\n");
+    indiClient.cnx.send("<newTextVector device='fakedev1' name='testtext'>\n");
+    indiClient.cnx.send("<oneText name='t' rawlen='10'>\n<a>b</a>\n</oneText>\n");
+    indiClient.cnx.send("</newTextVector>\n");
+
+    fprintf(stderr, "Driver receives it parsed\n");
+    fakeDriver.cnx.expectXml("<newTextVector device='fakedev1' name='testtext'>");
+    fakeDriver.cnx.expectXml("<oneText name='t' rawlen='10'>");
+    fakeDriver.cnx.expectXml("<a>");
+    fakeDriver.cnx.expect("\nb");
+    fakeDriver.cnx.expectXml("</a>");
+    fakeDriver.cnx.expectXml("</oneText>");
+    fakeDriver.cnx.expectXml("</newTextVector>");
+
+    fakeDriver.terminateDriver();
+    // Exit code 1 is expected when driver stopped
+    indiServer.waitProcessEnd(1);
+}
+
+TEST(IndiserverSingleDriver, IngestLargeBase64BlobFromIPClient)
+{
+    // This measures how fast the server reads a large newBLOBVector from a tcp client
+    DriverMock fakeDriver;
+    IndiServerController indiServer;
+
+    startFakeDev1(indiServer, fakeDriver);
+
+    IndiClientMock indiClient;
+
+    indiClient.connectTcp(indiServer);
+
+    connectFakeDev1Client(indiServer, fakeDriver, indiClient);
+
+    // 9 MiB of zeros, formatted like IUUserIOBLOBContextOne does
+    ssize_t size = 9 * 1024 * 1024;
+    ssize_t enclen = 4 * size / 3;
+    std::string base64;
+    for (ssize_t i = 0; i < enclen; i += 72)
+    {
+        base64.append(std::min<ssize_t>(72, enclen - i), 'A');
+        base64 += '\n';
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    fprintf(stderr, "Client send new blob value\n");
+    indiClient.cnx.send("<newBLOBVector device='fakedev1' name='testblob' timestamp='2018-01-01T00:01:00'>\n");
+    indiClient.cnx.send("<oneBLOB name='content' size='" + std::to_string(size) + "' format='.fits' enclen='" + std::to_string(
+                            enclen) + "'>\n");
+    indiClient.cnx.send(base64);
+    indiClient.cnx.send("</oneBLOB>\n");
+    indiClient.cnx.send("</newBLOBVector>\n");
+
+    fprintf(stderr, "Driver receive blob\n");
+    fakeDriver.cnx.allowBufferReceive(true);
+    fakeDriver.cnx.expectXml("<newBLOBVector device='fakedev1' name='testblob' timestamp='2018-01-01T00:01:00'>");
+    fakeDriver.cnx.expectXml("<oneBLOB name='content' size='" + std::to_string(size) + "' format='.fits' attached='true' len='" +
+                             std::to_string(size) + "'/>");
+    fakeDriver.cnx.expectXml("</newBLOBVector>");
+
+    SharedBuffer receivedFd;
+    fakeDriver.cnx.expectBuffer(receivedFd);
+    fakeDriver.cnx.allowBufferReceive(false);
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "Ingested %.1f MB of base64 in %.3fs: %.1f MB/s\n",
+            base64.size() / 1e6, elapsed, base64.size() / 1e6 / elapsed);
+
+    EXPECT_GE(receivedFd.getSize(), size);
+
+    fakeDriver.terminateDriver();
+    // Exit code 1 is expected when driver stopped
+    indiServer.waitProcessEnd(1);
+}
+
 #endif
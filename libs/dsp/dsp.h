@@ -484,6 +484,26 @@ DLL_EXPORT double* dsp_fourier_complex_array_get_magnitude(dsp_complex in, int l
 */
 DLL_EXPORT double* dsp_fourier_complex_array_get_phase(dsp_complex in, int len);
 
+/**
+* \brief Load the FFTW wisdom from a file and save it back there when new plans are created
+* Plans are then measured instead of estimated, the first transform of each size is slower.
+* \param filename the wisdom file, NULL to stop saving the wisdom.
+* \return non-zero if the wisdom was loaded
+*/
+DLL_EXPORT int dsp_fourier_wisdom_set_file(const char *filename);
+
+/**
+* \brief Set the number of threads used by each Fourier transform
+* Does nothing if FFTW was built without threads support.
+* \param threads the number of threads.
+*/
+DLL_EXPORT void dsp_fourier_set_threads(int threads);
+
+/**
+* \brief Destroy the cached Fourier transform plans
+*/
+DLL_EXPORT void dsp_fourier_plans_free(void);
+
 /**\}*/
 /**
  * \defgroup dsp_Filters DSP API Linear buffer filtering functions
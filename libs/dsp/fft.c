@@ -20,6 +20,158 @@
 #include "dsp.h"
 #include <fftw3.h>
 
+/* Plans are created once per layout and reused, the most recently used first */
+#define DSP_FOURIER_MAX_PLANS 32
+
+typedef struct dsp_fourier_plan_t {
+    fftw_plan plan;
+    int direction;
+    int dims;
+    int *sizes;
+    int in_alignment;
+    int out_alignment;
+    /* Transforms running with the plan, it is destroyed once unused and out of the cache */
+    int users;
+    int cached;
+    struct dsp_fourier_plan_t *next;
+} dsp_fourier_plan;
+
+static dsp_fourier_plan *dsp_fourier_plans = NULL;
+static pthread_mutex_t dsp_fourier_plans_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char *dsp_fourier_wisdom_filename = NULL;
+static int dsp_fourier_threads_initialized = 0;
+
+static void dsp_fourier_plan_destroy(dsp_fourier_plan *entry)
+{
+    fftw_destroy_plan(entry->plan);
+    free(entry->sizes);
+    free(entry);
+}
+
+static void dsp_fourier_plan_uncache(dsp_fourier_plan *entry)
+{
+    entry->cached = 0;
+    if(entry->users == 0)
+        dsp_fourier_plan_destroy(entry);
+}
+
+static void dsp_fourier_plans_clear(void)
+{
+    while(dsp_fourier_plans != NULL) {
+        dsp_fourier_plan *entry = dsp_fourier_plans;
+        dsp_fourier_plans = entry->next;
+        dsp_fourier_plan_uncache(entry);
+    }
+}
+
+static dsp_fourier_plan *dsp_fourier_plan_acquire(int direction, int dims, int *sizes, void *in, void *out)
+{
+    int in_alignment = fftw_alignment_of((double*)in);
+    int out_alignment = fftw_alignment_of((double*)out);
+    dsp_fourier_plan *entry;
+    dsp_fourier_plan **link;
+    int count = 0;
+    pthread_mutex_lock(&dsp_fourier_plans_mutex);
+    for(link = &dsp_fourier_plans; *link != NULL; link = &(*link)->next) {
+        entry = *link;
+        if(entry->direction == direction && entry->dims == dims &&
+           entry->in_alignment == in_alignment && entry->out_alignment == out_alignment &&
+           !memcmp(entry->sizes, sizes, sizeof(int) * dims)) {
+            *link = entry->next;
+            entry->next = dsp_fourier_plans;
+            dsp_fourier_plans = entry;
+            entry->users++;
+            pthread_mutex_unlock(&dsp_fourier_plans_mutex);
+            return entry;
+        }
+    }
+    /* The FFTW planner is not thread safe. Measuring is only worth it when the wisdom is kept */
+    unsigned flags = dsp_fourier_wisdom_filename != NULL ? FFTW_MEASURE : FFTW_ESTIMATE_PATIENT;
+    fftw_plan plan;
+    if(direction == FFTW_FORWARD)
+        plan = fftw_plan_dft_r2c(dims, sizes, (double*)in, (fftw_complex*)out, flags);
+    else
+        plan = fftw_plan_dft_c2r(dims, sizes, (fftw_complex*)in, (double*)out, flags);
+    if(plan == NULL) {
+        pthread_mutex_unlock(&dsp_fourier_plans_mutex);
+        return NULL;
+    }
+    if(dsp_fourier_wisdom_filename != NULL)
+        fftw_export_wisdom_to_filename(dsp_fourier_wisdom_filename);
+    entry = (dsp_fourier_plan*)malloc(sizeof(dsp_fourier_plan));
+    entry->plan = plan;
+    entry->direction = direction;
+    entry->dims = dims;
+    entry->sizes = (int*)malloc(sizeof(int) * dims);
+    memcpy(entry->sizes, sizes, sizeof(int) * dims);
+    entry->in_alignment = in_alignment;
+    entry->out_alignment = out_alignment;
+    entry->users = 1;
+    entry->cached = 1;
+    entry->next = dsp_fourier_plans;
+    dsp_fourier_plans = entry;
+    /* Drop the least recently used plans */
+    for(link = &dsp_fourier_plans; *link != NULL; count++) {
+        if(count < DSP_FOURIER_MAX_PLANS) {
+            link = &(*link)->next;
+            continue;
+        }
+        dsp_fourier_plan *oldest = *link;
+        *link = oldest->next;
+        dsp_fourier_plan_uncache(oldest);
+    }
+    pthread_mutex_unlock(&dsp_fourier_plans_mutex);
+    return entry;
+}
+
+static void dsp_fourier_plan_release(dsp_fourier_plan *entry)
+{
+    pthread_mutex_lock(&dsp_fourier_plans_mutex);
+    entry->users--;
+    if(entry->users == 0 && !entry->cached)
+        dsp_fourier_plan_destroy(entry);
+    pthread_mutex_unlock(&dsp_fourier_plans_mutex);
+}
+
+int dsp_fourier_wisdom_set_file(const char *filename)
+{
+    int ret = 0;
+    pthread_mutex_lock(&dsp_fourier_plans_mutex);
+    free(dsp_fourier_wisdom_filename);
+    dsp_fourier_wisdom_filename = NULL;
+    if(filename != NULL) {
+        dsp_fourier_wisdom_filename = strdup(filename);
+        ret = fftw_import_wisdom_from_filename(filename);
+    }
+    pthread_mutex_unlock(&dsp_fourier_plans_mutex);
+    return ret;
+}
+
+void dsp_fourier_set_threads(int threads)
+{
+#ifdef HAVE_FFTW3_THREADS
+    pthread_mutex_lock(&dsp_fourier_plans_mutex);
+    if(!dsp_fourier_threads_initialized)
+        dsp_fourier_threads_initialized = fftw_init_threads();
+    if(dsp_fourier_threads_initialized) {
+        /* The number of threads is fixed when a plan is created */
+        dsp_fourier_plans_clear();
+        fftw_plan_with_nthreads(threads > 1 ? threads : 1);
+    }
+    pthread_mutex_unlock(&dsp_fourier_plans_mutex);
+#else
+    (void)threads;
+    (void)dsp_fourier_threads_initialized;
+#endif
+}
+
+void dsp_fourier_plans_free(void)
+{
+    pthread_mutex_lock(&dsp_fourier_plans_mutex);
+    dsp_fourier_plans_clear();
+    pthread_mutex_unlock(&dsp_fourier_plans_mutex);
+}
+
 static void dsp_fourier_dft_magnitude(dsp_stream_p stream)
 {
     if(stream->magnitude)
@@ -141,14 +293,14 @@ void dsp_fourier_dft(dsp_stream_p stream, int exp)
         stream->phase = dsp_stream_copy(stream);
     if(stream->magnitude == NULL)
         stream->magnitude = dsp_stream_copy(stream);
+    /* Planning may overwrite the arrays, fill them afterwards */
+    dsp_fourier_plan *plan = dsp_fourier_plan_acquire(FFTW_FORWARD, stream->dims, stream->sizes, buf, stream->dft.pairs);
     dsp_buffer_set(stream->dft.buf, stream->len * 2, 0);
     dsp_buffer_copy(stream->buf, buf, stream->len);
-    int *sizes = (int*)malloc(sizeof(int)*stream->dims);
-    dsp_buffer_reverse(sizes, stream->dims);
-    fftw_plan plan = fftw_plan_dft_r2c(stream->dims, stream->sizes, buf, stream->dft.pairs, FFTW_ESTIMATE_PATIENT);
-    fftw_execute(plan);
-    fftw_free(plan);
-    free(sizes);
+    if(plan != NULL) {
+        fftw_execute_dft_r2c(plan->plan, buf, stream->dft.pairs);
+        dsp_fourier_plan_release(plan);
+    }
     free(buf);
     dsp_fourier_2dsp(stream);
     if(exp > 1) {
@@ -174,14 +326,13 @@ void dsp_fourier_idft(dsp_stream_p stream)
     double *buf = (double*)malloc(sizeof(double)*stream->len);
     dsp_t mn = dsp_stats_min(stream->buf, stream->len);
     dsp_t mx = dsp_stats_max(stream->buf, stream->len);
+    dsp_fourier_plan *plan = dsp_fourier_plan_acquire(FFTW_BACKWARD, stream->dims, stream->sizes, stream->dft.pairs, buf);
     dsp_buffer_set(buf, stream->len, 0);
     dsp_fourier_2complex_t(stream);
-    int *sizes = (int*)malloc(sizeof(int)*stream->dims);
-    dsp_buffer_reverse(sizes, stream->dims);
-    fftw_plan plan = fftw_plan_dft_c2r(stream->dims, stream->sizes, stream->dft.pairs, buf, FFTW_ESTIMATE_PATIENT);
-    fftw_execute(plan);
-    fftw_free(plan);
-    free(sizes);
+    if(plan != NULL) {
+        fftw_execute_dft_c2r(plan->plan, stream->dft.pairs, buf);
+        dsp_fourier_plan_release(plan);
+    }
     dsp_buffer_stretch(buf, stream->len, mn, mx);
     dsp_buffer_copy(buf, stream->buf, stream->len);
     dsp_buffer_shift(stream->magnitude);
@@ -20,6 +20,7 @@
 #define WIN32_LEAN_AND_MEAN
 
 #include "baseclient.h"
+#include "clientreactor.h"
 
 #include "indistandardproperty.h"
 #include "base64.h"
@@ -161,6 +162,14 @@ static const char * unixDomainPrefix = "localhost:";
 
 static const char * unixDefaultPath = "/tmp/indiserver";
 
+#ifndef _WINDOWS
+// Addresses of this host, for which the local domain socket is tried first
+static bool isLocalHost(const std::string &host)
+{
+    return host == "localhost" || host == "127.0.0.1" || host == "::1";
+}
+#endif
+
 bool BaseClientPrivate::establish(const std::string &cServer)
 {
     struct sockaddr_un serv_addr_un;
@@ -345,6 +354,7 @@ bool BaseClientPrivate::establish(const std::string &cServer)
 
 bool BaseClientPrivate::connect()
 {
+    bool useReactor = false;
     {
         std::unique_lock<std::mutex> locker(sSocketBusy);
         if (sConnected == true)
@@ -367,7 +377,8 @@ bool BaseClientPrivate::connect()
 
 #ifndef _WINDOWS
         // System with unix support automatically connect over unix domain
-        if (cServer == "localhost")
+        // This is where blobs are received as shared buffers, without base64 encoding
+        if (isLocalHost(cServer))
         {
             if (!(establish(unixDomainPrefix) || establish(cServer)))
                 return false;
@@ -400,10 +411,35 @@ bool BaseClientPrivate::connect()
         sConnected = true;
         sAboutToClose = false;
         sSocketChanged.notify_all();
-        std::thread(std::bind(&BaseClientPrivate::listenINDI, this)).detach();
+        useReactor = reactor != nullptr && reactor->isRunning();
+        if (!useReactor)
+            std::thread(std::bind(&BaseClientPrivate::listenINDI, this)).detach();
+        else
+            openParser();
     }
     parent->serverConnected();
 
+    if (useReactor)
+    {
+        // The threads of the reactor read the connection from now on
+        sendGetProperties();
+
+        auto onReadable = [this](char *buffer, size_t size)
+        {
+            return readINDI(buffer, size);
+        };
+        auto onClosed = [this]()
+        {
+            closeConnection();
+        };
+        if (!reactor->add(sockfd, onReadable, onClosed))
+        {
+            IDLog("INDI::BaseClient::connectServer: Unable to register the connection with the reactor.\n");
+            closeConnection();
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -429,7 +465,7 @@ bool BaseClientPrivate::disconnect(int exit_code)
     WSACleanup();
     sockfd = INVALID_SOCKET;
 #else
-    shutdown(sockfd, SHUT_RDWR); // no needed
+    shutdown(sockfd, SHUT_RDWR); // wakes up the reactor
     size_t c = 1;
     // wakeup 'select' function
     ssize_t ret = write(sendFd, &c, sizeof(c));
@@ -442,22 +478,8 @@ bool BaseClientPrivate::disconnect(int exit_code)
     return true;
 }
 
-void BaseClientPrivate::listenINDI()
+void BaseClientPrivate::sendGetProperties()
 {
-    char buffer[MAXINDIBUF];
-    char msg[MAXRBUF];
-#ifdef _WINDOWS
-    SOCKET maxfd = 0;
-#else
-    int maxfd = 0;
-#endif
-    fd_set rs;
-    XMLEle **nodes = nullptr;
-    XMLEle *root = nullptr;
-    int inode = 0;
-
-    connect();
-
     if (cDeviceNames.empty())
     {
         IUUserIOGetProperties(&io, this, nullptr, nullptr);
@@ -486,6 +508,32 @@ void BaseClientPrivate::listenINDI()
             }
         }
     }
+}
+
+void BaseClientPrivate::openParser()
+{
+    clear();
+    lillp = newLilXML();
+    rawParsing = rawBlobs;
+    allowRawContentXML(lillp, rawParsing);
+    useArenaXML(lillp, 1);
+    // base64 BLOBs are decoded as they come, BaseDevice takes the buffers
+    setBLOBSinkXML(lillp, realloc, free);
+}
+
+void BaseClientPrivate::listenINDI()
+{
+    char buffer[MAXINDIBUF];
+#ifdef _WINDOWS
+    SOCKET maxfd = 0;
+#else
+    int maxfd = 0;
+#endif
+    fd_set rs;
+
+    connect();
+
+    sendGetProperties();
 
     FD_ZERO(&rs);
 
@@ -497,12 +545,10 @@ void BaseClientPrivate::listenINDI()
     maxfd = std::max(maxfd, receiveFd);
 #endif
 
-    clear();
-    LilXML *lillp = newLilXML();
-    bool clientFatalError = false;
+    openParser();
 
     /* read from server, exit if find all requested properties */
-    while ((!sAboutToClose) && (!clientFatalError))
+    while (!sAboutToClose)
     {
         int n = select(maxfd + 1, &rs, nullptr, nullptr, nullptr);
 
@@ -523,141 +569,162 @@ void BaseClientPrivate::listenINDI()
             continue;
         }
 
-        if (FD_ISSET(sockfd, &rs))
+        if (FD_ISSET(sockfd, &rs) && !readINDI(buffer, MAXINDIBUF))
         {
+            break;
+        }
+    }
+
+    closeConnection();
+}
+
+bool BaseClientPrivate::readINDI(char *buffer, size_t size)
+{
+    char msg[MAXRBUF];
+    XMLEle **nodes = nullptr;
+    XMLEle *root = nullptr;
+    int inode = 0;
+    int n;
+
+    // Woken up by disconnectServer function.
+    if (sAboutToClose)
+    {
+        return false;
+    }
+
 #ifdef _WINDOWS
-            n = recv(sockfd, buffer, MAXINDIBUF, 0);
+    n = recv(sockfd, buffer, static_cast<int>(size), 0);
 #else
-            // Use recvmsg for ancillary data
-            struct msghdr msgh;
-            struct iovec iov;
+    // Use recvmsg for ancillary data
+    struct msghdr msgh;
+    struct iovec iov;
 
-            union
-            {
-                struct cmsghdr cmsgh;
-                /* Space large enough to hold an 'int' */
-                char control[CMSG_SPACE(MAXFD_PER_MESSAGE * sizeof(int))];
-            } control_un;
-
-            iov.iov_base = buffer;
-            iov.iov_len = MAXINDIBUF;
-
-            msgh.msg_name = NULL;
-            msgh.msg_namelen = 0;
-            msgh.msg_iov = &iov;
-            msgh.msg_iovlen = 1;
-            msgh.msg_flags = 0;
-            msgh.msg_control = control_un.control;
-            msgh.msg_controllen = sizeof(control_un.control);
-
-            int recvflag = MSG_DONTWAIT;
+    union
+    {
+        struct cmsghdr cmsgh;
+        /* Space large enough to hold an 'int' */
+        char control[CMSG_SPACE(MAXFD_PER_MESSAGE * sizeof(int))];
+    } control_un;
+
+    iov.iov_base = buffer;
+    iov.iov_len = size;
+
+    msgh.msg_name = NULL;
+    msgh.msg_namelen = 0;
+    msgh.msg_iov = &iov;
+    msgh.msg_iovlen = 1;
+    msgh.msg_flags = 0;
+    msgh.msg_control = control_un.control;
+    msgh.msg_controllen = sizeof(control_un.control);
+
+    int recvflag = MSG_DONTWAIT;
 #ifdef __linux__
-            recvflag |= MSG_CMSG_CLOEXEC;
+    recvflag |= MSG_CMSG_CLOEXEC;
 #endif
-            n = recvmsg(sockfd, &msgh, recvflag);
+    n = recvmsg(sockfd, &msgh, recvflag);
 
-            if (n >= 0)
+    if (n >= 0)
+    {
+        for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msgh); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msgh, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
             {
-                for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msgh); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msgh, cmsg))
+                int fdCount = 0;
+                while(cmsg->cmsg_len >= CMSG_LEN((fdCount + 1) * sizeof(int)))
+                {
+                    fdCount++;
+                }
+                //IDLog("Received %d fds\n", fdCount);
+                int * fds = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+                for(int i = 0; i < fdCount; ++i)
                 {
-                    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
-                    {
-                        int fdCount = 0;
-                        while(cmsg->cmsg_len >= CMSG_LEN((fdCount + 1) * sizeof(int)))
-                        {
-                            fdCount++;
-                        }
-                        //IDLog("Received %d fds\n", fdCount);
-                        int * fds = reinterpret_cast<int*>(CMSG_DATA(cmsg));
-                        for(int i = 0; i < fdCount; ++i)
-                        {
-                            int fd = fds[i];
-                            //IDLog("Received fd %d\n", fd);
+                    int fd = fds[i];
+                    //IDLog("Received fd %d\n", fd);
 #ifndef __linux__
-                            fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+                    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
 #endif
-                            incomingSharedBuffers.push_back(fd);
-                        }
-                    }
-                    else
-                    {
-                        IDLog("Ignoring ancillary data level %d, type %d\n", cmsg->cmsg_level, cmsg->cmsg_type);
-                    }
+                    incomingSharedBuffers.push_back(fd);
                 }
             }
-#endif
-            if (n < 0)
-            {
-                continue;
-            }
-
-            if (n == 0)
+            else
             {
-                IDLog("INDI server %s/%d disconnected.\n", cServer.c_str(), cPort);
-                break;
+                IDLog("Ignoring ancillary data level %d, type %d\n", cmsg->cmsg_level, cmsg->cmsg_type);
             }
+        }
+    }
+#endif
+    if (n < 0)
+    {
+        return true;
+    }
 
-            nodes = parseXMLChunk(lillp, buffer, n, msg);
-
-            if (!nodes)
-            {
-                if (msg[0])
-                {
-                    IDLog("Bad XML from %s/%d: %s\n%s\n", cServer.c_str(), cPort, msg, buffer);
-                }
-                break;
-            }
-            root = nodes[inode];
-            while (root)
-            {
-                if (verbose)
-                    prXMLEle(stderr, root, 0);
+    if (n == 0)
+    {
+        IDLog("INDI server %s/%d disconnected.\n", cServer.c_str(), cPort);
+        return false;
+    }
 
-                std::vector<std::string> blobs;
+    nodes = parseXMLChunk(lillp, buffer, n, msg);
 
-                if (!parseAttachedBlobs(root, blobs))
-                {
-                    IDLog("Missing attachment from %s/%d\n", cServer.c_str(), cPort);
-                    clientFatalError = true;
-                    break;
-                }
-                int err_code;
-                try
-                {
-                    err_code = dispatchCommand(root, msg);
-                }
-                catch(...)
-                {
-                    releaseBlobUids(blobs);
-                    throw;
-                }
-                releaseBlobUids(blobs);
+    if (!nodes)
+    {
+        if (msg[0])
+        {
+            IDLog("Bad XML from %s/%d: %s\n%s\n", cServer.c_str(), cPort, msg, buffer);
+        }
+        return false;
+    }
+    root = nodes[inode];
+    while (root)
+    {
+        if (verbose)
+            prXMLEle(stderr, root, 0);
 
-                if (err_code < 0)
-                {
-                    // Silenty ignore property duplication errors
-                    if (err_code != INDI_PROPERTY_DUPLICATED)
-                    {
-                        IDLog("Dispatch command error(%d): %s\n", err_code, msg);
-                        prXMLEle(stderr, root, 0);
-                    }
-                }
+        std::vector<std::string> blobs;
 
-                delXMLEle(root); // not yet, delete and continue
-                inode++;
-                root = nodes[inode];
-            }
+        if (!parseAttachedBlobs(root, blobs))
+        {
+            IDLog("Missing attachment from %s/%d\n", cServer.c_str(), cPort);
+            for (; nodes[inode]; inode++)
+                delXMLEle(nodes[inode]);
             free(nodes);
-            inode = 0;
+            return false;
+        }
+        int err_code;
+        try
+        {
+            err_code = dispatchCommand(root, msg);
+        }
+        catch(...)
+        {
+            releaseBlobUids(blobs);
+            throw;
+        }
+        releaseBlobUids(blobs);
 
-            if (clientFatalError)
+        if (err_code < 0)
+        {
+            // Silenty ignore property duplication errors
+            if (err_code != INDI_PROPERTY_DUPLICATED)
             {
-                break;
+                IDLog("Dispatch command error(%d): %s\n", err_code, msg);
+                prXMLEle(stderr, root, 0);
             }
         }
+
+        delXMLEle(root); // not yet, delete and continue
+        inode++;
+        root = nodes[inode];
     }
+    free(nodes);
 
+    return true;
+}
+
+void BaseClientPrivate::closeConnection()
+{
     delLilXML(lillp);
+    lillp = nullptr;
 
     int exit_code;
 
@@ -1160,6 +1227,12 @@ void INDI::BaseClient::setConnectionTimeout(uint32_t seconds, uint32_t microseco
     d->timeout_us  = microseconds;
 }
 
+void INDI::BaseClient::setReactor(INDI::ClientReactor *reactor)
+{
+    D_PTR(BaseClient);
+    d->reactor = reactor;
+}
+
 void INDI::BaseClient::setServer(const char *hostname, unsigned int port)
 {
     D_PTR(BaseClient);
@@ -1412,7 +1485,7 @@ void INDI::BaseClient::setBLOBMode(BLOBHandling blobH, const char *dev, const ch
         bMode->blobMode = blobH;
     }
 
-    IUUserIOEnableBLOB(&io, d, dev, prop, blobH);
+    IUUserIOEnableBLOBEncoding(&io, d, dev, prop, blobH, d->rawParsing ? "raw" : nullptr);
 }
 
 void INDI::BaseClient::enableDirectBlobAccess(const char * dev, const char * prop)
@@ -1421,6 +1494,12 @@ void INDI::BaseClient::enableDirectBlobAccess(const char * dev, const char * pro
     d->enableDirectBlobAccess(dev, prop);
 }
 
+void INDI::BaseClient::enableRawBlobs(bool enable)
+{
+    D_PTR(BaseClient);
+    d->rawBlobs = enable;
+}
+
 BLOBHandling INDI::BaseClient::getBLOBMode(const char *dev, const char *prop)
 {
     D_PTR(BaseClient);
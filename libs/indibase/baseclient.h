@@ -39,7 +39,8 @@
  *  notifications upon reception of new devices or properties.
  *
  *  Upon connecting to an INDI server, it creates a dedicated thread to handle all incoming traffic. The thread is terminated
- *  when disconnectServer() is called or when a communication error occurs.
+ *  when disconnectServer() is called or when a communication error occurs. Clients connecting to many servers can share
+ *  the threads of an INDI::ClientReactor instead, see setReactor().
  *
  *  @attention All notifications functions defined in INDI::BaseMediator <b>must</b> be implemented in the client class even if
  *  they are not used because these are pure virtual functions.
@@ -52,6 +53,7 @@
 namespace INDI
 {
 class BaseClientPrivate;
+class ClientReactor;
 }
 class INDI::BaseClient : public INDI::BaseMediator
 {
@@ -63,6 +65,9 @@ class INDI::BaseClient : public INDI::BaseMediator
 
     public:
         /** @brief Set the server host name and port.
+         *  For localhost (or 127.0.0.1, ::1), the local domain socket of the server is tried first: BLOBs are then
+         *  received as shared memory buffers instead of base64 (see enableDirectBlobAccess).
+         *  "localhost:<path>" connects to the local domain socket at path.
          *  @param hostname INDI server host name or IP address.
          *  @param port INDI server port.
          */
@@ -97,6 +102,16 @@ class INDI::BaseClient : public INDI::BaseMediator
          */
         void setConnectionTimeout(uint32_t seconds, uint32_t microseconds);
 
+        /** @brief setReactor Read the server from the threads of a shared reactor instead of a thread of its own.
+         *
+         *  Takes effect on the next connectServer. The notification functions are then called from the threads
+         *  of the reactor, still in order for a given client. When the reactor is not supported on this system,
+         *  the client keeps its own thread.
+         *  @param reactor Reactor shared with other clients, it must outlive the connection. nullptr to use a thread again.
+         *  @see INDI::ClientReactor
+         */
+        void setReactor(INDI::ClientReactor *reactor);
+
         void serverDisconnected(int exit_code) override;
 
     public:
@@ -192,6 +207,7 @@ class INDI::BaseClient : public INDI::BaseMediator
 
         /** @brief activate zero-copy delivering of the blob content.
          * When enabled, all blob copy will be avoided when possible (depending on the connection).
+         * Over the local domain socket, IBLOB.blob is then the read-only mapping of the buffer sent by the server.
          * This changes how the IBLOB.data field :
          * <ul>
          *   <li>it will point to readonly data: The client must not try to modify its content or realloc it</li>
@@ -202,6 +218,14 @@ class INDI::BaseClient : public INDI::BaseMediator
          */
         void enableDirectBlobAccess(const char * dev = nullptr, const char * prop = nullptr);
 
+        /** @brief ask the server to send BLOBs as raw bytes instead of base64.
+         * Takes effect from the next connection: the request is then carried by the setBLOBMode calls.
+         * Servers that do not support it keep sending base64, which is still decoded transparently.
+         * Has no effect on local connections, where BLOBs are already exchanged as shared buffers.
+         *  @param enable true to request raw BLOBs
+         */
+        void enableRawBlobs(bool enable = true);
+
         /** @brief Send new Text command to server */
         void sendNewText(ITextVectorProperty *pp);
         /** @brief Send new Text command to server */
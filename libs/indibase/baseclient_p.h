@@ -24,6 +24,7 @@ namespace INDI
 {
 
 class BaseDevice;
+class ClientReactor;
 
 struct BLOBMode
 {
@@ -57,6 +58,16 @@ class BaseClientPrivate
         /** @brief clear Clear devices and blob modes */
         void clear();
 
+        /** @brief Ask the server for the properties of the watched devices */
+        void sendGetProperties();
+        /** @brief Clear devices and create the parser of the new connection */
+        void openParser();
+        /** @brief Read the data available on the socket and dispatch the messages received
+         *  @return false once the connection is over */
+        bool readINDI(char *buffer, size_t size);
+        /** @brief Close the socket and the parser, notify serverDisconnected and clear devices */
+        void closeConnection();
+
     public:
         BLOBMode *findBLOBMode(const std::string &device, const std::string &property);
         void enableDirectBlobAccess(const char * dev = nullptr, const char * prop = nullptr);
@@ -103,11 +114,18 @@ class BaseClientPrivate
         int sendFd {-1};
 #endif
 
+        // Reads the connection instead of a thread of its own when set
+        ClientReactor *reactor {nullptr};
+        LilXML *lillp {nullptr};
+
         std::vector<INDI::BaseDevice *> cDevices;
         std::set<std::string> cDeviceNames;
         std::list<BLOBMode> blobModes;
         std::map<std::string, std::set<std::string>> cWatchProperties;
         std::map<std::string, std::set<std::string>> directBlobAccess;
+        bool rawBlobs {false};
+        // Raw BLOBs can be parsed on the current connection
+        bool rawParsing {false};
 
         std::string cServer;
         uint32_t cPort;
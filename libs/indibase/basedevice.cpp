@@ -34,6 +34,7 @@
 
 #include <cerrno>
 #include <cassert>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 #include <zlib.h>
@@ -52,6 +53,19 @@
 namespace INDI
 {
 
+// The elements of a vector usually come in the order its widgets were defined, try the next one first
+template <typename T>
+static WidgetView<T> *findNextWidget(PropertyView<T> *property, const char *name, int &next)
+{
+    if (next < property->count() && property->at(next)->isNameMatch(name))
+        return property->at(next++);
+
+    auto widget = property->findWidgetByName(name);
+    if (widget)
+        next = widget - property->begin() + 1;
+    return widget;
+}
+
 BaseDevicePrivate::BaseDevicePrivate()
 {
     static char indidev[] = "INDIDEV=";
@@ -70,6 +84,15 @@ BaseDevicePrivate::~BaseDevicePrivate()
     pAll.clear();
 }
 
+void BaseDevicePrivate::indexProperty(const std::string &name, const INDI::Property &property)
+{
+    // Lookups by name return the first property of pAll with that name, so an indexed one is kept.
+    // It is replaced only once renamed.
+    auto indexed = pIndex.emplace(name, property);
+    if (!indexed.second && !indexed.first->second.isNameMatch(name))
+        indexed.first->second = property;
+}
+
 BaseDevice::BaseDevice()
     : d_ptr(new BaseDevicePrivate)
 { }
@@ -135,6 +158,16 @@ INDI::Property BaseDevice::getProperty(const char *name, INDI_PROPERTY_TYPE type
     D_PTR(const BaseDevice);
     std::lock_guard<std::mutex> lock(d->m_Lock);
 
+    d->pIndexKey.assign(name);
+    auto it = d->pIndex.find(d->pIndexKey);
+    if (it != d->pIndex.end())
+    {
+        const auto &oneProp = it->second;
+        if ((type == oneProp.getType() || type == INDI_UNKNOWN) && oneProp.getRegistered() && oneProp.isNameMatch(name))
+            return oneProp;
+    }
+
+    // Not indexed: another property with the same name but another type, or renamed after it was added
     for (const auto &oneProp : getProperties())
     {
         if (type != oneProp.getType() && type != INDI_UNKNOWN)
@@ -198,6 +231,7 @@ int BaseDevice::removeProperty(const char *name, char *errmsg)
         else
             return false;
     });
+    d->pIndex.erase(name);
 
     if (result != 0)
         snprintf(errmsg, MAXRBUF, "Error: Property %s not found in device %s.", name, getDeviceName());
@@ -491,6 +525,7 @@ int BaseDevice::buildProp(XMLEle *root, char *errmsg, bool isDynamic)
 
     std::unique_lock<std::mutex> lock(d->m_Lock);
     d->pAll.push_back(indiProp);
+    d->indexProperty(rname, indiProp);
     lock.unlock();
 
     //IDLog("Adding number property %s to list.\n", indiProp->getName());
@@ -575,9 +610,10 @@ int BaseDevice::setValue(XMLEle *root, char *errmsg)
 
         AutoCNumeric locale;
 
+        int next = 0;
         for (ep = nextXMLEle(root, 1); ep != nullptr; ep = nextXMLEle(root, 0))
         {
-            auto np = nvp->findWidgetByName(findXMLAttValu(ep, "name"));
+            auto np = findNextWidget(nvp, findXMLAttValu(ep, "name"), next);
             if (!np)
                 continue;
 
@@ -609,9 +645,10 @@ int BaseDevice::setValue(XMLEle *root, char *errmsg)
         if (timeoutSet)
             tvp->setTimeout(timeout);
 
+        int next = 0;
         for (ep = nextXMLEle(root, 1); ep != nullptr; ep = nextXMLEle(root, 0))
         {
-            auto tp = tvp->findWidgetByName(findXMLAttValu(ep, "name"));
+            auto tp = findNextWidget(tvp, findXMLAttValu(ep, "name"), next);
             if (!tp)
                 continue;
 
@@ -636,9 +673,10 @@ int BaseDevice::setValue(XMLEle *root, char *errmsg)
         if (timeoutSet)
             svp->setTimeout(timeout);
 
+        int next = 0;
         for (ep = nextXMLEle(root, 1); ep != nullptr; ep = nextXMLEle(root, 0))
         {
-            auto sp = svp->findWidgetByName(findXMLAttValu(ep, "name"));
+            auto sp = findNextWidget(svp, findXMLAttValu(ep, "name"), next);
             if (!sp)
                 continue;
 
@@ -662,9 +700,10 @@ int BaseDevice::setValue(XMLEle *root, char *errmsg)
         if (stateSet)
             lvp->setState(state);
 
+        int next = 0;
         for (ep = nextXMLEle(root, 1); ep != nullptr; ep = nextXMLEle(root, 0))
         {
-            auto lp = lvp->findWidgetByName(findXMLAttValu(ep, "name"));
+            auto lp = findNextWidget(lvp, findXMLAttValu(ep, "name"), next);
             if (!lp)
                 continue;
 
@@ -727,16 +766,26 @@ int BaseDevice::setBLOB(IBLOBVectorProperty *bvp, XMLEle *root, char *errmsg)
                 }
 
                 blobEL->size    = blobSize;
+                size_t decodedSize = 0;
 
                 XMLAtt * attachementId = findXMLAtt(ep, "attached-data-id");
                 if (attachementId != nullptr)
                 {
+                    // size is the uncompressed size. len, when present, is the actual length of the buffer
+                    XMLAtt * la = findXMLAtt(ep, "len");
+                    char *end = nullptr;
+                    long blobLen = la ? strtol(valuXMLAtt(la), &end, 10) : blobSize;
+                    if ((la && (end == valuXMLAtt(la) || *end != '\0')) || blobLen <= 0 || blobLen > INT_MAX)
+                    {
+                        snprintf(errmsg, MAXRBUF, "INDI: %s.%s.%s invalid attached BLOB length %s", blobEL->bvp->device,
+                                 blobEL->bvp->name, blobEL->name, la ? valuXMLAtt(la) : valuXMLAtt(sa));
+                        return -1;
+                    }
+
                     // Client mark blob that can be attached directly
                     XMLAtt * directAttachment = findXMLAtt(ep, "attachment-direct");
                     bool directBlobAccess = directAttachment != nullptr;
                     // FIXME: Where is the blob data buffer freed at the end ?
-                    // FIXME: blobSize is not buffer size here. Must pass it all the way through
-                    // (while compressing shared buffer is useless)
                     if (directBlobAccess)
                     {
                         if (blobEL->blob)
@@ -745,17 +794,44 @@ int BaseDevice::setBLOB(IBLOBVectorProperty *bvp, XMLEle *root, char *errmsg)
                             blobEL->blob = nullptr;
                             blobEL->bloblen = 0;
                         }
-                        blobEL->blob = attachBlobByUid(valuXMLAtt(attachementId), blobSize);
+                        blobEL->blob = attachBlobByUid(valuXMLAtt(attachementId), blobLen);
+                        if (blobEL->blob == nullptr)
+                        {
+                            snprintf(errmsg, MAXRBUF, "INDI: %s.%s.%s unable to map the attached BLOB: %s",
+                                     blobEL->bvp->device, blobEL->bvp->name, blobEL->name, strerror(errno));
+                            return -1;
+                        }
                     }
                     else
                     {
                         // For compatibility, copy to a modifiable memory area
-                        blobEL->blob    = static_cast<unsigned char *>(realloc(blobEL->blob, blobSize));
-                        void * tmp = attachBlobByUid(valuXMLAtt(attachementId), blobSize);
-                        memcpy(blobEL->blob, tmp, blobSize);
+                        void * tmp = attachBlobByUid(valuXMLAtt(attachementId), blobLen);
+                        if (tmp == nullptr)
+                        {
+                            snprintf(errmsg, MAXRBUF, "INDI: %s.%s.%s unable to map the attached BLOB: %s",
+                                     blobEL->bvp->device, blobEL->bvp->name, blobEL->name, strerror(errno));
+                            return -1;
+                        }
+                        blobEL->blob    = static_cast<unsigned char *>(realloc(blobEL->blob, blobLen));
+                        memcpy(blobEL->blob, tmp, blobLen);
                         IDSharedBlobFree(tmp);
                     }
-                    blobEL->bloblen = blobSize;
+                    blobEL->bloblen = blobLen;
+                }
+                else if (findXMLAtt(ep, "rawlen") != nullptr)
+                {
+                    // Raw framing: content holds the bytes as is
+                    uint32_t rawSize = pcdatalenXMLEle(ep);
+                    blobEL->blob    = static_cast<unsigned char *>(realloc(blobEL->blob, rawSize));
+                    memcpy(blobEL->blob, pcdataXMLEle(ep), rawSize);
+                    blobEL->bloblen = rawSize;
+                }
+                else if (void *decoded = takeBLOBXMLEle(ep, &decodedSize))
+                {
+                    // Decoded while parsed by the BLOB sink of the client, the buffer is handed over
+                    IDSharedBlobFree(blobEL->blob);
+                    blobEL->blob    = decoded;
+                    blobEL->bloblen = decodedSize;
                 }
                 else
                 {
@@ -914,6 +990,7 @@ void BaseDevice::registerProperty(void *p, INDI_PROPERTY_TYPE type)
     {
         std::lock_guard<std::mutex> lock(d->m_Lock);
         d->pAll.push_back(INDI::Property(p, type));
+        d->indexProperty(name, d->pAll.back());
     }
 }
 
@@ -932,6 +1009,7 @@ void BaseDevice::registerProperty(INDI::Property &property)
     {
         std::lock_guard<std::mutex> lock(d->m_Lock);
         d->pAll.push_back(property);
+        d->indexProperty(property.getName(), property);
     }
 }
 
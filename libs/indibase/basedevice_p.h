@@ -25,6 +25,7 @@
 #include <deque>
 #include <string>
 #include <mutex>
+#include <unordered_map>
 
 namespace INDI
 {
@@ -35,9 +36,16 @@ class BaseDevicePrivate
         BaseDevicePrivate();
         virtual ~BaseDevicePrivate();
 
+        // Add property to pIndex, under m_Lock
+        void indexProperty(const std::string &name, const INDI::Property &property);
+
     public:
         std::string deviceName;
         BaseDevice::Properties pAll;
+        // First property added for each name, kept along pAll under m_Lock
+        std::unordered_map<std::string, INDI::Property> pIndex;
+        // Lookup key, reused so that lookups don't allocate
+        mutable std::string pIndexKey;
         LilXML *lp {nullptr};
         INDI::BaseMediator *mediator {nullptr};
         std::deque<std::string> messageLog;
@@ -0,0 +1,216 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "clientreactor.h"
+
+#include "indidevapi.h"
+#include "indimacros.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+// Same size as the buffer of a client reading from its own thread
+#define READ_BUFFER_SIZE 49152
+
+namespace INDI
+{
+
+#ifdef __linux__
+
+// One shot: once a thread gets a connection, no other thread gets it until it is armed again
+static const uint32_t CONNECTION_EVENTS = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+
+ClientReactor::ClientReactor(size_t threadCount)
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+    {
+        IDLog("ClientReactor: epoll_create1: %s\n", strerror(errno));
+        return;
+    }
+
+    // Level triggered, so it wakes up every thread when terminating
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (wakeFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) < 0)
+    {
+        IDLog("ClientReactor: eventfd: %s\n", strerror(errno));
+        if (wakeFd >= 0)
+            close(wakeFd);
+        close(epollFd);
+        wakeFd = epollFd = -1;
+        return;
+    }
+
+    threadCount = std::max<size_t>(threadCount, 1);
+    for (size_t i = 0; i < threadCount; i++)
+        threads.emplace_back(&ClientReactor::worker, this);
+}
+
+ClientReactor::~ClientReactor()
+{
+    if (epollFd < 0)
+        return;
+
+    terminate = true;
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) != sizeof(one))
+        IDLog("ClientReactor: Error. The threads cannot be woken up.\n");
+
+    for (auto &thread : threads)
+        thread.join();
+
+    std::set<Connection *> left;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        left.swap(connections);
+    }
+    for (auto connection : left)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+        connection->onClosed();
+        delete connection;
+    }
+
+    close(wakeFd);
+    close(epollFd);
+}
+
+bool ClientReactor::isSupported()
+{
+    return true;
+}
+
+bool ClientReactor::add(int fd, ReadHandler onReadable, CloseHandler onClosed)
+{
+    if (epollFd < 0 || terminate)
+        return false;
+
+    auto connection = new Connection{fd, std::move(onReadable), std::move(onClosed)};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        connections.insert(connection);
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = CONNECTION_EVENTS;
+    event.data.ptr = connection;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        IDLog("ClientReactor: epoll_ctl: %s\n", strerror(errno));
+        std::lock_guard<std::mutex> lock(mutex);
+        connections.erase(connection);
+        delete connection;
+        return false;
+    }
+    return true;
+}
+
+void ClientReactor::remove(Connection *connection)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        connections.erase(connection);
+    }
+    connection->onClosed();
+    delete connection;
+}
+
+void ClientReactor::worker()
+{
+    char buffer[READ_BUFFER_SIZE];
+    struct epoll_event event;
+
+    while (!terminate)
+    {
+        int n = epoll_wait(epollFd, &event, 1, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            IDLog("ClientReactor: epoll_wait: %s\n", strerror(errno));
+            break;
+        }
+
+        auto connection = static_cast<Connection *>(event.data.ptr);
+        // Woken up by the destructor
+        if (n == 0 || connection == nullptr)
+            continue;
+
+        bool open = connection->onReadable(buffer, sizeof(buffer));
+        if (open)
+        {
+            event.events = CONNECTION_EVENTS;
+            open = epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event) == 0;
+        }
+
+        if (!open)
+            remove(connection);
+    }
+}
+
+#else
+
+ClientReactor::ClientReactor(size_t threadCount)
+{
+    INDI_UNUSED(threadCount);
+}
+
+ClientReactor::~ClientReactor()
+{ }
+
+bool ClientReactor::isSupported()
+{
+    return false;
+}
+
+bool ClientReactor::add(int fd, ReadHandler onReadable, CloseHandler onClosed)
+{
+    INDI_UNUSED(fd);
+    INDI_UNUSED(onReadable);
+    INDI_UNUSED(onClosed);
+    return false;
+}
+
+void ClientReactor::remove(Connection *connection)
+{
+    INDI_UNUSED(connection);
+}
+
+void ClientReactor::worker()
+{ }
+
+#endif
+
+size_t ClientReactor::connectionCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return connections.size();
+}
+
+}
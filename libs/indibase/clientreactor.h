@@ -0,0 +1,108 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace INDI
+{
+
+/**
+ * @class ClientReactor
+ * @brief Reads the connections of many clients from a small fixed pool of threads.
+ *
+ * By default, each INDI::BaseClient reads its server from a thread of its own. A client given a reactor
+ * with BaseClient::setReactor is instead registered with it when connecting: the reactor waits on the
+ * sockets of all its clients with epoll, and its threads read and dispatch the messages, calling the
+ * notification functions of each client. A connection is only handled by one thread at a time, so the
+ * notifications of a client are still received in order and never concurrently.
+ *
+ * The reactor is only available on Linux, elsewhere the clients keep their own thread.
+ * Clients should be disconnected before the reactor is destroyed, the connections left are closed then.
+ */
+class ClientReactor
+{
+    public:
+        /**
+         * @brief Called with the read buffer of the thread when the connection is readable.
+         * @return false once the connection is over, it is then removed and closed.
+         */
+        using ReadHandler = std::function<bool(char *buffer, size_t size)>;
+        /** @brief Called once the connection is removed from the reactor, from the thread that removed it. */
+        using CloseHandler = std::function<void()>;
+
+    public:
+        /** @param threadCount Number of threads reading the connections */
+        explicit ClientReactor(size_t threadCount = 2);
+        ~ClientReactor();
+
+    public:
+        /** @return True if the reactor can drive connections on this system */
+        static bool isSupported();
+
+        /** @return True if the threads of the reactor are running */
+        bool isRunning() const
+        {
+            return epollFd >= 0;
+        }
+
+        /** @return Number of threads reading the connections */
+        size_t threadCount() const
+        {
+            return threads.size();
+        }
+
+        /** @return Number of connections registered */
+        size_t connectionCount() const;
+
+        /**
+         * @brief Register a non blocking socket.
+         * @param fd Socket to read, it is not closed by the reactor
+         * @param onReadable Reads and handles the data available
+         * @param onClosed Called when onReadable returned false or the reactor is destroyed
+         * @return false if the reactor is not running or the socket can't be waited on
+         */
+        bool add(int fd, ReadHandler onReadable, CloseHandler onClosed);
+
+    protected:
+        struct Connection
+        {
+            int fd;
+            ReadHandler onReadable;
+            CloseHandler onClosed;
+        };
+
+        void worker();
+        void remove(Connection *connection);
+
+    protected:
+        int epollFd {-1};
+        int wakeFd {-1};
+        std::atomic<bool> terminate {false};
+        std::vector<std::thread> threads;
+
+        mutable std::mutex mutex;
+        std::set<Connection *> connections;
+};
+
+}
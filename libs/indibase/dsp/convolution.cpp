@@ -22,6 +22,7 @@
 #include "indilogger.h"
 #include "dsp.h"
 #include "base64.h"
+#include "indiimagestatistics.h"
 
 #define _USE_MATH_DEFINES
 #include <cmath>
@@ -143,8 +144,18 @@ bool Wavelets::processBLOB(uint8_t *buf, uint32_t dims, int *sizes, int bits_per
 {
     if(!PluginActive) return false;
     setStream(buf, dims, sizes, bits_per_sample);
-    double min = dsp_stats_min(stream->buf, stream->len);
-    double max = dsp_stats_max(stream->buf, stream->len);
+    double min, max;
+    INDI::ImageStatistics stats;
+    if (INDI::computeImageStatistics(buf, stream->len, bits_per_sample, stats))
+    {
+        min = stats.min;
+        max = stats.max;
+    }
+    else
+    {
+        min = dsp_stats_min(stream->buf, stream->len);
+        max = dsp_stats_max(stream->buf, stream->len);
+    }
     dsp_stream_p out = dsp_stream_copy(stream);
     for (int i = 0; i < WaveletsNP.nnp; i++)
     {
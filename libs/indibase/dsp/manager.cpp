@@ -39,6 +39,12 @@ Manager::Manager(INDI::DefaultDevice *dev)
     spectrum = new Spectrum(dev);
     histogram = new Histogram(dev);
     wavelets = new Wavelets(dev);
+
+    // Reuse the FFTW plans measured by previous runs
+    const char *wisdom = getenv("INDIFFTWWISDOM");
+    if (wisdom != nullptr)
+        dsp_fourier_wisdom_set_file(wisdom);
+    dsp_fourier_set_threads(std::thread::hardware_concurrency());
 }
 
 Manager::~Manager()
@@ -21,6 +21,7 @@
 #include "indicom.h"
 #include "indilogger.h"
 #include "dsp.h"
+#include "indiimagestatistics.h"
 
 #include <dirent.h>
 #include <cerrno>
@@ -143,9 +144,25 @@ Histogram::~Histogram()
 bool Histogram::processBLOB(uint8_t *buf, uint32_t dims, int *sizes, int bits_per_sample)
 {
     if(!PluginActive) return false;
-    setStream(buf, dims, sizes, bits_per_sample);
 
-    double *histo = dsp_stats_histogram(stream, 4096);
+    size_t len = 1;
+    for (uint32_t dim = 0; dim < dims; dim++)
+        len *= sizes[dim];
+
+    // Integer frames are counted in place, other sample types go through the dsp stream
+    double *histo = nullptr;
+    INDI::ImageStatistics stats;
+    if (INDI::computeImageStatistics(buf, len, bits_per_sample, stats, 4096))
+    {
+        histo = static_cast<double*>(malloc(sizeof(double) * 4096));
+        std::copy(stats.histogram.begin(), stats.histogram.end(), histo);
+        dsp_buffer_stretch(histo, 4096, 0, 4096);
+    }
+    else
+    {
+        setStream(buf, dims, sizes, bits_per_sample);
+        histo = dsp_stats_histogram(stream, 4096);
+    }
     return Interface::processBLOB(static_cast<uint8_t*>(static_cast<void*>(histo)), 1, new int{4096}, -64);
 }
 }
@@ -33,6 +33,9 @@
 #include "indicom.h"
 #include "locale_compat.h"
 #include "indiutility.h"
+#include "indiimagestatistics.h"
+#include "indicompression.h"
+#include "indiparallel.h"
 
 #include <fitsio.h>
 
@@ -52,6 +55,8 @@
 #include <cstdlib>
 #include <zlib.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 const char * IMAGE_SETTINGS_TAB = "Image Settings";
 const char * IMAGE_INFO_TAB     = "Image Info";
@@ -121,10 +126,33 @@ CCD::CCD()
 
     exposureStartTime[0] = 0;
     exposureDuration = 0.0;
+
+    // The upload thread reports completed uploads to the event loop through this pipe
+    if (pipe(m_UploadDonePipe) == 0)
+    {
+        for (int fd : m_UploadDonePipe)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        m_UploadDoneCallback = IEAddCallback(m_UploadDonePipe[0], &CCD::uploadDoneCallback, this);
+    }
+    else
+        LOGF_ERROR("Failed to create the upload pipe: %s", strerror(errno));
 }
 
 CCD::~CCD()
 {
+    stopUploadThread();
+
+    if (m_UploadDoneCallback >= 0)
+        IERmCallback(m_UploadDoneCallback);
+    for (int fd : m_UploadDonePipe)
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
     // Only update if index is different.
     if (m_ConfigFastExposureIndex != IUFindOnSwitchIndex(&FastExposureToggleSP))
         saveConfig(true, FastExposureToggleSP.name);
@@ -215,6 +243,12 @@ bool CCD::initProperties()
                        IMAGE_SETTINGS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
     PrimaryCCD.SendCompressed = false;
 
+    // No more parts are compressed at once than there are cores, 0 picks the count from the image size
+    CompressionSettingsNP[COMPRESSION_THREADS].fill("THREADS", "Threads", "%.f", 0, INDI::parallelThreads(), 1, 0);
+    CompressionSettingsNP[COMPRESSION_LEVEL].fill("LEVEL", "Zlib Level", "%.f", 1, 9, 1, 9);
+    CompressionSettingsNP.fill(getDeviceName(), "CCD_COMPRESSION_SETTINGS", "Compression Settings", IMAGE_SETTINGS_TAB,
+                               IP_RW, 60, IPS_IDLE);
+
     // Primary CCD Chip Data Blob
     IUFillBLOB(&PrimaryCCD.FitsB, "CCD1", "Image", "");
     IUFillBLOBVector(&PrimaryCCD.FitsBP, &PrimaryCCD.FitsB, 1, getDeviceName(), "CCD1", "Image Data", IMAGE_INFO_TAB,
@@ -416,6 +450,11 @@ bool CCD::initProperties()
     IUFillNumberVector(&FastExposureCountNP, FastExposureCountN, 1, getDeviceName(), "CCD_FAST_COUNT", "Fast Count",
                        OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
 
+    // Upload latency and number of frames waiting for upload
+    UploadStatsNP[UPLOAD_STATS_LATENCY].fill("LATENCY", "Latency (s)", "%.3f", 0, 3600, 0, 0);
+    UploadStatsNP[UPLOAD_STATS_QUEUE].fill("QUEUE", "Queued", "%.f", 0, UPLOAD_POOL_SIZE, 1, 0);
+    UploadStatsNP.fill(getDeviceName(), "CCD_UPLOAD_STATS", "Upload Stats", OPTIONS_TAB, IP_RO, 60, IPS_IDLE);
+
     /**********************************************/
     /**************** Web Socket ******************/
     /**********************************************/
@@ -564,6 +603,7 @@ bool CCD::updateProperties()
                 defineProperty(&GuideCCD.ImageBinNP);
         }
         defineProperty(&PrimaryCCD.CompressSP);
+        defineProperty(CompressionSettingsNP);
         defineProperty(&PrimaryCCD.FitsBP);
         if (HasGuideHead())
         {
@@ -616,6 +656,7 @@ bool CCD::updateProperties()
 
         defineProperty(&FastExposureToggleSP);
         defineProperty(&FastExposureCountNP);
+        defineProperty(UploadStatsNP);
     }
     else
     {
@@ -636,6 +677,7 @@ bool CCD::updateProperties()
             deleteProperty(PrimaryCCD.AbortExposureSP.name);
         deleteProperty(PrimaryCCD.FitsBP.name);
         deleteProperty(PrimaryCCD.CompressSP.name);
+        deleteProperty(CompressionSettingsNP);
 
 #if 0
         deleteProperty(PrimaryCCD.RapidGuideSP.name);
@@ -703,6 +745,9 @@ bool CCD::updateProperties()
 #endif
         deleteProperty(FastExposureToggleSP.name);
         deleteProperty(FastExposureCountNP.name);
+        deleteProperty(UploadStatsNP);
+
+        stopUploadThread();
     }
 
     // Streamer
@@ -1148,6 +1193,22 @@ bool CCD::ISNewNumber(const char * dev, const char * name, double values[], char
             return true;
         }
 
+        // Compression Settings
+        if (CompressionSettingsNP.isNameMatch(name))
+        {
+            // Clamp the threads to the cores of this machine, the property then reports the count used
+            std::vector<double> clamped(values, values + n);
+            for (int i = 0; i < n; i++)
+            {
+                if (CompressionSettingsNP[COMPRESSION_THREADS].isNameMatch(names[i]))
+                    clamped[i] = std::min(clamped[i], CompressionSettingsNP[COMPRESSION_THREADS].getMax());
+            }
+            CompressionSettingsNP.update(clamped.data(), names, n);
+            CompressionSettingsNP.setState(IPS_OK);
+            CompressionSettingsNP.apply();
+            return true;
+        }
+
         // Scope Information
         if (ScopeInfoNP.isNameMatch(name))
         {
@@ -2164,18 +2225,12 @@ bool CCD::ExposureComplete(CCDChip * targetChip)
     // Reset POLLMS to default value
     setCurrentPollingPeriod(getPollingPeriod());
 
-    // Run async
-    std::thread(&CCD::ExposureCompletePrivate, this, targetChip).detach();
-
-    return true;
+    // The frame and header are taken now, encoding and upload run on the upload thread
+    return ExposureCompletePrivate(targetChip);
 }
 
 bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
 {
-    // save information used for the fits header
-    exposureDuration = targetChip->getExposureDuration();
-    strncpy(exposureStartTime, targetChip->getExposureStartTime(), MAXINDINAME);
-
     if(HasDSP())
     {
         uint8_t* buf = static_cast<uint8_t*>(malloc(targetChip->getFrameBufferSize()));
@@ -2185,169 +2240,311 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
         free(buf);
     }
 
-    if (processFastExposure(targetChip) == false)
-        return false;
+    // Everything the upload thread needs is taken now, from the thread that completed the exposure
+    UploadJob job;
+    job.targetChip = targetChip;
+    job.completed  = std::chrono::steady_clock::now();
+    job.subW  = targetChip->getSubW();
+    job.subH  = targetChip->getSubH();
+    job.binX  = targetChip->getBinX();
+    job.binY  = targetChip->getBinY();
+    job.bpp   = targetChip->getBPP();
+    job.naxis = targetChip->getNAxis();
+    job.encodeFITS   = EncodeFormatSP[FORMAT_FITS].getState() == ISS_ON;
+    job.fastExposure = FastExposureToggleS[INDI_ENABLED].s == ISS_ON;
+    job.sendCompressed     = targetChip->SendCompressed;
+    job.compressionThreads = CompressionSettingsNP[COMPRESSION_THREADS].getValue();
+    job.compressionLevel   = CompressionSettingsNP[COMPRESSION_LEVEL].getValue();
+    job.uploadDir    = UploadSettingsT[UPLOAD_DIR].text;
+    job.uploadPrefix = UploadSettingsT[UPLOAD_PREFIX].text;
+#ifdef HAVE_WEBSOCKET
+    job.webSocket = HasWebSocket() && WebSocketS[WEBSOCKET_ENABLED].s == ISS_ON;
+#endif
 
-    bool sendImage = (UploadS[UPLOAD_CLIENT].s == ISS_ON || UploadS[UPLOAD_BOTH].s == ISS_ON);
-    bool saveImage = (UploadS[UPLOAD_LOCAL].s == ISS_ON || UploadS[UPLOAD_BOTH].s == ISS_ON);
+    job.sendImage = (UploadS[UPLOAD_CLIENT].s == ISS_ON || UploadS[UPLOAD_BOTH].s == ISS_ON);
+    job.saveImage = (UploadS[UPLOAD_LOCAL].s == ISS_ON || UploadS[UPLOAD_BOTH].s == ISS_ON);
 
     // Do not send or save an empty image.
     if (targetChip->getFrameBufferSize() == 0)
-        sendImage = saveImage = false;
+        job.sendImage = job.saveImage = false;
 
-    if (sendImage || saveImage)
+    startUploadThread();
+
+    // Wait for a free buffer if the upload thread is behind, the pool bounds the memory used by queued frames.
+    while (m_UploadPool.pop(job.frame, 100) == false)
     {
-        if (EncodeFormatSP[FORMAT_FITS].getState() == ISS_ON)
-        {
-            int img_type  = 0;
-            int byte_type = 0;
-            int status    = 0;
-            long naxis    = targetChip->getNAxis();
-            long naxes[3];
-            int nelements = 0;
-            std::string bit_depth;
-            char error_status[MAXRBUF];
-
-            naxes[0] = targetChip->getSubW() / targetChip->getBinX();
-            naxes[1] = targetChip->getSubH() / targetChip->getBinY();
-
-            switch (targetChip->getBPP())
-            {
-                case 8:
-                    byte_type = TBYTE;
-                    img_type  = BYTE_IMG;
-                    bit_depth = "8 bits per pixel";
-                    break;
-
-                case 16:
-                    byte_type = TUSHORT;
-                    img_type  = USHORT_IMG;
-                    bit_depth = "16 bits per pixel";
-                    break;
-
-                case 32:
-                    byte_type = TULONG;
-                    img_type  = ULONG_IMG;
-                    bit_depth = "32 bits per pixel";
-                    break;
-
-                default:
-                    LOGF_ERROR("Unsupported bits per pixel value %d", targetChip->getBPP());
-                    return false;
-            }
+        if (m_UploadThreadTerminate)
+            return false;
+    }
 
-            nelements = naxes[0] * naxes[1];
-            if (naxis == 3)
-            {
-                nelements *= 3;
-                naxes[2] = 3;
-            }
+    if (job.sendImage || job.saveImage)
+    {
+        // If image extension was set to fits (default), change if bin if not already set to another format by the driver.
+        if (!job.encodeFITS && !strcmp(targetChip->getImageExtension(), "fits"))
+            targetChip->setImageExtension("bin");
+        job.imageExtension = targetChip->getImageExtension();
 
-            /*DEBUGF(Logger::DBG_DEBUG, "Exposure complete. Image Depth: %s. Width: %d Height: %d nelements: %d", bit_depth.c_str(), naxes[0],
-                    naxes[1], nelements);*/
+        std::unique_lock<std::mutex> guard(ccdBufferLock);
+        const uint8_t *frameBuffer = targetChip->getFrameBuffer();
+        job.frame.assign(frameBuffer, frameBuffer + targetChip->getFrameBufferSize());
+        guard.unlock();
 
-            std::unique_lock<std::mutex> guard(ccdBufferLock);
+        if (job.encodeFITS && !buildFITSHeader(job))
+        {
+            m_UploadPool.push(std::move(job.frame));
+            targetChip->setExposureFailed();
+            return false;
+        }
+    }
+    else
+        job.frame.clear();
 
-            // 8640 = 2880 * 3 which is sufficient for most cases.
-            uint32_t size = 8640 + nelements * (targetChip->getBPP() / 8);
-            //  Initialize FITS file.
-            if (targetChip->openFITSFile(size, status) == false)
-            {
-                fits_report_error(stderr, status); /* print out any error messages */
-                fits_get_errstatus(status, error_status);
-                LOGF_ERROR("FITS Error: %s", error_status);
-                return false;
-            }
+    // The frame buffer is free to receive the next exposure now.
+    if (processFastExposure(targetChip) == false)
+    {
+        m_UploadPool.push(std::move(job.frame));
+        return false;
+    }
 
-            auto fptr = *targetChip->fitsFilePointer();
+    m_UploadQueue.push(std::move(job));
+    return true;
+}
 
-            fits_create_img(fptr, img_type, naxis, naxes, &status);
+bool CCD::buildFITSHeader(UploadJob &job)
+{
+    CCDChip *targetChip = job.targetChip;
+    int img_type  = 0;
+    int status    = 0;
+    char error_status[MAXRBUF];
 
-            if (status)
-            {
-                fits_report_error(stderr, status); /* print out any error messages */
-                fits_get_errstatus(status, error_status);
-                LOGF_ERROR("FITS Error: %s", error_status);
-                targetChip->closeFITSFile();
-                return false;
-            }
+    switch (job.bpp)
+    {
+        case 8:
+            img_type  = BYTE_IMG;
+            break;
 
-            addFITSKeywords(targetChip);
+        case 16:
+            img_type  = USHORT_IMG;
+            break;
 
-            fits_write_img(fptr, byte_type, 1, nelements, targetChip->getFrameBuffer(), &status);
-            targetChip->finishFITSFile(status);
-            if (status)
-            {
-                fits_report_error(stderr, status); /* print out any error messages */
-                fits_get_errstatus(status, error_status);
-                LOGF_ERROR("FITS Error: %s", error_status);
-                targetChip->closeFITSFile();
-                return false;
-            }
+        case 32:
+            img_type  = ULONG_IMG;
+            break;
+
+        default:
+            LOGF_ERROR("Unsupported bits per pixel value %d", job.bpp);
+            return false;
+    }
 
+    // The header is built on a small memory file with unit axes, the upload thread then writes it along
+    // with the image in a single allocation of the final size, see CCDChip::writeFITSImage.
+    // 8640 = 2880 * 3 which is sufficient for most headers.
+    if (targetChip->openFITSFile(8640, status) == false)
+    {
+        fits_report_error(stderr, status); /* print out any error messages */
+        fits_get_errstatus(status, error_status);
+        LOGF_ERROR("FITS Error: %s", error_status);
+        return false;
+    }
 
-            bool rc = uploadFile(targetChip, *(targetChip->fitsMemoryBlockPointer()), *(targetChip->fitsMemorySizePointer()), sendImage,
-                                 saveImage);
+    long unitAxes[3] = {1, 1, 1};
+    fits_create_img(*targetChip->fitsFilePointer(), img_type, job.naxis, unitAxes, &status);
 
-            targetChip->closeFITSFile();
+    if (status)
+    {
+        fits_report_error(stderr, status); /* print out any error messages */
+        fits_get_errstatus(status, error_status);
+        LOGF_ERROR("FITS Error: %s", error_status);
+        targetChip->closeFITSFile();
+        return false;
+    }
 
-            guard.unlock();
+    // save information used for the fits header, getMinMax reads the frame copy
+    exposureDuration = targetChip->getExposureDuration();
+    strncpy(exposureStartTime, targetChip->getExposureStartTime(), MAXINDINAME);
+    m_CurrentUpload = &job;
+    addFITSKeywords(targetChip);
+    m_CurrentUpload = nullptr;
 
-            if (rc == false)
-            {
-                targetChip->setExposureFailed();
-                return false;
-            }
-        }
-        else
+    if (targetChip->closeFITSHeader(job.header, status) == false)
+    {
+        fits_report_error(stderr, status); /* print out any error messages */
+        fits_get_errstatus(status, error_status);
+        LOGF_ERROR("FITS Error: %s", error_status);
+        targetChip->closeFITSFile();
+        return false;
+    }
+
+    return true;
+}
+
+void CCD::startUploadThread()
+{
+    std::lock_guard<std::mutex> lock(m_UploadThreadLock);
+    if (m_UploadThread.joinable())
+        return;
+
+    m_UploadQueue.clear();
+    m_UploadPool.clear();
+    for (int i = 0; i < UPLOAD_POOL_SIZE; i++)
+        m_UploadPool.push(std::vector<uint8_t>());
+
+    m_UploadThreadTerminate = false;
+    m_UploadThread = std::thread(&CCD::uploadThreadEntry, this);
+}
+
+void CCD::stopUploadThread()
+{
+    std::lock_guard<std::mutex> lock(m_UploadThreadLock);
+    if (!m_UploadThread.joinable())
+        return;
+
+    // Wakes up an exposure completion waiting for a free buffer too
+    m_UploadThreadTerminate = true;
+    m_UploadThread.join();
+    m_UploadQueue.clear();
+    m_UploadDone.clear();
+}
+
+void CCD::uploadThreadEntry()
+{
+    UploadJob job;
+
+    while (!m_UploadThreadTerminate)
+    {
+        if (m_UploadQueue.pop(job, 100) == false)
+            continue;
+
+        job.uploaded = uploadJob(job);
+
+        std::chrono::duration<double> latency = std::chrono::steady_clock::now() - job.completed;
+        job.latency = latency.count();
+        job.queued  = m_UploadQueue.size();
+
+        m_UploadPool.push(std::move(job.frame));
+
+        // Properties and child classes are only touched from the event loop, see uploadDone
+        m_UploadDone.push(std::move(job));
+        char wake = 0;
+        if (::write(m_UploadDonePipe[1], &wake, 1) < 0 && errno != EAGAIN)
+            LOGF_ERROR("Failed to signal upload completion: %s", strerror(errno));
+    }
+}
+
+void CCD::uploadDoneCallback(int fd, void *ud)
+{
+    char buffer[64];
+    while (::read(fd, buffer, sizeof(buffer)) > 0)
+        ;
+    static_cast<CCD *>(ud)->uploadDone();
+}
+
+void CCD::uploadDone()
+{
+    UploadJob job;
+
+    while (m_UploadDone.pop(job, 0))
+    {
+        if (!job.savedFile.empty())
         {
-            // If image extension was set to fits (default), change if bin if not already set to another format by the driver.
-            if (!strcmp(targetChip->getImageExtension(), "fits"))
-                targetChip->setImageExtension("bin");
-            std::unique_lock<std::mutex> guard(ccdBufferLock);
-            bool rc = uploadFile(targetChip, targetChip->getFrameBuffer(), targetChip->getFrameBufferSize(), sendImage,
-                                 saveImage);
-            guard.unlock();
+            IUSaveText(&FileNameT[0], job.savedFile.c_str());
+            FileNameTP.s = IPS_OK;
+            IDSetText(&FileNameTP, nullptr);
+        }
 
-            if (rc == false)
-            {
-                targetChip->setExposureFailed();
-                return false;
-            }
+        UploadStatsNP[UPLOAD_STATS_LATENCY].setValue(job.latency);
+        UploadStatsNP[UPLOAD_STATS_QUEUE].setValue(job.queued);
+        UploadStatsNP.setState(job.uploaded ? IPS_OK : IPS_ALERT);
+        UploadStatsNP.apply();
+
+        if (job.uploaded == false)
+        {
+            job.targetChip->setExposureFailed();
+            continue;
         }
+
+        if (!job.fastExposure)
+            job.targetChip->setExposureComplete();
+
+        UploadComplete(job.targetChip);
     }
+}
 
-    if (FastExposureToggleS[INDI_ENABLED].s != ISS_ON)
-        targetChip->setExposureComplete();
+bool CCD::uploadJob(UploadJob &job)
+{
+    if (!job.sendImage && !job.saveImage)
+        return true;
 
-    UploadComplete(targetChip);
-    return true;
+    if (!job.encodeFITS)
+        return uploadFile(job, job.frame.data(), job.frame.size());
+
+    int status    = 0;
+    long naxis    = job.naxis;
+    long naxes[3];
+    int nelements = 0;
+    char error_status[MAXRBUF];
+
+    naxes[0] = job.subW / job.binX;
+    naxes[1] = job.subH / job.binY;
+
+    nelements = naxes[0] * naxes[1];
+    if (naxis == 3)
+    {
+        nelements *= 3;
+        naxes[2] = 3;
+    }
+
+    if (static_cast<size_t>(nelements) * (job.bpp / 8) > job.frame.size())
+    {
+        LOGF_ERROR("Frame buffer size %zu is smaller than the %dx%d image.", job.frame.size(), static_cast<int>(naxes[0]),
+                   static_cast<int>(naxes[1]));
+        return false;
+    }
+
+    size_t fitsSize = 0;
+    void *fitsData = CCDChip::writeFITSImage(job.header, naxis, naxes, job.bpp, job.frame.data(), fitsSize, status);
+    if (fitsData == nullptr)
+    {
+        fits_report_error(stderr, status); /* print out any error messages */
+        fits_get_errstatus(status, error_status);
+        LOGF_ERROR("FITS Error: %s", error_status);
+        return false;
+    }
+
+    bool rc = uploadFile(job, fitsData, fitsSize);
+
+    IDSharedBlobFree(fitsData);
+
+    return rc;
 }
 
-bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBytes, bool sendImage,
-                     bool saveImage)
+bool CCD::uploadFile(UploadJob &job, const void * fitsData, size_t totalBytes)
 {
+    CCDChip *targetChip = job.targetChip;
+    const char *extension = job.imageExtension.c_str();
+    bool sendImage = job.sendImage;
+    bool saveImage = job.saveImage;
     uint8_t * compressedData = nullptr;
+    std::vector<uint8_t> compressed;
 
     DEBUGF(Logger::DBG_DEBUG, "Uploading file. Ext: %s, Size: %d, sendImage? %s, saveImage? %s",
-           targetChip->getImageExtension(), totalBytes, sendImage ? "Yes" : "No", saveImage ? "Yes" : "No");
+           extension, totalBytes, sendImage ? "Yes" : "No", saveImage ? "Yes" : "No");
 
     if (saveImage)
     {
         targetChip->FitsB.blob    = const_cast<void *>(fitsData);
         targetChip->FitsB.bloblen = totalBytes;
-        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
+        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", extension);
 
         FILE * fp = nullptr;
         char imageFileName[MAXRBUF];
 
-        std::string prefix = UploadSettingsT[UPLOAD_PREFIX].text;
-        int maxIndex       = getFileIndex(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text,
-                                          targetChip->FitsB.format);
+        std::string prefix = job.uploadPrefix;
+        int maxIndex       = getFileIndex(job.uploadDir.c_str(), job.uploadPrefix.c_str(), targetChip->FitsB.format);
 
         if (maxIndex < 0)
         {
-            LOGF_ERROR("Error iterating directory %s. %s", UploadSettingsT[0].text,
+            LOGF_ERROR("Error iterating directory %s. %s", job.uploadDir.c_str(),
                        strerror(errno));
             return false;
         }
@@ -2370,7 +2567,7 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
             prefix = std::regex_replace(prefix, std::regex("XXX"), prefixIndex);
         }
 
-        snprintf(imageFileName, MAXRBUF, "%s/%s%s", UploadSettingsT[0].text, prefix.c_str(), targetChip->FitsB.format);
+        snprintf(imageFileName, MAXRBUF, "%s/%s%s", job.uploadDir.c_str(), prefix.c_str(), targetChip->FitsB.format);
 
         fp = fopen(imageFileName, "w");
         if (fp == nullptr)
@@ -2385,66 +2582,66 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
 
         fclose(fp);
 
-        // Save image file path
-        IUSaveText(&FileNameT[0], imageFileName);
+        // Save image file path, FileNameTP is updated from the event loop
+        job.savedFile = imageFileName;
 
         DEBUGF(Logger::DBG_SESSION, "Image saved to %s", imageFileName);
-        FileNameTP.s = IPS_OK;
-        IDSetText(&FileNameTP, nullptr);
     }
 
-    if (targetChip->SendCompressed)
+    if (job.sendCompressed)
     {
-        if (EncodeFormatSP[FORMAT_FITS].getState() == ISS_ON && !strcmp(targetChip->getImageExtension(), "fits"))
+        uint32_t threads = job.compressionThreads;
+        auto start = std::chrono::steady_clock::now();
+
+        if (job.encodeFITS && !strcmp(extension, "fits"))
         {
-            fpstate	fpvar;
-            fp_init (&fpvar);
-            size_t compressedBytes = 0;
-            int islossless = 0;
-            if (fp_pack_data_to_data(reinterpret_cast<const char *>(fitsData), totalBytes, &compressedData, &compressedBytes, fpvar,
-                                     &islossless) < 0)
+            // Rice compress the rows in parallel, fpack handles anything else
+            if (INDI::compressFITSTiles(fitsData, totalBytes, compressed, threads))
             {
-                free(compressedData);
-                LOG_ERROR("Error: Ran out of memory compressing image");
-                return false;
+                targetChip->FitsB.blob    = compressed.data();
+                targetChip->FitsB.bloblen = compressed.size();
             }
+            else
+            {
+                fpstate	fpvar;
+                fp_init (&fpvar);
+                size_t compressedBytes = 0;
+                int islossless = 0;
+                if (fp_pack_data_to_data(reinterpret_cast<const char *>(fitsData), totalBytes, &compressedData, &compressedBytes, fpvar,
+                                         &islossless) < 0)
+                {
+                    free(compressedData);
+                    LOG_ERROR("Error: Ran out of memory compressing image");
+                    return false;
+                }
 
-            targetChip->FitsB.blob    = compressedData;
-            targetChip->FitsB.bloblen = compressedBytes;
-            snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.fz", targetChip->getImageExtension());
+                targetChip->FitsB.blob    = compressedData;
+                targetChip->FitsB.bloblen = compressedBytes;
+            }
+            snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.fz", extension);
         }
         else
         {
-            uLong compressedBytes = sizeof(char) * totalBytes + totalBytes / 64 + 16 + 3;
-            compressedData  = new uint8_t[compressedBytes];
-
-            if (fitsData == nullptr || compressedData == nullptr)
-            {
-                if (compressedData)
-                    delete [] compressedData;
-                LOG_ERROR("Error: Ran out of memory compressing image");
-                return false;
-            }
-
-            int r = compress2(compressedData, &compressedBytes, (const Bytef *)fitsData, totalBytes, 9);
-            if (r != Z_OK)
+            if (fitsData == nullptr ||
+                    !INDI::compressZlib(fitsData, totalBytes, compressed, job.compressionLevel, threads))
             {
-                /* this should NEVER happen */
                 LOG_ERROR("Error: Failed to compress image");
-                delete [] compressedData;
                 return false;
             }
 
-            targetChip->FitsB.blob    = compressedData;
-            targetChip->FitsB.bloblen = compressedBytes;
-            snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.z", targetChip->getImageExtension());
+            targetChip->FitsB.blob    = compressed.data();
+            targetChip->FitsB.bloblen = compressed.size();
+            snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.z", extension);
         }
+
+        std::chrono::duration<double> diff = std::chrono::steady_clock::now() - start;
+        LOGF_DEBUG("Compression took %g seconds", diff.count());
     }
     else
     {
         targetChip->FitsB.blob    = const_cast<void *>(fitsData);
         targetChip->FitsB.bloblen = totalBytes;
-        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
+        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", extension);
     }
 
     targetChip->FitsB.size = totalBytes;
@@ -2453,7 +2650,7 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
     if (sendImage)
     {
 #ifdef HAVE_WEBSOCKET
-        if (HasWebSocket() && WebSocketS[WEBSOCKET_ENABLED].s == ISS_ON)
+        if (job.webSocket)
         {
             auto start = std::chrono::high_resolution_clock::now();
 
@@ -2476,8 +2673,8 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
         }
     }
 
-    if (compressedData)
-        delete [] compressedData;
+    // Allocated by fpack with realloc
+    free(compressedData);
 
     DEBUG(Logger::DBG_DEBUG, "Upload complete");
 
@@ -2581,6 +2778,7 @@ bool CCD::saveConfigItems(FILE * fp)
     IUSaveConfigSwitch(fp, &FastExposureToggleSP);
 
     IUSaveConfigSwitch(fp, &PrimaryCCD.CompressSP);
+    CompressionSettingsNP.save(fp);
 
     if (PrimaryCCD.getCCDInfo()->p != IP_RO)
         IUSaveConfigNumber(fp, PrimaryCCD.getCCDInfo());
@@ -2645,66 +2843,24 @@ IPState CCD::GuideWest(uint32_t ms)
 
 void CCD::getMinMax(double * min, double * max, CCDChip * targetChip)
 {
-    int ind         = 0, i, j;
     int imageHeight = targetChip->getSubH() / targetChip->getBinY();
     int imageWidth  = targetChip->getSubW() / targetChip->getBinX();
-    double lmin = 0, lmax = 0;
+    int bpp         = targetChip->getBPP();
+    const uint8_t * frameBuffer = targetChip->getFrameBuffer();
 
-    switch (targetChip->getBPP())
+    // While encoding a queued frame, use the frame copy instead of the live chip buffer.
+    if (m_CurrentUpload && m_CurrentUpload->targetChip == targetChip)
     {
-        case 8:
-        {
-            uint8_t * imageBuffer = targetChip->getFrameBuffer();
-            lmin = lmax = imageBuffer[0];
-
-            for (i = 0; i < imageHeight; i++)
-                for (j = 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin)
-                        lmin = imageBuffer[ind];
-                    else if (imageBuffer[ind] > lmax)
-                        lmax = imageBuffer[ind];
-                }
-        }
-        break;
-
-        case 16:
-        {
-            uint16_t * imageBuffer = reinterpret_cast<uint16_t*>(targetChip->getFrameBuffer());
-            lmin = lmax = imageBuffer[0];
-
-            for (i = 0; i < imageHeight; i++)
-                for (j = 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin)
-                        lmin = imageBuffer[ind];
-                    else if (imageBuffer[ind] > lmax)
-                        lmax = imageBuffer[ind];
-                }
-        }
-        break;
-
-        case 32:
-        {
-            uint32_t * imageBuffer = reinterpret_cast<uint32_t*>(targetChip->getFrameBuffer());
-            lmin = lmax = imageBuffer[0];
-
-            for (i = 0; i < imageHeight; i++)
-                for (j = 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin)
-                        lmin = imageBuffer[ind];
-                    else if (imageBuffer[ind] > lmax)
-                        lmax = imageBuffer[ind];
-                }
-        }
-        break;
+        imageHeight = m_CurrentUpload->subH / m_CurrentUpload->binY;
+        imageWidth  = m_CurrentUpload->subW / m_CurrentUpload->binX;
+        bpp         = m_CurrentUpload->bpp;
+        frameBuffer = m_CurrentUpload->frame.data();
     }
-    *min = lmin;
-    *max = lmax;
+
+    ImageStatistics stats;
+    computeImageStatistics(frameBuffer, static_cast<size_t>(imageWidth) * imageHeight, bpp, stats);
+    *min = stats.min;
+    *max = stats.max;
 }
 
 std::string regex_replace_compat(const std::string &input, const std::string &pattern, const std::string &replace)
@@ -35,6 +35,7 @@
 #include "indielapsedtimer.h"
 #include "dsp/manager.h"
 #include "stream/streammanager.h"
+#include "stream/uniquequeue.h"
 
 #ifdef HAVE_WEBSOCKET
 #include "indiwsserver.h"
@@ -48,6 +49,8 @@
 #include <stdint.h>
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <vector>
 
 extern const char * IMAGE_SETTINGS_TAB;
 extern const char * IMAGE_INFO_TAB;
@@ -90,6 +93,8 @@ class StreamManager;
  * approach unless for the most demanding and FPS sensitive tasks.
  *
  * INDI::CCD and INDI::StreamManager both upload frames asynchrounously in a worker thread.
+ * ExposureComplete copies the frame and builds its FITS header on the calling thread, only the encoding and
+ * upload run on the worker thread. Upload completion is then reported from the event loop.
  * The CCD Buffer data is protected by the ccdBufferLock mutex. When reading the camera data
  * and writing to the buffer, it must be first locked by the mutex. After the write is complete
  * release the lock. For example:
@@ -305,6 +310,9 @@ class CCD : public DefaultDevice, GuiderInterface
         /**
          * \brief Uploads target Chip exposed buffer as FITS to the client. Dervied classes should class
          * this function when an exposure is complete.
+         * The frame buffer is copied under ccdBufferLock and addFITSKeywords is called before this returns,
+         * encoding and upload then run in order on a background upload thread, so the frame buffer may be reused
+         * as soon as this returns.
          * @param targetChip chip that contains upload image data
          * \note This function is not implemented in CCD, it must be implemented in the child class
          */
@@ -533,9 +541,17 @@ class CCD : public DefaultDevice, GuiderInterface
          * @brief UploadComplete Signal that capture is completed and image was uploaded and/or saved successfully.
          * @param targetChip Active exposure chip
          * @note Child camera should override this function to receive notification on exposure upload completion.
+         * @note Called from the event loop once the upload thread is done with the frame.
          */
         virtual void UploadComplete(CCDChip *) {}
 
+        /**
+         * @brief stopUploadThread Wait for the frame being uploaded, drop the frames still queued and stop the upload
+         * thread. It is started again by the next completed exposure.
+         * @note This is done on disconnection and destruction. The upload thread calls no method of child classes.
+         */
+        void stopUploadThread();
+
         /**
          * @brief checkTemperatureTarget Checks the current temperature against target temperature and calculates
          * the next required temperature if there is a ramp. If the current temperature is within threshold of
@@ -721,6 +737,14 @@ class CCD : public DefaultDevice, GuiderInterface
             UPLOAD_PREFIX
         };
 
+        /// Threads used to compress images, 0 to use all the cores, and zlib compression level
+        INDI::PropertyNumber CompressionSettingsNP {2};
+        enum
+        {
+            COMPRESSION_THREADS,
+            COMPRESSION_LEVEL
+        };
+
         // Telescope Information
         INDI::PropertyNumber ScopeInfoNP {2};
         enum
@@ -765,6 +789,17 @@ class CCD : public DefaultDevice, GuiderInterface
         double m_UploadTime = { 0 };
         std::chrono::system_clock::time_point FastExposureToggleStartup;
 
+        /**
+         * @brief UploadStatsNP Time from exposure completion until the image was uploaded and/or saved,
+         * and the number of completed frames still waiting to be encoded and uploaded.
+         */
+        INDI::PropertyNumber UploadStatsNP {2};
+        enum
+        {
+            UPLOAD_STATS_LATENCY,
+            UPLOAD_STATS_QUEUE
+        };
+
         // FITS Header
         IText FITSHeaderT[2] {};
         ITextVectorProperty FITSHeaderTP;
@@ -785,11 +820,62 @@ class CCD : public DefaultDevice, GuiderInterface
         ///////////////////////////////////////////////////////////////////////////////
         /// Utility Functions
         ///////////////////////////////////////////////////////////////////////////////
-        bool uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBytes, bool sendImage, bool saveImage);
         void getMinMax(double * min, double * max, CCDChip * targetChip);
         int getFileIndex(const char * dir, const char * prefix, const char * ext);
         bool ExposureCompletePrivate(CCDChip * targetChip);
 
+        /**
+         * @brief UploadJob Copy of a completed frame with the state needed to encode and upload it, taken when
+         * the exposure completes so the upload thread reads no live property.
+         */
+        struct UploadJob
+        {
+            CCDChip *targetChip {nullptr};
+            std::vector<uint8_t> frame;
+            std::string header;
+            int subW {0}, subH {0}, binX {1}, binY {1}, bpp {0}, naxis {2};
+            bool sendImage {false};
+            bool saveImage {false};
+            bool encodeFITS {false};
+            bool fastExposure {false};
+            bool sendCompressed {false};
+            bool webSocket {false};
+            uint32_t compressionThreads {0};
+            int compressionLevel {9};
+            std::string imageExtension;
+            std::string uploadDir;
+            std::string uploadPrefix;
+            std::chrono::steady_clock::time_point completed;
+
+            // Set by the upload thread for the event loop
+            bool uploaded {false};
+            double latency {0};
+            size_t queued {0};
+            std::string savedFile;
+        };
+        bool buildFITSHeader(UploadJob &job);
+        bool uploadJob(UploadJob &job);
+        bool uploadFile(UploadJob &job, const void * fitsData, size_t totalBytes);
+        void startUploadThread();
+        void uploadThreadEntry();
+        static void uploadDoneCallback(int fd, void *ud);
+        void uploadDone();
+
+        // Threading for FITS encoding and upload. Frames are copied into one of the pool
+        // buffers so the next exposure can start while the previous one is being uploaded.
+        static constexpr int UPLOAD_POOL_SIZE = 3;
+        UniqueQueue<std::vector<uint8_t>> m_UploadPool;
+        UniqueQueue<UploadJob> m_UploadQueue;
+        std::thread m_UploadThread;
+        std::mutex m_UploadThreadLock;
+        std::atomic<bool> m_UploadThreadTerminate {false};
+        const UploadJob *m_CurrentUpload {nullptr};
+
+        // Uploaded jobs, the upload thread writes to the pipe to wake up the event loop
+        UniqueQueue<UploadJob> m_UploadDone;
+        int m_UploadDonePipe[2] {-1, -1};
+        int m_UploadDoneCallback {-1};
+
         // Threading for Websocket
 #ifdef HAVE_WEBSOCKET
         std::thread wsThread;
@@ -17,10 +17,445 @@
 *******************************************************************************/
 #include "indiccdchip.h"
 #include "indidevapi.h"
+#include "indiparallel.h"
 #include "locale_compat.h"
 
+#include <algorithm>
 #include <cstring>
 #include <ctime>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define CCDCHIP_SIMD_X86
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define CCDCHIP_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+// Software binning is done one binned row at a time: the source rows of the bin are summed
+// into 32 bit column accumulators, then the columns of each bin are summed and scaled.
+// The SIMD kernels process a prefix and return how many elements they consumed, the
+// scalar loops finish the remainder.
+
+typedef uint32_t (*AccumulateRow8)(uint32_t *acc, const uint8_t *row, uint32_t width);
+typedef uint32_t (*AccumulateRow16)(uint32_t *acc, const uint16_t *row, uint32_t width);
+
+uint32_t accumulateRowNone8(uint32_t *, const uint8_t *, uint32_t)
+{
+    return 0;
+}
+
+uint32_t accumulateRowNone16(uint32_t *, const uint16_t *, uint32_t)
+{
+    return 0;
+}
+
+#ifdef CCDCHIP_SIMD_X86
+uint32_t accumulateRowSSE2_8(uint32_t *acc, const uint8_t *row, uint32_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        __m128i *a = reinterpret_cast<__m128i *>(acc + x);
+        _mm_storeu_si128(a + 0, _mm_add_epi32(_mm_loadu_si128(a + 0), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+    return x;
+}
+
+uint32_t accumulateRowSSE2_16(uint32_t *acc, const uint16_t *row, uint32_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+        __m128i *a = reinterpret_cast<__m128i *>(acc + x);
+        _mm_storeu_si128(a + 0, _mm_add_epi32(_mm_loadu_si128(a + 0), _mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(v, zero)));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+uint32_t accumulateRowAVX2_8(uint32_t *acc, const uint8_t *row, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            __m256i v  = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(row + x + 8 * i)));
+            __m256i *a = reinterpret_cast<__m256i *>(acc + x + 8 * i);
+            _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), v));
+        }
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+uint32_t accumulateRowAVX2_16(uint32_t *acc, const uint16_t *row, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i v  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x));
+        __m256i *a = reinterpret_cast<__m256i *>(acc + x);
+        _mm256_storeu_si256(a + 0, _mm256_add_epi32(_mm256_loadu_si256(a + 0), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v))));
+        _mm256_storeu_si256(a + 1, _mm256_add_epi32(_mm256_loadu_si256(a + 1), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1))));
+    }
+    return x;
+}
+
+// out[i] = acc[2i] + acc[2i + 1]
+uint32_t sumPairs(uint32_t *out, const uint32_t *acc, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 a = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + 2 * i)));
+        __m128 b = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + 2 * i + 4)));
+        __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd  = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_add_epi32(even, odd));
+    }
+    return i;
+}
+
+// out[2i + q] = acc[4i + q] + acc[4i + 2 + q]
+uint32_t sumBayerPairs(uint32_t *out, const uint32_t *acc, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + 2 * i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + 2 * i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_add_epi32(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b)));
+    }
+    return i;
+}
+#elif defined(CCDCHIP_SIMD_NEON)
+uint32_t accumulateRowNEON_8(uint32_t *acc, const uint8_t *row, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t v = vld1q_u8(row + x);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+        vst1q_u32(acc + x + 0,  vaddw_u16(vld1q_u32(acc + x + 0),  vget_low_u16(lo)));
+        vst1q_u32(acc + x + 4,  vaddw_u16(vld1q_u32(acc + x + 4),  vget_high_u16(lo)));
+        vst1q_u32(acc + x + 8,  vaddw_u16(vld1q_u32(acc + x + 8),  vget_low_u16(hi)));
+        vst1q_u32(acc + x + 12, vaddw_u16(vld1q_u32(acc + x + 12), vget_high_u16(hi)));
+    }
+    return x;
+}
+
+uint32_t accumulateRowNEON_16(uint32_t *acc, const uint16_t *row, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        uint16x8_t v = vld1q_u16(row + x);
+        vst1q_u32(acc + x + 0, vaddw_u16(vld1q_u32(acc + x + 0), vget_low_u16(v)));
+        vst1q_u32(acc + x + 4, vaddw_u16(vld1q_u32(acc + x + 4), vget_high_u16(v)));
+    }
+    return x;
+}
+
+// out[i] = acc[2i] + acc[2i + 1]
+uint32_t sumPairs(uint32_t *out, const uint32_t *acc, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_u32(out + i, vpaddq_u32(vld1q_u32(acc + 2 * i), vld1q_u32(acc + 2 * i + 4)));
+    return i;
+}
+
+// out[2i + q] = acc[4i + q] + acc[4i + 2 + q]
+uint32_t sumBayerPairs(uint32_t *out, const uint32_t *acc, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        uint32x4_t a = vld1q_u32(acc + 2 * i);
+        uint32x4_t b = vld1q_u32(acc + 2 * i + 4);
+        vst1q_u32(out + i, vaddq_u32(vcombine_u32(vget_low_u32(a), vget_low_u32(b)),
+                                     vcombine_u32(vget_high_u32(a), vget_high_u32(b))));
+    }
+    return i;
+}
+#else
+uint32_t sumPairs(uint32_t *, const uint32_t *, uint32_t)
+{
+    return 0;
+}
+
+uint32_t sumBayerPairs(uint32_t *, const uint32_t *, uint32_t)
+{
+    return 0;
+}
+#endif
+
+// FITS data is big endian, and unsigned 16 and 32 bits samples are stored as signed integers
+// with a BZERO offset of 2^15 and 2^31, which amounts to flipping the sign bit before the swap.
+
+typedef size_t (*ToFITS16)(uint8_t *dst, const uint16_t *src, size_t count);
+typedef size_t (*ToFITS32)(uint8_t *dst, const uint32_t *src, size_t count);
+
+size_t toFITSNone16(uint8_t *, const uint16_t *, size_t)
+{
+    return 0;
+}
+
+size_t toFITSNone32(uint8_t *, const uint32_t *, size_t)
+{
+    return 0;
+}
+
+#ifdef CCDCHIP_SIMD_X86
+size_t toFITSSSE2_16(uint8_t *dst, const uint16_t *src, size_t count)
+{
+    const __m128i sign = _mm_set1_epi16(static_cast<short>(0x8000));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), sign);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+    return i;
+}
+
+size_t toFITSSSE2_32(uint8_t *dst, const uint32_t *src, size_t count)
+{
+    const __m128i sign = _mm_set1_epi32(INT32_MIN);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), sign);
+        // Swap the bytes of each 16 bits half, then the halves
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i), v);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t toFITSAVX2_16(uint8_t *dst, const uint16_t *src, size_t count)
+{
+    const __m256i sign = _mm256_set1_epi16(static_cast<short>(0x8000));
+    const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)), sign);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 2 * i), _mm256_shuffle_epi8(v, swap));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t toFITSAVX2_32(uint8_t *dst, const uint32_t *src, size_t count)
+{
+    const __m256i sign = _mm256_set1_epi32(INT32_MIN);
+    const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)), sign);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * i), _mm256_shuffle_epi8(v, swap));
+    }
+    return i;
+}
+#elif defined(CCDCHIP_SIMD_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+size_t toFITSNEON_16(uint8_t *dst, const uint16_t *src, size_t count)
+{
+    const uint16x8_t sign = vdupq_n_u16(0x8000);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        vst1q_u8(dst + 2 * i, vrev16q_u8(vreinterpretq_u8_u16(veorq_u16(vld1q_u16(src + i), sign))));
+    return i;
+}
+
+size_t toFITSNEON_32(uint8_t *dst, const uint32_t *src, size_t count)
+{
+    const uint32x4_t sign = vdupq_n_u32(0x80000000);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_u8(dst + 4 * i, vrev32q_u8(vreinterpretq_u8_u32(veorq_u32(vld1q_u32(src + i), sign))));
+    return i;
+}
+#define CCDCHIP_FITS_NEON
+#endif
+
+struct PixelKernels
+{
+    AccumulateRow8 accumulate8 {accumulateRowNone8};
+    AccumulateRow16 accumulate16 {accumulateRowNone16};
+    ToFITS16 toFITS16 {toFITSNone16};
+    ToFITS32 toFITS32 {toFITSNone32};
+};
+
+const PixelKernels &pixelKernels()
+{
+    static const PixelKernels kernels = []()
+    {
+        PixelKernels k;
+#if defined(CCDCHIP_SIMD_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            k.accumulate8  = accumulateRowAVX2_8;
+            k.accumulate16 = accumulateRowAVX2_16;
+            k.toFITS16     = toFITSAVX2_16;
+            k.toFITS32     = toFITSAVX2_32;
+        }
+        else
+        {
+            k.accumulate8  = accumulateRowSSE2_8;
+            k.accumulate16 = accumulateRowSSE2_16;
+            k.toFITS16     = toFITSSSE2_16;
+            k.toFITS32     = toFITSSSE2_32;
+        }
+#elif defined(CCDCHIP_SIMD_NEON)
+        k.accumulate8  = accumulateRowNEON_8;
+        k.accumulate16 = accumulateRowNEON_16;
+#ifdef CCDCHIP_FITS_NEON
+        k.toFITS16     = toFITSNEON_16;
+        k.toFITS32     = toFITSNEON_32;
+#endif
+#endif
+        return k;
+    }();
+    return kernels;
+}
+
+void toFITS(uint8_t *dst, const uint16_t *src, size_t count)
+{
+    for (size_t i = pixelKernels().toFITS16(dst, src, count); i < count; i++)
+    {
+        uint16_t v = src[i] ^ 0x8000;
+        dst[2 * i + 0] = v >> 8;
+        dst[2 * i + 1] = v & 0xFF;
+    }
+}
+
+void toFITS(uint8_t *dst, const uint32_t *src, size_t count)
+{
+    for (size_t i = pixelKernels().toFITS32(dst, src, count); i < count; i++)
+    {
+        uint32_t v = src[i] ^ 0x80000000;
+        dst[4 * i + 0] = v >> 24;
+        dst[4 * i + 1] = (v >> 16) & 0xFF;
+        dst[4 * i + 2] = (v >> 8) & 0xFF;
+        dst[4 * i + 3] = v & 0xFF;
+    }
+}
+
+/// FITS files are made of 2880 bytes blocks
+constexpr size_t FITS_BLOCK = 2880;
+constexpr size_t FITS_CARD  = 80;
+
+size_t fitsBlocks(size_t bytes)
+{
+    return (bytes + FITS_BLOCK - 1) / FITS_BLOCK * FITS_BLOCK;
+}
+
+inline void accumulateRow(uint32_t *acc, const uint8_t *row, uint32_t width)
+{
+    for (uint32_t x = pixelKernels().accumulate8(acc, row, width); x < width; x++)
+        acc[x] += row[x];
+}
+
+inline void accumulateRow(uint32_t *acc, const uint16_t *row, uint32_t width)
+{
+    for (uint32_t x = pixelKernels().accumulate16(acc, row, width); x < width; x++)
+        acc[x] += row[x];
+}
+
+/**
+ * @brief binRows Bin rows [first, last) of the binned frame.
+ * In a Bayer frame, each 2x2 cell of the binned frame sums the pixels of the same color in a
+ * (2 * binX) x (2 * binY) block of the source frame. Output pixels are sum / divisor capped to maxValue.
+ */
+template <typename T>
+void binRows(const T *src, T *dst, uint32_t width, uint32_t height, uint32_t binX, uint32_t binY, bool bayer,
+             uint32_t divisor, uint32_t maxValue, uint32_t first, uint32_t last)
+{
+    const uint32_t binW = width / binX;
+    std::vector<uint32_t> acc(width);
+    std::vector<uint32_t> sums(binW);
+
+    for (uint32_t r = first; r < last; r++)
+    {
+        std::fill(acc.begin(), acc.end(), 0);
+        for (uint32_t t = 0; t < binY; t++)
+        {
+            uint32_t y = bayer ? (r & ~1u) * binY + 2 * t + (r & 1u) : r * binY + t;
+            if (y >= height)
+                break;
+            accumulateRow(acc.data(), src + static_cast<size_t>(y) * width, width);
+        }
+
+        uint32_t c = 0;
+        if (binX == 2)
+            c = bayer ? sumBayerPairs(sums.data(), acc.data(), binW) : sumPairs(sums.data(), acc.data(), binW);
+        for (; c < binW; c++)
+        {
+            uint32_t sum = 0;
+            for (uint32_t u = 0; u < binX; u++)
+            {
+                uint32_t x = bayer ? (c & ~1u) * binX + 2 * u + (c & 1u) : c * binX + u;
+                if (x < width)
+                    sum += acc[x];
+            }
+            sums[c] = sum;
+        }
+
+        T *out = dst + static_cast<size_t>(r) * binW;
+        if (divisor == 1)
+            for (c = 0; c < binW; c++)
+                out[c] = static_cast<T>(std::min(sums[c], maxValue));
+        else
+            for (c = 0; c < binW; c++)
+                out[c] = static_cast<T>(std::min(sums[c] / divisor, maxValue));
+    }
+}
+
+/**
+ * @brief binImage Bin a whole frame, splitting the binned rows in parallel bands for large frames.
+ */
+template <typename T>
+void binImage(const T *src, T *dst, uint32_t width, uint32_t height, uint32_t binX, uint32_t binY, bool bayer,
+              uint32_t divisor, uint32_t maxValue)
+{
+    const uint32_t binH = height / binY;
+    if (width / binX == 0 || binH == 0)
+        return;
+
+    // Bands of at least 16 binned rows and a quarter of a megapixel
+    const size_t bandRows = std::max<size_t>(16, (size_t(1) << 18) / (static_cast<size_t>(width) * binY));
+    INDI::parallelFor(binH, INDI::parallelBands(binH, bandRows), [&](uint32_t, size_t first, size_t last)
+    {
+        binRows<T>(src, dst, width, height, binX, binY, bayer, divisor, maxValue, first, last);
+    });
+}
+
+}
 
 namespace INDI
 {
@@ -69,6 +504,105 @@ bool CCDChip::finishFITSFile(int &status)
     return (status == 0);
 }
 
+bool CCDChip::closeFITSHeader(std::string &header, int &status)
+{
+    char *cards = nullptr;
+    int nkeys   = 0;
+
+    if (fits_hdr2str(m_FITSFilePointer, 0, nullptr, 0, &cards, &nkeys, &status))
+        return false;
+
+    header.assign(cards);
+    fits_free_memory(cards, &status);
+
+    if (header.size() < FITS_CARD || header.compare(header.size() - FITS_CARD, 3, "END") != 0)
+        header += std::string("END").append(FITS_CARD - 3, ' ');
+
+    // The memory file only held the header, release it before the final file is allocated
+    fits_close_file(m_FITSFilePointer, &status);
+    m_FITSFilePointer = nullptr;
+    IDSharedBlobFree(m_FITSMemoryBlock);
+    m_FITSMemoryBlock = nullptr;
+    m_FITSMemorySize  = 0;
+    return (status == 0);
+}
+
+void *CCDChip::writeFITSImage(const std::string &header, int naxis, const long *naxes, int bpp, const void *image,
+                              size_t &size, int &status)
+{
+    // The header was created with placeholder axes sizes, set the actual ones.
+    // Fixed format integer values are right justified in columns 11 to 30.
+    std::string cards(header);
+    size_t nelements = 1;
+    for (int i = 0; i < naxis; i++)
+    {
+        char keyword[FLEN_KEYWORD], value[21];
+        snprintf(keyword, sizeof(keyword), "NAXIS%-3d", i + 1);
+        snprintf(value, sizeof(value), "%20ld", naxes[i]);
+        nelements *= naxes[i];
+
+        for (size_t card = 0; card + FITS_CARD <= cards.size(); card += FITS_CARD)
+        {
+            if (cards.compare(card, 8, keyword) == 0 && cards[card + 8] == '=')
+            {
+                cards.replace(card + 10, 20, value);
+                break;
+            }
+        }
+    }
+
+    size_t headerSize = fitsBlocks(cards.size());
+    size_t dataSize   = nelements * (bpp / 8);
+    uint8_t *file     = static_cast<uint8_t *>(IDSharedBlobAlloc(headerSize + fitsBlocks(dataSize)));
+    if (file == nullptr)
+    {
+        IDLog("Failed to allocate memory for FITS file.");
+        status = MEMORY_ALLOCATION;
+        return nullptr;
+    }
+
+    memcpy(file, cards.data(), cards.size());
+    memset(file + cards.size(), ' ', headerSize - cards.size());
+
+    uint8_t *data = file + headerSize;
+    switch (bpp)
+    {
+        case 8:
+            memcpy(data, image, dataSize);
+            break;
+        case 16:
+            toFITS(data, static_cast<const uint16_t *>(image), nelements);
+            break;
+        case 32:
+            toFITS(data, static_cast<const uint32_t *>(image), nelements);
+            break;
+        default:
+            IDSharedBlobFree(file);
+            status = BAD_BITPIX;
+            return nullptr;
+    }
+    memset(data + dataSize, 0, fitsBlocks(dataSize) - dataSize);
+
+    size = headerSize + fitsBlocks(dataSize);
+    return file;
+}
+
+bool CCDChip::writeFITSImage(int naxis, const long *naxes, int bpp, const void *image, int &status)
+{
+    std::string header;
+    if (!closeFITSHeader(header, status))
+        return false;
+
+    size_t size = 0;
+    void *file = writeFITSImage(header, naxis, naxes, bpp, image, size, status);
+    if (file == nullptr)
+        return false;
+
+    m_FITSMemoryBlock = file;
+    m_FITSMemorySize  = size;
+    return true;
+}
+
 void CCDChip::closeFITSFile()
 {
     if (m_FITSFilePointer != nullptr)
@@ -283,7 +817,7 @@ void CCDChip::setImageExtension(const char *ext)
 
 void CCDChip::binFrame()
 {
-    if (BinX == 1)
+    if (BinX == 1 && BinY == 1)
         return;
 
     // Jasem: Keep full frame shadow in memory to enhance performance and just swap frame pointers after operation is complete
@@ -296,76 +830,34 @@ void CCDChip::binFrame()
             BinFrame = static_cast<uint8_t*>(IDSharedBlobAlloc(RawFrameSize));
     }
 
-    memset(BinFrame, 0, RawFrameSize);
+    size_t binBytes = static_cast<size_t>(SubW / BinX) * (SubH / BinY) * (getBPP() / 8);
 
     switch (getBPP())
     {
         case 8:
-        {
-            uint8_t *bin_buf = BinFrame;
             // Try to average pixels since in 8bit they get saturated pretty quickly
-            double factor      = (BinX * BinX) / 2;
-            double accumulator;
-
-            for (uint32_t i = 0; i < SubH; i += BinX)
-                for (uint32_t j = 0; j < SubW; j += BinX)
-                {
-                    accumulator = 0;
-                    for (int k = 0; k < BinX; k++)
-                    {
-                        for (int l = 0; l < BinX; l++)
-                        {
-                            accumulator += *(RawFrame + j + (i + k) * SubW + l);
-                        }
-                    }
-
-                    accumulator /= factor;
-                    if (accumulator > UINT8_MAX)
-                        *bin_buf = UINT8_MAX;
-                    else
-                        *bin_buf += static_cast<uint8_t>(accumulator);
-                    bin_buf++;
-                }
-        }
-        break;
+            binImage(RawFrame, BinFrame, SubW, SubH, BinX, BinY, false, std::max(1u, BinX * BinY / 2), UINT8_MAX);
+            break;
 
         case 16:
-        {
-            uint16_t *bin_buf    = reinterpret_cast<uint16_t *>(BinFrame);
-            uint16_t *RawFrame16 = reinterpret_cast<uint16_t *>(RawFrame);
-            uint16_t val;
-
-            for (uint32_t i = 0; i < SubH; i += BinX)
-                for (uint32_t j = 0; j < SubW; j += BinX)
-                {
-                    for (int k = 0; k < BinX; k++)
-                    {
-                        for (int l = 0; l < BinX; l++)
-                        {
-                            val = *(RawFrame16 + j + (i + k) * SubW + l);
-                            if (val + *bin_buf > UINT16_MAX)
-                                *bin_buf = UINT16_MAX;
-                            else
-                                *bin_buf += val;
-                        }
-                    }
-                    bin_buf++;
-                }
-        }
-        break;
+            binImage(reinterpret_cast<uint16_t *>(RawFrame), reinterpret_cast<uint16_t *>(BinFrame), SubW, SubH, BinX, BinY,
+                     false, 1, UINT16_MAX);
+            break;
 
         default:
             return;
     }
 
+    // Keep the remainder of the frame buffer zeroed
+    if (binBytes < RawFrameSize)
+        memset(BinFrame + binBytes, 0, RawFrameSize - binBytes);
+
     // Swap frame pointers
     uint8_t *rawFramePointer = RawFrame;
     RawFrame                 = BinFrame;
-    // We just memset it next time we use it
     BinFrame = rawFramePointer;
 }
 
-
 // Thx8411:
 // Binning Bayer frames
 // Each raw frame pixel is mapped and summed onto the binned frame
@@ -374,9 +866,11 @@ void CCDChip::binFrame()
 // and
 // ((j/BinX) & 0xFFFFFFFE) + (j & 0x00000001)
 //
+// The binned frame is built row by row, each binned pixel being the sum of the raw pixels
+// mapped onto it, averaged in 8 bits and capped.
 void CCDChip::binBayerFrame()
 {
-    if (BinX == 1)
+    if (BinX == 1 && BinY == 1)
         return;
 
     // Jasem: Keep full frame shadow in memory to enhance performance and just swap frame pointers after operation is complete
@@ -389,84 +883,33 @@ void CCDChip::binBayerFrame()
             BinFrame = static_cast<uint8_t*>(IDSharedBlobAlloc(RawFrameSize));
     }
 
-    memset(BinFrame, 0, RawFrameSize);
+    size_t binBytes = static_cast<size_t>(SubW / BinX) * (SubH / BinY) * (getBPP() / 8);
 
     switch (getBPP())
     {
         // 8 bpp frame
         case 8:
-        {
-            uint32_t BinFrameOffset;
-            uint32_t val;
-            uint32_t BinW = SubW / BinX;
-            uint8_t BinFactor = BinX * BinY;
-            uint32_t RawOffset = 0;
-            uint32_t BinOffsetH;
-
-            // for each raw frame row
-            for (uint32_t i = 0; i < SubH; i++)
-            {
-                // find the binned frame row
-                BinOffsetH = (((i / BinY) & 0xFFFFFFFE) + (i & 0x00000001)) * BinW;
-                // for each raw column
-                for (uint32_t j = 0; j < SubW; j++)
-                {
-                    // find the proper position in the binned frame
-                    BinFrameOffset = BinOffsetH + ((j / BinX) & 0xFFFFFFFE) + (j & 0x00000001);
-                    // get the existing value in the binned frame
-                    val = BinFrame[BinFrameOffset];
-                    // add the new value, averaged and caped
-                    val += RawFrame[RawOffset] / BinFactor;
-                    if(val > UINT8_MAX)
-                        val = UINT8_MAX;
-                    // write back into the binned frame
-                    BinFrame[BinFrameOffset] = static_cast<uint8_t>(val);
-                    // next binned frame pixel
-                    RawOffset++;
-                }
-            }
-        }
-        break;
+            binImage(RawFrame, BinFrame, SubW, SubH, BinX, BinY, true, BinX * BinY, UINT8_MAX);
+            break;
 
         // 16 bpp frame
         case 16:
-        {
-            // works the same as the 8 bits version, without averaging but
-            // mapped onto 16 bits pixel
-            uint16_t *RawFrame16 = reinterpret_cast<uint16_t *>(RawFrame);
-            uint16_t *BinFrame16 = reinterpret_cast<uint16_t *>(BinFrame);
-
-            uint32_t BinFrameOffset;
-            uint32_t val;
-            uint32_t BinW = SubW / BinX;
-            uint32_t RawOffset = 0;
-
-            for (uint32_t i = 0; i < SubH; i++)
-            {
-                uint32_t BinOffsetH = (((i / BinY) & 0xFFFFFFFE) + (i & 0x00000001)) * BinW;
-                for (uint32_t j = 0; j < SubW; j++)
-                {
-                    BinFrameOffset = BinOffsetH + ((j / BinX) & 0xFFFFFFFE) + (j & 0x00000001);
-                    val = BinFrame16[BinFrameOffset];
-                    val += RawFrame16[RawOffset];
-                    if(val > UINT16_MAX)
-                        val = UINT16_MAX;
-                    BinFrame16[BinFrameOffset] = (uint16_t)val;
-                    RawOffset++;
-                }
-            }
-
-        }
-        break;
+            // works the same as the 8 bits version, without averaging
+            binImage(reinterpret_cast<uint16_t *>(RawFrame), reinterpret_cast<uint16_t *>(BinFrame), SubW, SubH, BinX, BinY,
+                     true, 1, UINT16_MAX);
+            break;
 
         default:
             return;
     }
 
+    // Keep the remainder of the frame buffer zeroed
+    if (binBytes < RawFrameSize)
+        memset(BinFrame + binBytes, 0, RawFrameSize - binBytes);
+
     // Swap frame pointers
     uint8_t *rawFramePointer = RawFrame;
     RawFrame                 = BinFrame;
-    // We just memset it next time we use it
     BinFrame = rawFramePointer;
 }
 
@@ -23,6 +23,7 @@
 #include <sys/time.h>
 #include <stdint.h>
 #include <fitsio.h>
+#include <string>
 
 namespace INDI
 {
@@ -64,6 +65,39 @@ class CCDChip
          */
         bool finishFITSFile(int &status);
 
+        /**
+         * @brief writeFITSImage Write the complete in-memory FITS file of an image in a single allocation.
+         * The header is taken from the FITS file opened with openFITSFile, whose image must have been created
+         * with the same number of axes. Its axes sizes are set here, so the header can be built on a small
+         * memory file with placeholder sizes. The header file is closed, and the FITS memory block and size
+         * are set to the final file.
+         * @param naxis Number of axes of the image.
+         * @param naxes Size of each axis.
+         * @param bpp Unsigned samples size, 8, 16 or 32 bits to match BYTE_IMG, USHORT_IMG and ULONG_IMG.
+         * @param image Image samples in native byte order.
+         * @param status FITS error code in case an error happens.
+         * @return True if successful, false otherwise.
+         */
+        bool writeFITSImage(int naxis, const long *naxes, int bpp, const void *image, int &status);
+
+        /**
+         * @brief closeFITSHeader Read the header of the FITS file opened with openFITSFile, then close the file
+         * and release its memory.
+         * @param header The header cards, ending with END.
+         * @param status FITS error code in case an error happens.
+         * @return True if successful, false otherwise.
+         */
+        bool closeFITSHeader(std::string &header, int &status);
+
+        /**
+         * @brief writeFITSImage Write a complete FITS file from a header read with closeFITSHeader, whose image
+         * was created with the same number of axes, in a single allocation. It uses no state of the chip.
+         * @param size Size of the file returned.
+         * @return The file, to be released with IDSharedBlobFree, or nullptr with status set.
+         */
+        static void *writeFITSImage(const std::string &header, int naxis, const long *naxes, int bpp, const void *image,
+                                    size_t &size, int &status);
+
         /**
          * @brief closeFITSFile Close the in-memory FITS File.
          */
@@ -0,0 +1,386 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "indicompression.h"
+#include "indiparallel.h"
+
+#include <fitsio.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace
+{
+
+/// FITS files are made of 2880 bytes blocks of 80 characters cards
+constexpr size_t FITS_BLOCK = 2880;
+constexpr size_t FITS_CARD  = 80;
+
+/// Rice block size used by fpack
+constexpr int RICE_BLOCKSIZE = 32;
+
+/// zlib streams are compressed in chunks, primed with the last window of the previous chunk
+constexpr size_t ZLIB_CHUNK  = 1 << 20;
+constexpr size_t ZLIB_WINDOW = 1 << 15;
+
+size_t fitsBlocks(size_t bytes)
+{
+    return (bytes + FITS_BLOCK - 1) / FITS_BLOCK * FITS_BLOCK;
+}
+
+/// Bands of items to compress in parallel: as many as requested, or what the items are worth
+uint32_t bandCount(uint32_t requested, size_t items, size_t minItems)
+{
+    if (requested > 0)
+        return static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(requested, items)));
+    return INDI::parallelBands(items, minItems);
+}
+
+/// Fixed format card, numbers and logicals are right justified to column 30, strings start at column 11
+std::string card(const char *keyword, const std::string &value, const char *comment)
+{
+    char text[FITS_CARD + 1];
+    snprintf(text, sizeof(text), value[0] == '\'' ? "%-8.8s= %-20s / %s" : "%-8.8s= %20s / %s",
+             keyword, value.c_str(), comment);
+    std::string result(text);
+    result.resize(FITS_CARD, ' ');
+    return result;
+}
+
+std::string card(const char *keyword, long value, const char *comment)
+{
+    return card(keyword, std::to_string(value), comment);
+}
+
+std::string quoted(const char *text)
+{
+    char value[FITS_CARD];
+    snprintf(value, sizeof(value), "'%-8s'", text);
+    return value;
+}
+
+struct FITSImage
+{
+    int bitpix {0};
+    int naxis {0};
+    long naxes[MAX_COMPRESS_DIM] {};
+    /// Cards other than the structural keywords, carried over to the compressed header
+    std::vector<std::string> cards;
+    const uint8_t *data {nullptr};
+    size_t samples {0};
+};
+
+bool parseFITS(const uint8_t *fits, size_t size, FITSImage &image)
+{
+    if (size < FITS_BLOCK || memcmp(fits, "SIMPLE  =", 9) != 0)
+        return false;
+
+    size_t offset = 0;
+    bool end = false;
+    for (; offset + FITS_CARD <= size && !end; offset += FITS_CARD)
+    {
+        const char *text = reinterpret_cast<const char *>(fits + offset);
+        std::string keyword(text, 8);
+        keyword.erase(keyword.find_last_not_of(' ') + 1);
+        long value = strtol(text + 10, nullptr, 10);
+
+        if (keyword == "END")
+            end = true;
+        else if (keyword == "BITPIX")
+            image.bitpix = value;
+        else if (keyword == "NAXIS")
+            image.naxis = value;
+        else if (keyword.compare(0, 5, "NAXIS") == 0)
+        {
+            int axis = atoi(keyword.c_str() + 5);
+            if (axis < 1 || axis > MAX_COMPRESS_DIM)
+                return false;
+            image.naxes[axis - 1] = value;
+        }
+        else if (keyword != "SIMPLE" && keyword != "EXTEND" && keyword != "CHECKSUM" && keyword != "DATASUM")
+            image.cards.emplace_back(text, FITS_CARD);
+    }
+
+    if (!end || (image.bitpix != 8 && image.bitpix != 16 && image.bitpix != 32) ||
+            image.naxis < 1 || image.naxis > MAX_COMPRESS_DIM)
+        return false;
+
+    image.samples = 1;
+    for (int i = 0; i < image.naxis; i++)
+    {
+        if (image.naxes[i] <= 0)
+            return false;
+        image.samples *= image.naxes[i];
+    }
+
+    size_t dataOffset = fitsBlocks(offset);
+    if (dataOffset + image.samples * (image.bitpix / 8) > size)
+        return false;
+
+    image.data = fits + dataOffset;
+    return true;
+}
+
+/**
+ * @brief riceTile Rice compress a tile of big endian samples.
+ * @return Compressed size, negative if the output buffer is too small.
+ */
+int riceTile(const uint8_t *tile, int samples, int bytepix, std::vector<int32_t> &scratch, uint8_t *out, int outSize)
+{
+    switch (bytepix)
+    {
+        case 1:
+            return fits_rcomp_byte(reinterpret_cast<signed char *>(const_cast<uint8_t *>(tile)), samples, out, outSize,
+                                   RICE_BLOCKSIZE);
+
+        case 2:
+        {
+            short *values = reinterpret_cast<short *>(scratch.data());
+            for (int i = 0; i < samples; i++)
+                values[i] = static_cast<short>((tile[2 * i] << 8) | tile[2 * i + 1]);
+            return fits_rcomp_short(values, samples, out, outSize, RICE_BLOCKSIZE);
+        }
+
+        default:
+            for (int i = 0; i < samples; i++)
+                scratch[i] = static_cast<int32_t>((uint32_t(tile[4 * i]) << 24) | (tile[4 * i + 1] << 16) |
+                                                  (tile[4 * i + 2] << 8) | tile[4 * i + 3]);
+            return fits_rcomp(scratch.data(), samples, out, outSize, RICE_BLOCKSIZE);
+    }
+}
+
+void writeBigEndian32(uint8_t *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = (value >> 16) & 0xFF;
+    out[2] = (value >> 8) & 0xFF;
+    out[3] = value & 0xFF;
+}
+
+bool deflateChunk(const uint8_t *input, size_t begin, size_t length, bool last, int level, std::vector<uint8_t> &out)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    if (begin > 0)
+    {
+        size_t window = std::min(begin, ZLIB_WINDOW);
+        deflateSetDictionary(&stream, input + begin - window, window);
+    }
+
+    // Room for the empty stored block that ends a sync flush
+    out.resize(deflateBound(&stream, length) + 16);
+    stream.next_in   = const_cast<Bytef *>(input + begin);
+    stream.avail_in  = length;
+    stream.next_out  = out.data();
+    stream.avail_out = out.size();
+
+    // Every chunk but the last ends on a byte boundary so the chunks can be concatenated
+    int rc = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    bool ok = (last ? rc == Z_STREAM_END : rc == Z_OK) && stream.avail_in == 0 && stream.avail_out > 0;
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return ok;
+}
+
+}
+
+namespace INDI
+{
+
+bool compressFITSTiles(const void *fits, size_t size, std::vector<uint8_t> &compressed, uint32_t threads)
+{
+    FITSImage image;
+    if (!parseFITS(static_cast<const uint8_t *>(fits), size, image))
+        return false;
+
+    // One tile per row, as fpack does by default
+    const int bytepix    = image.bitpix / 8;
+    const long tileWidth = image.naxes[0];
+    const size_t tiles   = image.samples / tileWidth;
+    if (tileWidth > INT_MAX / 8)
+        return false;
+    const int bound = tileWidth * bytepix + tileWidth / RICE_BLOCKSIZE + 16;
+
+    // Each band of tiles is compressed into its own heap
+    std::vector<std::vector<uint8_t>> heaps(bandCount(threads, tiles, std::max<size_t>(1, (1u << 18) / tileWidth)));
+    std::vector<uint32_t> tileSizes(tiles);
+    std::atomic<bool> failed {false};
+
+    INDI::parallelFor(tiles, heaps.size(), [&](uint32_t band, size_t first, size_t last)
+    {
+        std::vector<uint8_t> &heap = heaps[band];
+        std::vector<int32_t> scratch(tileWidth);
+        heap.reserve((last - first) * tileWidth * bytepix / 2);
+
+        for (size_t tile = first; tile < last && !failed; tile++)
+        {
+            size_t used = heap.size();
+            heap.resize(used + bound);
+            int rc = riceTile(image.data + tile * tileWidth * bytepix, tileWidth, bytepix, scratch, heap.data() + used, bound);
+            if (rc < 0)
+            {
+                failed = true;
+                break;
+            }
+            heap.resize(used + rc);
+            tileSizes[tile] = rc;
+        }
+    });
+
+    size_t heapSize = 0;
+    for (auto &heap : heaps)
+        heapSize += heap.size();
+
+    if (failed || heapSize > INT32_MAX)
+        return false;
+
+    std::string primary = card("SIMPLE", "T", "file does conform to FITS standard") +
+                          card("BITPIX", 8, "number of bits per data pixel") +
+                          card("NAXIS", 0, "number of data axes") +
+                          card("EXTEND", "T", "FITS dataset may contain extensions");
+    primary += "END";
+    primary.resize(FITS_BLOCK, ' ');
+
+    char tform[FITS_CARD];
+    snprintf(tform, sizeof(tform), "1PB(%u)", *std::max_element(tileSizes.begin(), tileSizes.end()));
+
+    std::string header = card("XTENSION", quoted("BINTABLE"), "binary table extension") +
+                         card("BITPIX", 8, "8-bit bytes") +
+                         card("NAXIS", 2, "2-dimensional binary table") +
+                         card("NAXIS1", 8, "width of table in bytes") +
+                         card("NAXIS2", tiles, "number of rows in table") +
+                         card("PCOUNT", heapSize, "size of special data area") +
+                         card("GCOUNT", 1, "one data group (required keyword)") +
+                         card("TFIELDS", 1, "number of fields in each row") +
+                         card("TTYPE1", quoted("COMPRESSED_DATA"), "label for field   1") +
+                         card("TFORM1", quoted(tform), "data format of field: variable length array") +
+                         card("ZIMAGE", "T", "extension contains compressed image") +
+                         card("ZSIMPLE", "T", "file does conform to FITS standard") +
+                         card("ZBITPIX", image.bitpix, "data type of original image") +
+                         card("ZNAXIS", image.naxis, "dimension of original image");
+    for (int i = 0; i < image.naxis; i++)
+    {
+        char keyword[FLEN_KEYWORD];
+        snprintf(keyword, sizeof(keyword), "ZNAXIS%d", i + 1);
+        header += card(keyword, image.naxes[i], "length of original image axis");
+    }
+    for (int i = 0; i < image.naxis; i++)
+    {
+        char keyword[FLEN_KEYWORD];
+        snprintf(keyword, sizeof(keyword), "ZTILE%d", i + 1);
+        header += card(keyword, i == 0 ? tileWidth : 1, "size of tiles to be compressed");
+    }
+    header += card("ZCMPTYPE", quoted("RICE_1"), "compression algorithm") +
+              card("ZNAME1", quoted("BLOCKSIZE"), "compression block size") +
+              card("ZVAL1", RICE_BLOCKSIZE, "pixels per block") +
+              card("ZNAME2", quoted("BYTEPIX"), "bytes per pixel (1, 2, 4, or 8)") +
+              card("ZVAL2", bytepix, "bytes per pixel (1, 2, 4, or 8)") +
+              card("EXTNAME", quoted("COMPRESSED_IMAGE"), "name of this binary table extension");
+    for (auto &original : image.cards)
+        header += original;
+    header += "END";
+    header.resize(fitsBlocks(header.size()), ' ');
+
+    size_t tableSize = 8 * tiles;
+    compressed.assign(primary.size() + header.size() + fitsBlocks(tableSize + heapSize), 0);
+
+    uint8_t *out = compressed.data();
+    memcpy(out, primary.data(), primary.size());
+    out += primary.size();
+    memcpy(out, header.data(), header.size());
+    out += header.size();
+
+    // Table rows are the size and heap offset of each tile, followed by the heap
+    uint32_t heapOffset = 0;
+    for (size_t tile = 0; tile < tiles; tile++)
+    {
+        writeBigEndian32(out + 8 * tile, tileSizes[tile]);
+        writeBigEndian32(out + 8 * tile + 4, heapOffset);
+        heapOffset += tileSizes[tile];
+    }
+    out += tableSize;
+
+    for (auto &heap : heaps)
+    {
+        memcpy(out, heap.data(), heap.size());
+        out += heap.size();
+    }
+
+    return true;
+}
+
+bool compressZlib(const void *data, size_t size, std::vector<uint8_t> &compressed, int level, uint32_t threads)
+{
+    const uint8_t *input = static_cast<const uint8_t *>(data);
+    level = std::min(std::max(level, 1), 9);
+
+    size_t chunks = std::max<size_t>(1, (size + ZLIB_CHUNK - 1) / ZLIB_CHUNK);
+    std::vector<std::vector<uint8_t>> outputs(chunks);
+    std::vector<uLong> checksums(chunks);
+    std::atomic<bool> failed {false};
+
+    INDI::parallelFor(chunks, bandCount(threads, chunks, 1), [&](uint32_t, size_t first, size_t last)
+    {
+        for (size_t chunk = first; chunk < last && !failed; chunk++)
+        {
+            size_t begin  = chunk * ZLIB_CHUNK;
+            size_t length = std::min(size - begin, ZLIB_CHUNK);
+            if (!deflateChunk(input, begin, length, chunk == chunks - 1, level, outputs[chunk]))
+                failed = true;
+            checksums[chunk] = adler32(adler32(0L, Z_NULL, 0), input + begin, length);
+        }
+    });
+
+    if (failed)
+        return false;
+
+    // zlib header for a 32K window deflate stream, and the Adler-32 checksum of the whole input
+    const uint8_t cmf = 0x78;
+    uint8_t flg = (level == 1 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+    flg += (31 - ((cmf << 8) | flg) % 31) % 31;
+
+    uLong checksum = checksums[0];
+    size_t total   = 2 + outputs[0].size() + 4;
+    for (size_t chunk = 1; chunk < chunks; chunk++)
+    {
+        checksum = adler32_combine(checksum, checksums[chunk], std::min(size - chunk * ZLIB_CHUNK, ZLIB_CHUNK));
+        total += outputs[chunk].size();
+    }
+
+    compressed.resize(total);
+    uint8_t *out = compressed.data();
+    *out++ = cmf;
+    *out++ = flg;
+    for (auto &output : outputs)
+    {
+        memcpy(out, output.data(), output.size());
+        out += output.size();
+    }
+    writeBigEndian32(out, checksum);
+
+    return true;
+}
+
+}
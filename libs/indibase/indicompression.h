@@ -0,0 +1,49 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace INDI
+{
+
+/**
+ * @brief compressFITSTiles Compress a FITS image to a standard tile compressed FITS file (.fits.fz), as fpack
+ * does with its default settings: one Rice compressed tile per row. The tiles are compressed on several threads.
+ * @param fits FITS file holding a single 8, 16 or 32 bits integer image in its primary HDU.
+ * @param size Size of the FITS file in bytes.
+ * @param compressed Compressed FITS file.
+ * @param threads Number of parts compressed in parallel, 0 for one per core when the data is large enough.
+ * @return False if the FITS file is not supported, in which case it can still be compressed with fpack.
+ */
+bool compressFITSTiles(const void *fits, size_t size, std::vector<uint8_t> &compressed, uint32_t threads = 0);
+
+/**
+ * @brief compressZlib Compress a buffer to a zlib stream, as compress2 does. The buffer is split into chunks that
+ * are deflated on several threads, each chunk using the end of the previous one as dictionary.
+ * @param data Data to compress.
+ * @param size Size of the data in bytes.
+ * @param compressed Compressed zlib stream.
+ * @param level Compression level, 1 (fastest) to 9 (best).
+ * @param threads Number of parts compressed in parallel, 0 for one per core when the data is large enough.
+ * @return True if successful, false otherwise.
+ */
+bool compressZlib(const void *data, size_t size, std::vector<uint8_t> &compressed, int level, uint32_t threads = 0);
+
+}
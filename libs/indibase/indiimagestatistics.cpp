@@ -0,0 +1,259 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "indiimagestatistics.h"
+#include "indiparallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace
+{
+
+// 8 and 16 bits frames are reduced to a histogram of every possible value in one pass,
+// all the statistics are then derived from the histogram, which is small next to the frame.
+// 32 bits frames are reduced to min, max, sums and a histogram of the upper 16 bits.
+
+/// Samples worth a band of their own, each band keeps its own tables
+constexpr size_t bandSamples = size_t(1) << 18;
+
+// Tables count in 32 bits, flushed to the 64 bits counts every UINT32_MAX samples
+constexpr size_t countChunk = std::numeric_limits<uint32_t>::max();
+
+void countValues(const uint8_t *buffer, size_t count, uint64_t *counts)
+{
+    // Four interleaved tables avoid serializing on runs of equal values
+    uint32_t table[4][256];
+
+    for (size_t first = 0; first < count; first += countChunk)
+    {
+        size_t last = std::min(count, first + countChunk);
+        size_t i = first;
+        std::fill(&table[0][0], &table[0][0] + 4 * 256, 0);
+        for (; i + 4 <= last; i += 4)
+        {
+            table[0][buffer[i + 0]]++;
+            table[1][buffer[i + 1]]++;
+            table[2][buffer[i + 2]]++;
+            table[3][buffer[i + 3]]++;
+        }
+        for (; i < last; i++)
+            table[0][buffer[i]]++;
+
+        for (int v = 0; v < 256; v++)
+            counts[v] += uint64_t(table[0][v]) + table[1][v] + table[2][v] + table[3][v];
+    }
+}
+
+void countValues(const uint16_t *buffer, size_t count, uint64_t *counts)
+{
+    std::vector<uint32_t> table(65536);
+
+    for (size_t first = 0; first < count; first += countChunk)
+    {
+        size_t last = std::min(count, first + countChunk);
+        size_t i = first;
+        for (; i + 4 <= last; i += 4)
+        {
+            table[buffer[i + 0]]++;
+            table[buffer[i + 1]]++;
+            table[buffer[i + 2]]++;
+            table[buffer[i + 3]]++;
+        }
+        for (; i < last; i++)
+            table[buffer[i]]++;
+
+        for (int v = 0; v < 65536; v++)
+        {
+            counts[v] += table[v];
+            table[v] = 0;
+        }
+    }
+}
+
+template <typename T>
+void statisticsFromCounts(const T *buffer, size_t samples, INDI::ImageStatistics &stats, size_t histogramBins)
+{
+    constexpr size_t values = size_t(1) << (sizeof(T) * 8);
+    uint32_t bands = INDI::parallelBands(samples, bandSamples);
+    std::vector<std::vector<uint64_t>> partial(bands, std::vector<uint64_t>(values));
+
+    INDI::parallelFor(samples, bands, [&](uint32_t band, size_t first, size_t last)
+    {
+        countValues(buffer + first, last - first, partial[band].data());
+    });
+
+    std::vector<uint64_t> &counts = partial[0];
+    for (uint32_t t = 1; t < bands; t++)
+        for (size_t v = 0; v < values; v++)
+            counts[v] += partial[t][v];
+
+    size_t low = 0, high = values - 1;
+    while (counts[low] == 0)
+        low++;
+    while (counts[high] == 0)
+        high--;
+
+    double sum = 0;
+    for (size_t v = low; v <= high; v++)
+        sum += double(v) * counts[v];
+    double mean = sum / samples;
+
+    double variance = 0;
+    uint64_t cumulative = 0, half = (samples - 1) / 2;
+    bool medianFound = false;
+    for (size_t v = low; v <= high; v++)
+    {
+        variance += (v - mean) * (v - mean) * counts[v];
+        cumulative += counts[v];
+        if (!medianFound && cumulative > half)
+        {
+            stats.median = v;
+            medianFound = true;
+        }
+    }
+
+    stats.min    = low;
+    stats.max    = high;
+    stats.mean   = mean;
+    stats.stddev = std::sqrt(variance / samples);
+
+    if (histogramBins > 0)
+    {
+        uint64_t range = high - low + 1;
+        for (size_t v = low; v <= high; v++)
+            stats.histogram[(v - low) * histogramBins / range] += counts[v];
+    }
+}
+
+struct Partial32
+{
+    uint32_t min {std::numeric_limits<uint32_t>::max()};
+    uint32_t max {0};
+    uint64_t sum {0};
+    double sumSquares {0};
+    std::vector<uint64_t> counts;
+};
+
+void statistics32(const uint32_t *buffer, size_t samples, INDI::ImageStatistics &stats, size_t histogramBins)
+{
+    uint32_t bands = INDI::parallelBands(samples, bandSamples);
+    std::vector<Partial32> partial(bands);
+
+    INDI::parallelFor(samples, bands, [&](uint32_t band, size_t first, size_t last)
+    {
+        Partial32 &p = partial[band];
+        p.counts.resize(65536);
+        uint32_t min = p.min, max = p.max;
+        uint64_t sum = 0;
+        double sumSquares = 0;
+        for (size_t i = first; i < last; i++)
+        {
+            uint32_t v = buffer[i];
+            min = std::min(min, v);
+            max = std::max(max, v);
+            sum += v;
+            sumSquares += double(v) * v;
+            p.counts[v >> 16]++;
+        }
+        p.min = min;
+        p.max = max;
+        p.sum = sum;
+        p.sumSquares = sumSquares;
+    });
+
+    Partial32 &total = partial[0];
+    for (uint32_t t = 1; t < bands; t++)
+    {
+        total.min = std::min(total.min, partial[t].min);
+        total.max = std::max(total.max, partial[t].max);
+        total.sum += partial[t].sum;
+        total.sumSquares += partial[t].sumSquares;
+        for (size_t v = 0; v < 65536; v++)
+            total.counts[v] += partial[t].counts[v];
+    }
+
+    stats.min    = total.min;
+    stats.max    = total.max;
+    stats.mean   = double(total.sum) / samples;
+    stats.stddev = std::sqrt(std::max(0.0, total.sumSquares / samples - stats.mean * stats.mean));
+
+    // Use the middle of each coarse bin, within the range of the frame
+    auto coarseValue = [&](size_t bin)
+    {
+        return std::min<double>(std::max<double>((bin << 16) + 0x8000, total.min), total.max);
+    };
+
+    uint64_t cumulative = 0, half = (samples - 1) / 2;
+    for (size_t v = 0; v < 65536; v++)
+    {
+        cumulative += total.counts[v];
+        if (cumulative > half)
+        {
+            stats.median = coarseValue(v);
+            break;
+        }
+    }
+
+    if (histogramBins > 0)
+    {
+        double range = double(total.max) - total.min + 1;
+        for (size_t v = total.min >> 16; v <= (total.max >> 16); v++)
+        {
+            size_t bin = static_cast<size_t>((coarseValue(v) - total.min) * histogramBins / range);
+            stats.histogram[std::min(bin, histogramBins - 1)] += total.counts[v];
+        }
+    }
+}
+
+}
+
+namespace INDI
+{
+
+bool computeImageStatistics(const void *buffer, size_t samples, int bpp, ImageStatistics &stats, size_t histogramBins)
+{
+    stats = ImageStatistics();
+    stats.histogram.assign(histogramBins, 0);
+
+    if (bpp != 8 && bpp != 16 && bpp != 32)
+        return false;
+
+    stats.samples = samples;
+    if (samples == 0 || buffer == nullptr)
+        return true;
+
+    switch (bpp)
+    {
+        case 8:
+            statisticsFromCounts(static_cast<const uint8_t *>(buffer), samples, stats, histogramBins);
+            break;
+
+        case 16:
+            statisticsFromCounts(static_cast<const uint16_t *>(buffer), samples, stats, histogramBins);
+            break;
+
+        case 32:
+            statistics32(static_cast<const uint32_t *>(buffer), samples, stats, histogramBins);
+            break;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,57 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace INDI
+{
+
+/**
+ * @brief The ImageStatistics struct holds the statistics of a frame, see computeImageStatistics.
+ */
+struct ImageStatistics
+{
+    /// Number of samples the statistics were computed on
+    size_t samples {0};
+    double min {0};
+    double max {0};
+    double mean {0};
+    /// Population standard deviation
+    double stddev {0};
+    /// Exact (lower) median for 8 and 16 bits frames, estimated within 65536 for 32 bits frames
+    double median {0};
+    /// Sample counts in bins evenly spaced from min to max, empty unless requested
+    std::vector<uint64_t> histogram;
+};
+
+/**
+ * @brief computeImageStatistics Compute min, max, mean, standard deviation, median and histogram of a
+ * frame in a single pass over the buffer. Large frames are split across threads.
+ * @param buffer Frame buffer of unsigned samples.
+ * @param samples Number of samples in the buffer.
+ * @param bpp Bits per sample, 8, 16 or 32.
+ * @param stats Computed statistics.
+ * @param histogramBins Number of histogram bins, 0 to skip the histogram.
+ * @return False if the sample size is not supported.
+ */
+bool computeImageStatistics(const void *buffer, size_t samples, int bpp, ImageStatistics &stats,
+                            size_t histogramBins = 0);
+
+}
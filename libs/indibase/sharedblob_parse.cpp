@@ -66,7 +66,10 @@ static uint64_t idGenerator = rand();
             receivedFds.erase(where);
         }
 
-        return IDSharedBlobAttach(fd, size);
+        void *blob = IDSharedBlobAttach(fd, size);
+        if (blob == nullptr)
+            ::close(fd);
+        return blob;
     }
 
     void releaseBlobUids(const std::vector<std::string> &blobs)
@@ -0,0 +1,172 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "indiparallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+uint32_t coreCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * Threads running the bands of parallelFor. The calling thread runs bands too, and while waiting for its own
+ * bands it runs any queued band, so nested or concurrent calls can not wait on each other.
+ */
+class WorkerPool
+{
+    public:
+        using Work = std::function<void(uint32_t band, size_t first, size_t last)>;
+
+        static WorkerPool &instance()
+        {
+            static WorkerPool pool(coreCount() - 1);
+            return pool;
+        }
+
+        void run(size_t count, uint32_t bands, const Work &work)
+        {
+            Batch batch {&work, count, (count + bands - 1) / bands, bands};
+
+            std::unique_lock<std::mutex> lock(mutex);
+            for (uint32_t band = 1; band < bands; band++)
+                tasks.push_back({&batch, band});
+            ready.notify_all();
+
+            runTask({&batch, 0}, lock);
+
+            while (batch.left > 0)
+            {
+                if (tasks.empty())
+                {
+                    done.wait(lock);
+                    continue;
+                }
+                Task task = tasks.front();
+                tasks.pop_front();
+                runTask(task, lock);
+            }
+        }
+
+    private:
+        struct Batch
+        {
+            const Work *work;
+            size_t count;
+            size_t step;
+            uint32_t left;  // bands not done yet, guarded by mutex
+        };
+
+        struct Task
+        {
+            Batch *batch;
+            uint32_t band;
+        };
+
+        explicit WorkerPool(uint32_t threadCount)
+        {
+            for (uint32_t i = 0; i < threadCount; i++)
+                threads.emplace_back(&WorkerPool::worker, this);
+        }
+
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                terminate = true;
+            }
+            ready.notify_all();
+            for (auto &thread : threads)
+                thread.join();
+        }
+
+        // Called and returns with the lock held
+        void runTask(Task task, std::unique_lock<std::mutex> &lock)
+        {
+            lock.unlock();
+            Batch *batch = task.batch;
+            size_t first = std::min(batch->count, task.band * batch->step);
+            (*batch->work)(task.band, first, std::min(batch->count, first + batch->step));
+            lock.lock();
+
+            if (--batch->left == 0)
+                done.notify_all();
+        }
+
+        void worker()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                ready.wait(lock, [this]()
+                {
+                    return terminate || !tasks.empty();
+                });
+                if (tasks.empty())
+                    return;
+
+                Task task = tasks.front();
+                tasks.pop_front();
+                runTask(task, lock);
+            }
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::condition_variable done;
+        std::deque<Task> tasks;
+        bool terminate {false};
+        std::vector<std::thread> threads;
+};
+
+}
+
+namespace INDI
+{
+
+uint32_t parallelThreads()
+{
+    return coreCount();
+}
+
+uint32_t parallelBands(size_t count, size_t minCount)
+{
+    size_t bands = count / std::max<size_t>(1, minCount);
+    return static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(bands, coreCount())));
+}
+
+void parallelFor(size_t count, uint32_t bands, const std::function<void(uint32_t band, size_t first, size_t last)> &work)
+{
+    bands = static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(bands, count)));
+    if (bands == 1)
+    {
+        work(0, 0, count);
+        return;
+    }
+    WorkerPool::instance().run(count, bands, work);
+}
+
+}
@@ -0,0 +1,51 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace INDI
+{
+
+/**
+ * @brief Number of bands parallelFor runs at the same time, one per processor core.
+ */
+uint32_t parallelThreads();
+
+/**
+ * @brief Number of bands to split count items into for parallelFor.
+ * @param count Number of items
+ * @param minCount Smallest number of items worth a band of its own
+ * @return At least 1, and no more than the number of processor cores
+ */
+uint32_t parallelBands(size_t count, size_t minCount);
+
+/**
+ * @brief Split [0, count) in bands of consecutive items and process them in parallel.
+ *
+ * work(band, first, last) is called once per band, from the calling thread and from the threads of a pool
+ * shared by the whole process. The pool is started on first use and kept, so frames do not pay for thread
+ * creation. Returns once every band is done.
+ * @param count Number of items
+ * @param bands Number of bands, see parallelBands. With 1 band, work is simply called on the calling thread.
+ * @param work Processes the items [first, last) of the given band
+ */
+void parallelFor(size_t count, uint32_t bands, const std::function<void(uint32_t band, size_t first, size_t last)> &work);
+
+}
@@ -342,6 +342,14 @@ void IUUserIOEnableBLOB(
     const userio *io, void *user,
     const char *dev, const char *name, BLOBHandling blobH
 )
+{
+    IUUserIOEnableBLOBEncoding(io, user, dev, name, blobH, NULL);
+}
+
+void IUUserIOEnableBLOBEncoding(
+    const userio *io, void *user,
+    const char *dev, const char *name, BLOBHandling blobH, const char *encoding
+)
 {
     userio_prints(io, user, "<enableBLOB device='");
     userio_xml_escape(io, user, dev);
@@ -350,6 +358,11 @@ void IUUserIOEnableBLOB(
         userio_prints(io, user, "' name='");
         userio_xml_escape(io, user, name);
     }
+    if (encoding != NULL)
+    {
+        userio_prints(io, user, "' encoding='");
+        userio_xml_escape(io, user, encoding);
+    }
     userio_prints(io, user, "'>");
     userio_prints(io, user, s_BLOBHandlingtoString(blobH));
     userio_prints(io, user, "</enableBLOB>\n");
@@ -62,6 +62,12 @@ void IUUserIOEnableBLOB(
     const char *dev, const char *name, BLOBHandling blobH
 );
 
+/** @brief Same as IUUserIOEnableBLOB, asking for a specific BLOB encoding (e.g. "raw"). NULL means default base64. */
+void IUUserIOEnableBLOBEncoding(
+    const userio *io, void *user,
+    const char *dev, const char *name, BLOBHandling blobH, const char *encoding
+);
+
 // Define
 void IUUserIODefTextVA(const userio *io, void *user, const struct _ITextVectorProperty *tvp, const char *fmt, va_list ap);
 void IUUserIODefNumberVA(const userio *io, void *user, const struct _INumberVectorProperty *n, const char *fmt, va_list ap);
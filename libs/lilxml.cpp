@@ -36,6 +36,12 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 #include <string.h>
 #include <assert.h>
 
+#include "base64.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #if defined(_MSC_VER)
 #define snprintf _snprintf
 #pragma warning(push)
@@ -45,14 +51,20 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 
 #include "lilxml.h"
 
+typedef struct XMLArena_ XMLArena;
+
 /* used to efficiently manage growing malloced string space */
 typedef struct
 {
-    char *s; /* malloced memory for string */
-    int sl;  /* string length, sans trailing \0 */
-    int sm;  /* total malloced bytes */
+    char *s;         /* malloced memory for string */
+    int sl;          /* string length, sans trailing \0 */
+    int sm;          /* total malloced bytes */
+    XMLArena *arena; /* arena holding s, NULL if malloced */
 } String;
 #define MINMEM 64 /* starting string length */
+#define ARENA_MINMEM 16 /* starting string length in an arena */
+#define MAXRAWLEN (512 * 1024 * 1024) /* largest raw content accepted */
+#define MAXBLOBRESERVE (4 * 1024 * 1024) /* largest BLOB allocated before its content comes */
 
 static int oneXMLchar(LilXML *lp, int c, char ynot[]);
 static void initParser(LilXML *lp);
@@ -60,15 +72,33 @@ static void pushXMLEle(LilXML *lp);
 static void popXMLEle(LilXML *lp);
 static void resetEndTag(LilXML *lp);
 static XMLAtt *growAtt(XMLEle *e);
-static XMLEle *growEle(XMLEle *pe);
+static XMLEle *growEle(XMLEle *pe, XMLArena *arena);
+static void delParsedXML(LilXML *lp);
 static void freeAtt(XMLAtt *a);
 static int isTokenChar(int start, int c);
 static void growString(String *sp, int c);
 static void appendString(String *sp, const char *str);
+static void appendBytes(String *sp, const char *buf, int n);
+static int startContent(LilXML *lp, char ynot[]);
+static int rawXMLchars(LilXML *lp, const char *buf, int n);
 static void freeString(String *sp);
 static void newString(String *sp);
+static void reserveString(String *sp, int l);
 static void *moremem(void *old, int n);
+static void **growArray(void **array, int n, XMLArena *arena);
+static XMLArena *newArena();
+static void delArena(XMLArena *a);
+static void *arenaAlloc(XMLArena *a, size_t n);
+static void *arenaRealloc(XMLArena *a, void *old, size_t oldn, size_t n);
+static void arenaFree(XMLArena *a, void *p, size_t n);
+static int contentRun(const char *buf, int n, int *nlines);
+static int attrValueRun(const char *buf, int n, int delim, int *nlines);
+static int startBLOB(LilXML *lp, char ynot[]);
+static int decodeBLOB(LilXML *lp, const char *buf, int n);
+static void endBLOB(LilXML *lp);
+static void freeBLOBs(XMLEle *ep);
 static void appXMLEle(XMLEle *ep, XMLEle *newep);
+static XMLEle **abortChunk(LilXML *lp, XMLEle **nodes);
 
 typedef enum
 {
@@ -86,7 +116,11 @@ typedef enum
     ENTINCON,       /* in entity in pcdata */
     SAWLTINCON,     /* saw < in content */
     LOOK4CLOSETAG,  /* looking for closing tag after < */
-    INCLOSETAG      /* reading closing tag */
+    INCLOSETAG,     /* reading closing tag */
+    LOOK4RAWCON,    /* expecting the newline before raw content */
+    INRAWCON,       /* reading raw content */
+    AFTERRAWCON,    /* looking for < after raw content */
+    INBLOBCON       /* decoding base64 content of a oneBLOB */
 } State;            /* parsing states */
 
 /* maintain state while parsing */
@@ -101,6 +135,13 @@ struct LilXML_
     int lastc;     /* last char (just used wiht skipping)*/
     int skipping;  /* in comment or declaration */
     int inblob;    /* in oneBLOB element */
+    int rawcontent; /* honour rawlen attributes */
+    int rawleft;   /* raw content bytes still to read */
+    int usearena;  /* allocate each tree from its own arena */
+    void *(*blobrealloc)(void *ptr, size_t size); /* BLOB sink, decodes oneBLOB content if set */
+    void (*blobfree)(void *ptr);
+    char b64quad[4]; /* base64 chars not yet decoded */
+    int b64n;
 };
 
 /* internal representation of a (possibly nested) XML element */
@@ -116,16 +157,57 @@ struct xml_ele_
     int eit;           /* used to iterate over el[] */
     String pcdata;     /* character data in this element */
     int pcdata_hasent; /* 1 if pcdata contains an entity char*/
+    XMLArena *arena;   /* arena holding this element and its descendants, NULL if malloced */
+    void *blob;        /* content decoded by the BLOB sink */
+    size_t bloblen;    /* decoded bytes in blob */
+    size_t blobsize;   /* bytes allocated for blob */
+    void (*blobfree)(void *ptr);
 };
 
 /* internal representation of an attribute */
 struct xml_att_
 {
-    String name; /* name */
-    String valu; /* value */
-    XMLEle *ce;  /* containing element */
+    String name;     /* name */
+    String valu;     /* value */
+    XMLEle *ce;      /* containing element */
+    XMLArena *arena; /* arena holding this attribute, NULL if malloced */
+};
+
+/* Memory of a tree parsed in arena mode.
+ * Small allocations are carved from blocks, the last one can grow in place.
+ * Large ones, such as BLOB content, are malloced on their own to be resized without copies.
+ * Everything is freed at once when the root is deleted.
+ */
+typedef struct XMLArenaBlock_
+{
+    struct XMLArenaBlock_ *next;
+    size_t size; /* bytes in the block, after this header */
+    size_t used;
+} XMLArenaBlock;
+
+typedef struct XMLArenaLarge_
+{
+    struct XMLArenaLarge_ *prev;
+    struct XMLArenaLarge_ *next;
+} XMLArenaLarge;
+
+struct XMLArena_
+{
+    XMLArenaBlock *blocks; /* current block first */
+    XMLArenaLarge *large;  /* large allocations */
+    XMLEle *root;          /* element owning the arena */
+    char *last;            /* last allocation in the current block, can grow in place */
+    int nblobs;            /* elements holding a decoded BLOB */
 };
 
+#define ARENA_ALIGN 16
+#define ARENA_BLOCK 4096    /* size of the first block, the following ones double up to ARENA_MAXBLOCK */
+#define ARENA_MAXBLOCK 65536
+#define ARENA_LARGE 2048    /* allocations larger than this are malloced on their own */
+
+/* empty string of the arena elements and attributes until something is appended */
+static char arenaEmpty[1] = "";
+
 /* characters that need escaping as "entities" in attr values and pcdata
  */
 static char entities[] = "&<>'\"";
@@ -155,14 +237,43 @@ LilXML *newLilXML()
     return (lp);
 }
 
+/* let elements with a rawlen attribute carry that many bytes of content, as is */
+void allowRawContentXML(LilXML *lp, int allow)
+{
+    lp->rawcontent = allow;
+}
+
+/* allocate each parsed tree from an arena and take runs of text at once */
+void useArenaXML(LilXML *lp, int use)
+{
+    lp->usearena = use;
+}
+
+/* decode the content of oneBLOB elements as it comes, to buffers obtained with blobrealloc */
+void setBLOBSinkXML(LilXML *lp, void *(*blobrealloc)(void *ptr, size_t size), void (*blobfree)(void *ptr))
+{
+    lp->blobrealloc = blobrealloc;
+    lp->blobfree    = blobfree;
+}
+
 /* discard */
 void delLilXML(LilXML *lp)
 {
-    delXMLEle(lp->ce);
+    delParsedXML(lp);
     freeString(&lp->endtag);
     (*myfree)(lp);
 }
 
+/* delete the tree being parsed, from its root */
+static void delParsedXML(LilXML *lp)
+{
+    XMLEle *root = lp->ce;
+    while (root && root->pe)
+        root = root->pe;
+    delXMLEle(root);
+    lp->ce = NULL;
+}
+
 /* delete ep and all its children and remove from parent's list if known */
 void delXMLEle(XMLEle *ep)
 {
@@ -172,7 +283,31 @@ void delXMLEle(XMLEle *ep)
     if (!ep)
         return;
 
+    /* the parts of arena elements go with the arena, which goes with the root */
+    if (ep->arena)
+    {
+        if (ep->arena->nblobs > 0)
+            freeBLOBs(ep);
+        if (ep->pe)
+        {
+            XMLEle *pe = ep->pe;
+            for (i = 0; i < pe->nel; i++)
+            {
+                if (pe->el[i] == ep)
+                {
+                    memmove(&pe->el[i], &pe->el[i + 1], (--pe->nel - i) * sizeof(XMLEle *));
+                    break;
+                }
+            }
+        }
+        if (ep->arena->root == ep)
+            delArena(ep->arena);
+        return;
+    }
+
     /* delete all parts of ep */
+    if (ep->blob)
+        ep->blobfree(ep->blob);
     freeString(&ep->tag);
     freeString(&ep->pcdata);
     if (ep->at)
@@ -211,6 +346,16 @@ void delXMLEle(XMLEle *ep)
     (*myfree)(ep);
 }
 
+/* the rest of the input can not be parsed, drop what parseXMLChunk collected so far and report the error */
+static XMLEle **abortChunk(LilXML *lp, XMLEle **nodes)
+{
+    initParser(lp);
+    for (int i = 0; nodes[i]; i++)
+        delXMLEle(nodes[i]);
+    free(nodes);
+    return NULL;
+}
+
 //#define WITH_MEMCHR
 XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
 {
@@ -237,8 +382,7 @@ XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
         char *ltpos = memchr(buf, '<', size);
         if (!ltpos)
         {
-            lp->ce->pcdata.s = (char *)moremem(lp->ce->pcdata.s, lp->ce->pcdata.sm + size);
-            lp->ce->pcdata.sm += size;
+            reserveString(&lp->ce->pcdata, lp->ce->pcdata.sm + size);
             memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
             lp->ce->pcdata.sl += size;
             return nodes;
@@ -264,7 +408,8 @@ XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
                     // Add room for those '\n' on every 72 character line + extra half-full line.
                     blen += (blen / 72) + 1;
 
-                    lp->ce->pcdata.s  = (char *)moremem(lp->ce->pcdata.s, blen);
+                    if (blen > lp->ce->pcdata.sm)
+                        reserveString(&lp->ce->pcdata, blen);
                     lp->ce->pcdata.sm = blen; // always set sm
 
                     if (size <= blen - lp->ce->pcdata.sl)
@@ -280,8 +425,7 @@ XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
                 char *ltpos = memchr(buf, '<', size);
                 if (!ltpos)
                 {
-                    lp->ce->pcdata.s = (char *)moremem(lp->ce->pcdata.s, lp->ce->pcdata.sm + size);
-                    lp->ce->pcdata.sm += size;
+                    reserveString(&lp->ce->pcdata, lp->ce->pcdata.sm + size);
                     memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
                     lp->ce->pcdata.sl += size;
                     lp->inblob = 1;
@@ -295,6 +439,54 @@ XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
     }
     while (curr - buf < size)
     {
+        /* raw content is copied as is, whatever it contains */
+        if (lp->cs == INRAWCON)
+        {
+            curr += rawXMLchars(lp, curr, size - (curr - buf));
+            continue;
+        }
+        if (lp->cs == LOOK4RAWCON)
+        {
+            oneXMLchar(lp, *curr, ynot);
+            curr++;
+            continue;
+        }
+
+        /* BLOB content is decoded a run at a time */
+        if (lp->cs == INBLOBCON && !lp->skipping && lp->lastc != '<')
+        {
+            int nlines = 0;
+            int n = contentRun(curr, size - (curr - buf), &nlines);
+            if (n > 0)
+            {
+                if (decodeBLOB(lp, curr, n) < 0)
+                {
+                    sprintf(ynot, "Line %d: Failed to allocate %.64s BLOB", lp->ln, findXMLAttValu(lp->ce, "name"));
+                    return abortChunk(lp, nodes);
+                }
+                lp->ln += nlines;
+                lp->lastc = curr[n - 1];
+                curr += n;
+                continue;
+            }
+        }
+
+        /* in arena mode, runs of plain content or attribute value are taken at once */
+        if (lp->usearena && !lp->skipping && lp->lastc != '<' && (lp->cs == INCON || lp->cs == INATTRV))
+        {
+            int nlines = 0;
+            int n = lp->cs == INCON ? contentRun(curr, size - (curr - buf), &nlines)
+                    : attrValueRun(curr, size - (curr - buf), lp->delim, &nlines);
+            if (n > 0)
+            {
+                appendBytes(lp->cs == INCON ? &lp->ce->pcdata : &lp->ce->at[lp->ce->nat - 1]->valu, curr, n);
+                lp->ln += nlines;
+                lp->lastc = curr[n - 1];
+                curr += n;
+                continue;
+            }
+        }
+
         char newc = *curr;
         /* EOF? */
         if (newc == 0)
@@ -352,6 +544,8 @@ XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
             curr++;
             continue;
         }
+        if (s == -2)
+            return abortChunk(lp, nodes);
         if (s < 0)
         {
             initParser(lp);
@@ -390,6 +584,13 @@ XMLEle *readXMLEle(LilXML *lp, int newc, char ynot[])
     /* start optimistic */
     ynot[0] = '\0';
 
+    /* raw content is taken as is, whatever it contains */
+    if (lp->cs == LOOK4RAWCON || lp->cs == INRAWCON)
+    {
+        oneXMLchar(lp, newc, ynot);
+        return (NULL);
+    }
+
     /* EOF? */
     if (newc == 0)
     {
@@ -669,7 +870,7 @@ XMLEle *readXMLFile(FILE *fp, LilXML *lp, char ynot[])
  */
 XMLEle *addXMLEle(XMLEle *parent, const char *tag)
 {
-    XMLEle *ep = growEle(parent);
+    XMLEle *ep = growEle(parent, parent ? parent->arena : NULL);
     appendString(&ep->tag, tag);
     return (ep);
 }
@@ -679,7 +880,7 @@ XMLEle *addXMLEle(XMLEle *parent, const char *tag)
  */
 static void appXMLEle(XMLEle *ep, XMLEle *newep)
 {
-    ep->el            = (XMLEle **)moremem(ep->el, (ep->nel + 1) * sizeof(XMLEle *));
+    ep->el            = (XMLEle **)growArray((void **)ep->el, ep->nel, ep->arena);
     ep->el[ep->nel++] = newep;
 }
 
@@ -1062,6 +1263,7 @@ static int decodeEntity(char *ent, int *cp)
  * if find final closure, return 1 and tree is in ce.
  * if need more, return 0.
  * if real trouble, return -1 and put reason in ynot.
+ * if the rest of the input can not be parsed any more, return -2 and put reason in ynot.
  */
 static int oneXMLchar(LilXML *lp, int c, char ynot[])
 {
@@ -1093,7 +1295,11 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
             if (isTokenChar(0, c))
                 growString(&lp->ce->tag, c);
             else if (c == '>')
-                lp->cs = LOOK4CON;
+            {
+                int r = startContent(lp, ynot);
+                if (r < 0)
+                    return (r);
+            }
             else if (c == '/')
                 lp->cs = SAWSLASH;
             else
@@ -1102,7 +1308,11 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
 
         case LOOK4ATTRN: /* looking for attr name, > or / */
             if (c == '>')
-                lp->cs = LOOK4CON;
+            {
+                int r = startContent(lp, ynot);
+                if (r < 0)
+                    return (r);
+            }
             else if (c == '/')
                 lp->cs = SAWSLASH;
             else if (isTokenChar(1, c))
@@ -1217,6 +1427,23 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
             }
             break;
 
+        case INBLOBCON: /* decoding base64 content of a oneBLOB */
+            if (c == '<')
+            {
+                endBLOB(lp);
+                lp->cs = SAWLTINCON;
+            }
+            else
+            {
+                char b = c;
+                if (decodeBLOB(lp, &b, 1) < 0)
+                {
+                    sprintf(ynot, "Line %d: Failed to allocate %.64s BLOB", lp->ln, findXMLAttValu(lp->ce, "name"));
+                    return (-2);
+                }
+            }
+            break;
+
         case ENTINCON: /* working on entity in content */
             if (c == ';')
             {
@@ -1296,17 +1523,299 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
                 return (-1);
             }
             break;
+
+        case LOOK4RAWCON: /* the raw content starts after the newline ending the opening tag */
+            lp->cs = INRAWCON;
+            if (c != '\n')
+            {
+                char b = (char)c;
+                rawXMLchars(lp, &b, 1);
+            }
+            break;
+
+        case INRAWCON: /* reading raw content */
+        {
+            char b = (char)c;
+            rawXMLchars(lp, &b, 1);
+            break;
+        }
+
+        case AFTERRAWCON: /* only whitespace until the closing tag */
+            if (c == '<')
+                lp->cs = SAWLTINCON;
+            else if (!isspace(c))
+            {
+                sprintf(ynot, "Line %d: Bogus char %c after raw content", lp->ln, c);
+                return (-1);
+            }
+            break;
+    }
+
+    return (0);
+}
+
+/* the opening tag of ce is complete. The content of a oneBLOB is raw if it has a rawlen attribute and the parser
+ * allows it, it is decoded to a BLOB if the parser has a BLOB sink.
+ * return -2 with a reason in ynot if the rawlen is bogus, the end of the raw content can not be found then,
+ * or if the BLOB could not be allocated.
+ */
+static int startContent(LilXML *lp, char ynot[])
+{
+    XMLAtt *ap;
+
+    lp->cs = LOOK4CON;
+    if (strcmp(lp->ce->tag.s, "oneBLOB"))
+        return (0);
+
+    if (lp->rawcontent && (ap = findXMLAtt(lp->ce, "rawlen")) != NULL)
+    {
+        char *end;
+        long rawlen = strtol(ap->valu.s, &end, 10);
+        if (end == ap->valu.s || *end != '\0' || rawlen < 0 || rawlen > MAXRAWLEN)
+        {
+            sprintf(ynot, "Line %d: Bogus rawlen %.32s", lp->ln, ap->valu.s);
+            return (-2);
+        }
+        lp->rawleft = (int)rawlen;
+        if (lp->rawleft > 0)
+            lp->cs = LOOK4RAWCON;
+        return (0);
     }
 
+    /* attached BLOBs have no content */
+    if (lp->blobrealloc && strcmp(findXMLAttValu(lp->ce, "attached"), "true"))
+        return (startBLOB(lp, ynot));
+
     return (0);
 }
 
+/* set *len to the length attribute name of ep, 0 when it is missing.
+ * return -1 if it is not a positive number.
+ */
+static int blobLength(XMLEle *ep, const char *name, long *len)
+{
+    XMLAtt *ap = findXMLAtt(ep, name);
+    char *end;
+
+    *len = 0;
+    if (!ap)
+        return (0);
+    *len = strtol(ap->valu.s, &end, 10);
+    return (end == ap->valu.s || *end != '\0' || *len < 0 ? -1 : 0);
+}
+
+/* allocate the BLOB of ce, sized after the attributes when they tell.
+ * the attributes come from the peer, so no more than MAXBLOBRESERVE is allocated up front, larger BLOBs grow
+ * as their content comes.
+ * return 0 if ok, -2 with reason in ynot if the lengths are bogus or the BLOB can not be allocated.
+ */
+static int startBLOB(LilXML *lp, char ynot[])
+{
+    XMLEle *ep = lp->ce;
+    long enclen, len;
+    size_t size = 65536;
+
+    if (blobLength(ep, "enclen", &enclen) < 0 || blobLength(ep, "size", &len) < 0)
+    {
+        sprintf(ynot, "Line %d: Bogus length of %.64s BLOB", lp->ln, findXMLAttValu(ep, "name"));
+        return (-2);
+    }
+
+    if (enclen > 0)
+        size = (size_t)enclen / 4 * 3 + 3;
+    else if (len > 0 && !strstr(findXMLAttValu(ep, "format"), ".z"))
+        size = (size_t)len + 3;
+    if (size > MAXBLOBRESERVE)
+        size = MAXBLOBRESERVE;
+
+    ep->blob = lp->blobrealloc(NULL, size);
+    if (!ep->blob)
+    {
+        sprintf(ynot, "Line %d: Failed to allocate %.64s BLOB", lp->ln, findXMLAttValu(ep, "name"));
+        return (-2);
+    }
+    ep->blobsize = size;
+    ep->bloblen  = 0;
+    ep->blobfree = lp->blobfree;
+    if (ep->arena)
+        ep->arena->nblobs++;
+
+    lp->b64n = 0;
+    lp->cs   = INBLOBCON;
+    return 0;
+}
+
+/* room for n more bytes in the BLOB of ce */
+static int growBLOB(XMLEle *ep, LilXML *lp, size_t n)
+{
+    if (ep->bloblen + n <= ep->blobsize)
+        return 0;
+
+    size_t size = ep->blobsize * 2;
+    if (size < ep->bloblen + n)
+        size = ep->bloblen + n;
+    void *blob = lp->blobrealloc(ep->blob, size);
+    if (!blob)
+        return (-1);
+    ep->blob     = blob;
+    ep->blobsize = size;
+    return 0;
+}
+
+static int isBase64Space(char c)
+{
+    return c == '\n' || c == '\r' || c == ' ' || c == '\t';
+}
+
+/* decode groups of 4 base64 chars to the BLOB of ce, newlines between groups are skipped */
+static int decodeGroups(XMLEle *ep, LilXML *lp, const char *buf, int groups)
+{
+    if (groups == 0)
+        return 0;
+    if (growBLOB(ep, lp, 3 * groups) < 0)
+        return (-1);
+    ep->bloblen += from64tobits_fast((char *)ep->blob + ep->bloblen, buf, 4 * groups);
+    return 0;
+}
+
+/* decode n more chars of base64 content to the BLOB of ce, whitespace is skipped.
+ * chars of an incomplete group are kept until the rest of it comes.
+ * return -1 if the BLOB could not grow.
+ */
+static int decodeBLOB(LilXML *lp, const char *buf, int n)
+{
+    XMLEle *ep = lp->ce;
+    const char *end = buf + n;
+
+    while (buf < end)
+    {
+        /* complete the group left over */
+        if (lp->b64n > 0)
+        {
+            if (!isBase64Space(*buf))
+                lp->b64quad[lp->b64n++] = *buf;
+            buf++;
+            if (lp->b64n == 4)
+            {
+                if (decodeGroups(ep, lp, lp->b64quad, 1) < 0)
+                    return (-1);
+                lp->b64n = 0;
+            }
+            continue;
+        }
+
+        /* lines made of whole groups, as they are sent, are decoded in one go */
+        const char *lines = buf;
+        int groups = 0;
+        while (buf < end)
+        {
+            const char *nl = (const char *)memchr(buf, '\n', end - buf);
+            int len = (nl ? nl : end) - buf;
+            if (len == 0 || len % 4 || isBase64Space(buf[0]) || isBase64Space(buf[len - 1]))
+                break;
+            groups += len / 4;
+            buf += nl ? len + 1 : len;
+        }
+        if (decodeGroups(ep, lp, lines, groups) < 0)
+            return (-1);
+
+        /* then anything else up to the next newline, a char at a time */
+        for (; buf < end && *buf != '\n'; buf++)
+        {
+            if (isBase64Space(*buf))
+                continue;
+            lp->b64quad[lp->b64n++] = *buf;
+            if (lp->b64n == 4)
+            {
+                if (decodeGroups(ep, lp, lp->b64quad, 1) < 0)
+                    return (-1);
+                lp->b64n = 0;
+            }
+        }
+        if (buf < end)
+            buf++;
+    }
+    return 0;
+}
+
+/* the BLOB content of ce is complete, give back the room it did not use */
+static void endBLOB(LilXML *lp)
+{
+    XMLEle *ep = lp->ce;
+
+    /* an incomplete group is not base64, drop it */
+    lp->b64n = 0;
+
+    if (ep->blobsize - ep->bloblen > ep->blobsize / 4)
+    {
+        void *blob = lp->blobrealloc(ep->blob, ep->bloblen > 0 ? ep->bloblen : 1);
+        if (blob)
+        {
+            ep->blob     = blob;
+            ep->blobsize = ep->bloblen > 0 ? ep->bloblen : 1;
+        }
+    }
+}
+
+/* free the BLOBs of ep and its descendants */
+static void freeBLOBs(XMLEle *ep)
+{
+    if (ep->blob)
+    {
+        ep->blobfree(ep->blob);
+        ep->blob = NULL;
+        if (ep->arena)
+            ep->arena->nblobs--;
+    }
+    for (int i = 0; i < ep->nel; i++)
+        freeBLOBs(ep->el[i]);
+}
+
+/* take the content of a oneBLOB decoded by the BLOB sink, NULL if it was not */
+void *takeBLOBXMLEle(XMLEle *ep, size_t *len)
+{
+    void *blob = ep->blob;
+
+    if (!blob)
+        return NULL;
+
+    *len         = ep->bloblen;
+    ep->blob     = NULL;
+    ep->bloblen  = 0;
+    ep->blobsize = 0;
+    if (ep->arena)
+        ep->arena->nblobs--;
+    return blob;
+}
+
+/* append up to n bytes of raw content to ce. return the number of bytes used */
+static int rawXMLchars(LilXML *lp, const char *buf, int n)
+{
+    if (n > lp->rawleft)
+        n = lp->rawleft;
+
+    appendBytes(&lp->ce->pcdata, buf, n);
+    lp->rawleft -= n;
+    if (lp->rawleft == 0)
+        lp->cs = AFTERRAWCON;
+    return n;
+}
+
 /* set up for a fresh start again */
 static void initParser(LilXML *lp)
 {
-    delXMLEle(lp->ce);
+    int rawcontent = lp->rawcontent;
+    int usearena = lp->usearena;
+    void *(*blobrealloc)(void *ptr, size_t size) = lp->blobrealloc;
+    void (*blobfree)(void *ptr) = lp->blobfree;
+
+    delParsedXML(lp);
     freeString(&lp->endtag);
     memset(lp, 0, sizeof(*lp));
+    lp->rawcontent = rawcontent;
+    lp->usearena = usearena;
+    lp->blobrealloc = blobrealloc;
+    lp->blobfree = blobfree;
     newString(&lp->endtag);
     lp->cs = LOOK4START;
     lp->ln = 1;
@@ -1319,7 +1828,10 @@ static void initParser(LilXML *lp)
  */
 static void pushXMLEle(LilXML *lp)
 {
-    lp->ce = growEle(lp->ce);
+    XMLArena *arena = lp->ce ? lp->ce->arena : (lp->usearena ? newArena() : NULL);
+    lp->ce = growEle(lp->ce, arena);
+    if (arena && !arena->root)
+        arena->root = lp->ce;
     resetEndTag(lp);
 }
 
@@ -1332,19 +1844,22 @@ static void popXMLEle(LilXML *lp)
     resetEndTag(lp);
 }
 
-/* return one new XMLEle, added to the given element if given */
-static XMLEle *growEle(XMLEle *pe)
+/* return one new XMLEle, from the arena if given, added to the given element if given */
+static XMLEle *growEle(XMLEle *pe, XMLArena *arena)
 {
-    XMLEle *newe = (XMLEle *)moremem(NULL, sizeof(XMLEle));
+    XMLEle *newe = (XMLEle *)(arena ? arenaAlloc(arena, sizeof(XMLEle)) : moremem(NULL, sizeof(XMLEle)));
 
     memset(newe, 0, sizeof(XMLEle));
+    newe->arena        = arena;
+    newe->tag.arena    = arena;
+    newe->pcdata.arena = arena;
     newString(&newe->tag);
     newString(&newe->pcdata);
     newe->pe = pe;
 
     if (pe)
     {
-        pe->el            = (XMLEle **)moremem(pe->el, (pe->nel + 1) * sizeof(XMLEle *));
+        pe->el            = (XMLEle **)growArray((void **)pe->el, pe->nel, pe->arena);
         pe->el[pe->nel++] = newe;
     }
 
@@ -1354,14 +1869,17 @@ static XMLEle *growEle(XMLEle *pe)
 /* add room for and return one new XMLAtt to the given element */
 static XMLAtt *growAtt(XMLEle *ep)
 {
-    XMLAtt *newa = (XMLAtt *)moremem(NULL, sizeof * newa);
+    XMLAtt *newa = (XMLAtt *)(ep->arena ? arenaAlloc(ep->arena, sizeof * newa) : moremem(NULL, sizeof * newa));
 
     memset(newa, 0, sizeof(*newa));
+    newa->arena      = ep->arena;
+    newa->name.arena = ep->arena;
+    newa->valu.arena = ep->arena;
     newString(&newa->name);
     newString(&newa->valu);
     newa->ce = ep;
 
-    ep->at            = (XMLAtt **)moremem(ep->at, (ep->nat + 1) * sizeof(XMLAtt *));
+    ep->at            = (XMLAtt **)growArray((void **)ep->at, ep->nat, ep->arena);
     ep->at[ep->nat++] = newa;
 
     return (newa);
@@ -1374,7 +1892,8 @@ static void freeAtt(XMLAtt *a)
         return;
     freeString(&a->name);
     freeString(&a->valu);
-    (*myfree)(a);
+    if (!a->arena)
+        (*myfree)(a);
 }
 
 /* reset endtag */
@@ -1398,14 +1917,7 @@ static void growString(String *sp, int c)
     int l = sp->sl + 2; /* need room for '\0' plus c */
 
     if (l > sp->sm)
-    {
-        if (!sp->s)
-            newString(sp);
-        else
-        {
-            sp->s = (char *)moremem(sp->s, sp->sm *= 2);
-        }
-    }
+        reserveString(sp, l);
     sp->s[--l] = '\0';
     sp->s[--l] = (char)c;
     sp->sl++;
@@ -1421,27 +1933,57 @@ static void appendString(String *sp, const char *str)
     int l    = sp->sl + strl + 1; /* need room for '\0' */
 
     if (l > sp->sm)
-    {
-        if (!sp->s)
-            newString(sp);
-        if (l > sp->sm)
-        {
-            sp->s = (char *)moremem(sp->s, (sp->sm = l));
-        }
-    }
-    if (sp->s)
-    {
-        strcpy(&sp->s[sp->sl], str);
-        sp->sl += strl;
-    }
+        reserveString(sp, l);
+    strcpy(&sp->s[sp->sl], str);
+    sp->sl += strl;
+}
+
+/* append n bytes, that may contain \0, to the String storage at *sp */
+static void appendBytes(String *sp, const char *buf, int n)
+{
+    int l = sp->sl + n + 1; /* need room for '\0' */
+
+    if (l > sp->sm)
+        reserveString(sp, l);
+    memcpy(&sp->s[sp->sl], buf, n);
+    sp->sl += n;
+    sp->s[sp->sl] = '\0';
 }
 
-/* init a String with a malloced string containing just \0 */
+/* make room for at least l bytes in the String storage at *sp, doubling its size */
+static void reserveString(String *sp, int l)
+{
+    if (!sp->s)
+        newString(sp);
+    if (l <= sp->sm)
+        return;
+
+    int sm = sp->sm > 0 ? sp->sm : ARENA_MINMEM;
+    while (sm < l)
+        sm *= 2;
+    if (sp->arena)
+        sp->s = (char *)arenaRealloc(sp->arena, sp->sm > 0 ? sp->s : NULL, sp->sm, sm);
+    else
+        sp->s = (char *)moremem(sp->s, sm);
+    sp->sm = sm;
+}
+
+/* init a String with a malloced string containing just \0.
+ * in an arena, nothing is allocated until something is appended.
+ */
 static void newString(String *sp)
 {
     if (!sp)
         return;
 
+    if (sp->arena)
+    {
+        sp->s  = arenaEmpty;
+        sp->sm = 0;
+        sp->sl = 0;
+        return;
+    }
+
     sp->s  = (char *)moremem(NULL, MINMEM);
     sp->sm = MINMEM;
     *sp->s = '\0';
@@ -1451,7 +1993,9 @@ static void newString(String *sp)
 /* free memory used by the given String */
 static void freeString(String *sp)
 {
-    if (sp->s)
+    if (sp->arena)
+        arenaFree(sp->arena, sp->s, sp->sm);
+    else if (sp->s)
         (*myfree)(sp->s);
     sp->s  = NULL;
     sp->sl = 0;
@@ -1470,6 +2014,184 @@ static void *moremem(void *old, int n)
     return p;
 }
 
+/* make room for one more pointer after the n ones of array.
+ * in an arena, the room doubles when n reaches a power of two.
+ */
+static void **growArray(void **array, int n, XMLArena *arena)
+{
+    if (!arena)
+        return (void **)moremem(array, (n + 1) * sizeof(void *));
+
+    if (n >= 4 && (n & (n - 1)))
+        return array;
+    if (n > 0 && n < 4)
+        return array;
+    int room = n < 4 ? 4 : n * 2;
+    return (void **)arenaRealloc(arena, n > 0 ? array : NULL, n * sizeof(void *), room * sizeof(void *));
+}
+
+static XMLArena *newArena()
+{
+    XMLArena *a = (XMLArena *)moremem(NULL, sizeof(XMLArena));
+    memset(a, 0, sizeof(*a));
+    return a;
+}
+
+static void delArena(XMLArena *a)
+{
+    while (a->blocks)
+    {
+        XMLArenaBlock *b = a->blocks;
+        a->blocks = b->next;
+        (*myfree)(b);
+    }
+    while (a->large)
+    {
+        XMLArenaLarge *l = a->large;
+        a->large = l->next;
+        (*myfree)(l);
+    }
+    (*myfree)(a);
+}
+
+static void *arenaAlloc(XMLArena *a, size_t n)
+{
+    if (n > ARENA_LARGE)
+    {
+        XMLArenaLarge *l = (XMLArenaLarge *)moremem(NULL, sizeof(XMLArenaLarge) + n);
+        l->prev = NULL;
+        l->next = a->large;
+        if (a->large)
+            a->large->prev = l;
+        a->large = l;
+        return l + 1;
+    }
+
+    n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    XMLArenaBlock *b = a->blocks;
+    if (!b || b->size - b->used < n)
+    {
+        size_t size = b ? (b->size < ARENA_MAXBLOCK ? b->size * 2 : ARENA_MAXBLOCK) : ARENA_BLOCK;
+        XMLArenaBlock *nb = (XMLArenaBlock *)moremem(NULL, sizeof(XMLArenaBlock) + size);
+        nb->next = b;
+        nb->size = size;
+        nb->used = 0;
+        a->blocks = b = nb;
+    }
+
+    a->last = (char *)(b + 1) + b->used;
+    b->used += n;
+    return a->last;
+}
+
+/* resize p of oldn bytes to n bytes, in place if p is the last allocation or a large one */
+static void *arenaRealloc(XMLArena *a, void *old, size_t oldn, size_t n)
+{
+    if (!old)
+        return arenaAlloc(a, n);
+
+    if (oldn > ARENA_LARGE)
+    {
+        XMLArenaLarge *l = (XMLArenaLarge *)old - 1;
+        l = (XMLArenaLarge *)moremem(l, sizeof(XMLArenaLarge) + n);
+        if (l->prev)
+            l->prev->next = l;
+        else
+            a->large = l;
+        if (l->next)
+            l->next->prev = l;
+        return l + 1;
+    }
+
+    XMLArenaBlock *b = a->blocks;
+    if (old == a->last && n <= ARENA_LARGE)
+    {
+        size_t start = a->last - (char *)(b + 1);
+        size_t end = (start + n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        if (end <= b->size)
+        {
+            b->used = end;
+            return old;
+        }
+    }
+
+    void *p = arenaAlloc(a, n);
+    memcpy(p, old, oldn < n ? oldn : n);
+    return p;
+}
+
+/* large allocations are given back at once, the others stay until the arena is deleted */
+static void arenaFree(XMLArena *a, void *p, size_t n)
+{
+    if (!p || n <= ARENA_LARGE)
+        return;
+
+    XMLArenaLarge *l = (XMLArenaLarge *)p - 1;
+    if (l->prev)
+        l->prev->next = l->next;
+    else
+        a->large = l->next;
+    if (l->next)
+        l->next->prev = l->prev;
+    (*myfree)(l);
+}
+
+/* return the number of bytes of plain content at the start of buf, up to '<', '&' or '\0'.
+ * set *nlines to the number of newlines among them.
+ */
+static int contentRun(const char *buf, int n, int *nlines)
+{
+    int i = 0;
+    *nlines = 0;
+
+#if defined(__SSE2__)
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i nul = _mm_setzero_si128();
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        unsigned stop = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, amp)),
+                                          _mm_cmpeq_epi8(v, nul)));
+        unsigned lines = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        if (stop)
+        {
+            int k = __builtin_ctz(stop);
+            *nlines += __builtin_popcount(lines & ((1u << k) - 1));
+            return i + k;
+        }
+        *nlines += __builtin_popcount(lines);
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        char c = buf[i];
+        if (c == '<' || c == '&' || c == '\0')
+            break;
+        if (c == '\n')
+            (*nlines)++;
+    }
+    return i;
+}
+
+/* return the number of bytes of plain attribute value at the start of buf,
+ * up to the delimiter, '<', '&' or a control character.
+ */
+static int attrValueRun(const char *buf, int n, int delim, int *nlines)
+{
+    int i;
+    *nlines = 0;
+    for (i = 0; i < n; i++)
+    {
+        unsigned char c = buf[i];
+        if (c == delim || c == '<' || c == '&' || c < ' ' || c == 0x7f)
+            break;
+    }
+    return i;
+}
+
 #if defined(MAIN_TST)
 int main(int ac, char *av[])
 {
@@ -115,6 +115,38 @@ extern XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char errmsg[]);
 */
 extern XMLEle *readXMLEle(LilXML *lp, int c, char errmsg[]);
 
+/** \brief Allow oneBLOB elements to carry raw content.
+    When allowed, the content of a oneBLOB with a rawlen attribute is made of exactly that many bytes,
+    taken as is from the newline that ends its opening tag. This is how BLOBs are sent to clients that
+    negotiated the raw BLOB encoding, so it must only be allowed on such connections. The rawlen attribute
+    of other elements is never honoured, and a rawlen that is not a valid size is a parse error.
+    \param lp a pointer to a lilxml parser.
+    \param allow 1 to allow raw content, 0 to ignore rawlen attributes (the default).
+*/
+extern void allowRawContentXML(LilXML *lp, int allow);
+
+/** \brief Parse in arena mode.
+    In arena mode, each tree is allocated from its own arena: a few large blocks instead of a malloc
+    per element, attribute and string. Deleting the root with delXMLEle frees the whole tree in one step,
+    deleting a child only detaches it. Trees can be edited as usual. parseXMLChunk also takes runs of
+    content and attribute values at once instead of one character at a time.
+    \param lp a pointer to a lilxml parser.
+    \param use 1 to parse in arena mode, 0 to malloc each part of the tree (the default).
+*/
+extern void useArenaXML(LilXML *lp, int use);
+
+/** \brief Decode the content of oneBLOB elements while it is parsed.
+    With a BLOB sink, the base64 content of a oneBLOB element is decoded as its chunks come, to a buffer
+    obtained with blobrealloc. It is sized after the enclen or size attribute when present, so the base64
+    text is never held in full. The pcdata of the element stays empty, use takeBLOBXMLEle to get the bytes.
+    Raw content and BLOBs sent with attached='true' are not affected. A BLOB that can not be allocated is a
+    parse error, parseXMLChunk returns NULL.
+    \param lp a pointer to a lilxml parser.
+    \param blobrealloc allocates and grows the buffers, like realloc. It may return shared memory. NULL to keep the content as pcdata (the default).
+    \param blobfree frees a buffer obtained with blobrealloc, when its element is deleted before the buffer is taken.
+*/
+extern void setBLOBSinkXML(LilXML *lp, void *(*blobrealloc)(void *ptr, size_t size), void (*blobfree)(void *ptr));
+
 /* search functions */
 /** \brief Find an XML attribute within an XML element.
     \param e a pointer to the XML element to search.
@@ -187,6 +219,14 @@ extern char *valuXMLAtt(XMLAtt *ap);
 */
 extern int pcdatalenXMLEle(XMLEle *ep);
 
+/** \brief Take the content of a oneBLOB element decoded by the BLOB sink (see setBLOBSinkXML).
+    \param ep a pointer to an XML element.
+    \param len set to the number of decoded bytes.
+    \return the decoded bytes, to be freed by the caller like the blobfree function given to the sink.
+    NULL if the content of the element was not decoded.
+*/
+extern void *takeBLOBXMLEle(XMLEle *ep, size_t *len);
+
 /** \brief Return the number of nested XML elements in a parent XML element.
     \param ep a pointer to an XML element.
     \return the number of nested XML elements.
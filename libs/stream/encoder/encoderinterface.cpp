@@ -56,4 +56,20 @@ bool EncoderInterface::setPixelFormat(INDI_PIXEL_FORMAT pixelFormat, uint8_t pix
     this->pixelDepth = pixelDepth;
     return true;
 }
+
+void EncoderInterface::setQuality(int quality)
+{
+    this->quality = quality;
+}
+
+void EncoderInterface::setMaxWidth(uint16_t width)
+{
+    maxWidth = width;
+}
+
+void EncoderInterface::setThreads(uint32_t threads)
+{
+    this->threads = threads;
+}
+
 }
@@ -28,6 +28,7 @@
 #include <cstdlib>
 #include <stdint.h>
 
+#include <atomic>
 #include <vector>
 
 namespace INDI
@@ -56,12 +57,32 @@ class EncoderInterface
 
         const char *getName();
 
+        /**
+         * @brief setQuality Set the compression quality, for encoders that compress lossily.
+         * @param quality 1 (smallest) to 100 (best)
+         */
+        void setQuality(int quality);
+
+        /**
+         * @brief setMaxWidth Set the widest frame to send, wider frames are downscaled by encoders that can.
+         */
+        void setMaxWidth(uint16_t width);
+
+        /**
+         * @brief setThreads Set the number of threads encoders may use.
+         */
+        void setThreads(uint32_t threads);
+
     protected:
         INDI::DefaultDevice *currentDevice;
         const char *name;
         INDI_PIXEL_FORMAT pixelFormat;            // INDI Pixel Format
         uint8_t pixelDepth = 8;                   // Bits per Pixels
         uint16_t rawWidth, rawHeight;
+        // Set from the driver thread while a frame is uploaded
+        std::atomic<int> quality {85};
+        std::atomic<uint16_t> maxWidth {640};
+        std::atomic<uint32_t> threads {2};
 };
 
 }
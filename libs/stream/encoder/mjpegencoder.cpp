@@ -22,32 +22,133 @@
 #include "mjpegencoder.h"
 #include "stream/streammanager.h"
 #include "indiccd.h"
+
+#include <algorithm>
 #include <cmath>
-#include <zlib.h>
+#include <cstdio>
+#include <cstring>
+
 #include <jpeglib.h>
 #include <jerror.h>
 
-static void init_destination(j_compress_ptr cinfo)
+namespace INDI
+{
+
+namespace
+{
+
+// Destination manager compressing into a vector, grown when libjpeg fills it
+struct VectorDestination : jpeg_destination_mgr
+{
+    std::vector<uint8_t> *output = nullptr;
+};
+
+void init_destination(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* No work necessary here */
+    auto dest = static_cast<VectorDestination *>(cinfo->dest);
+    if (dest->output->size() < 4096)
+        dest->output->resize(4096);
+    dest->next_output_byte = dest->output->data();
+    dest->free_in_buffer = dest->output->size();
 }
 
-static boolean empty_output_buffer(j_compress_ptr cinfo)
+boolean empty_output_buffer(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* No work necessary here */
+    // libjpeg calls this once the whole buffer is filled
+    auto dest = static_cast<VectorDestination *>(cinfo->dest);
+    size_t used = dest->output->size();
+    dest->output->resize(used * 2);
+    dest->next_output_byte = dest->output->data() + used;
+    dest->free_in_buffer = dest->output->size() - used;
     return TRUE;
 }
 
-static void term_destination(j_compress_ptr cinfo)
+void term_destination(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* no work necessary here */
+    auto dest = static_cast<VectorDestination *>(cinfo->dest);
+    dest->output->resize(dest->output->size() - dest->free_in_buffer);
 }
 
-namespace INDI
+// Average blocks of scale x scale pixels, the pixels past the last full block are dropped
+void downscale(const uint8_t *source, uint32_t width, uint32_t components, uint32_t scale,
+               uint8_t *destination, uint32_t destinationWidth, uint32_t destinationHeight)
+{
+    const uint32_t rowSize = destinationWidth * components;
+    const uint32_t count = scale * scale;
+    std::vector<uint32_t> sums(rowSize);
+
+    for (uint32_t y = 0; y < destinationHeight; y++)
+    {
+        std::fill(sums.begin(), sums.end(), 0);
+        for (uint32_t line = 0; line < scale; line++)
+        {
+            const uint8_t *in = source + (static_cast<size_t>(y) * scale + line) * width * components;
+            uint32_t *sum = sums.data();
+            for (uint32_t x = 0; x < destinationWidth; x++, sum += components)
+                for (uint32_t i = 0; i < scale; i++)
+                    for (uint32_t c = 0; c < components; c++)
+                        sum[c] += *in++;
+        }
+
+        uint8_t *out = destination + static_cast<size_t>(y) * rowSize;
+        for (uint32_t i = 0; i < rowSize; i++)
+            out[i] = (sums[i] + count / 2) / count;
+    }
+}
+
+}
+
+// libjpeg compressor kept between frames, so its tables and buffers are only set up once
+struct MJPEGEncoder::Compressor
 {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    VectorDestination dest;
+    int components = 0;
+    int quality = 0;
+
+    Compressor()
+    {
+        cinfo.err = jpeg_std_error(&jerr);
+        jpeg_create_compress(&cinfo);
+        dest.init_destination = init_destination;
+        dest.empty_output_buffer = empty_output_buffer;
+        dest.term_destination = term_destination;
+        cinfo.dest = &dest;
+    }
+
+    ~Compressor()
+    {
+        jpeg_destroy_compress(&cinfo);
+    }
+
+    void compress(const uint8_t *source, uint16_t width, uint16_t height, int components, int quality,
+                  std::vector<uint8_t> &output)
+    {
+        cinfo.image_width = width;
+        cinfo.image_height = height;
+
+        // Parameters are kept by libjpeg from one image to the next
+        if (components != this->components || quality != this->quality)
+        {
+            cinfo.input_components = components;
+            cinfo.in_color_space = components == 3 ? JCS_RGB : JCS_GRAYSCALE;
+            jpeg_set_defaults(&cinfo);
+            jpeg_set_quality(&cinfo, quality, TRUE);
+            this->components = components;
+            this->quality = quality;
+        }
+
+        dest.output = &output;
+        jpeg_start_compress(&cinfo, TRUE);
+        while (cinfo.next_scanline < cinfo.image_height)
+        {
+            JSAMPROW row = const_cast<JSAMPROW>(source + static_cast<size_t>(cinfo.next_scanline) * width * components);
+            jpeg_write_scanlines(&cinfo, &row, 1);
+        }
+        jpeg_finish_compress(&cinfo);
+    }
+};
 
 MJPEGEncoder::MJPEGEncoder()
 {
@@ -56,7 +157,7 @@ MJPEGEncoder::MJPEGEncoder()
 
 MJPEGEncoder::~MJPEGEncoder()
 {
-    delete [] jpegBuffer;
+    stopWorkers();
 }
 
 const char *MJPEGEncoder::getDeviceName()
@@ -64,143 +165,144 @@ const char *MJPEGEncoder::getDeviceName()
     return currentDevice->getDeviceName();
 }
 
-bool MJPEGEncoder::upload(IBLOB *bp, const uint8_t *buffer, uint32_t nbytes, bool isCompressed)
+void MJPEGEncoder::startWorkers(uint32_t count)
 {
-    // We do not support compression
-    if (isCompressed)
+    stopWorkers();
+
+    isWorkerAboutToQuit = false;
+    for (uint32_t i = 0; i < count; i++)
     {
-        LOG_ERROR("Compression is not supported in MJPEG stream.");
-        return false;
+        auto worker = new Worker;
+        worker->compressor.reset(new Compressor);
+        workers.emplace_back(worker);
+        worker->thread = std::thread(&MJPEGEncoder::runWorker, this, worker);
     }
+    nextWorker = 0;
+}
 
-    INDI_UNUSED(nbytes);
-    int bufsize = rawWidth * rawHeight * ((pixelFormat == INDI_RGB) ? 3 : 1);
-    if (bufsize != jpegBufferSize)
+void MJPEGEncoder::stopWorkers()
+{
     {
-        delete [] jpegBuffer;
-        jpegBuffer = new uint8_t[bufsize];
-        jpegBufferSize = bufsize;
+        std::lock_guard<std::mutex> lock(workerLock);
+        isWorkerAboutToQuit = true;
+        workerStarted.notify_all();
     }
 
-    // Scale image DOWN by this factor
-    // 640 is now selected arbitrary to test mpeg streaming performance
-    int scale = std::max(1, static_cast<int>(std::floor(rawWidth / SCALE_WIDTH)));
-    if (pixelFormat == INDI_RGB)
-        jpeg_compress_8u_rgb(buffer, rawWidth, rawHeight, rawWidth * 3, scale, jpegBuffer, &bufsize, 85);
-    else
-        jpeg_compress_8u_gray(buffer, rawWidth, rawHeight, rawWidth, scale, jpegBuffer, &bufsize, 85);
-
-    bp->blob    = jpegBuffer;
-    bp->bloblen = bufsize;
-    bp->size    = bufsize;
-    strcpy(bp->format, ".stream_jpg");
+    for (auto &worker : workers)
+        worker->thread.join();
+    workers.clear();
+}
 
-    return true;
+void MJPEGEncoder::runWorker(Worker *worker)
+{
+    std::unique_lock<std::mutex> lock(workerLock);
+    for (;;)
+    {
+        workerStarted.wait(lock, [&]()
+        {
+            return isWorkerAboutToQuit || worker->isBusy;
+        });
+
+        if (isWorkerAboutToQuit)
+            break;
+
+        lock.unlock();
+        auto start = std::chrono::steady_clock::now();
+        worker->compressor->compress(worker->frame.data(), worker->width, worker->height,
+                                     worker->components, worker->quality, worker->jpeg);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        lock.lock();
+
+        // Frames may complete out of order, keep the latest one
+        if (worker->sequence > completedSequence)
+        {
+            completedJPEG.swap(worker->jpeg);
+            completedSequence = worker->sequence;
+        }
+        compressMsecs = elapsed.count();
+        worker->isBusy = false;
+        workerDone.notify_all();
+    }
 }
 
-/*
-FROM: https://svn.csail.mit.edu/rrg_pods/jpeg-utils/
+bool MJPEGEncoder::upload(IBLOB *bp, const uint8_t *buffer, uint32_t nbytes, bool isCompressed)
+{
+    // We do not support compression
+    if (isCompressed)
+    {
+        LOG_ERROR("Compression is not supported in MJPEG stream.");
+        return false;
+    }
 
-Name:         jpeg-utils
-Maintainers:  Albert Huang <albert@csail.mit.edu>
-Summary:      Wrapper functions around libjpeg to simplify JPEG compression and
-              decompression with in-memory buffers.
-Description:
-  note: This is a simple enough library that you could just copy the .c
-  and .h files in to your own programs.
+    const int components = (pixelFormat == INDI_RGB) ? 3 : 1;
+    if (nbytes < static_cast<uint32_t>(rawWidth) * rawHeight * components)
+        return false;
 
-  To use the library, link against -ljpeg-utils, or use
-  pkg-config --cflags --libs jpeg-utils
+    // Average blocks of pixels down to the maximum width
+    const uint32_t scale = std::max(1, static_cast<int>(std::ceil(rawWidth / static_cast<double>(maxWidth))));
+    const uint16_t width = rawWidth / scale;
+    const uint16_t height = rawHeight / scale;
+    if (width == 0 || height == 0)
+        return false;
 
-Requirements:
-  libjpeg62
+    if (workers.size() != std::max<uint32_t>(threads, 1))
+        startWorkers(std::max<uint32_t>(threads, 1));
 
-  For faster performance, install libjpeg-turbo, an SSE-accelerated
-  library that is ABI compatible with libjpeg62.
-*/
+    std::unique_lock<std::mutex> lock(workerLock);
 
-int MJPEGEncoder::jpeg_compress_8u_gray (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale,
-        uint8_t * dest,
-        int * destsize, int quality)
-{
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-#if JPEG_LIB_VERSION >= 70
-    cinfo.scale_denom = scale;
-#else
-    INDI_UNUSED(scale);
-#endif
-    cinfo.input_components = 1;
-    cinfo.in_color_space = JCS_GRAYSCALE;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
-
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height)
+    // Wait for the next worker in turn, the frames are only dropped once all of them are busy
+    Worker *worker = workers[nextWorker].get();
+    nextWorker = (nextWorker + 1) % workers.size();
+    workerDone.wait(lock, [worker]()
+    {
+        return !worker->isBusy;
+    });
+
+    // The worker is idle, its buffers can be used without the lock
+    lock.unlock();
+    worker->frame.resize(static_cast<size_t>(width) * height * components);
+    if (scale == 1)
+        memcpy(worker->frame.data(), buffer, worker->frame.size());
+    else
+        downscale(buffer, rawWidth, components, scale, worker->frame.data(), width, height);
+    worker->width = width;
+    worker->height = height;
+    worker->components = components;
+    worker->quality = quality;
+    lock.lock();
+
+    worker->sequence = ++submittedSequence;
+    worker->isBusy = true;
+    workerStarted.notify_all();
+
+    // While frames come slower than they are compressed, send each frame as soon as it is ready.
+    // Otherwise send the latest compressed frame and let the workers catch up.
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> sinceLastUpload = now - lastUpload;
+    lastUpload = now;
+    if (workers.size() == 1 || sinceLastUpload.count() > compressMsecs)
     {
-        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * stride);
-        jpeg_write_scanlines (&cinfo, &row, 1);
+        uint64_t sequence = worker->sequence;
+        workerDone.wait(lock, [this, sequence]()
+        {
+            return completedSequence >= sequence;
+        });
     }
 
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
-    return 0;
-}
+    if (completedSequence == uploadedSequence)
+        return false;
 
-int MJPEGEncoder::jpeg_compress_8u_rgb (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale,
-                                        uint8_t * dest, int * destsize, int quality)
-{
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-#if JPEG_LIB_VERSION >= 70
-    cinfo.scale_denom = scale;
-#else
-    INDI_UNUSED(scale);
-#endif
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
-
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height)
-    {
-        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * stride);
-        jpeg_write_scanlines (&cinfo, &row, 1);
-    }
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
-    return 0;
+    // The client reads the blob until the next upload
+    uploadedJPEG.swap(completedJPEG);
+    uploadedSequence = completedSequence;
+    lock.unlock();
+
+    bp->blob    = uploadedJPEG.data();
+    bp->bloblen = uploadedJPEG.size();
+    bp->size    = uploadedJPEG.size();
+    strcpy(bp->format, ".stream_jpg");
+
+    return true;
 }
 
 }
@@ -23,13 +23,23 @@
 
 #include "encoderinterface.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 namespace INDI
 {
 
 /**
  * @brief The MJPEGEncoder class encodes frames in JPEG format before transmitting them to the client.
  *
- * The quality is now hard-coded at 70 when encoding the JPEG image. Further compression is not supported.
+ * Frames wider than the maximum width are downscaled by averaging blocks of pixels, then compressed
+ * at the set quality. Each worker thread keeps its own compressor between frames. When frames arrive
+ * faster than one of them is compressed, the following frames are compressed on the other workers
+ * and upload returns the latest compressed frame instead of waiting for the current one.
  */
 class MJPEGEncoder : public EncoderInterface
 {
@@ -40,16 +50,37 @@ class MJPEGEncoder : public EncoderInterface
         virtual bool upload(IBLOB *bp, const uint8_t *buffer, uint32_t nbytes, bool isCompressed = false) override;
 
     private:
+        struct Compressor;
+        struct Worker
+        {
+            std::unique_ptr<Compressor> compressor;
+            std::thread thread;
+            std::vector<uint8_t> frame; // downscaled frame to compress
+            std::vector<uint8_t> jpeg;
+            uint16_t width = 0, height = 0;
+            int components = 1, quality = 85;
+            uint64_t sequence = 0;
+            bool isBusy = false;
+        };
+
         const char *getDeviceName();
-        int jpeg_compress_8u_gray (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale, uint8_t * dest,
-                                   int * destsize, int quality);
-        int jpeg_compress_8u_rgb (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale, uint8_t * dest,
-                                  int * destsize, int quality);
-        uint8_t *jpegBuffer = nullptr;
-        uint16_t jpegBufferSize = 1;
+        void startWorkers(uint32_t count);
+        void stopWorkers();
+        void runWorker(Worker *worker);
 
-        static const int SCALE_WIDTH = 640;
+        std::vector<std::unique_ptr<Worker>> workers;
+        size_t nextWorker = 0;
+        bool isWorkerAboutToQuit = false;
+        std::mutex workerLock;
+        std::condition_variable workerStarted;
+        std::condition_variable workerDone;
 
+        // Latest compressed frame, and the one passed to the client
+        std::vector<uint8_t> completedJPEG, uploadedJPEG;
+        uint64_t submittedSequence = 0, completedSequence = 0, uploadedSequence = 0;
+        // Time to compress the last frame and time of the last upload, to detect a backlog
+        double compressMsecs = 0;
+        std::chrono::steady_clock::time_point lastUpload;
 };
 
 }
@@ -0,0 +1,124 @@
+/*
+    Frame Ring
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#include "framering.h"
+
+#include <chrono>
+
+namespace INDI
+{
+
+FrameRing::FrameRing(size_t capacity)
+    : frames(capacity)
+    , recycled(capacity)
+{ }
+
+FrameRing::Frame *FrameRing::acquire(size_t size)
+{
+    size_t position = tail.load(std::memory_order_relaxed);
+    if (position - head.load(std::memory_order_acquire) >= frames.size())
+        return nullptr;
+
+    Frame &frame = frames[position % frames.size()];
+
+    // Take a buffer released by the consumer, if any
+    size_t recycledPosition = recycledHead.load(std::memory_order_relaxed);
+    if (frame.buffer.empty() && recycledPosition != recycledTail.load(std::memory_order_acquire))
+    {
+        frame.buffer.swap(recycled[recycledPosition % recycled.size()]);
+        recycledHead.store(recycledPosition + 1, std::memory_order_release);
+    }
+
+    if (frame.buffer.size() < size)
+        frame.buffer.resize(size);
+
+    frame.size = size;
+    return &frame;
+}
+
+void FrameRing::commit(double time)
+{
+    size_t position = tail.load(std::memory_order_relaxed);
+    frames[position % frames.size()].time = time;
+    tail.store(position + 1, std::memory_order_release);
+
+    // Lock so the consumer cannot miss the wake up between its check and its wait
+    std::lock_guard<std::mutex> lock(mutex);
+    increase.notify_one();
+}
+
+FrameRing::Frame *FrameRing::front(uint32_t msecs)
+{
+    size_t position = head.load(std::memory_order_relaxed);
+    if (position == tail.load(std::memory_order_acquire))
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        increase.wait_for(lock, std::chrono::milliseconds(msecs), [&]()
+        {
+            return aborted || position != tail.load(std::memory_order_acquire);
+        });
+    }
+
+    if (aborted || position == tail.load(std::memory_order_acquire))
+        return nullptr;
+
+    return &frames[position % frames.size()];
+}
+
+void FrameRing::release()
+{
+    size_t position = head.load(std::memory_order_relaxed);
+    Frame &frame = frames[position % frames.size()];
+
+    // Hand the buffer back to the producer, the recycled ring can't be full as it holds at most one buffer per frame
+    size_t recycledPosition = recycledTail.load(std::memory_order_relaxed);
+    if (recycledPosition - recycledHead.load(std::memory_order_acquire) < recycled.size())
+    {
+        recycled[recycledPosition % recycled.size()].swap(frame.buffer);
+        recycledTail.store(recycledPosition + 1, std::memory_order_release);
+    }
+
+    head.store(position + 1, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    decrease.notify_all();
+}
+
+void FrameRing::waitForEmpty() const
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    decrease.wait(lock, [this]()
+    {
+        return aborted || head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    });
+}
+
+void FrameRing::abort()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    aborted = true;
+    increase.notify_all();
+    decrease.notify_all();
+}
+
+size_t FrameRing::size() const
+{
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+}
+
+}
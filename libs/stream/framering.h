@@ -0,0 +1,122 @@
+/*
+    Frame Ring
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace INDI
+{
+
+/**
+ * \class FrameRing
+ * \brief The FrameRing class passes frames from a single producer thread to a single consumer thread
+ * without allocating memory per frame.
+ *
+ * The producer acquires a frame, fills it and commits it. The consumer takes the oldest committed frame
+ * with front() and gives it back with release(). Frame buffers given back by the consumer are recycled for
+ * the next acquired frames, so the memory held is that of the most frames that were in flight at once.
+ */
+class FrameRing
+{
+    public:
+        struct Frame
+        {
+            /// Frame buffer, at least size bytes
+            std::vector<uint8_t> buffer;
+            /// Frame size in bytes
+            size_t size {0};
+            /// Time in milliseconds since the previous frame
+            double time {0};
+
+            uint8_t *data()
+            {
+                return buffer.data();
+            }
+        };
+
+    public:
+        /**
+         * @param capacity Maximum number of frames in flight
+         */
+        explicit FrameRing(size_t capacity = 256);
+
+    public:
+        /**
+         * @brief Producer side, get the next frame to fill
+         * @param size Frame size in bytes
+         * @return Frame with a buffer of at least size bytes, nullptr if all the frames are in flight
+         */
+        Frame *acquire(size_t size);
+
+        /**
+         * @brief Producer side, pass the acquired frame to the consumer
+         * @param time Time in milliseconds since the previous frame
+         */
+        void commit(double time);
+
+        /**
+         * @brief Consumer side, wait for the oldest committed frame
+         * @param msecs timeout in milliseconds
+         * @return Frame to process, nullptr if timeout or the abort function was called
+         */
+        Frame *front(uint32_t msecs);
+
+        /**
+         * @brief Consumer side, give the frame returned by front back to the producer
+         */
+        void release();
+
+        /**
+         * @brief Wait until the consumer released every committed frame
+         */
+        void waitForEmpty() const;
+
+        /**
+         * @brief Wake up the consumer, front returns nullptr from now on
+         */
+        void abort();
+
+        /**
+         * @brief Return the number of committed frames not yet released
+         */
+        size_t size() const;
+
+    protected:
+        std::vector<Frame> frames;
+        /// Buffers released by the consumer, waiting to be reused by the producer
+        std::vector<std::vector<uint8_t>> recycled;
+
+        // Frames [head, tail) are committed, recycled buffers [recycledHead, recycledTail) are available
+        std::atomic<size_t> head {0};
+        std::atomic<size_t> tail {0};
+        std::atomic<size_t> recycledHead {0};
+        std::atomic<size_t> recycledTail {0};
+        std::atomic<bool> aborted {false};
+
+        mutable std::mutex mutex;
+        mutable std::condition_variable increase;
+        mutable std::condition_variable decrease;
+};
+
+}
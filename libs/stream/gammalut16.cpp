@@ -21,7 +21,155 @@
 
 */
 #include "gammalut16.h"
+#include "indiparallel.h"
+
+#include <algorithm>
 #include <cmath>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define GAMMALUT16_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// The SIMD kernels process a prefix and return how many elements they consumed, the
+// scalar loops finish the remainder. The table has 3 bytes of padding, so that the AVX2
+// kernel can gather 32 bits at any index.
+
+typedef size_t (*LookUp)(const uint8_t *lookUpTable, const uint16_t *source, size_t count, uint8_t *destination);
+typedef size_t (*AccumulateRow)(uint32_t *acc, const uint16_t *row, size_t count);
+typedef size_t (*AveragePairs)(uint16_t *average, const uint32_t *sum, size_t count);
+
+size_t lookUpNone(const uint8_t *, const uint16_t *, size_t, uint8_t *)
+{
+    return 0;
+}
+
+size_t accumulateRowNone(uint32_t *, const uint16_t *, size_t)
+{
+    return 0;
+}
+
+size_t averagePairsNone(uint16_t *, const uint32_t *, size_t)
+{
+    return 0;
+}
+
+#ifdef GAMMALUT16_SIMD_X86
+size_t accumulateRowSSE2(uint32_t *acc, const uint16_t *row, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+        __m128i *a = reinterpret_cast<__m128i *>(acc + x);
+        _mm_storeu_si128(a + 0, _mm_add_epi32(_mm_loadu_si128(a + 0), _mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(v, zero)));
+    }
+    return x;
+}
+
+// average[i] = (sum[2i] + sum[2i + 1] + 2) / 4, the sums of 2x2 blocks of 16 bits values
+size_t averagePairsSSE2(uint16_t *average, const uint32_t *sum, size_t count)
+{
+    const __m128i round = _mm_set1_epi32(2);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i out[2];
+        for (int j = 0; j < 2; j++)
+        {
+            __m128 a = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(sum + 2 * i + 8 * j)));
+            __m128 b = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(sum + 2 * i + 8 * j + 4)));
+            __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, 0x88));
+            __m128i odd  = _mm_castps_si128(_mm_shuffle_ps(a, b, 0xDD));
+            __m128i v    = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(even, odd), round), 2);
+            // Sign extend the low 16 bits, so that the signed saturation keeps them
+            out[j] = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(average + i), _mm_packs_epi32(out[0], out[1]));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t accumulateRowAVX2(uint32_t *acc, const uint16_t *row, size_t count)
+{
+    size_t x = 0;
+    for (; x + 16 <= count; x += 16)
+    {
+        __m256i v  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x));
+        __m256i *a = reinterpret_cast<__m256i *>(acc + x);
+        _mm256_storeu_si256(a + 0, _mm256_add_epi32(_mm256_loadu_si256(a + 0), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v))));
+        _mm256_storeu_si256(a + 1, _mm256_add_epi32(_mm256_loadu_si256(a + 1), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1))));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+size_t lookUpAVX2(const uint8_t *lookUpTable, const uint16_t *source, size_t count, uint8_t *destination)
+{
+    const int *table = reinterpret_cast<const int *>(lookUpTable);
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i v  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i));
+        __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+        lo = _mm256_and_si256(_mm256_i32gather_epi32(table, lo, 1), mask);
+        hi = _mm256_and_si256(_mm256_i32gather_epi32(table, hi, 1), mask);
+
+        // 32 -> 16 -> 8 bits, packing works within 128 bits lanes, permute the 64 bits quarters back in order
+        __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), _mm256_castsi256_si128(bytes));
+    }
+    return i;
+}
+#endif
+
+struct GammaKernels
+{
+    LookUp lookUp {lookUpNone};
+    AccumulateRow accumulate {accumulateRowNone};
+    AveragePairs averagePairs {averagePairsNone};
+};
+
+const GammaKernels &gammaKernels()
+{
+    static const GammaKernels kernels = []()
+    {
+        GammaKernels k;
+#ifdef GAMMALUT16_SIMD_X86
+        k.averagePairs = averagePairsSSE2;
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            k.lookUp     = lookUpAVX2;
+            k.accumulate = accumulateRowAVX2;
+        }
+        else
+        {
+            k.accumulate = accumulateRowSSE2;
+        }
+#endif
+        return k;
+    }();
+    return kernels;
+}
+
+void accumulateRow(uint32_t *acc, const uint16_t *row, size_t count)
+{
+    for (size_t x = gammaKernels().accumulate(acc, row, count); x < count; x++)
+        acc[x] += row[x];
+}
+
+}
 
 GammaLut16::GammaLut16(double gamma, double a, double b, double Ii)
 {
@@ -38,6 +186,8 @@ GammaLut16::GammaLut16(double gamma, double a, double b, double Ii)
             p = (1 + b) * powf(I, 1.0 / gamma) - b;
         value = round(255.0 * p);
     }
+
+    mLookUpTable.resize(65536 + 3, 0);
 }
 
 void GammaLut16::apply(const uint16_t *source, size_t count, uint8_t *destination) const
@@ -50,6 +200,67 @@ void GammaLut16::apply(const uint16_t *first, const uint16_t *last, uint8_t *des
 {
     const uint8_t *lookUpTable = mLookUpTable.data();
 
+    size_t done = gammaKernels().lookUp(lookUpTable, first, last - first, destination);
+    first += done;
+    destination += done;
+
     while (first != last)
         *destination++ = lookUpTable[*first++];
 }
+
+void GammaLut16::apply(const uint16_t *source, uint32_t width, uint32_t height, uint32_t components, uint32_t scale,
+                       uint8_t *destination, uint32_t threads) const
+{
+    scale = std::max(1u, scale);
+    const uint32_t scaledWidth = width / scale, scaledHeight = height / scale;
+    const size_t rowSize = static_cast<size_t>(width) * components;
+    const size_t scaledRowSize = static_cast<size_t>(scaledWidth) * components;
+
+    // Bands of at least a quarter of a megapixel
+    if (threads == 0)
+        threads = INDI::parallelBands(scaledHeight, std::max<size_t>(1, (size_t(1) << 18) / (rowSize * scale)));
+
+    INDI::parallelFor(scaledHeight, threads, [&](uint32_t, size_t first, size_t last)
+    {
+        if (scale == 1)
+        {
+            for (size_t y = first; y < last; y++)
+                apply(source + y * rowSize, scaledRowSize, destination + y * scaledRowSize);
+            return;
+        }
+
+        // Sum the rows of each block in column accumulators, then the columns of each block into
+        // 16 bits averages that go through the table like unscaled rows.
+        // Dividing by the block size is a multiplication by its 32 bits reciprocal, exact while
+        // the sum times the reciprocal error fits 32 bits, i.e. blocks of less than 256 pixels.
+        const uint32_t blockScale = scale, blockComponents = components, blockSize = scale * scale;
+        const uint64_t reciprocal = ((uint64_t(1) << 32) + blockSize - 1) / blockSize;
+        std::vector<uint32_t> sums(scaledWidth * scale * components);
+        std::vector<uint16_t> averages(scaledRowSize);
+        for (size_t y = first; y < last; y++)
+        {
+            const uint16_t *row = source + static_cast<size_t>(y) * blockScale * rowSize;
+            uint32_t *sum = sums.data();
+            std::fill(sums.begin(), sums.end(), 0);
+            for (uint32_t k = 0; k < blockScale; k++, row += rowSize)
+                accumulateRow(sum, row, sums.size());
+
+            // 2x2 mono blocks have a SIMD kernel, the most common preview downscale
+            uint16_t *average = averages.data();
+            uint32_t x = blockScale == 2 && blockComponents == 1 ? gammaKernels().averagePairs(average, sum, scaledWidth) : 0;
+            for (average += x * blockComponents, sum += x * blockScale * blockComponents; x < scaledWidth;
+                    x++, sum += blockScale * blockComponents)
+            {
+                for (uint32_t c = 0; c < blockComponents; c++)
+                {
+                    uint32_t total = blockSize / 2;
+                    for (uint32_t k = 0; k < blockScale; k++)
+                        total += sum[k * blockComponents + c];
+                    *average++ = blockSize < 256 ? (total * reciprocal) >> 32 : total / blockSize;
+                }
+            }
+
+            apply(averages.data(), scaledRowSize, destination + y * scaledRowSize);
+        }
+    });
+}
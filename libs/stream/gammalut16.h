@@ -35,6 +35,15 @@ class GammaLut16
         void apply(const uint16_t *source, size_t count, uint8_t *destination) const;
         void apply(const uint16_t *first, const uint16_t *last, uint8_t *destination) const;
 
+        /**
+         * @brief Convert a 16 bits frame to 8 bits, averaging blocks of scale x scale pixels.
+         * @param source Frame of width x height pixels, of components interleaved values each
+         * @param destination Frame of width / scale x height / scale pixels
+         * @param threads Number of bands converted in parallel, 0 to pick it from the frame size
+         */
+        void apply(const uint16_t *source, uint32_t width, uint32_t height, uint32_t components, uint32_t scale,
+                   uint8_t *destination, uint32_t threads = 0) const;
+
     protected:
         std::vector<uint8_t> mLookUpTable;
 };
@@ -23,6 +23,7 @@
 
 #include "indidevapi.h"
 #include "indibasetypes.h"
+#include "indimacros.h"
 
 #include <stdio.h>
 #include <cstdlib>
@@ -79,6 +80,21 @@ class RecorderInterface
         // and no need to do any further subframing operations. Otherwise, subframing must be done.
         // This is to reduce process time and save memory for a dedicated subframe buffer
         virtual void setStreamEnabled(bool enable) = 0;
+        // Write the file with O_DIRECT, bypassing the page cache, for recorders that support it
+        virtual void setDirectIO(bool enable)
+        {
+            INDI_UNUSED(enable);
+        }
+        // Bytes written to the file since it was opened
+        virtual uint64_t getBytesWritten()
+        {
+            return 0;
+        }
+        // Frames dropped since the file was opened because the disk did not keep up
+        virtual uint64_t getDroppedFrames()
+        {
+            return 0;
+        }
 
     protected:
         const char *name;
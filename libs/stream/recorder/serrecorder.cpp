@@ -53,7 +53,6 @@ SER_Recorder::SER_Recorder()
     // always default to. LITTLE_ENDIAN appears to be ignored by them leading to garbled data.
     serh.LittleEndian = SER_BIG_ENDIAN;
     isRecordingActive = false;
-    f = nullptr;
 
     jpegBuffer = static_cast<uint8_t*>(malloc(1));
 }
@@ -72,35 +71,19 @@ bool SER_Recorder::is_little_endian()
 
 void SER_Recorder::write_int_le(uint32_t *i)
 {
-    if (is_little_endian())
-        fwrite((i), sizeof(uint32_t), 1, f);
-    else
-    {
-        unsigned char *c = (unsigned char *)i;
-        fwrite((c + 3), sizeof(char), 1, f);
-        fwrite((c + 2), sizeof(char), 1, f);
-        fwrite((c + 1), sizeof(char), 1, f);
-        fwrite((c), sizeof(char), 1, f);
-    }
+    for (int shift = 0; shift < 32; shift += 8)
+        buffer.push_back(*i >> shift);
 }
 
 void SER_Recorder::write_long_int_le(uint64_t *i)
 {
-    if (is_little_endian())
-    {
-        fwrite(((uint32_t *)i), sizeof(int), 1, f);
-        fwrite(((uint32_t *)(i) + 1), sizeof(int), 1, f);
-    }
-    else
-    {
-        write_int_le((uint32_t *)(i) + 1);
-        write_int_le((uint32_t *)(i));
-    }
+    for (int shift = 0; shift < 64; shift += 8)
+        buffer.push_back(*i >> shift);
 }
 
 void SER_Recorder::write_header(ser_header *s)
 {
-    fwrite((s->FileID), sizeof(char), 14, f);
+    buffer.insert(buffer.end(), s->FileID, s->FileID + 14);
     write_int_le(&(s->LuID));
     write_int_le(&(s->ColorID));
     write_int_le(&(s->LittleEndian));
@@ -108,9 +91,9 @@ void SER_Recorder::write_header(ser_header *s)
     write_int_le(&(s->ImageHeight));
     write_int_le(&(s->PixelDepth));
     write_int_le(&(s->FrameCount));
-    fwrite((s->Observer), sizeof(char), 40, f);
-    fwrite((s->Instrume), sizeof(char), 40, f);
-    fwrite((s->Telescope), sizeof(char), 40, f);
+    buffer.insert(buffer.end(), s->Observer, s->Observer + 40);
+    buffer.insert(buffer.end(), s->Instrume, s->Instrume + 40);
+    buffer.insert(buffer.end(), s->Telescope, s->Telescope + 40);
     write_long_int_le(&(s->DateTime));
     write_long_int_le(&(s->DateTime_UTC));
 }
@@ -175,7 +158,7 @@ bool SER_Recorder::open(const char *filename, char *errmsg)
     if (isRecordingActive)
         return false;
     serh.FrameCount = 0;
-    if ((f = fopen(filename, "w")) == nullptr)
+    if (!file.open(filename, isDirectIO))
     {
         snprintf(errmsg, ERRMSGSIZ, "recorder open error %d, %s\n", errno, strerror(errno));
         return false;
@@ -183,33 +166,41 @@ bool SER_Recorder::open(const char *filename, char *errmsg)
 
     serh.DateTime     = getLocalTimeStamp();
     serh.DateTime_UTC = getUTCTimeStamp();
+    buffer.clear();
     write_header(&serh);
+    file.write(buffer.data(), buffer.size());
     frame_size        = serh.ImageWidth * serh.ImageHeight * (serh.PixelDepth <= 8 ? 1 : 2) * number_of_planes;
     isRecordingActive = true;
 
     frameStamps.clear();
+    droppedFrames = 0;
 
     return true;
 }
 
 bool SER_Recorder::close()
 {
-    if (f)
+    bool ok = true;
+    if (file.isOpen())
     {
+        ok = file.flush();
+
         // Write all timestamps
+        buffer.clear();
         for (auto value : frameStamps)
             write_long_int_le(&value);
+        ok = file.writeAt(file.size(), buffer.data(), buffer.size()) && ok;
 
         frameStamps.clear();
 
-        fseek(f, 0L, SEEK_SET);
+        buffer.clear();
         write_header(&serh);
-        fclose(f);
-        f = nullptr;
+        ok = file.writeAt(0, buffer.data(), buffer.size()) && ok;
+        ok = file.close() && ok;
     }
 
     isRecordingActive = false;
-    return true;
+    return ok;
 }
 
 bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes)
@@ -253,7 +244,7 @@ bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes)
     }
 #endif
 
-    frameStamps.push_back(getUTCTimeStamp());
+    uint64_t timeStamp = getUTCTimeStamp();
 
     // Not technically pixel format, but let's use this for now.
     if (m_PixelFormat == INDI_JPG)
@@ -266,10 +257,20 @@ bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes)
         serh.ImageWidth = w;
         serh.ImageHeight = h;
         serh.ColorID = (naxis == 3) ? SER_RGB : SER_MONO;
-        fwrite(jpegBuffer, 1, memsize, f);
+        frame = jpegBuffer;
+        nbytes = memsize;
     }
-    else
-        fwrite(frame, 1, nbytes, f);
+
+    // The disk doesn't keep up, drop the frame rather than stalling the stream
+    if (!file.write(frame, nbytes))
+    {
+        if (file.hasFailed())
+            return false;
+        droppedFrames++;
+        return true;
+    }
+
+    frameStamps.push_back(timeStamp);
     serh.FrameCount += 1;
     return true;
 }
@@ -22,6 +22,7 @@
 #pragma once
 
 #include "recorderinterface.h"
+#include "writebehindfile.h"
 
 #include <cstdint>
 #include <stdio.h>
@@ -86,6 +87,18 @@ class SER_Recorder : public RecorderInterface
         {
             isStreamingActive = enable;
         }
+        virtual void setDirectIO(bool enable)
+        {
+            isDirectIO = enable;
+        }
+        virtual uint64_t getBytesWritten()
+        {
+            return file.bytesWritten();
+        }
+        virtual uint64_t getDroppedFrames()
+        {
+            return droppedFrames;
+        }
 
         // Public constants
         static const uint64_t C_SEPASECONDS_PER_SECOND = 10000000;
@@ -97,8 +110,11 @@ class SER_Recorder : public RecorderInterface
         void write_long_int_le(uint64_t *i);
         void write_header(ser_header *s);
         ser_header serh;
-        bool isRecordingActive = false, isStreamingActive = false;
-        FILE *f;
+        bool isRecordingActive = false, isStreamingActive = false, isDirectIO = false;
+        // Frames are written from a dedicated I/O thread, the header and timestamps go through buffer
+        WriteBehindFile file;
+        std::vector<uint8_t> buffer;
+        uint64_t droppedFrames = 0;
         uint32_t frame_size;
         uint32_t number_of_planes;
         uint16_t rawWidth = 0, rawHeight = 0;
@@ -0,0 +1,320 @@
+/*
+    Write Behind File
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#include "writebehindfile.h"
+#include "indidevapi.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace INDI
+{
+
+// O_DIRECT needs buffers, offsets and sizes aligned to the logical block size of the device
+static constexpr size_t IO_ALIGNMENT = 4096;
+// The file is preallocated this far ahead of the writes, so it doesn't fragment while it grows
+static constexpr uint64_t PREALLOCATE_STEP = 256 * 1024 * 1024;
+
+WriteBehindFile::WriteBehindFile(size_t batchSize, size_t batchCount)
+    : batchSize((std::max<size_t>(batchSize, 1) + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT)
+    , buffers(std::max<size_t>(batchCount, 1), nullptr)
+{ }
+
+WriteBehindFile::~WriteBehindFile()
+{
+    close();
+}
+
+bool WriteBehindFile::open(const char *filename, bool directIO)
+{
+    if (fd >= 0)
+        return false;
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    isDirect = false;
+#ifdef O_DIRECT
+    if (directIO)
+    {
+        fd = ::open(filename, flags | O_DIRECT, 0644);
+        isDirect = fd >= 0;
+    }
+#endif
+    // Some file systems (tmpfs) refuse O_DIRECT
+    if (fd < 0)
+        fd = ::open(filename, flags, 0644);
+    if (fd < 0)
+        return false;
+
+    freeBuffers.clear();
+    for (auto &buffer : buffers)
+    {
+        void *memory = nullptr;
+        if (posix_memalign(&memory, IO_ALIGNMENT, batchSize) != 0)
+        {
+            close();
+            errno = ENOMEM;
+            return false;
+        }
+        buffer = static_cast<uint8_t *>(memory);
+        freeBuffers.push_back(buffer);
+    }
+
+    pending.clear();
+    current = Batch();
+    appended = 0;
+    preallocated = 0;
+    written = 0;
+    failed = false;
+    isFlushed = false;
+    terminate = false;
+    thread = std::thread(&WriteBehindFile::ioThread, this);
+    return true;
+}
+
+bool WriteBehindFile::write(const void *data, size_t size)
+{
+    if (fd < 0 || isFlushed || failed)
+        return false;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        // Data larger than every batch together would never fit
+        if (current.size + size > buffers.size() * batchSize && !growBatches(lock, current.size + size))
+            return false;
+
+        size_t available = freeBuffers.size() * batchSize + (current.data ? batchSize - current.size : 0);
+        if (size > available)
+            return false;
+    }
+
+    // The I/O thread only gives buffers back, so the ones counted above are still free
+    const uint8_t *source = static_cast<const uint8_t *>(data);
+    while (size > 0)
+    {
+        if (current.data == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current.data = freeBuffers.back();
+            freeBuffers.pop_back();
+        }
+
+        size_t n = std::min(size, batchSize - current.size);
+        memcpy(current.data + current.size, source, n);
+        current.size += n;
+        appended += n;
+        source += n;
+        size -= n;
+
+        if (current.size == batchSize)
+            submit();
+    }
+
+    return true;
+}
+
+bool WriteBehindFile::growBatches(std::unique_lock<std::mutex> &lock, size_t size)
+{
+    size_t grownSize = (size + buffers.size() - 1) / buffers.size();
+    grownSize = (grownSize + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+
+    std::vector<uint8_t *> grown;
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        void *memory = nullptr;
+        if (posix_memalign(&memory, IO_ALIGNMENT, grownSize) != 0)
+        {
+            for (auto &buffer : grown)
+                free(buffer);
+            IDLog("Failed to allocate write batches of %zu bytes for %zu bytes of data\n", grownSize, size);
+            return false;
+        }
+        grown.push_back(static_cast<uint8_t *>(memory));
+    }
+
+    IDLog("Growing write batches from %zu to %zu bytes for %zu bytes of data\n", batchSize, grownSize, size);
+
+    // Every buffer but the current one is free once the I/O thread is done
+    completed.wait(lock, [this]()
+    {
+        return pending.empty();
+    });
+
+    // The current batch keeps its offset, a multiple of the previous size, so still aligned for O_DIRECT
+    if (current.data != nullptr)
+    {
+        memcpy(grown.front(), current.data, current.size);
+        current.data = grown.front();
+    }
+
+    for (auto &buffer : buffers)
+        free(buffer);
+    buffers = grown;
+    freeBuffers.assign(buffers.begin() + (current.data != nullptr ? 1 : 0), buffers.end());
+    batchSize = grownSize;
+    return true;
+}
+
+void WriteBehindFile::submit()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back(current);
+    current = Batch();
+    current.offset = appended;
+    submitted.notify_one();
+}
+
+bool WriteBehindFile::writeAll(const uint8_t *data, size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t n = pwrite(fd, data, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+
+        data += n;
+        size -= n;
+        offset += n;
+        written.fetch_add(n, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void WriteBehindFile::ioThread()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        submitted.wait(lock, [this]()
+        {
+            return terminate || !pending.empty();
+        });
+
+        if (pending.empty())
+            break;
+
+        Batch batch = pending.front();
+        lock.unlock();
+
+#ifdef __linux__
+        // Keep the file size, so a crash doesn't leave a file padded with zeros
+        if (batch.offset + batch.size > preallocated)
+        {
+            if (fallocate(fd, FALLOC_FL_KEEP_SIZE, preallocated, PREALLOCATE_STEP) == 0)
+                preallocated += PREALLOCATE_STEP;
+            else
+                preallocated = UINT64_MAX; // not supported, don't try again
+        }
+#endif
+
+        if (!failed && !writeAll(batch.data, batch.size, batch.offset))
+            failed = true;
+
+        lock.lock();
+        pending.pop_front();
+        freeBuffers.push_back(batch.data);
+        completed.notify_all();
+    }
+}
+
+bool WriteBehindFile::flush()
+{
+    if (fd < 0)
+        return false;
+
+    if (isFlushed)
+        return !failed;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        completed.wait(lock, [this]()
+        {
+            return pending.empty();
+        });
+    }
+
+    // The last batch is partial, its size is not aligned for O_DIRECT
+#ifdef O_DIRECT
+    if (isDirect)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+#endif
+
+    if (current.data != nullptr)
+    {
+        if (current.size > 0 && !failed && !writeAll(current.data, current.size, current.offset))
+            failed = true;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        freeBuffers.push_back(current.data);
+        current = Batch();
+    }
+
+    isFlushed = true;
+    return !failed;
+}
+
+bool WriteBehindFile::writeAt(uint64_t offset, const void *data, size_t size)
+{
+    if (fd < 0 || !isFlushed)
+        return false;
+
+    return writeAll(static_cast<const uint8_t *>(data), size, offset);
+}
+
+bool WriteBehindFile::close()
+{
+    if (fd < 0)
+        return true;
+
+    bool ok = flush();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        terminate = true;
+        submitted.notify_one();
+    }
+    if (thread.joinable())
+        thread.join();
+
+    // Give back the preallocated space past the end of the file
+    struct stat st;
+    if (preallocated > 0 && fstat(fd, &st) == 0)
+        ok = ftruncate(fd, st.st_size) == 0 && ok;
+
+    ok = ::close(fd) == 0 && ok;
+    fd = -1;
+
+    for (auto &buffer : buffers)
+    {
+        free(buffer);
+        buffer = nullptr;
+    }
+    freeBuffers.clear();
+
+    return ok;
+}
+
+}
@@ -0,0 +1,147 @@
+/*
+    Write Behind File
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace INDI
+{
+
+/**
+ * \class WriteBehindFile
+ * \brief The WriteBehindFile class appends data to a file from a dedicated I/O thread.
+ *
+ * Data written to the file is copied into large batches, each full batch is written by the I/O thread
+ * in one call while the next one is filled. When every batch is waiting to be written, write fails
+ * instead of blocking, so the caller can drop the data and count it. Data larger than every batch
+ * together makes the batches larger instead, once the I/O thread is done with the pending ones. On Linux, the file is preallocated
+ * ahead of the writes and can be written with O_DIRECT, bypassing the page cache.
+ */
+class WriteBehindFile
+{
+    public:
+        /**
+         * @param batchSize Size of a batch in bytes, rounded up to a multiple of 4096
+         * @param batchCount Number of batches, the most data waiting to be written is batchSize x batchCount
+         */
+        explicit WriteBehindFile(size_t batchSize = 4 * 1024 * 1024, size_t batchCount = 16);
+        ~WriteBehindFile();
+
+    public:
+        /**
+         * @brief Create or truncate a file and start the I/O thread.
+         * @param filename File to write
+         * @param directIO Write with O_DIRECT if the file system supports it
+         * @return false with errno set if the file can't be opened
+         */
+        bool open(const char *filename, bool directIO = false);
+
+        /**
+         * @brief Append data to the file.
+         * @return false if every batch is waiting to be written or a write failed, nothing is appended then.
+         * Data larger than every batch together waits for the pending batches and makes them larger.
+         */
+        bool write(const void *data, size_t size);
+
+        /**
+         * @brief Write the data appended so far and wait for the I/O thread to be done with it.
+         * writeAt can be used from then on.
+         * @return false if a write failed
+         */
+        bool flush();
+
+        /**
+         * @brief Write data at an offset, bypassing the batches. Only valid after flush.
+         */
+        bool writeAt(uint64_t offset, const void *data, size_t size);
+
+        /**
+         * @brief Flush, trim the preallocated space and close the file.
+         * @return false if a write failed
+         */
+        bool close();
+
+        bool isOpen() const
+        {
+            return fd >= 0;
+        }
+
+        /// Bytes appended with write
+        uint64_t size() const
+        {
+            return appended;
+        }
+
+        /// True once a write to the file failed
+        bool hasFailed() const
+        {
+            return failed;
+        }
+
+        /// Bytes written to the file by the I/O thread
+        uint64_t bytesWritten() const
+        {
+            return written.load(std::memory_order_relaxed);
+        }
+
+    protected:
+        void ioThread();
+        bool writeAll(const uint8_t *data, size_t size, uint64_t offset);
+        bool growBatches(std::unique_lock<std::mutex> &lock, size_t size);
+        void submit();
+
+    protected:
+        struct Batch
+        {
+            uint8_t *data {nullptr};
+            size_t size {0};
+            uint64_t offset {0};
+        };
+
+        int fd {-1};
+        bool isDirect {false};
+        size_t batchSize;
+
+        // Batches are filled by the writer and written by the I/O thread, then given back
+        std::vector<uint8_t *> buffers;
+        std::vector<uint8_t *> freeBuffers;
+        std::deque<Batch> pending;
+        Batch current;
+
+        uint64_t appended {0};
+        uint64_t preallocated {0};
+        std::atomic<uint64_t> written {0};
+        std::atomic<bool> failed {false};
+        bool isFlushed {false};
+
+        std::thread thread;
+        bool terminate {false};
+        mutable std::mutex mutex;
+        std::condition_variable submitted;
+        std::condition_variable completed;
+};
+
+}
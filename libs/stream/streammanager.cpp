@@ -35,6 +35,7 @@
 #include <sys/stat.h>
 
 #include <algorithm>
+#include <cmath>
 
 static const char * STREAM_TAB = "Streaming";
 
@@ -169,6 +170,21 @@ bool StreamManagerPrivate::initProperties()
     LimitsNP[LIMITS_BUFFER_MAX ].fill("LIMITS_BUFFER_MAX",  "Maximum Buffer Size (MB)", "%.0f", 1, 1024 * 64, 1, 512);
     LimitsNP[LIMITS_PREVIEW_FPS].fill("LIMITS_PREVIEW_FPS", "Maximum Preview FPS",      "%.0f", 1, 120,     1,  10);
     LimitsNP.fill(getDeviceName(), "LIMITS", "Limits", STREAM_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Encoder Options
+    EncoderOptionsNP[ENCODER_QUALITY  ].fill("ENCODER_QUALITY",   "Quality",   "%.0f", 1,  100,   1, 85);
+    EncoderOptionsNP[ENCODER_MAX_WIDTH].fill("ENCODER_MAX_WIDTH", "Max Width", "%.0f", 64, 65535, 1, 640);
+    EncoderOptionsNP[ENCODER_THREADS  ].fill("ENCODER_THREADS",   "Threads",   "%.0f", 1,  8,     1, 2);
+    EncoderOptionsNP.fill(getDeviceName(), "STREAM_ENCODER_OPTIONS", "Encoder Options", STREAM_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Record I/O
+    RecordDirectIOSP[DIRECT_IO_ON ].fill("DIRECT_IO_ON",  "On",  ISS_OFF);
+    RecordDirectIOSP[DIRECT_IO_OFF].fill("DIRECT_IO_OFF", "Off", ISS_ON);
+    RecordDirectIOSP.fill(getDeviceName(), "RECORD_DIRECT_IO", "Direct I/O", STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    RecordStatsNP[RECORD_STATS_RATE   ].fill("RECORD_RATE",    "Write rate (MB/s)", "%.1f", 0, 100000,     0, 0);
+    RecordStatsNP[RECORD_STATS_DROPPED].fill("RECORD_DROPPED", "Dropped frames",    "%.f",  0, 999999999.0, 0, 0);
+    RecordStatsNP.fill(getDeviceName(), "RECORD_STATS", "Record Stats", STREAM_TAB, IP_RO, 0, IPS_IDLE);
     return true;
 }
 
@@ -196,6 +212,9 @@ void StreamManagerPrivate::ISGetProperties(const char *dev)
         currentDevice->defineProperty(EncoderSP);
         currentDevice->defineProperty(RecorderSP);
         currentDevice->defineProperty(LimitsNP);
+        currentDevice->defineProperty(EncoderOptionsNP);
+        currentDevice->defineProperty(RecordDirectIOSP);
+        currentDevice->defineProperty(RecordStatsNP);
     }
 }
 
@@ -230,6 +249,9 @@ bool StreamManagerPrivate::updateProperties()
         currentDevice->defineProperty(EncoderSP);
         currentDevice->defineProperty(RecorderSP);
         currentDevice->defineProperty(LimitsNP);
+        currentDevice->defineProperty(EncoderOptionsNP);
+        currentDevice->defineProperty(RecordDirectIOSP);
+        currentDevice->defineProperty(RecordStatsNP);
     }
     else
     {
@@ -245,6 +267,9 @@ bool StreamManagerPrivate::updateProperties()
         currentDevice->deleteProperty(EncoderSP.getName());
         currentDevice->deleteProperty(RecorderSP.getName());
         currentDevice->deleteProperty(LimitsNP.getName());
+        currentDevice->deleteProperty(EncoderOptionsNP.getName());
+        currentDevice->deleteProperty(RecordDirectIOSP.getName());
+        currentDevice->deleteProperty(RecordStatsNP.getName());
     }
 
     return true;
@@ -261,14 +286,14 @@ bool StreamManager::updateProperties()
  * Subframing for streaming/recording is done in the stream manager.
  * Therefore nbytes is expected to be SubW/BinX * SubH/BinY * Bytes_Per_Pixels * Number_Color_Components
  * Binned frame must be sent from the camera driver for this to work consistentaly for all drivers.*/
-void StreamManagerPrivate::newFrame(const uint8_t * buffer, uint32_t nbytes)
+uint8_t *StreamManagerPrivate::acquireFrame(uint32_t nbytes)
 {
     // close the data stream on the same thread as the data stream
     // manually triggered to stop recording.
     if (isRecordingAboutToClose)
     {
         stopRecording();
-        return;
+        return nullptr;
     }
 
     // Discard every N frame.
@@ -280,7 +305,7 @@ void StreamManagerPrivate::newFrame(const uint8_t * buffer, uint32_t nbytes)
         (frameCountDivider % static_cast<int>(StreamExposureNP[STREAM_DIVISOR].value)) == 0
     )
     {
-        return;
+        return nullptr;
     }
 
     if (FPSAverage.newFrame())
@@ -299,19 +324,30 @@ void StreamManagerPrivate::newFrame(const uint8_t * buffer, uint32_t nbytes)
         }).detach();
     }
 
-    if (isStreaming || (isRecording && !isRecordingAboutToClose))
+    if (!isStreaming && !(isRecording && !isRecordingAboutToClose))
+        return nullptr;
+
+    size_t allocatedSize = nbytes * framesIncoming.size() / 1024 / 1024; // allocated size in MB
+    FrameRing::Frame *frame = nullptr;
+    if (allocatedSize > LimitsNP[LIMITS_BUFFER_MAX].getValue() || (frame = framesIncoming.acquire(nbytes)) == nullptr)
     {
-        size_t allocatedSize = nbytes * framesIncoming.size() / 1024 / 1024; // allocated size in MB
-        if (allocatedSize > LimitsNP[LIMITS_BUFFER_MAX].getValue())
-        {
-            LOG_WARN("Frame buffer is full, skipping frame...");
-            return;
-        }
+        LOG_WARN("Frame buffer is full, skipping frame...");
+        if (isRecording)
+            ++recordDroppedFrames;
+        return nullptr;
+    }
 
-        std::vector<uint8_t> copyBuffer(buffer, buffer + nbytes); // copy the frame
+    isFrameAcquired = true;
+    return frame->data();
+}
 
-        framesIncoming.push(TimeFrame{FPSFast.deltaTime(), std::move(copyBuffer)}); // push it into the queue
-    }
+void StreamManagerPrivate::commitFrame(double deltaTime)
+{
+    if (!isFrameAcquired)
+        return;
+
+    isFrameAcquired = false;
+    framesIncoming.commit(deltaTime); // pass it to the stream thread
 
     if (isRecording && !isRecordingAboutToClose)
     {
@@ -343,12 +379,56 @@ void StreamManagerPrivate::newFrame(const uint8_t * buffer, uint32_t nbytes)
     }
 }
 
+void StreamManagerPrivate::commitFrame()
+{
+    lastFrameTimestamp = std::chrono::steady_clock::time_point();
+    commitFrame(FPSFast.deltaTime());
+}
+
+void StreamManagerPrivate::commitFrame(std::chrono::steady_clock::time_point timestamp)
+{
+    double deltaTime = FPSFast.deltaTime();
+    if (lastFrameTimestamp.time_since_epoch().count() != 0 && timestamp >= lastFrameTimestamp)
+        deltaTime = std::chrono::duration<double, std::milli>(timestamp - lastFrameTimestamp).count();
+
+    lastFrameTimestamp = timestamp;
+    commitFrame(deltaTime);
+}
+
+void StreamManagerPrivate::newFrame(const uint8_t * buffer, uint32_t nbytes)
+{
+    uint8_t *frame = acquireFrame(nbytes);
+    if (frame == nullptr)
+        return;
+
+    memcpy(frame, buffer, nbytes); // copy the frame into a recycled buffer
+    commitFrame();
+}
+
 void StreamManager::newFrame(const uint8_t * buffer, uint32_t nbytes)
 {
     D_PTR(StreamManager);
     d->newFrame(buffer, nbytes);
 }
 
+uint8_t *StreamManager::acquireFrame(uint32_t nbytes)
+{
+    D_PTR(StreamManager);
+    return d->acquireFrame(nbytes);
+}
+
+void StreamManager::commitFrame()
+{
+    D_PTR(StreamManager);
+    d->commitFrame();
+}
+
+void StreamManager::commitFrame(std::chrono::steady_clock::time_point timestamp)
+{
+    D_PTR(StreamManager);
+    d->commitFrame(timestamp);
+}
+
 
 StreamManagerPrivate::FrameInfo StreamManagerPrivate::updateSourceFrameInfo()
 {
@@ -412,27 +492,30 @@ void StreamManagerPrivate::subframe(
 
 void StreamManagerPrivate::asyncStreamThread()
 {
-    TimeFrame sourceTimeFrame;
-    sourceTimeFrame.time = 0;
-
-    std::vector<uint8_t> subframeBuffer;  // Subframe buffer for recording/streaming
-    std::vector<uint8_t> downscaleBuffer; // Downscale buffer for streaming
+    std::vector<uint8_t> subframeBuffer;    // Subframe buffer for recording/streaming
+    std::vector<uint8_t> previewBuffers[2]; // Preview buffers, one is filled while the other one is uploaded
+    size_t previewIndex = 0;
+    INDI::ElapsedTimer previewElapsed;
 
+    // Declared last: its destructor joins the thread once the running upload is done, before the buffers and
+    // timer used by the upload are destroyed
     INDI::SingleThreadPool previewThreadPool;
-    INDI::ElapsedTimer previewElapsed;
 
     while(!framesThreadTerminate)
     {
-        if (framesIncoming.pop(sourceTimeFrame) == false)
+        FrameRing::Frame *sourceFrame = framesIncoming.front(100);
+        if (sourceFrame == nullptr)
             continue;
 
         FrameInfo srcFrameInfo = updateSourceFrameInfo();
 
-        std::vector<uint8_t> *sourceBuffer = &sourceTimeFrame.frame;
+        const uint8_t *sourceBuffer = sourceFrame->data();
+        size_t sourceSize = sourceFrame->size;
 
-        if (PixelFormat != INDI_JPG && sourceBuffer->size() != srcFrameInfo.totalSize())
+        if (PixelFormat != INDI_JPG && sourceSize != srcFrameInfo.totalSize())
         {
             LOG_ERROR("Invalid source buffer size, skipping frame...");
+            framesIncoming.release();
             continue;
         }
 
@@ -444,9 +527,10 @@ void StreamManagerPrivate::asyncStreamThread()
         )
         {
             subframeBuffer.resize(dstFrameInfo.totalSize());
-            subframe(sourceBuffer->data(), srcFrameInfo, subframeBuffer.data(), dstFrameInfo);
+            subframe(sourceBuffer, srcFrameInfo, subframeBuffer.data(), dstFrameInfo);
 
-            sourceBuffer = &subframeBuffer;
+            sourceBuffer = subframeBuffer.data();
+            sourceSize = subframeBuffer.size();
         }
 
         // For recording, save immediately.
@@ -454,45 +538,72 @@ void StreamManagerPrivate::asyncStreamThread()
             std::lock_guard<std::mutex> lock(recordMutex);
             if (
                 isRecording && !isRecordingAboutToClose &&
-                recordStream(sourceBuffer->data(), sourceBuffer->size(), sourceTimeFrame.time) == false
+                recordStream(sourceBuffer, sourceSize, sourceFrame->time) == false
             )
             {
                 LOG_ERROR("Recording failed.");
                 isRecordingAboutToClose = true;
             }
+
+            if (isRecording && recordStatsElapsed.hasExpired(1000))
+                updateRecordStats();
         }
 
         // For streaming, downscale to 8bit if higher than 8bit to reduce bandwidth
         // You can reduce the number of frames by setting a frame limit.
         if (isStreaming && FPSPreview.newFrame())
         {
+            // The preview thread is done with this buffer, start() waits for the previous upload to end
+            std::vector<uint8_t> *previewBuffer = &previewBuffers[previewIndex];
+            previewIndex ^= 1;
+
+            uint32_t previewWidth = dstFrameInfo.w;
+            uint32_t previewHeight = dstFrameInfo.h;
+
             // Downscale to 8bit always for streaming to reduce bandwidth
             if (PixelFormat != INDI_JPG && PixelDepth > 8)
             {
+                // MJPEG previews wider than Max Width are averaged down in the same pass
+                uint32_t scale = 1;
+                if (PixelFormat == INDI_MONO && EncoderSP[ENCODER_MJPEG].getState() == ISS_ON)
+                    scale = std::max(1, static_cast<int>(std::ceil(previewWidth / EncoderOptionsNP[ENCODER_MAX_WIDTH].getValue())));
+                previewWidth /= scale;
+                previewHeight /= scale;
+
                 // Allocale new buffer if size changes
-                downscaleBuffer.resize(dstFrameInfo.pixels());
+                previewBuffer->resize(static_cast<size_t>(previewWidth) * previewHeight);
 
-                // Apply gamma
+                // Apply gamma, over row bands on several threads for large frames
                 gammaLut16.apply(
-                    reinterpret_cast<const uint16_t*>(sourceBuffer->data()),
-                    downscaleBuffer.size(),
-                    downscaleBuffer.data()
+                    reinterpret_cast<const uint16_t*>(sourceBuffer),
+                    dstFrameInfo.w, dstFrameInfo.h, 1, scale,
+                    previewBuffer->data()
                 );
-
-                sourceBuffer = &downscaleBuffer;
             }
+            else
+            {
+                previewBuffer->assign(sourceBuffer, sourceBuffer + sourceSize);
+            }
+
+            framesIncoming.release();
 
-            //uploadStream(sourceBuffer->data(), sourceBuffer->size());
-            previewThreadPool.start(std::bind([this, &previewElapsed](const std::atomic_bool & isAboutToQuit,
-                                              std::vector<uint8_t> frame)
+            //uploadStream(previewBuffer->data(), previewBuffer->size());
+            previewThreadPool.start([this, &previewElapsed, previewBuffer, previewWidth,
+                                     previewHeight](const std::atomic_bool & isAboutToQuit)
             {
                 INDI_UNUSED(isAboutToQuit);
                 previewElapsed.start();
-                uploadStream(frame.data(), frame.size());
+                // The encoder gets the frame as converted, already downscaled for MJPEG
+                if (PixelFormat != INDI_JPG)
+                    encoder->setSize(previewWidth, previewHeight);
+                uploadStream(previewBuffer->data(), previewBuffer->size());
                 StreamTimeNP[0].setValue(previewElapsed.nsecsElapsed() / 1000000000.0);
                 StreamTimeNP.apply();
-
-            }, std::placeholders::_1, std::move(*sourceBuffer)));
+            });
+        }
+        else
+        {
+            framesIncoming.release();
         }
     }
 }
@@ -593,6 +704,29 @@ bool StreamManagerPrivate::recordStream(const uint8_t * buffer, uint32_t nbytes,
     return recorder->writeFrame(buffer, nbytes);
 }
 
+void StreamManagerPrivate::updateRecordStats()
+{
+    uint64_t bytes = recorder->getBytesWritten();
+    double seconds = recordStatsElapsed.restart() / 1000.0;
+    if (seconds > 0 && bytes >= recordStatsBytes)
+        RecordStatsNP[RECORD_STATS_RATE].setValue((bytes - recordStatsBytes) / seconds / 1024 / 1024);
+    recordStatsBytes = bytes;
+
+    RecordStatsNP[RECORD_STATS_DROPPED].setValue(recordDroppedFrames + recorder->getDroppedFrames());
+    RecordStatsNP.setState(isRecording ? IPS_BUSY : IPS_IDLE);
+    RecordStatsNP.apply();
+}
+
+void StreamManagerPrivate::applyEncoderOptions()
+{
+    for (EncoderInterface * oneEncoder : encoderManager.getEncoderList())
+    {
+        oneEncoder->setQuality(EncoderOptionsNP[ENCODER_QUALITY].getValue());
+        oneEncoder->setMaxWidth(EncoderOptionsNP[ENCODER_MAX_WIDTH].getValue());
+        oneEncoder->setThreads(EncoderOptionsNP[ENCODER_THREADS].getValue());
+    }
+}
+
 std::string StreamManagerPrivate::expand(const std::string &fname, const std::map<std::string, std::string> &patterns)
 {
     std::string result = fname;
@@ -662,6 +796,7 @@ bool StreamManagerPrivate::startRecording()
                   strerror(errno));
         return false;
     }
+    recorder->setDirectIO(RecordDirectIOSP[DIRECT_IO_ON].getState() == ISS_ON);
     if (!recorder->open(filename.c_str(), errmsg))
     {
         RecordStreamSP.setState(IPS_ALERT);
@@ -690,6 +825,9 @@ bool StreamManagerPrivate::startRecording()
 #endif
     FPSRecorder.reset();
     frameCountDivider = 0;
+    recordDroppedFrames = 0;
+    recordStatsBytes = 0;
+    recordStatsElapsed.start();
 
     if (isStreaming == false)
     {
@@ -746,11 +884,15 @@ bool StreamManagerPrivate::stopRecording(bool force)
     {
         std::lock_guard<std::mutex> lock(recordMutex);
         recorder->close();
+        updateRecordStats();
     }
 
     if (force)
         return false;
 
+    if (RecordStatsNP[RECORD_STATS_DROPPED].getValue() > 0)
+        LOGF_WARN("%.f frames were dropped while recording.", RecordStatsNP[RECORD_STATS_DROPPED].getValue());
+
     LOGF_INFO(
         "Record Duration: %g millisec / %d frames",
         FPSRecorder.totalTime(),
@@ -891,6 +1033,15 @@ bool StreamManagerPrivate::ISNewSwitch(const char * dev, const char * name, ISSt
         return true;
     }
 
+    // Direct I/O, used from the next recording
+    if (RecordDirectIOSP.isNameMatch(name))
+    {
+        RecordDirectIOSP.update(states, names, n);
+        RecordDirectIOSP.setState(IPS_OK);
+        RecordDirectIOSP.apply();
+        return true;
+    }
+
     // No properties were processed
     return false;
 }
@@ -958,6 +1109,16 @@ bool StreamManagerPrivate::ISNewNumber(const char * dev, const char * name, doub
         return true;
     }
 
+    /* Encoder Options */
+    if (EncoderOptionsNP.isNameMatch(name))
+    {
+        EncoderOptionsNP.update(values, names, n);
+        applyEncoderOptions();
+        EncoderOptionsNP.setState(IPS_OK);
+        EncoderOptionsNP.apply();
+        return true;
+    }
+
     /* Record Options */
     if (RecordOptionsNP.isNameMatch(name))
     {
@@ -1136,6 +1297,8 @@ bool StreamManager::saveConfigItems(FILE * fp)
     d->RecordOptionsNP.save(fp);
     d->RecorderSP.save(fp);
     d->LimitsNP.save(fp);
+    d->EncoderOptionsNP.save(fp);
+    d->RecordDirectIOSP.save(fp);
     return true;
 }
 
@@ -26,6 +26,7 @@
 #include "indidevapi.h"
 #include "indibasetypes.h"
 #include "indimacros.h"
+#include <chrono>
 #include <memory>
 
 /**
@@ -117,6 +118,28 @@ class StreamManager
          */
         void newFrame(const uint8_t *buffer, uint32_t nbytes);
 
+        /**
+         * @brief acquireFrame Get a buffer for the next frame, for drivers that can write the frame directly into it.
+         * Fill the buffer, then call commitFrame to stream or record it like newFrame does, without copying it.
+         * @param nbytes Frame size in bytes, same as the newFrame size.
+         * @return Buffer of nbytes, nullptr if the frame is not needed or the frame buffer is full. Do not call
+         * commitFrame in that case.
+         */
+        uint8_t *acquireFrame(uint32_t nbytes);
+
+        /**
+         * @brief commitFrame Stream or record the frame filled in the buffer returned by acquireFrame.
+         * The buffer must not be used after this call.
+         */
+        void commitFrame();
+
+        /**
+         * @brief commitFrame Stream or record the frame filled in the buffer returned by acquireFrame.
+         * The buffer must not be used after this call.
+         * @param timestamp Capture time of the frame, used for the recorded frame timing instead of the commit time.
+         */
+        void commitFrame(std::chrono::steady_clock::time_point timestamp);
+
         bool close();
 
     public:
@@ -27,10 +27,12 @@
 #include "recorder/recordermanager.h"
 #include "encoder/encodermanager.h"
 #include "fpsmeter.h"
-#include "uniquequeue.h"
+#include "framering.h"
 #include "gammalut16.h"
+#include "indielapsedtimer.h"
 
 #include <atomic>
+#include <chrono>
 #include <string>
 #include <map>
 #include <thread>
@@ -110,6 +112,10 @@ class StreamManagerPrivate
         bool ISNewNumber(const char * dev, const char * name, double values[], char * names[], int n);
 
         void newFrame(const uint8_t * buffer, uint32_t nbytes);
+        uint8_t *acquireFrame(uint32_t nbytes);
+        void commitFrame();
+        void commitFrame(std::chrono::steady_clock::time_point timestamp);
+        void commitFrame(double deltaTime);
 
         bool updateProperties();
         bool setStream(bool enable);
@@ -147,6 +153,16 @@ class StreamManagerPrivate
          */
         bool recordStream(const uint8_t *buffer, uint32_t nbytes, double deltams);
 
+        /**
+         * @brief updateRecordStats Publishes the recorder write rate and the dropped frames.
+         */
+        void updateRecordStats();
+
+        /**
+         * @brief applyEncoderOptions Passes the quality, maximum width and threads to every encoder.
+         */
+        void applyEncoderOptions();
+
         void getStreamFrame(uint16_t * x, uint16_t * y, uint16_t * w, uint16_t * h) const;
         void setStreamFrame(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
         void setStreamFrame(const FrameInfo &frameInfo);
@@ -215,6 +231,18 @@ class StreamManagerPrivate
         INDI::PropertyNumber LimitsNP {2};
         enum { LIMITS_BUFFER_MAX, LIMITS_PREVIEW_FPS };
 
+        // Encoder options. JPEG quality, widest preview frame and compression threads
+        INDI::PropertyNumber EncoderOptionsNP {3};
+        enum { ENCODER_QUALITY, ENCODER_MAX_WIDTH, ENCODER_THREADS };
+
+        // Record with O_DIRECT, bypassing the page cache
+        INDI::PropertySwitch RecordDirectIOSP {2};
+        enum { DIRECT_IO_ON, DIRECT_IO_OFF };
+
+        // Record write rate and frames dropped while recording
+        INDI::PropertyNumber RecordStatsNP {2};
+        enum { RECORD_STATS_RATE, RECORD_STATS_DROPPED };
+
         std::atomic<bool> isStreaming { false };
         std::atomic<bool> isRecording { false };
         std::atomic<bool> isRecordingAboutToClose { false };
@@ -243,16 +271,15 @@ class StreamManagerPrivate
         uint16_t rawWidth = 0, rawHeight = 0;
         std::string Format;
 
-        // Processing for streaming
-        typedef struct
-        {
-            double time;
-            std::vector<uint8_t> frame;
-        } TimeFrame;
-
+        // Processing for streaming, frames are passed to the stream thread in recycled buffers
         std::thread              framesThread;   // async incoming frames processing
         std::atomic<bool>        framesThreadTerminate {false};
-        UniqueQueue<TimeFrame>   framesIncoming;
+        FrameRing                framesIncoming;
+        bool                     isFrameAcquired {false};
+        std::atomic<uint64_t>    recordDroppedFrames {0}; // frames dropped by the frame buffer while recording
+        uint64_t                 recordStatsBytes {0};
+        INDI::ElapsedTimer       recordStatsElapsed;
+        std::chrono::steady_clock::time_point lastFrameTimestamp; // timestamp of the previous committed frame, if any
 
         std::mutex               fastFPSUpdate;
         std::mutex               recordMutex;
@@ -119,7 +119,16 @@ ERROR:
 }
 
 void * IDSharedBlobAttach(int fd, size_t size) {
-    shared_buffer * sb = (shared_buffer*)malloc(sizeof(shared_buffer));
+    shared_buffer * sb = NULL;
+    struct stat st;
+
+    // The size comes from the peer, mapping past the end of the buffer would fault on access
+    if (size == 0 || fstat(fd, &st) == -1 || (size_t)st.st_size < size) {
+        errno = EINVAL;
+        goto ERROR;
+    }
+
+    sb = (shared_buffer*)malloc(sizeof(shared_buffer));
     if (sb == NULL) goto ERROR;
     sb->fd = fd;
     sb->size = size;
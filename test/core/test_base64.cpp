@@ -21,8 +21,14 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <string>
+#include <vector>
 
 #include "base64.h"
 
@@ -117,3 +123,103 @@ TEST(CORE_BASE64, Test_from64tobits_fast_with_bug_time)
     }
 }
 
+
+static std::string reference64(const std::vector<unsigned char> &in)
+{
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+
+    for (size_t i = 0; i < in.size(); i += 3)
+    {
+        uint32_t n = in[i] << 16;
+        if (i + 1 < in.size())
+            n |= in[i + 1] << 8;
+        if (i + 2 < in.size())
+            n |= in[i + 2];
+        out += digits[(n >> 18) & 0x3f];
+        out += digits[(n >> 12) & 0x3f];
+        out += (i + 1 < in.size()) ? digits[(n >> 6) & 0x3f] : '=';
+        out += (i + 2 < in.size()) ? digits[n & 0x3f] : '=';
+    }
+    return out;
+}
+
+static std::vector<unsigned char> randomBytes(size_t size)
+{
+    std::vector<unsigned char> data(size);
+    uint32_t seed = 0x12345678 + size;
+    for (auto &c : data)
+    {
+        seed = seed * 1103515245 + 12345;
+        c = seed >> 23;
+    }
+    return data;
+}
+
+// Covers the vector kernels, their block boundaries and the scalar tail
+TEST(CORE_BASE64, Test_roundtrip_sizes)
+{
+    for (size_t size = 1; size < 600; size++)
+    {
+        std::vector<unsigned char> data = randomBytes(size);
+        std::string expected = reference64(data);
+
+        std::vector<char> b64(4 * size / 3 + 4);
+        int b64len = to64frombits_s(reinterpret_cast<unsigned char *>(b64.data()), data.data(), size, b64.size());
+        ASSERT_EQ(expected.size(), size_t(b64len)) << "size " << size;
+        ASSERT_EQ(expected, std::string(b64.data(), b64len)) << "size " << size;
+
+        std::vector<char> back(3 * b64len / 4 + 4);
+        int backlen = from64tobits_fast(back.data(), b64.data(), b64len);
+        ASSERT_EQ(size, size_t(backlen)) << "size " << size;
+        ASSERT_EQ(0, memcmp(back.data(), data.data(), size)) << "size " << size;
+    }
+}
+
+// Line breaks between groups, as sent by drivers, must be skipped
+TEST(CORE_BASE64, Test_from64tobits_fast_newlines)
+{
+    for (size_t size : {100, 1000, 10000})
+    {
+        std::vector<unsigned char> data = randomBytes(size);
+        std::string b64 = reference64(data);
+
+        std::string wrapped;
+        for (size_t i = 0; i < b64.size(); i += 72)
+            wrapped += b64.substr(i, 72) + "\n";
+
+        std::vector<char> back(size + 4);
+        int backlen = from64tobits_fast(back.data(), wrapped.c_str(), b64.size());
+        ASSERT_EQ(size, size_t(backlen));
+        ASSERT_EQ(0, memcmp(back.data(), data.data(), size));
+    }
+}
+
+TEST(CORE_BASE64, Test_throughput)
+{
+    for (size_t size : {1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024})
+    {
+        std::vector<unsigned char> data = randomBytes(size);
+        std::vector<unsigned char> b64(4 * size / 3 + 4);
+        std::vector<char> back(size + 4);
+        // Roughly 256MB per measure
+        int iterations = std::max(size_t(1), (size_t(256) << 20) / size);
+        int b64len = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+            b64len = to64frombits_s(b64.data(), data.data(), size, b64.size());
+        std::chrono::duration<double> encodeTime = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+            from64tobits_fast(back.data(), reinterpret_cast<char *>(b64.data()), b64len);
+        std::chrono::duration<double> decodeTime = std::chrono::steady_clock::now() - start;
+
+        ASSERT_EQ(0, memcmp(back.data(), data.data(), size));
+
+        double mb = double(size) * iterations / (1024 * 1024);
+        printf("%9zu bytes: encode %8.1f MB/s, decode %8.1f MB/s\n", size, mb / encodeTime.count(),
+               mb / decodeTime.count());
+    }
+}
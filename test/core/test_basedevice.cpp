@@ -0,0 +1,189 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "basedevice.h"
+#include "indiapi.h"
+#include "indipropertynumber.h"
+#include "indipropertyswitch.h"
+#include "indipropertytext.h"
+#include "lilxml.h"
+
+static XMLEle *parse(const std::string &text)
+{
+    char errmsg[1024];
+    LilXML *lp = newLilXML();
+    XMLEle **nodes = parseXMLChunk(lp, const_cast<char *>(text.data()), text.size(), errmsg);
+    EXPECT_NE(nodes, nullptr) << errmsg;
+    XMLEle *root = nodes ? nodes[0] : nullptr;
+    free(nodes);
+    delLilXML(lp);
+    return root;
+}
+
+static std::string propertyName(int i)
+{
+    // Names with a long common prefix, as in real drivers
+    return "TELESCOPE_PROPERTY_" + std::to_string(i);
+}
+
+static void defineNumbers(INDI::BaseDevice &device, int i)
+{
+    char errmsg[MAXRBUF];
+    XMLEle *root = parse("<defNumberVector device='Mount' name='" + propertyName(i) + "' state='Idle' perm='rw'>"
+                         "<defNumber name='AXIS_1' format='%g' min='0' max='100' step='1'>0</defNumber>"
+                         "<defNumber name='AXIS_2' format='%g' min='0' max='100' step='1'>0</defNumber>"
+                         "<defNumber name='AXIS_3' format='%g' min='0' max='100' step='1'>0</defNumber>"
+                         "</defNumberVector>");
+    ASSERT_EQ(device.buildProp(root, errmsg), 0) << errmsg;
+    delXMLEle(root);
+}
+
+static std::string setNumbers(int i, double value)
+{
+    std::string v = std::to_string(value);
+    return "<setNumberVector device='Mount' name='" + propertyName(i) + "' state='Busy'>"
+           "<oneNumber name='AXIS_1'>" + v + "</oneNumber>"
+           "<oneNumber name='AXIS_2'>" + v + "</oneNumber>"
+           "<oneNumber name='AXIS_3'>" + v + "</oneNumber>"
+           "</setNumberVector>";
+}
+
+TEST(CORE_BASEDEVICE, Test_lookup)
+{
+    INDI::BaseDevice device;
+    char errmsg[MAXRBUF];
+
+    for (int i = 0; i < 100; i++)
+        defineNumbers(device, i);
+
+    ASSERT_NE(device.getNumber(propertyName(42).c_str()), nullptr);
+    ASSERT_EQ(device.getSwitch(propertyName(42).c_str()), nullptr);
+    ASSERT_TRUE(device.getProperty(propertyName(42).c_str()).isValid());
+    ASSERT_FALSE(device.getProperty("UNKNOWN").isValid());
+
+    // Defined twice
+    XMLEle *root = parse("<defNumberVector device='Mount' name='" + propertyName(42) + "' state='Idle' perm='rw'/>");
+    ASSERT_EQ(device.buildProp(root, errmsg), INDI_PROPERTY_DUPLICATED);
+    delXMLEle(root);
+
+    ASSERT_EQ(device.removeProperty(propertyName(42).c_str(), errmsg), 0);
+    ASSERT_EQ(device.getNumber(propertyName(42).c_str()), nullptr);
+    ASSERT_NE(device.getNumber(propertyName(43).c_str()), nullptr);
+    ASSERT_NE(device.removeProperty(propertyName(42).c_str(), errmsg), 0);
+
+    defineNumbers(device, 42);
+    ASSERT_NE(device.getNumber(propertyName(42).c_str()), nullptr);
+    ASSERT_EQ(device.getProperties().size(), 100u);
+}
+
+TEST(CORE_BASEDEVICE, Test_lookupDuplicateNames)
+{
+    INDI::BaseDevice device;
+    char errmsg[MAXRBUF];
+
+    // Drivers may register the same name with several types, lookups of any type return the first registered
+    INDI::PropertySwitch switches {1};
+    INDI::PropertyNumber numbers {1};
+    INDI::PropertyText texts {1};
+    switches.setName("DUPLICATE");
+    numbers.setName("DUPLICATE");
+    texts.setName("DUPLICATE");
+
+    device.registerProperty(switches);
+    device.registerProperty(numbers);
+    device.registerProperty(texts);
+    ASSERT_EQ(device.getProperties().size(), 3u);
+
+    ASSERT_EQ(device.getProperty("DUPLICATE").getType(), INDI_SWITCH);
+    ASSERT_EQ(device.getProperty("DUPLICATE", INDI_NUMBER).getType(), INDI_NUMBER);
+    ASSERT_EQ(device.getProperty("DUPLICATE", INDI_TEXT).getType(), INDI_TEXT);
+    ASSERT_NE(device.getNumber("DUPLICATE"), nullptr);
+    ASSERT_EQ(device.getLight("DUPLICATE"), nullptr);
+
+    ASSERT_EQ(device.removeProperty("DUPLICATE", errmsg), 0);
+    ASSERT_FALSE(device.getProperty("DUPLICATE").isValid());
+}
+
+TEST(CORE_BASEDEVICE, Test_setValue)
+{
+    INDI::BaseDevice device;
+    char errmsg[MAXRBUF];
+    defineNumbers(device, 0);
+
+    // In order, out of order, unknown and missing elements
+    XMLEle *root = parse("<setNumberVector device='Mount' name='" + propertyName(0) + "' state='Ok'>"
+                         "<oneNumber name='AXIS_1'>1</oneNumber>"
+                         "<oneNumber name='AXIS_3'>3</oneNumber>"
+                         "<oneNumber name='UNKNOWN'>4</oneNumber>"
+                         "<oneNumber name='AXIS_2'>2</oneNumber>"
+                         "</setNumberVector>");
+    ASSERT_EQ(device.setValue(root, errmsg), 0) << errmsg;
+    delXMLEle(root);
+
+    auto nvp = device.getNumber(propertyName(0).c_str());
+    ASSERT_EQ(nvp->getState(), IPS_OK);
+    ASSERT_EQ(nvp->at(0)->getValue(), 1);
+    ASSERT_EQ(nvp->at(1)->getValue(), 2);
+    ASSERT_EQ(nvp->at(2)->getValue(), 3);
+
+    root = parse("<setNumberVector device='Mount' name='" + propertyName(0) + "'>"
+                 "<oneNumber name='AXIS_2'>5</oneNumber>"
+                 "</setNumberVector>");
+    ASSERT_EQ(device.setValue(root, errmsg), 0) << errmsg;
+    delXMLEle(root);
+    ASSERT_EQ(nvp->at(0)->getValue(), 1);
+    ASSERT_EQ(nvp->at(1)->getValue(), 5);
+
+    root = parse("<setNumberVector device='Mount' name='UNKNOWN'/>");
+    ASSERT_LT(device.setValue(root, errmsg), 0);
+    delXMLEle(root);
+}
+
+TEST(CORE_BASEDEVICE, Test_setValueThroughput)
+{
+    const int properties = 500;
+    INDI::BaseDevice device;
+    char errmsg[MAXRBUF];
+
+    for (int i = 0; i < properties; i++)
+        defineNumbers(device, i);
+
+    std::vector<XMLEle *> messages;
+    for (int i = 0; i < properties; i++)
+        messages.push_back(parse(setNumbers((i * 7919) % properties, i)));
+
+    const int rounds = 100;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+        for (auto root : messages)
+            ASSERT_EQ(device.setValue(root, errmsg), 0) << errmsg;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("setValue: %.0f updates/s on %d properties\n", rounds * messages.size() / elapsed.count(), properties);
+
+    for (int i = 0; i < properties; i++)
+        ASSERT_EQ(device.getNumber(propertyName((i * 7919) % properties).c_str())->at(2)->getValue(), i);
+
+    for (auto root : messages)
+        delXMLEle(root);
+}
@@ -0,0 +1,314 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "baseclient.h"
+#include "basedevice.h"
+#include "clientreactor.h"
+
+template <typename Predicate>
+static bool waitFor(Predicate predicate, int seconds = 10)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while (!predicate())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+TEST(CORE_CLIENTREACTOR, Test_connections)
+{
+    if (!INDI::ClientReactor::isSupported())
+        GTEST_SKIP();
+
+    struct Peer
+    {
+        int fds[2];
+        std::atomic<bool> busy {false};
+        std::atomic<bool> overlapped {false};
+        std::atomic<bool> closed {false};
+        std::string received;
+    };
+
+    const int count = 30;
+    const int messages = 200;
+    std::vector<std::unique_ptr<Peer>> peers;
+
+    INDI::ClientReactor reactor(4);
+    ASSERT_TRUE(reactor.isRunning());
+    ASSERT_EQ(reactor.threadCount(), 4u);
+
+    for (int i = 0; i < count; i++)
+    {
+        peers.emplace_back(new Peer());
+        Peer *peer = peers.back().get();
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, peer->fds), 0);
+        fcntl(peer->fds[0], F_SETFL, O_NONBLOCK);
+
+        auto onReadable = [peer](char *buffer, size_t size)
+        {
+            if (peer->busy.exchange(true))
+                peer->overlapped = true;
+            ssize_t n = read(peer->fds[0], buffer, size);
+            if (n > 0)
+                peer->received.append(buffer, n);
+            peer->busy = false;
+            return n != 0;
+        };
+        auto onClosed = [peer]()
+        {
+            close(peer->fds[0]);
+            peer->closed = true;
+        };
+        ASSERT_TRUE(reactor.add(peer->fds[0], onReadable, onClosed));
+    }
+    ASSERT_EQ(reactor.connectionCount(), size_t(count));
+
+    std::string expected;
+    for (int m = 0; m < messages; m++)
+        expected += "<message " + std::to_string(m) + "/>";
+
+    // Each connection gets its messages in order, whatever thread reads it
+    for (int m = 0; m < messages; m++)
+    {
+        std::string message = "<message " + std::to_string(m) + "/>";
+        for (auto &peer : peers)
+            ASSERT_EQ(write(peer->fds[1], message.data(), message.size()), ssize_t(message.size()));
+    }
+
+    for (auto &peer : peers)
+        close(peer->fds[1]);
+
+    ASSERT_TRUE(waitFor([&]()
+    {
+        return reactor.connectionCount() == 0;
+    }));
+
+    for (auto &peer : peers)
+    {
+        ASSERT_TRUE(peer->closed);
+        ASSERT_FALSE(peer->overlapped);
+        ASSERT_EQ(peer->received, expected);
+    }
+}
+
+TEST(CORE_CLIENTREACTOR, Test_destroy)
+{
+    if (!INDI::ClientReactor::isSupported())
+        GTEST_SKIP();
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    bool closed = false;
+    {
+        INDI::ClientReactor reactor(1);
+        ASSERT_TRUE(reactor.add(fds[0], [](char *, size_t)
+        {
+            return true;
+        }, [&]()
+        {
+            closed = true;
+        }));
+    }
+    // Connections left are closed with the reactor
+    ASSERT_TRUE(closed);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+class ReactorClient : public INDI::BaseClient
+{
+    public:
+        std::atomic<int> properties {0};
+        std::atomic<int> updates {0};
+        std::atomic<bool> connected {false};
+        std::atomic<bool> disconnected {false};
+        std::atomic<int> exitCode {1};
+
+    protected:
+        void newDevice(INDI::BaseDevice *) override {}
+        void removeDevice(INDI::BaseDevice *) override {}
+        void newProperty(INDI::Property *) override
+        {
+            properties++;
+        }
+        void removeProperty(INDI::Property *) override {}
+        void newBLOB(IBLOB *) override {}
+        void newSwitch(ISwitchVectorProperty *) override {}
+        void newNumber(INumberVectorProperty *) override
+        {
+            updates++;
+        }
+        void newText(ITextVectorProperty *) override {}
+        void newLight(ILightVectorProperty *) override {}
+        void newMessage(INDI::BaseDevice *, int) override {}
+        void serverConnected() override
+        {
+            connected = true;
+        }
+        void serverDisconnected(int exit_code) override
+        {
+            exitCode = exit_code;
+            disconnected = true;
+        }
+};
+
+// Accepts the clients on a local port, sends each a property and updates of it
+class FakeServer
+{
+    public:
+        FakeServer(int clients, int updates) : clients(clients), updates(updates)
+        {
+            listenFd = socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = 0;
+            socklen_t len = sizeof(addr);
+            if (bind(listenFd, reinterpret_cast<struct sockaddr *>(&addr), len) == 0 &&
+                    listen(listenFd, clients) == 0 &&
+                    getsockname(listenFd, reinterpret_cast<struct sockaddr *>(&addr), &len) == 0)
+                port = ntohs(addr.sin_port);
+            thread = std::thread(&FakeServer::serve, this);
+        }
+
+        ~FakeServer()
+        {
+            thread.join();
+            close(listenFd);
+        }
+
+        int port {0};
+
+    private:
+        void serve()
+        {
+            std::vector<int> fds;
+            for (int i = 0; i < clients; i++)
+            {
+                int fd = accept(listenFd, nullptr, nullptr);
+                if (fd < 0)
+                    return;
+                fds.push_back(fd);
+            }
+
+            for (size_t i = 0; i < fds.size(); i++)
+            {
+                std::string device = "Device" + std::to_string(i);
+                std::string data = "<defNumberVector device='" + device + "' name='POSITION' state='Idle' perm='rw'>"
+                                   "<defNumber name='X' format='%g' min='0' max='1000' step='1'>0</defNumber>"
+                                   "</defNumberVector>";
+                for (int u = 1; u <= updates; u++)
+                    data += "<setNumberVector device='" + device + "' name='POSITION' state='Ok'>"
+                            "<oneNumber name='X'>" + std::to_string(u) + "</oneNumber>"
+                            "</setNumberVector>";
+                ssize_t sent = 0;
+                while (sent < ssize_t(data.size()))
+                {
+                    ssize_t n = write(fds[i], data.data() + sent, data.size() - sent);
+                    if (n <= 0)
+                        break;
+                    sent += n;
+                }
+            }
+
+            // Until the clients disconnect
+            char buffer[1024];
+            for (int fd : fds)
+            {
+                while (read(fd, buffer, sizeof(buffer)) > 0) {}
+                close(fd);
+            }
+        }
+
+        int clients;
+        int updates;
+        int listenFd {-1};
+        std::thread thread;
+};
+
+TEST(CORE_CLIENTREACTOR, Test_clients)
+{
+    if (!INDI::ClientReactor::isSupported())
+        GTEST_SKIP();
+
+    const int count = 30;
+    const int updates = 100;
+    FakeServer server(count, updates);
+    ASSERT_NE(server.port, 0);
+
+    INDI::ClientReactor reactor(2);
+    std::vector<std::unique_ptr<ReactorClient>> clients;
+    for (int i = 0; i < count; i++)
+    {
+        clients.emplace_back(new ReactorClient());
+        clients.back()->setServer("127.0.0.1", server.port);
+        clients.back()->setReactor(&reactor);
+        ASSERT_TRUE(clients.back()->connectServer());
+    }
+    ASSERT_EQ(reactor.connectionCount(), size_t(count));
+
+    for (int i = 0; i < count; i++)
+    {
+        auto &client = clients[i];
+        ASSERT_TRUE(waitFor([&]()
+        {
+            return client->updates == updates;
+        })) << client->updates;
+        ASSERT_TRUE(client->connected);
+        ASSERT_EQ(client->properties, 1);
+
+        // The last update was applied last
+        auto device = client->getDevice(("Device" + std::to_string(i)).c_str());
+        ASSERT_NE(device, nullptr);
+        ASSERT_EQ(device->getNumber("POSITION")->at(0)->getValue(), updates);
+    }
+
+    for (auto &client : clients)
+        ASSERT_TRUE(client->disconnectServer(0));
+
+    for (auto &client : clients)
+    {
+        ASSERT_TRUE(waitFor([&]()
+        {
+            return client->disconnected.load();
+        }));
+        ASSERT_EQ(client->exitCode, 0);
+        ASSERT_FALSE(client->isServerConnected());
+    }
+    ASSERT_EQ(reactor.connectionCount(), 0u);
+}
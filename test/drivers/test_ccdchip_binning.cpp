@@ -0,0 +1,244 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "indiccd.h"
+
+class BinningCCD : public INDI::CCD
+{
+    public:
+        BinningCCD()
+        {
+            initProperties();
+        }
+
+        const char *getDefaultName() override
+        {
+            return "Binning CCD";
+        }
+
+        INDI::CCDChip &chip()
+        {
+            return PrimaryCCD;
+        }
+};
+
+template <typename T>
+static std::vector<T> randomFrame(uint32_t width, uint32_t height, uint32_t maxValue)
+{
+    std::vector<T> frame(static_cast<size_t>(width) * height);
+    srand(width * 31 + height);
+    for (auto &pixel : frame)
+        pixel = static_cast<T>(rand() % (maxValue + 1));
+    return frame;
+}
+
+// Straightforward definition of the binned frame, see CCDChip::binFrame and CCDChip::binBayerFrame
+template <typename T>
+static std::vector<T> referenceBin(const std::vector<T> &src, uint32_t width, uint32_t height, uint32_t binX, uint32_t binY,
+                                   bool bayer, uint32_t divisor, uint32_t maxValue)
+{
+    uint32_t binW = width / binX, binH = height / binY;
+    std::vector<T> dst(static_cast<size_t>(binW) * binH);
+
+    for (uint32_t r = 0; r < binH; r++)
+        for (uint32_t c = 0; c < binW; c++)
+        {
+            uint32_t sum = 0;
+            for (uint32_t t = 0; t < binY; t++)
+                for (uint32_t u = 0; u < binX; u++)
+                {
+                    uint32_t y = bayer ? (r & ~1u) * binY + 2 * t + (r & 1u) : r * binY + t;
+                    uint32_t x = bayer ? (c & ~1u) * binX + 2 * u + (c & 1u) : c * binX + u;
+                    if (y < height && x < width)
+                        sum += src[static_cast<size_t>(y) * width + x];
+                }
+            dst[static_cast<size_t>(r) * binW + c] = static_cast<T>(std::min(sum / divisor, maxValue));
+        }
+
+    return dst;
+}
+
+// Previous implementation of CCDChip::binFrame for 16 bits frames, used as the benchmark baseline
+static void legacyBinFrame16(const uint16_t *RawFrame16, uint16_t *bin_buf, uint32_t SubW, uint32_t SubH, int BinX)
+{
+    uint16_t val;
+    for (uint32_t i = 0; i < SubH; i += BinX)
+        for (uint32_t j = 0; j < SubW; j += BinX)
+        {
+            for (int k = 0; k < BinX; k++)
+            {
+                for (int l = 0; l < BinX; l++)
+                {
+                    val = *(RawFrame16 + j + (i + k) * SubW + l);
+                    if (val + *bin_buf > UINT16_MAX)
+                        *bin_buf = UINT16_MAX;
+                    else
+                        *bin_buf += val;
+                }
+            }
+            bin_buf++;
+        }
+}
+
+// Previous implementation of CCDChip::binBayerFrame for 16 bits frames, used as the benchmark baseline
+static void legacyBinBayerFrame16(const uint16_t *RawFrame16, uint16_t *BinFrame16, uint32_t SubW, uint32_t SubH,
+                                  uint32_t BinX, uint32_t BinY)
+{
+    uint32_t BinFrameOffset;
+    uint32_t val;
+    uint32_t BinW = SubW / BinX;
+    uint32_t RawOffset = 0;
+
+    for (uint32_t i = 0; i < SubH; i++)
+    {
+        uint32_t BinOffsetH = (((i / BinY) & 0xFFFFFFFE) + (i & 0x00000001)) * BinW;
+        for (uint32_t j = 0; j < SubW; j++)
+        {
+            BinFrameOffset = BinOffsetH + ((j / BinX) & 0xFFFFFFFE) + (j & 0x00000001);
+            val = BinFrame16[BinFrameOffset];
+            val += RawFrame16[RawOffset];
+            if(val > UINT16_MAX)
+                val = UINT16_MAX;
+            BinFrame16[BinFrameOffset] = (uint16_t)val;
+            RawOffset++;
+        }
+    }
+}
+
+template <typename T>
+static void loadChip(INDI::CCDChip &chip, const std::vector<T> &src, uint32_t width, uint32_t height, uint32_t binX,
+                     uint32_t binY)
+{
+    chip.setResolution(width, height);
+    chip.setFrame(0, 0, width, height);
+    chip.setBPP(sizeof(T) * 8);
+    chip.setFrameBufferSize(src.size() * sizeof(T));
+    memcpy(chip.getFrameBuffer(), src.data(), src.size() * sizeof(T));
+    chip.setBin(binX, binY);
+}
+
+template <typename T>
+static std::vector<T> binChip(INDI::CCDChip &chip, const std::vector<T> &src, uint32_t width, uint32_t height,
+                              uint32_t binX, uint32_t binY, bool bayer)
+{
+    loadChip(chip, src, width, height, binX, binY);
+
+    if (bayer)
+        chip.binBayerFrame();
+    else
+        chip.binFrame();
+
+    const T *binned = reinterpret_cast<const T *>(chip.getFrameBuffer());
+    return std::vector<T>(binned, binned + (width / binX) * (height / binY));
+}
+
+TEST(CCDCHIP_BINNING, Test_mono)
+{
+    BinningCCD ccd;
+
+    for (uint32_t bin : {2, 3, 4})
+    {
+        // Widths are not multiples of the SIMD block sizes to exercise the scalar remainder
+        const uint32_t width = 12 * 37, height = 12 * 5;
+
+        auto src8 = randomFrame<uint8_t>(width, height, UINT8_MAX);
+        ASSERT_EQ(binChip(ccd.chip(), src8, width, height, bin, bin, false),
+                  referenceBin(src8, width, height, bin, bin, false, bin * bin / 2, UINT8_MAX)) << "bin " << bin;
+
+        auto src16 = randomFrame<uint16_t>(width, height, UINT16_MAX);
+        ASSERT_EQ(binChip(ccd.chip(), src16, width, height, bin, bin, false),
+                  referenceBin(src16, width, height, bin, bin, false, 1, UINT16_MAX)) << "bin " << bin;
+
+        std::vector<uint16_t> legacy(src16.size(), 0);
+        legacyBinFrame16(src16.data(), legacy.data(), width, height, bin);
+        legacy.resize((width / bin) * (height / bin));
+        ASSERT_EQ(binChip(ccd.chip(), src16, width, height, bin, bin, false), legacy) << "bin " << bin;
+    }
+
+    // Asymmetric binning and sizes that are not multiples of the bin
+    auto src16 = randomFrame<uint16_t>(101, 53, 4095);
+    ASSERT_EQ(binChip(ccd.chip(), src16, 101, 53, 2, 3, false), referenceBin(src16, 101, 53, 2, 3, false, 1, UINT16_MAX));
+}
+
+TEST(CCDCHIP_BINNING, Test_bayer)
+{
+    BinningCCD ccd;
+
+    for (uint32_t bin : {2, 3, 4})
+    {
+        const uint32_t width = 24 * 19, height = 24 * 3;
+
+        auto src8 = randomFrame<uint8_t>(width, height, UINT8_MAX);
+        ASSERT_EQ(binChip(ccd.chip(), src8, width, height, bin, bin, true),
+                  referenceBin(src8, width, height, bin, bin, true, bin * bin, UINT8_MAX)) << "bin " << bin;
+
+        auto src16 = randomFrame<uint16_t>(width, height, 4095);
+        ASSERT_EQ(binChip(ccd.chip(), src16, width, height, bin, bin, true),
+                  referenceBin(src16, width, height, bin, bin, true, 1, UINT16_MAX)) << "bin " << bin;
+
+        std::vector<uint16_t> legacy(src16.size(), 0);
+        legacyBinBayerFrame16(src16.data(), legacy.data(), width, height, bin, bin);
+        legacy.resize((width / bin) * (height / bin));
+        ASSERT_EQ(binChip(ccd.chip(), src16, width, height, bin, bin, true), legacy) << "bin " << bin;
+    }
+}
+
+TEST(CCDCHIP_BINNING, Test_throughput)
+{
+    BinningCCD ccd;
+    const uint32_t width = 6000, height = 4000;
+    auto src16 = randomFrame<uint16_t>(width, height, 4095);
+    std::vector<uint16_t> legacy(src16.size());
+
+    for (bool bayer : {false, true})
+    {
+        // Warm up the frame buffers so both runs bin into memory that is already mapped
+        auto binned = binChip(ccd.chip(), src16, width, height, 2, 2, bayer);
+
+        std::fill(legacy.begin(), legacy.end(), 0);
+        auto start = std::chrono::steady_clock::now();
+        if (bayer)
+            legacyBinBayerFrame16(src16.data(), legacy.data(), width, height, 2, 2);
+        else
+            legacyBinFrame16(src16.data(), legacy.data(), width, height, 2);
+        std::chrono::duration<double> legacyTime = std::chrono::steady_clock::now() - start;
+
+        loadChip(ccd.chip(), src16, width, height, 2, 2);
+        start = std::chrono::steady_clock::now();
+        if (bayer)
+            ccd.chip().binBayerFrame();
+        else
+            ccd.chip().binFrame();
+        std::chrono::duration<double> binTime = std::chrono::steady_clock::now() - start;
+
+        legacy.resize(binned.size());
+        ASSERT_EQ(binned, legacy);
+        legacy.resize(src16.size());
+
+        printf("%s 2x2 16 bits %ux%u: previous %.1f ms, current %.1f ms\n",
+               bayer ? "bayer" : "mono", width, height, legacyTime.count() * 1000, binTime.count() * 1000);
+    }
+}
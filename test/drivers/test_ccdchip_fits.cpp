@@ -0,0 +1,135 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <fitsio.h>
+
+#include "indiccdchip.h"
+#include "indidevapi.h"
+
+// Write a frame with CCDChip::writeFITSImage the way CCD does, and read it back with cfitsio
+template <typename T>
+static void roundTrip(int imgType, int readType, int naxis, long width, long height)
+{
+    long naxes[3] = {width, height, 3};
+    size_t nelements = width * height * (naxis == 3 ? 3 : 1);
+    std::vector<T> frame(nelements);
+    for (size_t i = 0; i < nelements; i++)
+        frame[i] = static_cast<T>(i * 2654435761u);
+
+    INDI::CCDChip chip;
+    int status = 0;
+    ASSERT_TRUE(chip.openFITSFile(2880, status));
+
+    long unitAxes[3] = {1, 1, 1};
+    fits_create_img(*chip.fitsFilePointer(), imgType, naxis, unitAxes, &status);
+    fits_update_key_lng(*chip.fitsFilePointer(), "XBINNING", 2, "Binning factor in width", &status);
+    ASSERT_EQ(status, 0);
+
+    ASSERT_TRUE(chip.writeFITSImage(naxis, naxes, sizeof(T) * 8, frame.data(), status));
+    ASSERT_EQ(*chip.fitsFilePointer(), nullptr);
+    ASSERT_EQ(*chip.fitsMemorySizePointer() % 2880, 0u);
+
+    fitsfile *fptr = nullptr;
+    fits_open_memfile(&fptr, "", READONLY, chip.fitsMemoryBlockPointer(), chip.fitsMemorySizePointer(), 0, nullptr,
+                      &status);
+    ASSERT_EQ(status, 0);
+
+    int bitpix = 0, readAxis = 0;
+    long readAxes[3] = {0, 0, 0};
+    fits_get_img_param(fptr, 3, &bitpix, &readAxis, readAxes, &status);
+    ASSERT_EQ(readAxis, naxis);
+    for (int i = 0; i < naxis; i++)
+        ASSERT_EQ(readAxes[i], naxes[i]);
+
+    long binning = 0;
+    fits_read_key(fptr, TLONG, "XBINNING", &binning, nullptr, &status);
+    ASSERT_EQ(binning, 2);
+
+    std::vector<T> image(nelements);
+    int anynul = 0;
+    fits_read_img(fptr, readType, 1, nelements, nullptr, image.data(), &anynul, &status);
+    ASSERT_EQ(status, 0);
+    ASSERT_EQ(image, frame);
+
+    fits_close_file(fptr, &status);
+    chip.closeFITSFile();
+}
+
+TEST(CCDCHIP_FITS, Test_8bits)
+{
+    roundTrip<uint8_t>(BYTE_IMG, TBYTE, 2, 101, 53);
+}
+
+TEST(CCDCHIP_FITS, Test_16bits)
+{
+    // Widths are not multiples of the SIMD block sizes to exercise the scalar remainder
+    roundTrip<uint16_t>(USHORT_IMG, TUSHORT, 2, 101, 53);
+    roundTrip<uint16_t>(USHORT_IMG, TUSHORT, 3, 37, 21);
+}
+
+TEST(CCDCHIP_FITS, Test_32bits)
+{
+    roundTrip<uint32_t>(ULONG_IMG, TUINT, 2, 101, 53);
+}
+
+TEST(CCDCHIP_FITS, Test_headerThenImage)
+{
+    long naxes[2] = {67, 31};
+    std::vector<uint16_t> frame(naxes[0] * naxes[1]);
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = static_cast<uint16_t>(i * 40503u);
+
+    INDI::CCDChip chip;
+    int status = 0;
+    ASSERT_TRUE(chip.openFITSFile(2880, status));
+    long unitAxes[2] = {1, 1};
+    fits_create_img(*chip.fitsFilePointer(), USHORT_IMG, 2, unitAxes, &status);
+    fits_update_key_lng(*chip.fitsFilePointer(), "XBINNING", 3, "Binning factor in width", &status);
+
+    std::string header;
+    ASSERT_TRUE(chip.closeFITSHeader(header, status));
+    ASSERT_EQ(*chip.fitsFilePointer(), nullptr);
+    ASSERT_EQ(header.size() % 80, 0u);
+    ASSERT_EQ(header.compare(header.size() - 80, 3, "END"), 0);
+
+    // The chip builds the header of the next frame while the file of this one is written
+    ASSERT_TRUE(chip.openFITSFile(2880, status));
+    size_t size = 0;
+    void *file = INDI::CCDChip::writeFITSImage(header, 2, naxes, 16, frame.data(), size, status);
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(size % 2880, 0u);
+
+    fitsfile *fptr = nullptr;
+    fits_open_memfile(&fptr, "", READONLY, &file, &size, 0, nullptr, &status);
+    long binning = 0;
+    fits_read_key(fptr, TLONG, "XBINNING", &binning, nullptr, &status);
+    ASSERT_EQ(binning, 3);
+    std::vector<uint16_t> image(frame.size());
+    int anynul = 0;
+    fits_read_img(fptr, TUSHORT, 1, image.size(), nullptr, image.data(), &anynul, &status);
+    ASSERT_EQ(status, 0);
+    ASSERT_EQ(image, frame);
+
+    fits_close_file(fptr, &status);
+    IDSharedBlobFree(file);
+    chip.closeFITSFile();
+}
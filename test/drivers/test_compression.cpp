@@ -0,0 +1,142 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include <fitsio.h>
+#include <zlib.h>
+
+#include "indiccdchip.h"
+#include "indicompression.h"
+
+// Rows of noise, ramps, constants and random values cover every Rice block encoding
+static std::vector<uint16_t> testFrame(long width, long height)
+{
+    std::vector<uint16_t> frame(width * height);
+    srand(width + height);
+    for (size_t i = 0; i < frame.size(); i++)
+    {
+        switch ((i / width) % 4)
+        {
+            case 0:
+                frame[i] = static_cast<uint16_t>(rand());
+                break;
+            case 1:
+                frame[i] = 1000 + i % width;
+                break;
+            case 2:
+                frame[i] = 7;
+                break;
+            default:
+                frame[i] = 1000 + rand() % 64;
+                break;
+        }
+    }
+    return frame;
+}
+
+// FITS file of a frame, written the way CCD does
+static void writeFITS(INDI::CCDChip &chip, const std::vector<uint16_t> &frame, long width, long height)
+{
+    int status = 0;
+    long naxes[2] = {width, height}, unitAxes[2] = {1, 1};
+    ASSERT_TRUE(chip.openFITSFile(2880, status));
+    fits_create_img(*chip.fitsFilePointer(), USHORT_IMG, 2, unitAxes, &status);
+    fits_update_key_lng(*chip.fitsFilePointer(), "XBINNING", 2, "Binning factor in width", &status);
+    ASSERT_TRUE(chip.writeFITSImage(2, naxes, 16, frame.data(), status));
+}
+
+TEST(COMPRESSION, Test_fits_tiles)
+{
+    const long width = 999, height = 1001;
+    auto frame = testFrame(width, height);
+    INDI::CCDChip chip;
+    writeFITS(chip, frame, width, height);
+
+    for (uint32_t threads : {1, 4})
+    {
+        std::vector<uint8_t> compressed;
+        ASSERT_TRUE(INDI::compressFITSTiles(*chip.fitsMemoryBlockPointer(), *chip.fitsMemorySizePointer(), compressed,
+                                            threads));
+        ASSERT_EQ(compressed.size() % 2880, 0u);
+
+        int status = 0;
+        fitsfile *fptr = nullptr;
+        void *buffer = compressed.data();
+        size_t size = compressed.size();
+        fits_open_memfile(&fptr, "", READONLY, &buffer, &size, 0, nullptr, &status);
+        fits_movabs_hdu(fptr, 2, nullptr, &status);
+        ASSERT_EQ(status, 0);
+
+        int compressedImage = fits_is_compressed_image(fptr, &status);
+        ASSERT_TRUE(compressedImage);
+
+        long binning = 0;
+        fits_read_key(fptr, TLONG, "XBINNING", &binning, nullptr, &status);
+        ASSERT_EQ(binning, 2);
+
+        std::vector<uint16_t> image(frame.size());
+        int anynul = 0;
+        fits_read_img(fptr, TUSHORT, 1, image.size(), nullptr, image.data(), &anynul, &status);
+        ASSERT_EQ(status, 0);
+        ASSERT_EQ(image, frame) << threads << " threads";
+
+        fits_close_file(fptr, &status);
+    }
+
+    chip.closeFITSFile();
+}
+
+TEST(COMPRESSION, Test_fits_unsupported)
+{
+    std::vector<uint8_t> notFITS(2880, ' '), compressed;
+    ASSERT_FALSE(INDI::compressFITSTiles(notFITS.data(), notFITS.size(), compressed));
+}
+
+TEST(COMPRESSION, Test_zlib)
+{
+    // Several chunks, the last one partial
+    auto frame = testFrame(3000, 1001);
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(frame.data());
+    size_t size = frame.size() * 2;
+
+    for (uint32_t threads : {1, 4})
+    {
+        for (int level : {1, 6, 9})
+        {
+            std::vector<uint8_t> compressed;
+            ASSERT_TRUE(INDI::compressZlib(data, size, compressed, level, threads));
+
+            std::vector<uint8_t> uncompressed(size);
+            uLongf uncompressedSize = size;
+            ASSERT_EQ(uncompress(uncompressed.data(), &uncompressedSize, compressed.data(), compressed.size()), Z_OK);
+            ASSERT_EQ(uncompressedSize, size);
+            ASSERT_TRUE(std::equal(uncompressed.begin(), uncompressed.end(), data)) << threads << " threads, level " << level;
+        }
+    }
+
+    std::vector<uint8_t> compressed;
+    ASSERT_TRUE(INDI::compressZlib(data, 0, compressed, 9));
+    uint8_t byte;
+    uLongf uncompressedSize = 1;
+    ASSERT_EQ(uncompress(&byte, &uncompressedSize, compressed.data(), compressed.size()), Z_OK);
+    ASSERT_EQ(uncompressedSize, 0u);
+}
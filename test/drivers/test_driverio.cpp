@@ -0,0 +1,344 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "eventloop.h"
+#include "indidevapi.h"
+#include "lilxml.h"
+
+// Captures what the driver functions write to stdout, as indiserver reads it
+class DriverOutput
+{
+    public:
+        DriverOutput()
+        {
+            fflush(stdout);
+            savedStdout = dup(1);
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0)
+            {
+                dup2(fds[0], 1);
+                close(fds[0]);
+                reader = std::thread([this]()
+                {
+                    char buffer[65536];
+                    // No more room for attached buffers than indiserver has
+                    char control[CMSG_SPACE(16 * sizeof(int))];
+                    iovec iov {buffer, sizeof(buffer)};
+                    msghdr msgh {};
+                    ssize_t n;
+                    for (;;)
+                    {
+                        msgh.msg_iov = &iov;
+                        msgh.msg_iovlen = 1;
+                        msgh.msg_control = control;
+                        msgh.msg_controllen = sizeof(control);
+                        if ((n = recvmsg(fds[1], &msgh, 0)) <= 0)
+                            break;
+                        if (msgh.msg_flags & MSG_CTRUNC)
+                            truncated = true;
+                        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msgh); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msgh, cmsg))
+                        {
+                            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                                continue;
+                            int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                            for (int i = 0; i < count; i++)
+                                close(reinterpret_cast<int *>(CMSG_DATA(cmsg))[i]);
+                            attached += count;
+                        }
+                        std::lock_guard<std::mutex> lock(mutex);
+                        data.append(buffer, n);
+                    }
+                    close(fds[1]);
+                });
+            }
+        }
+
+        // Restore stdout and return everything written
+        std::string finish()
+        {
+            fflush(stdout);
+            dup2(savedStdout, 1);
+            close(savedStdout);
+            if (reader.joinable())
+                reader.join();
+            return data;
+        }
+
+        // Bytes read so far
+        size_t received()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return data.size();
+        }
+
+        // Buffers attached to the messages, and whether some did not fit
+        int attached {0};
+        bool truncated {false};
+
+    private:
+        int fds[2] {-1, -1};
+        int savedStdout {-1};
+        std::thread reader;
+        std::mutex mutex;
+        std::string data;
+};
+
+static std::vector<XMLEle *> parseAll(const std::string &data)
+{
+    std::vector<XMLEle *> result;
+    char errmsg[1024];
+    LilXML *lp = newLilXML();
+    XMLEle **nodes = parseXMLChunk(lp, const_cast<char *>(data.data()), data.size(), errmsg);
+    if (nodes)
+    {
+        for (int i = 0; nodes[i]; i++)
+            result.push_back(nodes[i]);
+        free(nodes);
+    }
+    delLilXML(lp);
+    return result;
+}
+
+struct NumberProperty
+{
+    INumber number;
+    INumberVectorProperty vector;
+
+    explicit NumberProperty(const char *name)
+    {
+        IUFillNumber(&number, "VALUE", "Value", "%g", 0, 1e9, 1, 0);
+        IUFillNumberVector(&vector, &number, 1, "Device", name, "Label", "Main", IP_RO, 60, IPS_OK);
+    }
+};
+
+TEST(DRIVER_IO, Test_messages)
+{
+    NumberProperty property("VALUES");
+    const int count = 1000;
+
+    DriverOutput output;
+    for (int i = 0; i < count; i++)
+    {
+        property.number.value = i;
+        IDSetNumber(&property.vector, nullptr);
+        if (i % 100 == 0)
+            IDMessage("Device", "Message %d", i);
+    }
+    std::string data = output.finish();
+
+    auto nodes = parseAll(data);
+    int numbers = 0, messages = 0;
+    for (auto root : nodes)
+    {
+        if (!strcmp(tagXMLEle(root), "setNumberVector"))
+        {
+            // In order, and the messages between the right updates
+            ASSERT_EQ(atof(pcdataXMLEle(nextXMLEle(root, 1))), numbers);
+            numbers++;
+        }
+        else if (!strcmp(tagXMLEle(root), "message"))
+        {
+            ASSERT_EQ(std::string(findXMLAttValu(root, "message")), "Message " + std::to_string(numbers - 1));
+            messages++;
+        }
+        delXMLEle(root);
+    }
+    ASSERT_EQ(numbers, count);
+    ASSERT_EQ(messages, count / 100);
+}
+
+TEST(DRIVER_IO, Test_largeMessage)
+{
+    // Larger than the output buffer, written in several parts
+    std::string text(300000, 'x');
+    for (size_t i = 0; i < text.size(); i += 1000)
+        text[i] = 'a' + (i / 1000) % 26;
+
+    IText widget {};
+    ITextVectorProperty vector;
+    IUFillText(&widget, "TEXT", "Text", text.c_str());
+    IUFillTextVector(&vector, &widget, 1, "Device", "LARGE", "Label", "Main", IP_RO, 60, IPS_OK);
+
+    NumberProperty property("AFTER");
+
+    DriverOutput output;
+    IDSetText(&vector, nullptr);
+    IDSetNumber(&property.vector, nullptr);
+    std::string data = output.finish();
+
+    auto nodes = parseAll(data);
+    ASSERT_EQ(nodes.size(), 2u);
+    ASSERT_EQ(std::string(pcdataXMLEle(nextXMLEle(nodes[0], 1))), text);
+    ASSERT_STREQ(findXMLAttValu(nodes[1], "name"), "AFTER");
+    for (auto root : nodes)
+        delXMLEle(root);
+    free(widget.text);
+}
+
+TEST(DRIVER_IO, Test_threads)
+{
+    const int threads = 4;
+    const int count = 2000;
+    std::vector<NumberProperty *> properties;
+    for (int t = 0; t < threads; t++)
+        properties.push_back(new NumberProperty(("THREAD_" + std::to_string(t)).c_str()));
+
+    // Updates from other threads than the event loop are never delayed
+    IDCoalesceSets(1);
+
+    DriverOutput output;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> senders;
+    for (int t = 0; t < threads; t++)
+        senders.emplace_back([&, t]()
+        {
+            for (int i = 0; i < count; i++)
+            {
+                properties[t]->number.value = i;
+                IDSetNumber(&properties[t]->vector, nullptr);
+            }
+        });
+    for (auto &sender : senders)
+        sender.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::string data = output.finish();
+
+    IDCoalesceSets(0);
+    printf("IDSetNumber: %.0f messages/s from %d threads\n", threads * count / elapsed.count(), threads);
+
+    std::vector<int> next(threads, 0);
+    auto nodes = parseAll(data);
+    ASSERT_EQ(nodes.size(), size_t(threads * count));
+    for (auto root : nodes)
+    {
+        int t = atoi(findXMLAttValu(root, "name") + strlen("THREAD_"));
+        ASSERT_EQ(atof(pcdataXMLEle(nextXMLEle(root, 1))), next[t]);
+        next[t]++;
+        delXMLEle(root);
+    }
+
+    for (auto property : properties)
+        delete property;
+}
+
+TEST(DRIVER_IO, Test_attachedBLOBs)
+{
+    // More buffers than attached to a single write
+    const int count = 40;
+    std::vector<std::vector<char>> data(count);
+    std::vector<IBLOB> blobs(count);
+    for (int i = 0; i < count; i++)
+    {
+        data[i].assign(100 + i, char(i));
+        IUFillBLOB(&blobs[i], ("BLOB_" + std::to_string(i)).c_str(), "Blob", ".bin");
+        blobs[i].blob = data[i].data();
+        blobs[i].bloblen = blobs[i].size = data[i].size();
+    }
+    IBLOBVectorProperty vector;
+    IUFillBLOBVector(&vector, blobs.data(), count, "Device", "BLOBS", "Label", "Main", IP_RO, 60, IPS_OK);
+
+    NumberProperty property("AFTER");
+
+    DriverOutput output;
+    IDSetBLOB(&vector, nullptr);
+    IDSetNumber(&property.vector, nullptr);
+    std::string text = output.finish();
+
+    // The BLOB is followed by a ping, answered once the server is done with the buffers
+    auto nodes = parseAll(text);
+    ASSERT_EQ(nodes.size(), 3u);
+    ASSERT_STREQ(tagXMLEle(nodes[1]), "pingRequest");
+    int oneBLOBs = 0, attached = 0;
+    for (XMLEle *ep = nextXMLEle(nodes[0], 1); ep != nullptr; ep = nextXMLEle(nodes[0], 0))
+    {
+        ASSERT_STREQ(findXMLAttValu(ep, "name"), ("BLOB_" + std::to_string(oneBLOBs)).c_str());
+        attached += !strcmp(findXMLAttValu(ep, "attached"), "true");
+        oneBLOBs++;
+    }
+    ASSERT_EQ(oneBLOBs, count);
+    ASSERT_EQ(output.attached, attached);
+    ASSERT_FALSE(output.truncated);
+    ASSERT_STREQ(findXMLAttValu(nodes[2], "name"), "AFTER");
+    for (auto root : nodes)
+        delXMLEle(root);
+}
+
+struct CoalesceState
+{
+    DriverOutput *output;
+    NumberProperty *property;
+    size_t receivedBeforeMessage;
+    int done;
+};
+
+static void sendUpdates(void *p)
+{
+    auto state = static_cast<CoalesceState *>(p);
+    for (int i = 0; i < 20; i++)
+    {
+        // Any other message sends the pending updates first
+        if (i == 10)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            state->receivedBeforeMessage = state->output->received();
+            IDMessage("Device", "Message");
+        }
+        state->property->number.value = i;
+        IDSetNumber(&state->property->vector, nullptr);
+    }
+    state->done = 1;
+}
+
+TEST(DRIVER_IO, Test_coalesceSets)
+{
+    NumberProperty property("VALUES");
+    IDCoalesceSets(1);
+
+    // Updates sent from the event loop wait for the end of the loop iteration
+    DriverOutput output;
+    CoalesceState state {&output, &property, 0, 0};
+    IEAddTimer(0, sendUpdates, &state);
+    ASSERT_EQ(IEDeferLoop(5000, &state.done), 0);
+    ASSERT_TRUE(isEventLoopThread());
+    std::string data = output.finish();
+    IDCoalesceSets(0);
+
+    ASSERT_EQ(state.receivedBeforeMessage, 0u);
+
+    auto nodes = parseAll(data);
+    ASSERT_EQ(nodes.size(), 21u);
+    for (int i = 0; i < 21; i++)
+    {
+        if (i == 10)
+            ASSERT_STREQ(tagXMLEle(nodes[i]), "message");
+        else
+            ASSERT_EQ(atof(pcdataXMLEle(nextXMLEle(nodes[i], 1))), i < 10 ? i : i - 1);
+    }
+    for (auto root : nodes)
+        delXMLEle(root);
+}
@@ -0,0 +1,130 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "dsp.h"
+
+static dsp_stream_p newStream(int width, int height)
+{
+    dsp_stream_p stream = dsp_stream_new();
+    dsp_stream_add_dim(stream, width);
+    dsp_stream_add_dim(stream, height);
+    dsp_stream_alloc_buffer(stream, stream->len);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            stream->buf[y * width + x] = 100 + 50 * std::cos(2 * M_PI * 8 * x / width);
+    return stream;
+}
+
+static std::vector<dsp_t> transform(int width, int height)
+{
+    dsp_stream_p stream = newStream(width, height);
+    dsp_fourier_dft(stream, 1);
+    std::vector<dsp_t> magnitude(stream->magnitude->buf, stream->magnitude->buf + stream->len);
+    dsp_stream_free_buffer(stream->magnitude);
+    dsp_stream_free(stream->magnitude);
+    dsp_stream_free_buffer(stream->phase);
+    dsp_stream_free(stream->phase);
+    dsp_stream_free_buffer(stream);
+    dsp_stream_free(stream);
+    return magnitude;
+}
+
+TEST(DSP_FOURIER, Test_cached_plans)
+{
+    // The cached plans give the same result as the first transform, for each size
+    auto first = transform(128, 64);
+    auto other = transform(64, 32);
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_EQ(transform(128, 64), first);
+        ASSERT_EQ(transform(64, 32), other);
+    }
+    dsp_fourier_plans_free();
+    ASSERT_EQ(transform(128, 64), first);
+}
+
+TEST(DSP_FOURIER, Test_threads)
+{
+    auto expected = transform(128, 128);
+
+    std::vector<std::thread> threads;
+    std::vector<int> matches(4, 0);
+    for (size_t t = 0; t < matches.size(); t++)
+        threads.emplace_back([&, t]()
+        {
+            for (int i = 0; i < 20; i++)
+                matches[t] += transform(128, 128) == expected;
+        });
+    for (auto &thread : threads)
+        thread.join();
+
+    for (auto count : matches)
+        ASSERT_EQ(count, 20);
+}
+
+static double transformMsecs(dsp_stream_p stream, int count)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+        dsp_fourier_dft(stream, 1);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / count;
+}
+
+TEST(DSP_FOURIER, Test_throughput)
+{
+    const int width = 1024, height = 1024, count = 10;
+    dsp_stream_p stream = newStream(width, height);
+
+    dsp_fourier_plans_free();
+    double first = transformMsecs(stream, 1);
+    printf("%dx%d estimated plan: first %.2f ms, then %.2f ms\n", width, height, first, transformMsecs(stream, count));
+
+    // Measured plans are slower to create, the wisdom file keeps them for the next runs
+    char wisdom[] = "/tmp/test_dsp_fourier_XXXXXX";
+    int fd = mkstemp(wisdom);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    dsp_fourier_wisdom_set_file(wisdom);
+    dsp_fourier_plans_free();
+    first = transformMsecs(stream, 1);
+    printf("%dx%d measured plan: first %.2f ms, then %.2f ms\n", width, height, first, transformMsecs(stream, count));
+
+    dsp_fourier_plans_free();
+    ASSERT_NE(dsp_fourier_wisdom_set_file(wisdom), 0);
+    first = transformMsecs(stream, 1);
+    printf("%dx%d plan from wisdom: first %.2f ms\n", width, height, first);
+
+    dsp_fourier_wisdom_set_file(nullptr);
+    dsp_fourier_plans_free();
+    unlink(wisdom);
+
+    dsp_stream_free_buffer(stream->magnitude);
+    dsp_stream_free(stream->magnitude);
+    dsp_stream_free_buffer(stream->phase);
+    dsp_stream_free(stream->phase);
+    dsp_stream_free_buffer(stream);
+    dsp_stream_free(stream);
+}
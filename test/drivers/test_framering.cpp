@@ -0,0 +1,113 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <set>
+#include <thread>
+
+#include "framering.h"
+
+TEST(FRAME_RING, Test_capacity)
+{
+    INDI::FrameRing ring(4);
+
+    for (int i = 0; i < 4; i++)
+    {
+        auto frame = ring.acquire(100);
+        ASSERT_NE(frame, nullptr);
+        ASSERT_GE(frame->buffer.size(), 100u);
+        frame->data()[0] = i;
+        ring.commit(i);
+    }
+
+    ASSERT_EQ(ring.size(), 4u);
+    ASSERT_EQ(ring.acquire(100), nullptr);
+
+    auto frame = ring.front(0);
+    ASSERT_NE(frame, nullptr);
+    ASSERT_EQ(frame->data()[0], 0);
+    ASSERT_EQ(frame->size, 100u);
+    ring.release();
+
+    ASSERT_NE(ring.acquire(100), nullptr);
+}
+
+TEST(FRAME_RING, Test_recycle)
+{
+    INDI::FrameRing ring(8);
+    std::set<const uint8_t *> buffers;
+
+    // One frame in flight at a time keeps reusing the same buffer
+    for (int i = 0; i < 100; i++)
+    {
+        auto frame = ring.acquire(1000);
+        buffers.insert(frame->data());
+        ring.commit(0);
+
+        ASSERT_NE(ring.front(0), nullptr);
+        ring.release();
+    }
+
+    ASSERT_EQ(buffers.size(), 1u);
+    ASSERT_EQ(ring.front(0), nullptr);
+}
+
+TEST(FRAME_RING, Test_threads)
+{
+    INDI::FrameRing ring(16);
+    const uint32_t frames = 10000;
+
+    std::thread consumer([&]()
+    {
+        for (uint32_t i = 0; i < frames; i++)
+        {
+            auto frame = ring.front(1000);
+            ASSERT_NE(frame, nullptr);
+            uint32_t value;
+            memcpy(&value, frame->data(), sizeof(value));
+            ASSERT_EQ(value, i);
+            ASSERT_EQ(frame->size, 64 + i % 64);
+            ASSERT_EQ(frame->time, i);
+            ring.release();
+        }
+    });
+
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        INDI::FrameRing::Frame *frame;
+        while ((frame = ring.acquire(64 + i % 64)) == nullptr)
+            std::this_thread::yield();
+        memcpy(frame->data(), &i, sizeof(i));
+        ring.commit(i);
+    }
+
+    ring.waitForEmpty();
+    ASSERT_EQ(ring.size(), 0u);
+    consumer.join();
+}
+
+TEST(FRAME_RING, Test_abort)
+{
+    INDI::FrameRing ring;
+    std::thread consumer([&]()
+    {
+        ASSERT_EQ(ring.front(10000), nullptr);
+    });
+    ring.abort();
+    consumer.join();
+}
@@ -0,0 +1,173 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "gammalut16.h"
+
+// Previous implementation of GammaLut16, used as the reference and the benchmark baseline
+class LegacyGammaLut16
+{
+    public:
+        LegacyGammaLut16(double gamma = 2.4, double a = 12.92, double b = 0.055, double Ii = 0.00304)
+        {
+            mLookUpTable.resize(65536);
+
+            unsigned int i = 0;
+            for (auto &value : mLookUpTable)
+            {
+                double I = static_cast<double>(i++) / 65535.0;
+                double p;
+                if (I <= Ii)
+                    p = a * I;
+                else
+                    p = (1 + b) * powf(I, 1.0 / gamma) - b;
+                value = round(255.0 * p);
+            }
+        }
+
+        void apply(const uint16_t *first, const uint16_t *last, uint8_t *destination) const
+        {
+            const uint8_t *lookUpTable = mLookUpTable.data();
+
+            while (first != last)
+                *destination++ = lookUpTable[*first++];
+        }
+
+        uint8_t operator[](uint16_t value) const
+        {
+            return mLookUpTable[value];
+        }
+
+    protected:
+        std::vector<uint8_t> mLookUpTable;
+};
+
+static std::vector<uint16_t> randomFrame(size_t count)
+{
+    std::vector<uint16_t> frame(count);
+    srand(count);
+    for (auto &value : frame)
+        value = rand() & 0xFFFF;
+    return frame;
+}
+
+TEST(GAMMA_LUT16, Test_every_value)
+{
+    GammaLut16 lut;
+    LegacyGammaLut16 legacy;
+
+    // Every value, plus a remainder that is not a multiple of the SIMD block size
+    std::vector<uint16_t> values(65536 + 7);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = i;
+
+    std::vector<uint8_t> result(values.size()), expected(values.size());
+    lut.apply(values.data(), values.size(), result.data());
+    legacy.apply(values.data(), values.data() + values.size(), expected.data());
+    ASSERT_EQ(result, expected);
+}
+
+TEST(GAMMA_LUT16, Test_frame)
+{
+    GammaLut16 lut;
+    LegacyGammaLut16 legacy;
+    const uint32_t width = 1001, height = 67;
+    auto frame = randomFrame(width * height * 3);
+
+    for (uint32_t threads : {1, 4})
+    {
+        std::vector<uint8_t> result(width * height), expected(width * height);
+        lut.apply(frame.data(), width, height, 1, 1, result.data(), threads);
+        legacy.apply(frame.data(), frame.data() + expected.size(), expected.data());
+        ASSERT_EQ(result, expected) << threads << " threads";
+    }
+}
+
+TEST(GAMMA_LUT16, Test_downscale)
+{
+    GammaLut16 lut;
+    LegacyGammaLut16 legacy;
+    const uint32_t width = 1001, height = 67;
+    auto frame = randomFrame(width * height * 3);
+
+    for (uint32_t components : {1, 3})
+    {
+        for (uint32_t scale : {2, 3, 4})
+        {
+            const uint32_t scaledWidth = width / scale, scaledHeight = height / scale;
+            std::vector<uint8_t> expected;
+            for (uint32_t y = 0; y < scaledHeight; y++)
+                for (uint32_t x = 0; x < scaledWidth; x++)
+                    for (uint32_t c = 0; c < components; c++)
+                    {
+                        uint32_t sum = 0;
+                        for (uint32_t k = 0; k < scale; k++)
+                            for (uint32_t l = 0; l < scale; l++)
+                                sum += frame[((y * scale + k) * width + x * scale + l) * components + c];
+                        expected.push_back(legacy[(sum + scale * scale / 2) / (scale * scale)]);
+                    }
+
+            for (uint32_t threads : {1, 4})
+            {
+                std::vector<uint8_t> result(expected.size());
+                lut.apply(frame.data(), width, height, components, scale, result.data(), threads);
+                ASSERT_EQ(result, expected) << components << " components, scale " << scale << ", " << threads << " threads";
+            }
+        }
+    }
+}
+
+TEST(GAMMA_LUT16, Test_throughput)
+{
+    GammaLut16 lut;
+    LegacyGammaLut16 legacy;
+    const uint32_t width = 4096, height = 3072, frames = 10;
+
+    // Camera frames use a narrow part of the range, unlike uniform noise
+    std::vector<uint16_t> frame(width * height);
+    srand(width);
+    for (auto &value : frame)
+        value = 1000 + rand() % 4096;
+
+    std::vector<uint8_t> expected(frame.size()), result(frame.size()), scaled(frame.size() / 4);
+    legacy.apply(frame.data(), frame.data() + frame.size(), expected.data());
+    lut.apply(frame.data(), width, height, 1, 1, result.data());
+    ASSERT_EQ(result, expected);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frames; i++)
+        legacy.apply(frame.data(), frame.data() + frame.size(), expected.data());
+    std::chrono::duration<double> legacyTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frames; i++)
+        lut.apply(frame.data(), width, height, 1, 1, result.data());
+    std::chrono::duration<double> lutTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frames; i++)
+        lut.apply(frame.data(), width, height, 1, 2, scaled.data());
+    std::chrono::duration<double> scaledTime = std::chrono::steady_clock::now() - start;
+
+    printf("16 to 8 bits %ux%u: previous %.1f fps, current %.1f fps, with 2x2 downscale %.1f fps\n",
+           width, height, frames / legacyTime.count(), frames / lutTime.count(), frames / scaledTime.count());
+}
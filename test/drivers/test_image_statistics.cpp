@@ -0,0 +1,112 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+
+#include "indiimagestatistics.h"
+
+template <typename T>
+static std::vector<T> randomFrame(size_t samples, uint32_t low, uint32_t high)
+{
+    std::vector<T> frame(samples);
+    srand(samples);
+    for (auto &sample : frame)
+        sample = static_cast<T>(low + (static_cast<uint64_t>(rand()) * rand()) % (uint64_t(high) - low + 1));
+    return frame;
+}
+
+template <typename T>
+static void checkStatistics(const std::vector<T> &frame, double medianTolerance)
+{
+    INDI::ImageStatistics stats;
+    ASSERT_TRUE(INDI::computeImageStatistics(frame.data(), frame.size(), sizeof(T) * 8, stats, 100));
+
+    std::vector<T> sorted(frame);
+    std::sort(sorted.begin(), sorted.end());
+    double mean = std::accumulate(frame.begin(), frame.end(), 0.0) / frame.size();
+    double variance = 0;
+    for (auto sample : frame)
+        variance += (sample - mean) * (sample - mean);
+
+    ASSERT_EQ(stats.samples, frame.size());
+    ASSERT_EQ(stats.min, sorted.front());
+    ASSERT_EQ(stats.max, sorted.back());
+    ASSERT_NEAR(stats.mean, mean, 1e-6 * std::max(1.0, mean));
+    ASSERT_NEAR(stats.stddev, std::sqrt(variance / frame.size()), 1e-6 * std::max(1.0, mean));
+    ASSERT_NEAR(stats.median, sorted[(frame.size() - 1) / 2], medianTolerance);
+
+    ASSERT_EQ(stats.histogram.size(), 100u);
+    ASSERT_EQ(std::accumulate(stats.histogram.begin(), stats.histogram.end(), uint64_t(0)), frame.size());
+}
+
+TEST(IMAGE_STATISTICS, Test_8bits)
+{
+    checkStatistics(randomFrame<uint8_t>(1001, 3, 250), 0);
+    // Large enough to be split across threads
+    checkStatistics(randomFrame<uint8_t>(3 << 20, 0, 255), 0);
+}
+
+TEST(IMAGE_STATISTICS, Test_16bits)
+{
+    checkStatistics(randomFrame<uint16_t>(1001, 100, 4000), 0);
+    checkStatistics(randomFrame<uint16_t>(3 << 20, 0, 65535), 0);
+}
+
+TEST(IMAGE_STATISTICS, Test_32bits)
+{
+    checkStatistics(randomFrame<uint32_t>(1001, 0, 1 << 20), 65536);
+    checkStatistics(randomFrame<uint32_t>(3 << 20, 1000, 0xFFFFFFF0), 65536);
+}
+
+TEST(IMAGE_STATISTICS, Test_histogram)
+{
+    // Values 10 to 19, each once, two values per bin
+    std::vector<uint16_t> frame(10);
+    std::iota(frame.begin(), frame.end(), 10);
+
+    INDI::ImageStatistics stats;
+    ASSERT_TRUE(INDI::computeImageStatistics(frame.data(), frame.size(), 16, stats, 5));
+    ASSERT_EQ(stats.histogram, std::vector<uint64_t>({2, 2, 2, 2, 2}));
+    ASSERT_EQ(stats.median, 14);
+}
+
+TEST(IMAGE_STATISTICS, Test_unsupported)
+{
+    float frame[4] = {};
+    INDI::ImageStatistics stats;
+    ASSERT_FALSE(INDI::computeImageStatistics(frame, 4, -32, stats));
+}
+
+TEST(IMAGE_STATISTICS, Test_throughput)
+{
+    auto frame = randomFrame<uint16_t>(6000 * 4000, 0, 4095);
+
+    auto start = std::chrono::steady_clock::now();
+    INDI::ImageStatistics stats;
+    INDI::computeImageStatistics(frame.data(), frame.size(), 16, stats, 4096);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("16 bits 6000x4000 statistics: %.1f ms\n", elapsed.count() * 1000);
+}
@@ -0,0 +1,141 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "encoder/mjpegencoder.h"
+
+static std::vector<uint8_t> decode(const IBLOB &blob, uint32_t &width, uint32_t &height, uint32_t &components)
+{
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, static_cast<unsigned char *>(blob.blob), blob.bloblen);
+    jpeg_read_header(&cinfo, TRUE);
+    jpeg_start_decompress(&cinfo);
+
+    width = cinfo.output_width;
+    height = cinfo.output_height;
+    components = cinfo.output_components;
+    std::vector<uint8_t> image(width * height * components);
+    while (cinfo.output_scanline < height)
+    {
+        JSAMPROW row = image.data() + cinfo.output_scanline * width * components;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return image;
+}
+
+TEST(MJPEG_ENCODER, Test_downscale)
+{
+    const uint16_t width = 1280, height = 960;
+    // Alternating columns average to a flat gray, dropping pixels would keep one of them
+    std::vector<uint8_t> frame(width * height);
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = (i % 2) ? 200 : 100;
+
+    INDI::MJPEGEncoder encoder;
+    encoder.setPixelFormat(INDI_MONO, 8);
+    encoder.setSize(width, height);
+    encoder.setMaxWidth(640);
+    encoder.setThreads(1);
+
+    IBLOB blob {};
+    ASSERT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+    ASSERT_STREQ(blob.format, ".stream_jpg");
+
+    uint32_t w, h, c;
+    auto image = decode(blob, w, h, c);
+    ASSERT_EQ(w, 640u);
+    ASSERT_EQ(h, 480u);
+    ASSERT_EQ(c, 1u);
+    for (auto value : image)
+        ASSERT_NEAR(value, 150, 2);
+}
+
+TEST(MJPEG_ENCODER, Test_rgb)
+{
+    const uint16_t width = 300, height = 200;
+    std::vector<uint8_t> frame(width * height * 3);
+    for (size_t i = 0; i < frame.size(); i += 3)
+    {
+        frame[i] = 250;
+        frame[i + 1] = 120;
+        frame[i + 2] = 10;
+    }
+
+    INDI::MJPEGEncoder encoder;
+    encoder.setPixelFormat(INDI_RGB, 8);
+    encoder.setSize(width, height);
+    encoder.setQuality(95);
+
+    IBLOB blob {};
+    ASSERT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+
+    uint32_t w, h, c;
+    auto image = decode(blob, w, h, c);
+    ASSERT_EQ(w, width);
+    ASSERT_EQ(h, height);
+    ASSERT_EQ(c, 3u);
+    ASSERT_NEAR(image[0], 250, 4);
+    ASSERT_NEAR(image[1], 120, 4);
+    ASSERT_NEAR(image[2], 10, 4);
+}
+
+TEST(MJPEG_ENCODER, Test_workers)
+{
+    const uint16_t width = 1920, height = 1080;
+    std::vector<uint8_t> frame(width * height);
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = rand();
+
+    INDI::MJPEGEncoder encoder;
+    encoder.setPixelFormat(INDI_MONO, 8);
+    encoder.setSize(width, height);
+    encoder.setMaxWidth(width);
+    encoder.setThreads(3);
+
+    // Frames come faster than they are compressed, some uploads have no new frame to send
+    int uploaded = 0;
+    for (int i = 0; i < 30; i++)
+    {
+        IBLOB blob {};
+        if (encoder.upload(&blob, frame.data(), frame.size()))
+        {
+            uint32_t w, h, c;
+            decode(blob, w, h, c);
+            ASSERT_EQ(w, width);
+            ASSERT_EQ(h, height);
+            uploaded++;
+        }
+    }
+    ASSERT_GT(uploaded, 0);
+
+    // Changing the number of threads restarts the workers
+    encoder.setThreads(1);
+    IBLOB blob {};
+    ASSERT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+}
@@ -0,0 +1,150 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+#include <vector>
+
+#include "recorder/serrecorder.h"
+#include "recorder/writebehindfile.h"
+
+static std::vector<uint8_t> readFile(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static uint32_t readInt(const std::vector<uint8_t> &data, size_t offset)
+{
+    return data[offset] | data[offset + 1] << 8 | data[offset + 2] << 16 | static_cast<uint32_t>(data[offset + 3]) << 24;
+}
+
+static std::string tempFile(const char *name)
+{
+    return std::string("/tmp/") + name + "_" + std::to_string(getpid());
+}
+
+TEST(WRITE_BEHIND_FILE, Test_batches)
+{
+    std::string filename = tempFile("write_behind");
+
+    for (bool directIO : {false, true})
+    {
+        // Small batches, so the data spans several of them and ends with a partial one
+        INDI::WriteBehindFile file(4096, 4);
+        ASSERT_TRUE(file.open(filename.c_str(), directIO));
+
+        std::vector<uint8_t> expected;
+        for (int i = 0; i < 100; i++)
+        {
+            std::vector<uint8_t> data(1000 + i, static_cast<uint8_t>(i));
+            while (!file.write(data.data(), data.size()))
+                ASSERT_FALSE(file.hasFailed());
+            expected.insert(expected.end(), data.begin(), data.end());
+        }
+
+        ASSERT_TRUE(file.flush());
+        ASSERT_EQ(file.size(), expected.size());
+
+        uint8_t header[3] = {'S', 'E', 'R'};
+        ASSERT_TRUE(file.writeAt(0, header, sizeof(header)));
+        ASSERT_TRUE(file.writeAt(file.size(), header, sizeof(header)));
+        ASSERT_TRUE(file.close());
+
+        std::copy(header, header + 3, expected.begin());
+        expected.insert(expected.end(), header, header + 3);
+        ASSERT_EQ(readFile(filename), expected) << "direct I/O " << directIO;
+    }
+
+    unlink(filename.c_str());
+}
+
+TEST(WRITE_BEHIND_FILE, Test_large)
+{
+    std::string filename = tempFile("write_behind_large");
+
+    for (bool directIO : {false, true})
+    {
+        INDI::WriteBehindFile file(4096, 2);
+        ASSERT_TRUE(file.open(filename.c_str(), directIO));
+
+        // More than every batch together, after a partial batch, grows the batches
+        std::vector<uint8_t> small(100, 1), large(3 * 4096 + 5, 2);
+        ASSERT_TRUE(file.write(small.data(), small.size()));
+        ASSERT_TRUE(file.write(large.data(), large.size()));
+        ASSERT_TRUE(file.write(small.data(), small.size()));
+        ASSERT_FALSE(file.hasFailed());
+        ASSERT_TRUE(file.close());
+
+        std::vector<uint8_t> expected(small);
+        expected.insert(expected.end(), large.begin(), large.end());
+        expected.insert(expected.end(), small.begin(), small.end());
+        ASSERT_EQ(readFile(filename), expected) << "direct I/O " << directIO;
+    }
+
+    unlink(filename.c_str());
+}
+
+TEST(SER_RECORDER, Test_file)
+{
+    std::string filename = tempFile("ser_recorder") + ".ser";
+    const uint16_t width = 64, height = 48;
+    const uint32_t frames = 20;
+
+    INDI::SER_Recorder recorder;
+    ASSERT_TRUE(recorder.setPixelFormat(INDI_MONO, 16));
+    ASSERT_TRUE(recorder.setSize(width, height));
+
+    char errmsg[1024];
+    ASSERT_TRUE(recorder.open(filename.c_str(), errmsg)) << errmsg;
+
+    std::vector<uint8_t> frame(width * height * 2);
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        std::fill(frame.begin(), frame.end(), static_cast<uint8_t>(i));
+        ASSERT_TRUE(recorder.writeFrame(frame.data(), frame.size()));
+    }
+    ASSERT_TRUE(recorder.close());
+    ASSERT_EQ(recorder.getDroppedFrames(), 0u);
+    ASSERT_GE(recorder.getBytesWritten(), frames * frame.size());
+
+    auto data = readFile(filename);
+    const size_t headerSize = 178;
+    ASSERT_EQ(data.size(), headerSize + frames * frame.size() + frames * 8);
+    ASSERT_EQ(std::string(data.begin(), data.begin() + 13), "INDI-RECORDER");
+    ASSERT_EQ(readInt(data, 26), width);
+    ASSERT_EQ(readInt(data, 30), height);
+    ASSERT_EQ(readInt(data, 34), 16u);
+    ASSERT_EQ(readInt(data, 38), frames);
+
+    for (uint32_t i = 0; i < frames; i++)
+        ASSERT_EQ(data[headerSize + i * frame.size() + frame.size() / 2], i);
+
+    // Timestamps follow the frames, in increasing order
+    size_t stamps = headerSize + frames * frame.size();
+    for (uint32_t i = 1; i < frames; i++)
+    {
+        uint64_t previous = readInt(data, stamps + 8 * (i - 1)) | static_cast<uint64_t>(readInt(data, stamps + 8 * (i - 1) + 4)) << 32;
+        uint64_t current  = readInt(data, stamps + 8 * i) | static_cast<uint64_t>(readInt(data, stamps + 8 * i + 4)) << 32;
+        ASSERT_LE(previous, current);
+    }
+
+    unlink(filename.c_str());
+}